@@ -0,0 +1,427 @@
+#include "aabb_tree.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+
+// Depth-first stacks: a balanced tree of a billion leaves is still under 50 levels deep.
+const int AABB_STACK = 256;
+
+int allocNode(AabbTree& t) {
+    int i = t.freeList;
+    if (i == AABB_NULL) {
+        i = int(t.nodes.size());
+        t.nodes.push_back(AabbNode());
+    } else {
+        t.freeList = t.nodes[i].parent;
+    }
+    AabbNode& n = t.nodes[i];
+    n.parent = n.child1 = n.child2 = AABB_NULL;
+    n.height = 0;
+    n.mask = 0;
+    n.user = 0;
+    return i;
+}
+
+void freeNode(AabbTree& t, int i) {
+    t.nodes[i].parent = t.freeList;
+    t.nodes[i].height = -1;
+    t.freeList = i;
+}
+
+bool isLeaf(const AabbNode& n) { return n.child1 == AABB_NULL; }
+
+// Box, height and mask of an internal node from its children.
+void refitNode(AabbTree& t, int i) {
+    AabbNode& n = t.nodes[i];
+    const AabbNode& a = t.nodes[n.child1];
+    const AabbNode& b = t.nodes[n.child2];
+    n.box = aabbUnion(a.box, b.box);
+    n.height = 1 + std::max(a.height, b.height);
+    n.mask = a.mask | b.mask;
+}
+
+void replaceChild(AabbTree& t, int parent, int oldChild, int newChild) {
+    if (parent == AABB_NULL) {
+        t.root = newChild;
+    } else if (t.nodes[parent].child1 == oldChild) {
+        t.nodes[parent].child1 = newChild;
+    } else {
+        t.nodes[parent].child2 = newChild;
+    }
+}
+
+// If one child of a is two levels taller than the other, the taller child takes a's place and
+// a takes the shorter of its grandchildren; returns the node now in a's place.
+int rotate(AabbTree& t, int a) {
+    AabbNode& A = t.nodes[a];
+    if (isLeaf(A) || A.height < 2) return a;
+    int b = A.child1, c = A.child2;
+    int balance = t.nodes[c].height - t.nodes[b].height;
+    if (balance >= -1 && balance <= 1) return a;
+
+    // up is the taller child, down the one staying under a
+    bool upIsC = balance > 1;
+    int up = upIsC ? c : b;
+    AabbNode& U = t.nodes[up];
+    int f = U.child1, g = U.child2;
+    int keep = t.nodes[f].height > t.nodes[g].height ? f : g;  // the taller grandchild stays with up
+    int give = keep == f ? g : f;
+
+    U.child1 = a;
+    U.parent = A.parent;
+    A.parent = up;
+    replaceChild(t, U.parent, a, up);
+    U.child2 = keep;
+    if (upIsC) A.child2 = give; else A.child1 = give;
+    t.nodes[give].parent = a;
+    refitNode(t, a);
+    refitNode(t, up);
+    ++t.stats.rotations;
+    return up;
+}
+
+// Heights, boxes and masks from i up to the root, rotating where a subtree leans.
+void refitUp(AabbTree& t, int i) {
+    while (i != AABB_NULL) {
+        i = rotate(t, i);
+        refitNode(t, i);
+        i = t.nodes[i].parent;
+    }
+}
+
+// Cost of making the leaf a sibling of node i: the new parent's area plus the growth of i's
+// ancestors (inherited).
+float siblingCost(const AabbTree& t, int i, const Aabb& leafBox, float inherited) {
+    const AabbNode& n = t.nodes[i];
+    float area = aabbArea(aabbUnion(leafBox, n.box));
+    return (isLeaf(n) ? area : area - aabbArea(n.box)) + inherited;
+}
+
+void insertLeaf(AabbTree& t, int leaf) {
+    if (t.root == AABB_NULL) {
+        t.root = leaf;
+        t.nodes[leaf].parent = AABB_NULL;
+        return;
+    }
+    const Aabb leafBox = t.nodes[leaf].box;
+    int i = t.root;
+    while (!isLeaf(t.nodes[i])) {
+        const AabbNode& n = t.nodes[i];
+        float area = aabbArea(n.box), combined = aabbArea(aabbUnion(n.box, leafBox));
+        float here = 2.0f * combined, inherited = 2.0f * (combined - area);
+        float cost1 = siblingCost(t, n.child1, leafBox, inherited);
+        float cost2 = siblingCost(t, n.child2, leafBox, inherited);
+        if (here < cost1 && here < cost2) break;
+        i = cost1 < cost2 ? n.child1 : n.child2;
+    }
+
+    int sibling = i, oldParent = t.nodes[sibling].parent;
+    int parent = allocNode(t);
+    AabbNode& p = t.nodes[parent];
+    p.parent = oldParent;
+    p.child1 = sibling;
+    p.child2 = leaf;
+    t.nodes[sibling].parent = parent;
+    t.nodes[leaf].parent = parent;
+    replaceChild(t, oldParent, sibling, parent);
+    refitUp(t, parent);
+}
+
+void removeLeaf(AabbTree& t, int leaf) {
+    if (leaf == t.root) {
+        t.root = AABB_NULL;
+        return;
+    }
+    int parent = t.nodes[leaf].parent, grand = t.nodes[parent].parent;
+    int sibling = t.nodes[parent].child1 == leaf ? t.nodes[parent].child2 : t.nodes[parent].child1;
+    replaceChild(t, grand, parent, sibling);
+    t.nodes[sibling].parent = grand;
+    freeNode(t, parent);
+    refitUp(t, grand);
+}
+
+Aabb fatten(const AabbTree& t, const Aabb& box, const Vec3& displacement) {
+    Vec3 m(t.margin, t.margin, t.margin), d = displacement * t.predict;
+    Aabb fat = { box.min - m, box.max + m };
+    if (d.x < 0.0f) fat.min.x += d.x; else fat.max.x += d.x;
+    if (d.y < 0.0f) fat.min.y += d.y; else fat.max.y += d.y;
+    if (d.z < 0.0f) fat.min.z += d.z; else fat.max.z += d.z;
+    return fat;
+}
+
+// A ray prepared for slab tests.
+struct SlabRay {
+    float o[3], d[3], inv[3];
+
+    SlabRay(const Vec3& origin, const Vec3& dir) {
+        o[0] = origin.x; o[1] = origin.y; o[2] = origin.z;
+        d[0] = dir.x; d[1] = dir.y; d[2] = dir.z;
+        for (int k=0; k<3; ++k) inv[k] = d[k] != 0.0f ? 1.0f / d[k] : 0.0f;
+    }
+};
+
+// Entry and exit distances through the box grown by pad on every side; axis is the face
+// entered, -1 when the ray starts inside.
+bool slab(const SlabRay& r, const Aabb& box, const Vec3& pad, float* enter, float* exit, int* axis) {
+    const float lo[3] = { box.min.x - pad.x, box.min.y - pad.y, box.min.z - pad.z };
+    const float hi[3] = { box.max.x + pad.x, box.max.y + pad.y, box.max.z + pad.z };
+    float t0 = -1e30f, t1 = 1e30f;
+    int entered = -1;
+    for (int k=0; k<3; ++k) {
+        if (r.d[k] == 0.0f) {
+            if (r.o[k] < lo[k] || r.o[k] > hi[k]) return false;
+            continue;
+        }
+        float a = (lo[k] - r.o[k]) * r.inv[k], b = (hi[k] - r.o[k]) * r.inv[k];
+        if (a > b) std::swap(a, b);
+        if (a > t0) { t0 = a; entered = k; }
+        t1 = std::min(t1, b);
+        if (t0 > t1) return false;
+    }
+    *enter = t0;
+    *exit = t1;
+    *axis = t0 >= 0.0f ? entered : -1;
+    return true;
+}
+
+Vec3 faceNormal(const SlabRay& r, int axis) {
+    float n[3] = { 0.0f, 0.0f, 0.0f };
+    if (axis >= 0) n[axis] = r.d[axis] > 0.0f ? -1.0f : 1.0f;
+    return Vec3(n[0], n[1], n[2]);
+}
+
+// Nearest leaf along the ray within maxDist; pad grows every box (sweeps), and with sweep set
+// leaves the ray starts inside are skipped.
+AabbRayHit castRay(const AabbTree& t, const SlabRay& r, float maxDist, const Vec3& pad, uint32_t mask, bool sweep) {
+    AabbRayHit hit = { AABB_NULL, maxDist, Vec3() };
+    if (t.root == AABB_NULL) return hit;
+    int stack[AABB_STACK];
+    float stackDist[AABB_STACK];
+    int sp = 0;
+    stack[sp] = t.root;
+    stackDist[sp++] = 0.0f;
+    uint64_t visited = 0;
+    while (sp > 0) {
+        --sp;
+        if (stackDist[sp] > hit.dist) continue;
+        const AabbNode& n = t.nodes[stack[sp]];
+        ++visited;
+        if (isLeaf(n)) {
+            float enter, exit;
+            int axis;
+            if (!slab(r, n.tight, pad, &enter, &exit, &axis) || exit < 0.0f) continue;
+            if (sweep && axis < 0) continue;
+            float d = std::max(enter, 0.0f);
+            if (d <= hit.dist && (d < hit.dist || hit.proxy == AABB_NULL)) {
+                hit.proxy = stack[sp];
+                hit.dist = d;
+                hit.normal = faceNormal(r, axis);
+            }
+            continue;
+        }
+        // children hit within the best so far, the nearer one on top
+        int child[2] = { n.child1, n.child2 };
+        float at[2];
+        bool in[2];
+        for (int k=0; k<2; ++k) {
+            const AabbNode& c = t.nodes[child[k]];
+            float enter = 0.0f, exit;
+            int axis;
+            in[k] = (c.mask & mask) && slab(r, c.box, pad, &enter, &exit, &axis) && exit >= 0.0f &&
+                    enter <= hit.dist;
+            at[k] = std::max(enter, 0.0f);
+        }
+        int first = in[0] && in[1] && at[1] < at[0] ? 1 : 0;
+        for (int k=1; k>=0; --k) {
+            int c = k == 0 ? first : 1 - first;
+            if (!in[c]) continue;
+            stack[sp] = child[c];
+            stackDist[sp++] = at[c];
+        }
+    }
+    t.stats.nodesVisited += visited;
+    return hit;
+}
+
+} // namespace
+
+int aabbInsert(AabbTree& t, const Aabb& box, uint32_t mask, uint32_t user) {
+    int leaf = allocNode(t);
+    AabbNode& n = t.nodes[leaf];
+    n.tight = box;
+    n.box = fatten(t, box, Vec3());
+    n.mask = mask;
+    n.user = user;
+    insertLeaf(t, leaf);
+    ++t.proxies;
+    ++t.stats.inserts;
+    return leaf;
+}
+
+void aabbRemove(AabbTree& t, int proxy) {
+    removeLeaf(t, proxy);
+    freeNode(t, proxy);
+    --t.proxies;
+    ++t.stats.removes;
+}
+
+bool aabbMove(AabbTree& t, int proxy, const Aabb& box, const Vec3& displacement) {
+    ++t.stats.moves;
+    AabbNode& n = t.nodes[proxy];
+    n.tight = box;
+    Aabb fat = fatten(t, box, displacement);
+    // a fat box that no longer predicts the motion (the object slowed down) is replaced too
+    Vec3 slack(4.0f * t.margin, 4.0f * t.margin, 4.0f * t.margin);
+    Aabb huge = { fat.min - slack, fat.max + slack };
+    if (aabbContains(n.box, box) && aabbContains(huge, n.box)) return false;
+    if (n.parent != AABB_NULL && aabbContains(t.nodes[n.parent].box, fat)) {
+        n.box = fat;
+        ++t.stats.refits;
+        return true;
+    }
+    removeLeaf(t, proxy);
+    t.nodes[proxy].box = fat;
+    insertLeaf(t, proxy);
+    ++t.stats.reinserts;
+    return true;
+}
+
+float aabbQuality(const AabbTree& t) {
+    if (t.root == AABB_NULL) return 0.0f;
+    float total = 0.0f;
+    for (const AabbNode& n : t.nodes) if (n.height > 0) total += aabbArea(n.box);
+    return total / std::max(aabbArea(t.nodes[t.root].box), 1e-6f);
+}
+
+bool aabbValidate(const AabbTree& t) {
+    if (t.root != AABB_NULL && t.nodes[t.root].parent != AABB_NULL) {
+        printf("[aabb] root %d has a parent\n", t.root);
+        return false;
+    }
+    int leaves = 0;
+    std::vector<int> stack;
+    if (t.root != AABB_NULL) stack.push_back(t.root);
+    while (!stack.empty()) {
+        int i = stack.back();
+        stack.pop_back();
+        const AabbNode& n = t.nodes[i];
+        if (isLeaf(n)) {
+            ++leaves;
+            if (n.height != 0 || !aabbContains(n.box, n.tight)) {
+                printf("[aabb] leaf %d: height %d or fat box short of its object\n", i, n.height);
+                return false;
+            }
+            continue;
+        }
+        const AabbNode& a = t.nodes[n.child1];
+        const AabbNode& b = t.nodes[n.child2];
+        if (a.parent != i || b.parent != i) {
+            printf("[aabb] node %d: children %d/%d point elsewhere\n", i, n.child1, n.child2);
+            return false;
+        }
+        if (n.height != 1 + std::max(a.height, b.height)) {
+            printf("[aabb] node %d: height %d over %d/%d\n", i, n.height, a.height, b.height);
+            return false;
+        }
+        if (n.mask != (a.mask | b.mask) || !aabbContains(n.box, a.box) || !aabbContains(n.box, b.box)) {
+            printf("[aabb] node %d: mask or box does not cover its children\n", i);
+            return false;
+        }
+        stack.push_back(n.child1);
+        stack.push_back(n.child2);
+    }
+    if (leaves != t.proxies) {
+        printf("[aabb] %d leaves reachable, %d proxies\n", leaves, t.proxies);
+        return false;
+    }
+    return true;
+}
+
+// ----------------- Batched queries -----------------
+void aabbOverlapBatch(const AabbTree& t, const Aabb* boxes, int count, uint32_t mask, std::vector<AabbPair>& out) {
+    if (t.root == AABB_NULL) return;
+    int stack[AABB_STACK];
+    uint64_t visited = 0;
+    for (int q=0; q<count; ++q) {
+        const Aabb& box = boxes[q];
+        int sp = 0;
+        stack[sp++] = t.root;
+        while (sp > 0) {
+            int i = stack[--sp];
+            const AabbNode& n = t.nodes[i];
+            ++visited;
+            if (!(n.mask & mask) || !aabbOverlaps(n.box, box)) continue;
+            if (isLeaf(n)) {
+                out.push_back({ q, i });
+            } else {
+                stack[sp++] = n.child1;
+                stack[sp++] = n.child2;
+            }
+        }
+    }
+    t.stats.nodesVisited += visited;
+}
+
+void aabbRayOverlapBatch(const AabbTree& t, const AabbRay* rays, int count, uint32_t mask, std::vector<AabbPair>& out) {
+    if (t.root == AABB_NULL) return;
+    int stack[AABB_STACK];
+    uint64_t visited = 0;
+    for (int q=0; q<count; ++q) {
+        SlabRay r(rays[q].origin, rays[q].dir);
+        int sp = 0;
+        stack[sp++] = t.root;
+        while (sp > 0) {
+            int i = stack[--sp];
+            const AabbNode& n = t.nodes[i];
+            ++visited;
+            float enter, exit;
+            int axis;
+            if (!(n.mask & mask) || !slab(r, n.box, Vec3(), &enter, &exit, &axis) || exit < 0.0f ||
+                enter > rays[q].maxDist) {
+                continue;
+            }
+            if (isLeaf(n)) {
+                out.push_back({ q, i });
+            } else {
+                stack[sp++] = n.child1;
+                stack[sp++] = n.child2;
+            }
+        }
+    }
+    t.stats.nodesVisited += visited;
+}
+
+void aabbRaycastBatch(const AabbTree& t, const AabbRay* rays, int count, uint32_t mask, AabbRayHit* hits) {
+    for (int q=0; q<count; ++q) {
+        if (t.root != AABB_NULL && !(t.nodes[t.root].mask & mask)) {
+            hits[q] = { AABB_NULL, rays[q].maxDist, Vec3() };
+            continue;
+        }
+        hits[q] = castRay(t, SlabRay(rays[q].origin, rays[q].dir), rays[q].maxDist, Vec3(), mask, false);
+    }
+}
+
+void aabbSweepBatch(const AabbTree& t, const Aabb* boxes, const Vec3* deltas, int count, uint32_t mask,
+                    AabbRayHit* hits) {
+    for (int q=0; q<count; ++q) {
+        // the box's centre as a ray through every box grown by its half extents
+        Vec3 centre = (boxes[q].min + boxes[q].max) * 0.5f, half = (boxes[q].max - boxes[q].min) * 0.5f;
+        if (t.root != AABB_NULL && !(t.nodes[t.root].mask & mask)) {
+            hits[q] = { AABB_NULL, 1.0f, Vec3() };
+            continue;
+        }
+        hits[q] = castRay(t, SlabRay(centre, deltas[q]), 1.0f, half, mask, true);
+    }
+}
+
+bool aabbRayBox(const Aabb& box, const Vec3& origin, const Vec3& dir, float maxDist, float* dist, Vec3* normal) {
+    SlabRay r(origin, dir);
+    float enter, exit;
+    int axis;
+    if (!slab(r, box, Vec3(), &enter, &exit, &axis) || exit < 0.0f || enter > maxDist) return false;
+    *dist = std::max(enter, 0.0f);
+    *normal = faceNormal(r, axis);
+    return true;
+}
@@ -0,0 +1,128 @@
+// Dynamic bounding-volume tree for everything collidable that is not a grid column: doors,
+// moving platforms, pickups and trigger volumes (props.h).
+//
+// Each object is a leaf holding its own box and a fat box: the object's box grown by a margin
+// plus a few frames of its displacement. An object that moves within its fat box costs nothing;
+// one that leaves it is refit in place when the new fat box still fits its parent, and removed
+// and reinserted otherwise. Insertion descends by the surface-area heuristic, and every node on
+// the way back up is rebalanced with AVL-style rotations, so the tree stays shallow however the
+// objects were added.
+//
+// Leaves carry layer bits and every internal node the union of its children's, so a query for
+// one layer (solids, sensors) skips subtrees without it. Queries come in batches: one call
+// takes many boxes, rays or sweeps and walks the tree for each with one shared stack. Rays and
+// sweeps are tested against the objects' own boxes, not the fat ones.
+#pragma once
+
+#include "vecmath.h"
+
+#include <cstdint>
+#include <vector>
+
+const int AABB_NULL = -1;
+
+struct Aabb {
+    Vec3 min, max;
+};
+
+inline Aabb aabbUnion(const Aabb& a, const Aabb& b) {
+    return { Vec3(fminf(a.min.x, b.min.x), fminf(a.min.y, b.min.y), fminf(a.min.z, b.min.z)),
+             Vec3(fmaxf(a.max.x, b.max.x), fmaxf(a.max.y, b.max.y), fmaxf(a.max.z, b.max.z)) };
+}
+inline bool aabbOverlaps(const Aabb& a, const Aabb& b) {
+    return a.min.x <= b.max.x && b.min.x <= a.max.x && a.min.y <= b.max.y && b.min.y <= a.max.y &&
+           a.min.z <= b.max.z && b.min.z <= a.max.z;
+}
+inline bool aabbContains(const Aabb& outer, const Aabb& inner) {
+    return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y && outer.min.z <= inner.min.z &&
+           inner.max.x <= outer.max.x && inner.max.y <= outer.max.y && inner.max.z <= outer.max.z;
+}
+inline float aabbArea(const Aabb& a) {
+    Vec3 d = a.max - a.min;
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+struct AabbNode {
+    Aabb box;            // fat box for leaves, union of the children otherwise
+    Aabb tight;          // leaves: the object's own box
+    int parent;          // next free node while on the free list
+    int child1, child2;  // AABB_NULL for leaves
+    int height;          // leaves 0, free nodes -1
+    uint32_t mask;       // leaf layer bits; internal nodes: union of the children's
+    uint32_t user;
+};
+
+struct AabbTreeStats {
+    uint64_t inserts = 0, removes = 0;
+    uint64_t moves = 0;       // aabbMove() calls
+    uint64_t refits = 0;      // leaves that left their fat box but fitted their parent
+    uint64_t reinserts = 0;   // leaves that did not
+    uint64_t rotations = 0;
+    uint64_t nodesVisited = 0;  // by queries
+};
+
+struct AabbTree {
+    std::vector<AabbNode> nodes;
+    int root = AABB_NULL;
+    int freeList = AABB_NULL;
+    int proxies = 0;
+    float margin = 0.1f;   // fat boxes grow this much on every side
+    float predict = 4.0f;  // and this many displacements ahead
+    mutable AabbTreeStats stats;  // queries count their node visits
+};
+
+// Returns the proxy (a leaf index, stable until removed).
+int aabbInsert(AabbTree& t, const Aabb& box, uint32_t mask, uint32_t user);
+void aabbRemove(AabbTree& t, int proxy);
+// New box for an object that moved by displacement since the last call; returns true when the
+// tree changed (refit or reinsertion).
+bool aabbMove(AabbTree& t, int proxy, const Aabb& box, const Vec3& displacement);
+
+inline const Aabb& aabbTight(const AabbTree& t, int proxy) { return t.nodes[proxy].tight; }
+inline uint32_t aabbUser(const AabbTree& t, int proxy) { return t.nodes[proxy].user; }
+inline int aabbHeight(const AabbTree& t) { return t.root == AABB_NULL ? 0 : t.nodes[t.root].height; }
+// Internal node area over root area, summed: lower is a better tree.
+float aabbQuality(const AabbTree& t);
+// Structure, heights, masks and enclosing boxes; prints the first problem found.
+bool aabbValidate(const AabbTree& t);
+
+// ----------------- Batched queries -----------------
+struct AabbPair {
+    int query;  // index into the batch
+    int proxy;
+};
+
+struct AabbRay {
+    Vec3 origin, dir;  // dir need not be unit length; distances are in units of dir
+    float maxDist;
+};
+
+struct AabbRayHit {
+    int proxy;    // AABB_NULL: nothing hit
+    float dist;   // rays: along dir; sweeps: fraction of the displacement
+    Vec3 normal;  // of the face entered
+};
+
+// Every leaf in mask whose fat box overlaps each query box, appended as pairs.
+void aabbOverlapBatch(const AabbTree& t, const Aabb* boxes, int count, uint32_t mask, std::vector<AabbPair>& out);
+// Every leaf in mask whose fat box each ray crosses within its maxDist, appended as pairs: the
+// candidates for a finer test of what the leaf stands for.
+void aabbRayOverlapBatch(const AabbTree& t, const AabbRay* rays, int count, uint32_t mask, std::vector<AabbPair>& out);
+// Nearest leaf in mask each ray enters within its maxDist.
+void aabbRaycastBatch(const AabbTree& t, const AabbRay* rays, int count, uint32_t mask, AabbRayHit* hits);
+// First leaf in mask each box runs into while moving by its delta, as the fraction of the delta
+// travelled. Leaves the box already overlaps at the start are ignored.
+void aabbSweepBatch(const AabbTree& t, const Aabb* boxes, const Vec3* deltas, int count, uint32_t mask,
+                    AabbRayHit* hits);
+
+inline bool aabbRaycast(const AabbTree& t, const AabbRay& ray, uint32_t mask, AabbRayHit& hit) {
+    aabbRaycastBatch(t, &ray, 1, mask, &hit);
+    return hit.proxy != AABB_NULL;
+}
+inline bool aabbSweep(const AabbTree& t, const Aabb& box, const Vec3& delta, uint32_t mask, AabbRayHit& hit) {
+    aabbSweepBatch(t, &box, &delta, 1, mask, &hit);
+    return hit.proxy != AABB_NULL;
+}
+
+// Slab test of one ray against one box: entry distance in [0, maxDist] and the face entered.
+bool aabbRayBox(const Aabb& box, const Vec3& origin, const Vec3& dir, float maxDist, float* dist, Vec3* normal);
@@ -0,0 +1,205 @@
+#include "animation.h"
+#include "jobs.h"
+#include "profiler.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
+
+const Skeleton humanSkeleton = {
+    // parent
+    { -1, BONE_PELVIS, BONE_SPINE,
+      BONE_SPINE, BONE_UPPER_ARM_L, BONE_SPINE, BONE_UPPER_ARM_R,
+      BONE_PELVIS, BONE_THIGH_L, BONE_PELVIS, BONE_THIGH_R },
+    // joint
+    { Vec3(0,0.95f,0), Vec3(0,1.1f,0), Vec3(0,1.55f,0),
+      Vec3(-0.26f,1.5f,0), Vec3(-0.26f,1.2f,0), Vec3(0.26f,1.5f,0), Vec3(0.26f,1.2f,0),
+      Vec3(-0.1f,0.9f,0), Vec3(-0.1f,0.48f,0), Vec3(0.1f,0.9f,0), Vec3(0.1f,0.48f,0) },
+    // boxMin
+    { Vec3(-0.16f,0.85f,-0.1f), Vec3(-0.2f,1.1f,-0.11f), Vec3(-0.12f,1.55f,-0.12f),
+      Vec3(-0.32f,1.2f,-0.06f), Vec3(-0.31f,0.9f,-0.05f), Vec3(0.2f,1.2f,-0.06f), Vec3(0.2f,0.9f,-0.05f),
+      Vec3(-0.17f,0.48f,-0.07f), Vec3(-0.16f,0.0f,-0.06f), Vec3(0.03f,0.48f,-0.07f), Vec3(0.04f,0.0f,-0.06f) },
+    // boxMax
+    { Vec3(0.16f,1.1f,0.1f), Vec3(0.2f,1.52f,0.11f), Vec3(0.12f,1.8f,0.12f),
+      Vec3(-0.2f,1.52f,0.06f), Vec3(-0.2f,1.2f,0.05f), Vec3(0.32f,1.52f,0.06f), Vec3(0.31f,1.2f,0.05f),
+      Vec3(-0.03f,0.9f,0.07f), Vec3(-0.04f,0.48f,0.12f), Vec3(0.17f,0.9f,0.07f), Vec3(0.16f,0.48f,0.12f) },
+};
+
+namespace {
+
+// Keyframed local rotations. Component arrays hold keys * SKEL_LANES floats so one key of
+// all bones is three F4 loads per component.
+struct AnimClip {
+    float duration;
+    int keys;
+    std::vector<float> qx, qy, qz, qw;
+};
+
+AnimClip clips[CLIP_COUNT];
+Vec3 localOffset[SKEL_BONES];  // joint relative to parent joint
+int profSample = -1, profPosed = -1;
+
+struct Quat { float x, y, z, w; };
+
+Quat axisAngle(const Vec3& axis, float a) {
+    float s = sinf(a * 0.5f);
+    return { axis.x * s, axis.y * s, axis.z * s, cosf(a * 0.5f) };
+}
+
+void setKey(AnimClip& c, int key, int bone, const Quat& q) {
+    int i = key * SKEL_LANES + bone;
+    c.qx[i] = q.x; c.qy[i] = q.y; c.qz[i] = q.z; c.qw[i] = q.w;
+}
+
+void initClip(AnimClip& c, float duration, int keys) {
+    c.duration = duration;
+    c.keys = keys;
+    // identity everywhere, padding lanes included
+    c.qx.assign(keys * SKEL_LANES, 0.0f); c.qy.assign(keys * SKEL_LANES, 0.0f);
+    c.qz.assign(keys * SKEL_LANES, 0.0f); c.qw.assign(keys * SKEL_LANES, 1.0f);
+}
+
+void buildClips() {
+    const Vec3 X(1,0,0), Y(0,1,0), Z(0,0,1);
+    const float tau = 6.2831853f;
+
+    AnimClip& walk = clips[CLIP_WALK];
+    initClip(walk, 0.9f, 8);
+    for (int k=0; k<walk.keys; ++k) {
+        float s = sinf(tau * k / walk.keys);
+        float c = cosf(tau * k / walk.keys);
+        setKey(walk, k, BONE_THIGH_L, axisAngle(X,  0.55f * s));
+        setKey(walk, k, BONE_THIGH_R, axisAngle(X, -0.55f * s));
+        setKey(walk, k, BONE_SHIN_L, axisAngle(X, -0.5f * std::max(0.0f, -c)));
+        setKey(walk, k, BONE_SHIN_R, axisAngle(X, -0.5f * std::max(0.0f,  c)));
+        setKey(walk, k, BONE_UPPER_ARM_L, axisAngle(X, -0.45f * s));
+        setKey(walk, k, BONE_UPPER_ARM_R, axisAngle(X,  0.45f * s));
+        setKey(walk, k, BONE_LOWER_ARM_L, axisAngle(X, 0.3f));
+        setKey(walk, k, BONE_LOWER_ARM_R, axisAngle(X, 0.3f));
+        setKey(walk, k, BONE_SPINE, axisAngle(Y, 0.12f * s));
+    }
+
+    AnimClip& idle = clips[CLIP_IDLE];
+    initClip(idle, 2.4f, 4);
+    for (int k=0; k<idle.keys; ++k) {
+        float s = sinf(tau * k / idle.keys);
+        setKey(idle, k, BONE_SPINE, axisAngle(X, 0.04f * s));
+        setKey(idle, k, BONE_HEAD, axisAngle(Y, 0.15f * s));
+        setKey(idle, k, BONE_UPPER_ARM_L, axisAngle(Z, -0.08f - 0.03f * s));
+        setKey(idle, k, BONE_UPPER_ARM_R, axisAngle(Z,  0.08f + 0.03f * s));
+    }
+}
+
+// Samples all bone rotations of a clip at time t: nlerp between the two surrounding keys,
+// four bones per SIMD op.
+void sampleClip(const AnimClip& c, float t, float* qx, float* qy, float* qz, float* qw) {
+    float kt = fmodf(t, c.duration) / c.duration * c.keys;
+    if (kt < 0.0f) kt += c.keys;
+    int k0 = int(kt) % c.keys;
+    int k1 = (k0 + 1) % c.keys;
+    F4 f = f4Splat(kt - floorf(kt));
+    F4 zero = f4Splat(0.0f), one = f4Splat(1.0f);
+    for (int lane=0; lane<SKEL_LANES; lane+=4) {
+        int a = k0 * SKEL_LANES + lane, b = k1 * SKEL_LANES + lane;
+        F4 ax = f4Load(&c.qx[a]), ay = f4Load(&c.qy[a]), az = f4Load(&c.qz[a]), aw = f4Load(&c.qw[a]);
+        F4 bx = f4Load(&c.qx[b]), by = f4Load(&c.qy[b]), bz = f4Load(&c.qz[b]), bw = f4Load(&c.qw[b]);
+        // shortest arc: flip the second key where the dot product is negative
+        F4 d = ax*bx + ay*by + az*bz + aw*bw;
+        F4 sign = f4Select(f4Less(d, zero), zero - one, one);
+        F4 fb = f * sign, fa = one - f;
+        F4 x = ax*fa + bx*fb, y = ay*fa + by*fb, z = az*fa + bz*fb, w = aw*fa + bw*fb;
+        F4 inv = one / f4Sqrt(x*x + y*y + z*z + w*w);
+        f4Store(qx + lane, x*inv); f4Store(qy + lane, y*inv);
+        f4Store(qz + lane, z*inv); f4Store(qw + lane, w*inv);
+    }
+}
+
+// Row-major 3x4 affine helpers.
+void affineMul(const float* a, const float* b, float* o) {
+    for (int r=0; r<3; ++r) {
+        const float* ar = a + r*4;
+        for (int c=0; c<4; ++c) {
+            o[r*4 + c] = ar[0]*b[c] + ar[1]*b[4 + c] + ar[2]*b[8 + c] + (c == 3 ? ar[3] : 0.0f);
+        }
+    }
+}
+
+void affineFromQuat(float x, float y, float z, float w, const Vec3& t, float* o) {
+    o[0] = 1 - 2*(y*y + z*z); o[1] = 2*(x*y - z*w);     o[2]  = 2*(x*z + y*w);     o[3]  = t.x;
+    o[4] = 2*(x*y + z*w);     o[5] = 1 - 2*(x*x + z*z); o[6]  = 2*(y*z - x*w);     o[7]  = t.y;
+    o[8] = 2*(x*z - y*w);     o[9] = 2*(y*z + x*w);     o[10] = 1 - 2*(x*x + y*y); o[11] = t.z;
+}
+
+void posePalette(const CharacterSet& set, int i, float* palette) {
+    alignas(16) float qx[SKEL_LANES], qy[SKEL_LANES], qz[SKEL_LANES], qw[SKEL_LANES];
+    sampleClip(clips[set.clip[i]], set.animTime[i], qx, qy, qz, qw);
+
+    float model[SKEL_BONES][12];
+    for (int b=0; b<SKEL_BONES; ++b) {
+        float local[12];
+        affineFromQuat(qx[b], qy[b], qz[b], qw[b], localOffset[b], local);
+        int p = humanSkeleton.parent[b];
+        if (p < 0) memcpy(model[b], local, sizeof(local));
+        else affineMul(model[p], local, model[b]);
+        // skinning matrix = model * inverse(bind); the bind pose has no rotation
+        float* out = palette + b*12;
+        const Vec3& j = humanSkeleton.joint[b];
+        for (int r=0; r<3; ++r) {
+            const float* m = model[b] + r*4;
+            out[r*4 + 0] = m[0]; out[r*4 + 1] = m[1]; out[r*4 + 2] = m[2];
+            out[r*4 + 3] = m[3] - (m[0]*j.x + m[1]*j.y + m[2]*j.z);
+        }
+    }
+}
+
+} // namespace
+
+int CharacterSet::add(const Vec3& pos, float h, AnimClipId c) {
+    posX.push_back(pos.x); posY.push_back(pos.y); posZ.push_back(pos.z);
+    heading.push_back(h);
+    animTime.push_back(0.37f * count);  // desynchronise the crowd
+    animSpeed.push_back(1.0f);
+    clip.push_back(uint8_t(c));
+    lodInterval.push_back(1);
+    gpu.resize(gpu.size() + CHAR_GPU_FLOATS, 0.0f);
+    // valid pose before the first update
+    posePalette(*this, count, &gpu[size_t(count) * CHAR_GPU_FLOATS + 12]);
+    return count++;
+}
+
+void animationInit() {
+    for (int b=0; b<SKEL_BONES; ++b) {
+        int p = humanSkeleton.parent[b];
+        localOffset[b] = p < 0 ? humanSkeleton.joint[b] : humanSkeleton.joint[b] - humanSkeleton.joint[p];
+    }
+    buildClips();
+    profSample = profilerSlot("anim.update");
+    profPosed = profilerSlot("anim.posed");
+}
+
+void animateCharacters(CharacterSet& set, float dt, const Vec3& camera, uint32_t frame) {
+    ProfileScope scope(profSample);
+    int posed = 0;
+    for (int i=0; i<set.count; ++i) {
+        float dx = set.posX[i] - camera.x, dz = set.posZ[i] - camera.z;
+        float d2 = dx*dx + dz*dz;
+        set.lodInterval[i] = d2 < 20.0f*20.0f ? 1 : d2 < 45.0f*45.0f ? 2 : d2 < 90.0f*90.0f ? 4 : 8;
+        set.animTime[i] += dt * set.animSpeed[i];
+        if ((frame + uint32_t(i)) % set.lodInterval[i] == 0) ++posed;
+    }
+    profilerAddCount(profPosed, posed);
+
+    parallelFor(set.count, 16, [&](int begin, int end) {
+        for (int i=begin; i<end; ++i) {
+            float* rec = &set.gpu[size_t(i) * CHAR_GPU_FLOATS];
+            // instance -> world: translate, then rotate +z onto the heading direction
+            float a = 1.5707963f - set.heading[i];
+            float c = cosf(a), s = sinf(a);
+            float world[12] = { c, 0, s, set.posX[i],
+                                0, 1, 0, set.posY[i],
+                               -s, 0, c, set.posZ[i] };
+            memcpy(rec, world, sizeof(world));
+            if ((frame + uint32_t(i)) % set.lodInterval[i] == 0) posePalette(set, i, rec + 12);
+        }
+    });
+}
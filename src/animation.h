@@ -0,0 +1,56 @@
+// Skeletal animation for characters: a fixed humanoid skeleton, keyframed clips stored SoA
+// (one array per quaternion component, bones padded to the SIMD width) and a batched,
+// parallel pose update with distance-based animation LOD.
+#pragma once
+
+#include "vecmath.h"
+
+#include <cstdint>
+#include <vector>
+
+enum HumanBone {
+    BONE_PELVIS, BONE_SPINE, BONE_HEAD,
+    BONE_UPPER_ARM_L, BONE_LOWER_ARM_L, BONE_UPPER_ARM_R, BONE_LOWER_ARM_R,
+    BONE_THIGH_L, BONE_SHIN_L, BONE_THIGH_R, BONE_SHIN_R,
+    SKEL_BONES
+};
+const int SKEL_LANES = 12;  // SKEL_BONES rounded up to a multiple of 4
+
+// Bind pose in model space (feet at y=0, facing +z). Parents precede children.
+struct Skeleton {
+    int parent[SKEL_BONES];
+    Vec3 joint[SKEL_BONES];
+    Vec3 boxMin[SKEL_BONES], boxMax[SKEL_BONES];  // body part volume in bind pose
+};
+extern const Skeleton humanSkeleton;
+
+enum AnimClipId { CLIP_IDLE, CLIP_WALK, CLIP_COUNT };
+
+// Per-instance GPU record: 3 texels (row-major 3x4) of instance-to-world transform followed by
+// 3 texels per bone of model-space skinning matrix. CharacterSet::gpu is laid out exactly like
+// the palette texture rows so it uploads without repacking.
+const int CHAR_GPU_TEXELS = 3 * (SKEL_BONES + 1);
+const int CHAR_GPU_FLOATS = CHAR_GPU_TEXELS * 4;
+
+struct CharacterSet {
+    int count = 0;
+    std::vector<float> posX, posY, posZ, heading;  // heading: movement angle, same convention as yaw
+    std::vector<float> animTime, animSpeed;
+    std::vector<uint8_t> clip;
+    std::vector<uint8_t> lodInterval;   // pose is resampled every lodInterval frames
+    std::vector<float> gpu;             // count * CHAR_GPU_FLOATS
+
+    int add(const Vec3& pos, float heading, AnimClipId clip);
+};
+
+void animationInit();
+
+// Advances clip time, picks each character's LOD from its distance to the camera and resamples
+// the poses that are due this frame (staggered by index), spread over the job workers.
+// World transforms are refreshed for every character every frame.
+void animateCharacters(CharacterSet& set, float dt, const Vec3& camera, uint32_t frame);
+
+// Model-space bone matrix (row-major 3x4) of a character's current pose.
+inline const float* characterBoneMatrix(const CharacterSet& set, int i, int bone) {
+    return &set.gpu[size_t(i) * CHAR_GPU_FLOATS + 12 + bone * 12];
+}
@@ -0,0 +1,264 @@
+#include "audio.h"
+#include "profiler.h"
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#if SANDBOX_HAS_THREADS
+#include <chrono>
+#include <thread>
+#endif
+
+#ifdef __EMSCRIPTEN__
+#include <emscripten/emscripten.h>
+#endif
+
+namespace {
+
+enum AudioCommandType : uint8_t { AUDIO_CMD_PLAY, AUDIO_CMD_LISTENER };
+
+struct AudioCommand {
+    uint8_t type;
+    uint8_t sound;
+    float volume;
+    Vec3 pos;
+    Vec3 right;
+};
+
+const uint32_t kCommandRing = 1024;
+
+// Allocated once and leaked like the jobs.cpp pool: the output callback may still run while
+// static destructors do.
+struct Engine {
+    AudioMixer mixer;                    // mixer thread only
+    AudioRing<AudioCommand> commands;    // game -> mixer
+    AudioRing<float> samples;            // mixer -> output
+    const AudioOutput* output = nullptr;
+    std::atomic<bool> running{false};
+    std::atomic<uint64_t> blocks{0}, underruns{0}, dropped{0};
+    std::atomic<int> voices{0};
+    std::atomic<float> mixUs{0.0f}, maxMixUs{0.0f};
+    float block[AUDIO_BLOCK * 2];
+#if SANDBOX_HAS_THREADS
+    std::thread thread;
+#endif
+};
+Engine* engine = nullptr;
+
+void push(const AudioCommand& c) {
+    if (!engine || !engine->running.load(std::memory_order_relaxed)) return;
+    if (engine->commands.push(&c, 1) == 0) engine->dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Applies the queued commands and mixes until AUDIO_LATENCY frames wait for the output.
+void pump(Engine& e) {
+    AudioCommand c;
+    while (e.commands.pop(&c, 1)) {
+        if (c.type == AUDIO_CMD_PLAY) {
+            audioMixerPlay(e.mixer, SoundId(c.sound), c.pos, c.volume);
+        } else {
+            e.mixer.listener.pos = c.pos;
+            e.mixer.listener.right = c.right;
+        }
+    }
+    while (e.samples.size() < uint32_t(AUDIO_LATENCY * 2) && e.samples.space() >= uint32_t(AUDIO_BLOCK * 2)) {
+        double start = profilerNowMs();
+        audioMixBlock(e.mixer, e.block);
+        float us = float((profilerNowMs() - start) * 1000.0);
+        e.samples.push(e.block, AUDIO_BLOCK * 2);
+        e.blocks.fetch_add(1, std::memory_order_relaxed);
+        e.voices.store(e.mixer.voices, std::memory_order_relaxed);
+        e.mixUs.store(us, std::memory_order_relaxed);
+        if (us > e.maxMixUs.load(std::memory_order_relaxed)) e.maxMixUs.store(us, std::memory_order_relaxed);
+    }
+}
+
+#if SANDBOX_HAS_THREADS
+void mixerMain() {
+    while (engine->running.load(std::memory_order_acquire)) {
+        pump(*engine);
+        // a block lasts 5.3 ms; waking every millisecond keeps the ring full without spinning
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+#endif
+
+// ----------------- Outputs -----------------
+#ifdef __EMSCRIPTEN__
+std::vector<float> webBuffer;
+
+bool webOpen() {
+    return EM_ASM_INT({
+        var AC = window.AudioContext || window.webkitAudioContext;
+        if (!AC) return 0;
+        var ctx = new AC({ sampleRate: $0 });
+        var node = ctx.createScriptProcessor(1024, 0, 2);
+        node.onaudioprocess = function(e) {
+            var l = e.outputBuffer.getChannelData(0), r = e.outputBuffer.getChannelData(1);
+            var p = Module._audioWebPull(l.length) >> 2;
+            for (var i = 0; i < l.length; ++i) {
+                l[i] = HEAPF32[p + 2*i];
+                r[i] = HEAPF32[p + 2*i + 1];
+            }
+        };
+        node.connect(ctx.destination);
+        var resume = function() { if (ctx.state !== 'running') ctx.resume(); };
+        document.addEventListener('mousedown', resume);
+        document.addEventListener('keydown', resume);
+        Module.sandboxAudio = { ctx: ctx, node: node };
+        return 1;
+    }, AUDIO_RATE) != 0;
+}
+
+void webClose() {
+    EM_ASM({
+        if (!Module.sandboxAudio) return;
+        Module.sandboxAudio.node.disconnect();
+        Module.sandboxAudio.ctx.close();
+        Module.sandboxAudio = null;
+    });
+}
+#else
+bool webOpen() {
+    printf("[audio] the web output needs a browser\n");
+    return false;
+}
+void webClose() {}
+#endif
+
+#if SANDBOX_HAS_THREADS
+std::atomic<bool> nullRunning{false};
+std::thread nullThread;
+
+void nullMain() {
+    float buffer[AUDIO_BLOCK * 2];
+    auto period = std::chrono::microseconds(1000000LL * AUDIO_BLOCK / AUDIO_RATE);
+    auto next = std::chrono::steady_clock::now();
+    while (nullRunning.load(std::memory_order_acquire)) {
+        next += period;
+        std::this_thread::sleep_until(next);
+        audioPull(buffer, AUDIO_BLOCK);
+    }
+}
+
+bool nullOpen() {
+    nullRunning.store(true);
+    nullThread = std::thread(nullMain);
+    return true;
+}
+
+void nullClose() {
+    nullRunning.store(false);
+    if (nullThread.joinable()) nullThread.join();
+}
+#else
+bool nullOpen() { return true; }
+void nullClose() {}
+#endif
+
+} // namespace
+
+const AudioOutput audioOutputWeb = { "web", webOpen, webClose };
+const AudioOutput audioOutputNull = { "null", nullOpen, nullClose };
+
+#ifdef __EMSCRIPTEN__
+// Called by the script processor node with the frames it wants; returns the interleaved block.
+extern "C" EMSCRIPTEN_KEEPALIVE float* audioWebPull(int frames) {
+    if (webBuffer.size() < size_t(frames) * 2) webBuffer.resize(size_t(frames) * 2);
+    audioPull(webBuffer.data(), frames);
+    return webBuffer.data();
+}
+#endif
+
+bool audioInit(const AudioOutput& output, uint32_t seed) {
+    if (engine && engine->running.load()) return true;
+    if (!engine) engine = new Engine();
+    Engine& e = *engine;
+    audioMixerInit(e.mixer, seed);
+    e.commands.init(kCommandRing);
+    e.samples.init(uint32_t(AUDIO_LATENCY * 4));
+    e.output = &output;
+    e.running.store(true, std::memory_order_release);
+#if SANDBOX_HAS_THREADS
+    e.thread = std::thread(mixerMain);
+#else
+    pump(e);
+#endif
+    if (!output.open()) {
+        printf("[audio] %s output failed to open, running silent\n", output.name);
+        e.output = nullptr;
+        return false;
+    }
+    printf("[audio] %s output, %d Hz, %d-frame blocks, %d frames of latency\n", output.name, AUDIO_RATE, AUDIO_BLOCK,
+           AUDIO_LATENCY);
+    return true;
+}
+
+void audioShutdown() {
+    if (!engine || !engine->running.load()) return;
+    if (engine->output) engine->output->close();
+    engine->output = nullptr;
+    engine->running.store(false, std::memory_order_release);
+#if SANDBOX_HAS_THREADS
+    if (engine->thread.joinable()) engine->thread.join();
+#endif
+}
+
+void audioPlay(SoundId sound, const Vec3& pos, float volume) {
+    AudioCommand c = { AUDIO_CMD_PLAY, uint8_t(sound), volume, pos, Vec3() };
+    push(c);
+}
+
+void audioSetListener(const Vec3& pos, float yaw) {
+    // the right of the view direction, level like the walking code's
+    AudioCommand c = { AUDIO_CMD_LISTENER, 0, 0.0f, pos, Vec3(-sinf(yaw), 0.0f, cosf(yaw)) };
+    push(c);
+}
+
+void audioUpdate() {
+#if !SANDBOX_HAS_THREADS
+    if (engine && engine->running.load()) pump(*engine);
+#endif
+}
+
+AudioStats audioStats() {
+    AudioStats s;
+    if (!engine) return s;
+    s.blocks = engine->blocks.load(std::memory_order_relaxed);
+    s.underruns = engine->underruns.load(std::memory_order_relaxed);
+    s.dropped = engine->dropped.load(std::memory_order_relaxed);
+    s.voices = engine->voices.load(std::memory_order_relaxed);
+    s.mixUs = engine->mixUs.load(std::memory_order_relaxed);
+    s.maxMixUs = engine->maxMixUs.load(std::memory_order_relaxed);
+    return s;
+}
+
+int audioPull(float* out, int frames) {
+    int got = 0;
+    if (engine && engine->running.load(std::memory_order_acquire)) {
+        got = int(engine->samples.pop(out, uint32_t(frames) * 2) / 2);
+        if (got < frames) engine->underruns.fetch_add(uint64_t(frames - got), std::memory_order_relaxed);
+    }
+    for (int i=got * 2; i<frames * 2; ++i) out[i] = 0.0f;
+    return got;
+}
+
+bool audioRenderWav(const char* path, int blocks, uint32_t seed, void (*script)(AudioMixer& m, int block, void* user),
+                    void* user, double* mixMs) {
+    AudioMixer m;
+    audioMixerInit(m, seed);
+    WavWriter w;
+    if (!wavOpen(w, path, AUDIO_RATE, 2)) return false;
+    float block[AUDIO_BLOCK * 2];
+    double ms = 0.0;
+    for (int b=0; b<blocks; ++b) {
+        if (script) script(m, b, user);
+        double start = profilerNowMs();
+        audioMixBlock(m, block);
+        ms += profilerNowMs() - start;
+        wavWrite(w, block, AUDIO_BLOCK);
+    }
+    if (mixMs) *mixMs = ms;
+    return wavClose(w);
+}
@@ -0,0 +1,62 @@
+// Game audio: sounds queued from the game thread, mixed on a dedicated thread, played by an
+// output device.
+//
+// audioPlay() and audioSetListener() only push commands into a lock-free ring. The mixer
+// thread drains it, mixes AUDIO_BLOCK frames at a time (audio_mixer.h) and keeps a second
+// ring of interleaved samples topped up to AUDIO_LATENCY frames, which the output pulls from
+// its own callback with audioPull(). Builds without threads mix from audioUpdate() once a
+// frame instead, with more latency to cover the gap between frames.
+//
+// Where the samples go is a pluggable output (the same idea as NetIoBackend):
+//   web   a Web Audio script processor node (web builds); the context starts on the first
+//         click or key press, as browsers require
+//   null  discards at the real-time rate (native, headless)
+// audioRenderWav() skips both and renders a scripted scene to a file as fast as it mixes.
+#pragma once
+
+#include "audio_mixer.h"
+#include "jobs.h"
+
+#include <cstdint>
+
+#if SANDBOX_HAS_THREADS
+const int AUDIO_LATENCY = 2048;  // frames queued ahead of the output, ~43 ms
+#else
+const int AUDIO_LATENCY = 4096;  // mixed once a frame: ~85 ms
+#endif
+
+struct AudioOutput {
+    const char* name;
+    bool (*open)();   // starts calling audioPull()
+    void (*close)();
+};
+extern const AudioOutput audioOutputWeb;
+extern const AudioOutput audioOutputNull;
+
+struct AudioStats {
+    uint64_t blocks = 0;      // mixed
+    uint64_t underruns = 0;   // frames the output asked for before they were mixed
+    uint64_t dropped = 0;     // commands lost to a full ring
+    int voices = 0;
+    double mixUs = 0.0;       // last block
+    double maxMixUs = 0.0;
+};
+
+bool audioInit(const AudioOutput& output, uint32_t seed);
+void audioShutdown();
+
+// Game thread.
+void audioPlay(SoundId sound, const Vec3& pos, float volume = 1.0f);
+void audioSetListener(const Vec3& pos, float yaw);
+// Once a frame; mixes here when there are no threads.
+void audioUpdate();
+AudioStats audioStats();
+
+// Output side: interleaved stereo; what is not mixed yet is silence. Returns frames mixed.
+int audioPull(float* out, int frames);
+
+// Mixes `blocks` blocks into a WAV file; before each block script() may play sounds on the
+// mixer and move its listener. Returns false when the file could not be written; *mixMs is the
+// time spent mixing alone.
+bool audioRenderWav(const char* path, int blocks, uint32_t seed, void (*script)(AudioMixer& m, int block, void* user),
+                    void* user, double* mixMs);
@@ -0,0 +1,272 @@
+#include "audio_mixer.h"
+#include "simd.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+struct Noise {
+    uint32_t s;
+    float next() {
+        s ^= s << 13; s ^= s >> 17; s ^= s << 5;
+        return float(s) * (1.0f / 2147483648.0f) - 1.0f;
+    }
+};
+
+// Every sound is noise through a one-pole lowpass plus a decaying tone, shaped differently.
+struct Recipe {
+    float seconds;
+    float noise, noiseDecay, lowpass, body, bodyDecay;
+    float tone, toneDecay, hz, hz2, toneSwitch;  // the tone jumps to hz2 after toneSwitch seconds
+};
+
+const Recipe recipes[SOUND_COUNT] = {
+    // seconds noise decay  lowpass body  decay  tone  decay  hz     hz2     switch
+    { 0.35f,   0.55f, 0.04f, 0.35f,  0.5f, 0.09f, 0.6f, 0.10f, 70.0f, 70.0f,  1.0f },   // shot
+    { 0.18f,   0.0f,  0.03f, 0.15f,  1.6f, 0.03f, 0.4f, 0.05f, 160.0f, 160.0f, 1.0f },  // impact
+    { 0.10f,   0.0f,  0.02f, 0.08f,  1.5f, 0.015f, 0.0f, 0.02f, 0.0f, 0.0f,   1.0f },   // step
+    { 0.35f,   0.0f,  0.01f, 0.5f,   0.0f, 0.01f, 0.4f, 0.12f, 880.0f, 1320.0f, 0.1f }, // pickup
+};
+
+void synthesise(std::vector<float>& out, int& length, const Recipe& r, uint32_t seed) {
+    length = int(r.seconds * AUDIO_RATE);
+    out.assign(size_t(length + AUDIO_BLOCK), 0.0f);
+    Noise noise = { seed | 1u };
+    float lp = 0.0f, phase = 0.0f;
+    for (int n=0; n<length; ++n) {
+        float t = float(n) / AUDIO_RATE;
+        float white = noise.next();
+        lp += r.lowpass * (white - lp);
+        phase += 6.2831853f * (t < r.toneSwitch ? r.hz : r.hz2) / AUDIO_RATE;
+        float attack = std::min(t * 2000.0f, 1.0f);  // half a millisecond, against clicks
+        out[n] = attack * (r.noise * white * expf(-t / r.noiseDecay) + r.body * lp * expf(-t / r.bodyDecay) +
+                           r.tone * sinf(phase) * expf(-t / r.toneDecay));
+    }
+}
+
+// The scalar reference's min and max: the same answers as the SSE instructions.
+inline float minf(float a, float b) { return a < b ? a : b; }
+inline float maxf(float a, float b) { return a > b ? a : b; }
+
+const float kPanEpsilon = 1e-3f;
+
+void spatialise(AudioMixer& m) {
+    const AudioListener& l = m.listener;
+    const F4 lx = f4Splat(l.pos.x), ly = f4Splat(l.pos.y), lz = f4Splat(l.pos.z);
+    const F4 rx = f4Splat(l.right.x), ry = f4Splat(l.right.y), rz = f4Splat(l.right.z);
+    const F4 ref = f4Splat(m.refDist), far = f4Splat(m.maxDist), fade = f4Splat(1.0f / (m.maxDist - m.refDist));
+    const F4 master = f4Splat(m.masterGain), zero = f4Splat(0.0f), one = f4Splat(1.0f), half = f4Splat(0.5f);
+    const F4 eps = f4Splat(kPanEpsilon);
+    for (int i=0; i<m.voices; i += 4) {
+        F4 dx = f4Load(&m.posX[i]) - lx, dy = f4Load(&m.posY[i]) - ly, dz = f4Load(&m.posZ[i]) - lz;
+        F4 dist = f4Sqrt(dx * dx + dy * dy + dz * dz);
+        F4 att = ref / f4Max(dist, ref);
+        F4 g = f4Load(&m.volume[i]) * master * att * f4Clamp((far - dist) * fade, zero, one);
+        F4 pan = f4Clamp((dx * rx + dy * ry + dz * rz) / f4Max(dist, eps), zero - one, one);
+        f4Store(&m.targetL[i], g * f4Sqrt(half - half * pan));
+        f4Store(&m.targetR[i], g * f4Sqrt(half + half * pan));
+    }
+}
+
+void spatialiseScalar(AudioMixer& m) {
+    const AudioListener& l = m.listener;
+    const float fade = 1.0f / (m.maxDist - m.refDist);
+    for (int i=0; i<m.voices; ++i) {
+        float dx = m.posX[i] - l.pos.x, dy = m.posY[i] - l.pos.y, dz = m.posZ[i] - l.pos.z;
+        float dist = sqrtf(dx * dx + dy * dy + dz * dz);
+        float att = m.refDist / maxf(dist, m.refDist);
+        float g = m.volume[i] * m.masterGain * att * minf(maxf((m.maxDist - dist) * fade, 0.0f), 1.0f);
+        float pan = minf(maxf((dx * l.right.x + dy * l.right.y + dz * l.right.z) / maxf(dist, kPanEpsilon),
+                              0.0f - 1.0f), 1.0f);
+        m.targetL[i] = g * sqrtf(0.5f - 0.5f * pan);
+        m.targetR[i] = g * sqrtf(0.5f + 0.5f * pan);
+    }
+}
+
+// Where voice v's ramp starts and how far it climbs per frame; false when it is silent for
+// the whole block.
+bool voiceRamp(const AudioMixer& m, int v, float* startL, float* startR, float* stepL, float* stepR) {
+    *startL = m.fresh[v] != 0.0f ? m.targetL[v] : m.gainL[v];
+    *startR = m.fresh[v] != 0.0f ? m.targetR[v] : m.gainR[v];
+    if (*startL == 0.0f && *startR == 0.0f && m.targetL[v] == 0.0f && m.targetR[v] == 0.0f) return false;
+    *stepL = (m.targetL[v] - *startL) * (1.0f / AUDIO_BLOCK);
+    *stepR = (m.targetR[v] - *startR) * (1.0f / AUDIO_BLOCK);
+    return true;
+}
+
+// Advances the voices, retires the finished ones and writes the clamped, interleaved block.
+void finishBlock(AudioMixer& m, float* out) {
+    for (int v=m.voices-1; v>=0; --v) {
+        m.gainL[v] = m.targetL[v];
+        m.gainR[v] = m.targetR[v];
+        m.fresh[v] = 0.0f;
+        m.cursor[v] += AUDIO_BLOCK;
+        if (m.cursor[v] < m.length[m.sound[v]]) continue;
+        int last = --m.voices;
+        m.posX[v] = m.posX[last]; m.posY[v] = m.posY[last]; m.posZ[v] = m.posZ[last];
+        m.volume[v] = m.volume[last];
+        m.gainL[v] = m.gainL[last]; m.gainR[v] = m.gainR[last];
+        m.fresh[v] = m.fresh[last];
+        m.cursor[v] = m.cursor[last];
+        m.sound[v] = m.sound[last];
+    }
+    uint64_t clipped = 0;
+    for (int k=0; k<AUDIO_BLOCK; ++k) {
+        float l = m.mixL[k], r = m.mixR[k];
+        clipped += (l < -1.0f || l > 1.0f) + (r < -1.0f || r > 1.0f);
+        out[2*k] = minf(maxf(l, -1.0f), 1.0f);
+        out[2*k + 1] = minf(maxf(r, -1.0f), 1.0f);
+    }
+    m.stats.clipped += clipped;
+    ++m.stats.blocks;
+}
+
+} // namespace
+
+void audioMixerInit(AudioMixer& m, uint32_t seed) {
+    for (int s=0; s<SOUND_COUNT; ++s) synthesise(m.sounds[s], m.length[s], recipes[s], seed * 2654435761u + uint32_t(s));
+    m.voices = 0;
+    for (std::vector<float>* v : { &m.posX, &m.posY, &m.posZ, &m.volume, &m.gainL, &m.gainR, &m.fresh,
+                                   &m.targetL, &m.targetR }) {
+        v->assign(AUDIO_MAX_VOICES, 0.0f);
+    }
+    m.cursor.assign(AUDIO_MAX_VOICES, 0);
+    m.sound.assign(AUDIO_MAX_VOICES, 0);
+    m.mixL.assign(AUDIO_BLOCK, 0.0f);
+    m.mixR.assign(AUDIO_BLOCK, 0.0f);
+    m.ramps.assign(AUDIO_MAX_VOICES * 4, 0.0f);
+    m.rampSource.assign(AUDIO_MAX_VOICES, nullptr);
+}
+
+int audioMixerPlay(AudioMixer& m, SoundId sound, const Vec3& pos, float volume) {
+    int v = m.voices;
+    if (v < AUDIO_MAX_VOICES) {
+        ++m.voices;
+    } else {
+        // the quietest voice heard last block; one played since has no gain yet, so it only
+        // goes when every voice is fresh, the lowest volume first
+        auto quieter = [&](int a, int b) {
+            if ((m.fresh[a] != 0.0f) != (m.fresh[b] != 0.0f)) return m.fresh[a] == 0.0f;
+            if (m.fresh[a] != 0.0f) return m.volume[a] < m.volume[b];
+            return std::max(m.gainL[a], m.gainR[a]) < std::max(m.gainL[b], m.gainR[b]);
+        };
+        v = 0;
+        for (int i=1; i<m.voices; ++i) {
+            if (quieter(i, v)) v = i;
+        }
+        ++m.stats.stolen;
+    }
+    m.posX[v] = pos.x; m.posY[v] = pos.y; m.posZ[v] = pos.z;
+    m.volume[v] = volume;
+    m.gainL[v] = m.gainR[v] = 0.0f;
+    m.fresh[v] = 1.0f;
+    m.cursor[v] = 0;
+    m.sound[v] = sound;
+    return v;
+}
+
+void audioMixBlock(AudioMixer& m, float* out) {
+    spatialise(m);
+    // the audible voices' ramps, then the block sixteen frames at a time with the sums in
+    // registers: every voice adds into them in the same order as the scalar path
+    int audible = 0;
+    for (int v=0; v<m.voices; ++v) {
+        float* r = &m.ramps[size_t(audible) * 4];
+        if (!voiceRamp(m, v, &r[0], &r[1], &r[2], &r[3])) { ++m.stats.culled; continue; }
+        m.rampSource[audible++] = &m.sounds[m.sound[v]][m.cursor[v]];
+    }
+    m.stats.voicesMixed += uint64_t(audible);
+    const F4 four = f4Splat(4.0f);
+    for (int c=0; c<AUDIO_BLOCK; c += 16) {
+        F4 l0 = f4Splat(0.0f), l1 = l0, l2 = l0, l3 = l0, r0 = l0, r1 = l0, r2 = l0, r3 = l0;
+        const F4 i0 = f4Set(float(c), float(c + 1), float(c + 2), float(c + 3));
+        const F4 i1 = i0 + four, i2 = i1 + four, i3 = i2 + four;
+        for (int a=0; a<audible; ++a) {
+            const float* src = m.rampSource[a] + c;
+            const float* r = &m.ramps[size_t(a) * 4];
+            const F4 gl = f4Splat(r[0]), gr = f4Splat(r[1]), dl = f4Splat(r[2]), dr = f4Splat(r[3]);
+            F4 s0 = f4Load(src), s1 = f4Load(src + 4), s2 = f4Load(src + 8), s3 = f4Load(src + 12);
+            l0 = l0 + s0 * (gl + dl * i0); r0 = r0 + s0 * (gr + dr * i0);
+            l1 = l1 + s1 * (gl + dl * i1); r1 = r1 + s1 * (gr + dr * i1);
+            l2 = l2 + s2 * (gl + dl * i2); r2 = r2 + s2 * (gr + dr * i2);
+            l3 = l3 + s3 * (gl + dl * i3); r3 = r3 + s3 * (gr + dr * i3);
+        }
+        f4Store(&m.mixL[c], l0); f4Store(&m.mixL[c + 4], l1); f4Store(&m.mixL[c + 8], l2); f4Store(&m.mixL[c + 12], l3);
+        f4Store(&m.mixR[c], r0); f4Store(&m.mixR[c + 4], r1); f4Store(&m.mixR[c + 8], r2); f4Store(&m.mixR[c + 12], r3);
+    }
+    finishBlock(m, out);
+}
+
+void audioMixBlockScalar(AudioMixer& m, float* out) {
+    spatialiseScalar(m);
+    memset(m.mixL.data(), 0, sizeof(float) * AUDIO_BLOCK);
+    memset(m.mixR.data(), 0, sizeof(float) * AUDIO_BLOCK);
+    for (int v=0; v<m.voices; ++v) {
+        float startL, startR, stepL, stepR;
+        if (!voiceRamp(m, v, &startL, &startR, &stepL, &stepR)) { ++m.stats.culled; continue; }
+        const float* src = &m.sounds[m.sound[v]][m.cursor[v]];
+        for (int k=0; k<AUDIO_BLOCK; ++k) {
+            m.mixL[k] = m.mixL[k] + src[k] * (startL + stepL * float(k));
+            m.mixR[k] = m.mixR[k] + src[k] * (startR + stepR * float(k));
+        }
+        ++m.stats.voicesMixed;
+    }
+    finishBlock(m, out);
+}
+
+// ----------------- WAV files -----------------
+namespace {
+
+void put16(uint8_t* p, uint32_t v) { p[0] = uint8_t(v); p[1] = uint8_t(v >> 8); }
+void put32(uint8_t* p, uint32_t v) { put16(p, v); put16(p + 2, v >> 16); }
+
+void wavHeader(uint8_t* h, int rate, int channels, uint32_t frames) {
+    uint32_t bytes = frames * uint32_t(channels) * 2u;
+    memcpy(h, "RIFF", 4); put32(h + 4, 36u + bytes); memcpy(h + 8, "WAVEfmt ", 8);
+    put32(h + 16, 16u); put16(h + 20, 1u); put16(h + 22, uint32_t(channels));
+    put32(h + 24, uint32_t(rate)); put32(h + 28, uint32_t(rate * channels * 2)); put16(h + 32, uint32_t(channels * 2));
+    put16(h + 34, 16u); memcpy(h + 36, "data", 4); put32(h + 40, bytes);
+}
+
+} // namespace
+
+bool wavOpen(WavWriter& w, const char* path, int rate, int channels) {
+    w.f = fopen(path, "wb");
+    w.frames = 0;
+    w.rate = rate;
+    w.channels = channels;
+    if (!w.f) {
+        printf("[audio] cannot write %s\n", path);
+        return false;
+    }
+    uint8_t h[44];
+    wavHeader(h, rate, channels, 0);  // sizes are filled in by wavClose()
+    fwrite(h, 1, sizeof(h), w.f);
+    return true;
+}
+
+void wavWrite(WavWriter& w, const float* samples, int frames) {
+    if (!w.f) return;
+    int16_t pcm[AUDIO_BLOCK * 2];
+    const int chunk = AUDIO_BLOCK * 2 / w.channels;
+    for (int done=0; done<frames; done += chunk) {
+        int n = std::min(chunk, frames - done) * w.channels;
+        for (int i=0; i<n; ++i) {
+            float s = minf(maxf(samples[done * w.channels + i], -1.0f), 1.0f);
+            pcm[i] = int16_t(lrintf(s * 32767.0f));
+        }
+        fwrite(pcm, sizeof(int16_t), size_t(n), w.f);  // little-endian hosts only, like the region files
+    }
+    w.frames += uint32_t(frames);
+}
+
+bool wavClose(WavWriter& w) {
+    if (!w.f) return false;
+    uint8_t h[44];
+    wavHeader(h, w.rate, w.channels, w.frames);
+    bool ok = fseek(w.f, 0, SEEK_SET) == 0 && fwrite(h, 1, sizeof(h), w.f) == sizeof(h);
+    ok = fclose(w.f) == 0 && ok;
+    w.f = nullptr;
+    return ok;
+}
@@ -0,0 +1,124 @@
+// Software audio mixer: a few procedurally synthesised sounds played by hundreds of positioned
+// voices into stereo blocks.
+//
+// Voices live in SoA arrays, packed at the front. Each block first spatialises every voice
+// four at a time in SIMD lanes (simd.h): inverse-distance attenuation faded to silence at
+// maxDist, and equal-power panning from the side the sound is on. It then sums the audible
+// voices sixteen frames at a time, the sums held in registers until every voice is in. The
+// gains ramp across the block from the last block's, so moving sounds do not click. audioMixBlockScalar() is the
+// same arithmetic without lanes, the reference the SIMD mixer must match bit for bit.
+//
+// AudioRing is the single-producer, single-consumer lock-free queue between the game, the
+// mixer (audio.h) and the output. WavWriter stores mixed blocks as 16-bit PCM for offline
+// renders.
+#pragma once
+
+#include "vecmath.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+const int AUDIO_RATE = 48000;
+const int AUDIO_BLOCK = 256;        // frames mixed at a time
+const int AUDIO_MAX_VOICES = 512;   // the quietest voice is stolen beyond this
+
+enum SoundId : uint8_t { SOUND_SHOT, SOUND_IMPACT, SOUND_STEP, SOUND_PICKUP, SOUND_COUNT };
+
+struct AudioListener {
+    Vec3 pos;
+    Vec3 right = Vec3(1.0f, 0.0f, 0.0f);  // unit length
+};
+
+struct AudioMixerStats {
+    uint64_t blocks = 0;
+    uint64_t voicesMixed = 0;  // summed over blocks
+    uint64_t culled = 0;       // voices out of earshot for a whole block
+    uint64_t stolen = 0;
+    uint64_t clipped = 0;      // output samples beyond full scale
+};
+
+struct AudioMixer {
+    // mono samples at AUDIO_RATE, followed by AUDIO_BLOCK zeros so a block never reads past
+    // the end; length excludes the padding
+    std::vector<float> sounds[SOUND_COUNT];
+    int length[SOUND_COUNT] = {};
+
+    int voices = 0;
+    std::vector<float> posX, posY, posZ, volume;
+    std::vector<float> gainL, gainR;  // where the last block's ramp ended
+    std::vector<float> fresh;         // 1 until the first block: no ramp from silence
+    std::vector<int> cursor;
+    std::vector<uint8_t> sound;
+
+    AudioListener listener;
+    float refDist = 2.0f;      // full volume up to here
+    float maxDist = 60.0f;     // silent from here
+    float masterGain = 0.5f;
+
+    std::vector<float> targetL, targetR;  // scratch: this block's gains
+    std::vector<float> mixL, mixR;        // scratch: AUDIO_BLOCK planar accumulators
+    std::vector<float> ramps;             // scratch: start and step per channel of each audible voice
+    std::vector<const float*> rampSource;
+    AudioMixerStats stats;
+};
+
+// Synthesises the sounds and sizes the voice arrays.
+void audioMixerInit(AudioMixer& m, uint32_t seed);
+// Starts a sound at a position; returns its voice, stealing the quietest when all are busy.
+int audioMixerPlay(AudioMixer& m, SoundId sound, const Vec3& pos, float volume);
+// Mixes the next AUDIO_BLOCK frames into out (interleaved stereo) and retires finished voices.
+void audioMixBlock(AudioMixer& m, float* out);
+void audioMixBlockScalar(AudioMixer& m, float* out);
+
+// ----------------- Lock-free ring -----------------
+// One thread pushes, one other thread pops; capacity is a power of two.
+template<class T>
+struct AudioRing {
+    std::vector<T> items;
+    uint32_t mask = 0;
+    std::atomic<uint32_t> head{0};  // next to pop, written by the consumer
+    std::atomic<uint32_t> tail{0};  // next to push, written by the producer
+
+    void init(uint32_t capacity) {
+        uint32_t n = 1;
+        while (n < capacity) n <<= 1;
+        items.assign(n, T());
+        mask = n - 1;
+        head.store(0);
+        tail.store(0);
+    }
+    uint32_t size() const { return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire); }
+    uint32_t space() const { return mask + 1 - size(); }
+
+    // Both return how many items moved, possibly fewer than asked.
+    uint32_t push(const T* src, uint32_t n) {
+        uint32_t t = tail.load(std::memory_order_relaxed), h = head.load(std::memory_order_acquire);
+        n = std::min(n, mask + 1 - (t - h));
+        for (uint32_t i=0; i<n; ++i) items[(t + i) & mask] = src[i];
+        tail.store(t + n, std::memory_order_release);
+        return n;
+    }
+    uint32_t pop(T* dst, uint32_t n) {
+        uint32_t h = head.load(std::memory_order_relaxed), t = tail.load(std::memory_order_acquire);
+        n = std::min(n, t - h);
+        for (uint32_t i=0; i<n; ++i) dst[i] = items[(h + i) & mask];
+        head.store(h + n, std::memory_order_release);
+        return n;
+    }
+};
+
+// ----------------- WAV files -----------------
+struct WavWriter {
+    FILE* f = nullptr;
+    uint32_t frames = 0;
+    int rate = AUDIO_RATE, channels = 2;
+};
+
+bool wavOpen(WavWriter& w, const char* path, int rate, int channels);
+// Interleaved float samples, clamped to 16 bits.
+void wavWrite(WavWriter& w, const float* samples, int frames);
+// Fills in the sizes; returns false when something failed to write.
+bool wavClose(WavWriter& w);
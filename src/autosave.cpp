@@ -0,0 +1,375 @@
+#include "autosave.h"
+#include "jobs.h"
+#include "profiler.h"
+#include "region_file.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#if SANDBOX_HAS_THREADS
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+#endif
+
+#ifdef __EMSCRIPTEN__
+#include <emscripten/emscripten.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace {
+
+struct SaveJob {
+    WorldSnapshot snap;
+    uint32_t seed = 0;
+    uint64_t version = 0;
+};
+
+// Worker-side progress through one job. savedVersion is what is on disk per chunk.
+struct SaveWriter {
+    std::vector<uint64_t> savedVersion;
+    uint32_t savedSeed = 0;
+    int region = 0;
+    int row = -1;         // next chunk row of the region being encoded; -1 before it starts
+    int regionsWritten = 0;
+    size_t bytesWritten = 0;
+    double workMs = 0.0;
+    uint64_t jobVersion = 0;
+    bool failed = false;  // some region could not be written; the job doesn't count as saved
+    std::vector<uint8_t> buffer;
+};
+
+std::string saveDir;
+bool ready = false;
+AutosaveStats stats;
+int profStall = -1;
+double lastSaveMs = -1.0;
+uint64_t requestedVersion = 0;
+uint32_t requestedSeed = 0;
+bool requestedAny = false;
+
+void startWriter(SaveWriter& wr, const SaveJob& job) {
+    const World& w = *job.snap;
+    if (wr.savedSeed != job.seed || wr.savedVersion.size() != w.chunks.size()) {
+        wr.savedSeed = job.seed;
+        wr.savedVersion.assign(w.chunks.size(), ~uint64_t(0));  // unknown: write everything
+    }
+    wr.region = 0;
+    wr.row = -1;
+    wr.jobVersion = job.version;
+    wr.failed = false;
+    wr.regionsWritten = 0;
+    wr.bytesWritten = 0;
+    wr.workMs = 0.0;
+}
+
+// Advances the job by one step: skipping an unchanged region, or one chunk row of a changed
+// region's encoding, or writing it out, so a slice can stop well inside its budget. False
+// once every region is done.
+bool stepWriter(SaveWriter& wr, const SaveJob& job) {
+    const World& w = *job.snap;
+    int regions = regionCountX(w) * regionCountZ(w);
+    if (wr.region >= regions) return false;
+    double start = profilerNowMs();
+    int rx = wr.region % regionCountX(w), rz = wr.region / regionCountX(w);
+
+    if (wr.row < 0) {
+        bool changed = false;
+        for (int cz=rz*REGION_CHUNKS; cz<std::min((rz+1)*REGION_CHUNKS, w.chunksZ); ++cz) {
+            for (int cx=rx*REGION_CHUNKS; cx<std::min((rx+1)*REGION_CHUNKS, w.chunksX); ++cx) {
+                int c = cz * w.chunksX + cx;
+                changed = changed || wr.savedVersion[c] != worldChunkVersion(w, c);
+            }
+        }
+        if (changed) {
+            regionEncodeBegin(w, job.seed, rx, rz, wr.buffer);
+            wr.row = 0;
+        } else {
+            ++wr.region;
+        }
+    } else if (wr.row < REGION_CHUNKS) {
+        regionEncodeRow(w, rx, rz, wr.row++, wr.buffer);
+    } else {
+        regionEncodeEnd(wr.buffer);
+        char path[512];
+        regionFileName(path, sizeof(path), saveDir.c_str(), job.seed, rx, rz);
+        if (saveWriteAtomic(path, wr.buffer)) {
+            for (int cz=rz*REGION_CHUNKS; cz<std::min((rz+1)*REGION_CHUNKS, w.chunksZ); ++cz) {
+                for (int cx=rx*REGION_CHUNKS; cx<std::min((rx+1)*REGION_CHUNKS, w.chunksX); ++cx) {
+                    int c = cz * w.chunksX + cx;
+                    wr.savedVersion[c] = worldChunkVersion(w, c);
+                }
+            }
+            ++wr.regionsWritten;
+            wr.bytesWritten += wr.buffer.size();
+        } else {
+            wr.failed = true;
+        }
+        wr.row = -1;
+        ++wr.region;
+    }
+    wr.workMs += profilerNowMs() - start;
+    return wr.region < regions;
+}
+
+// After a load the world matches the files, so the baseline is the loaded versions.
+void setBaseline(SaveWriter& wr, const World& w, uint32_t seed) {
+    wr.savedSeed = seed;
+    wr.savedVersion.resize(w.chunks.size());
+    for (size_t c=0; c<w.chunks.size(); ++c) wr.savedVersion[c] = w.chunks[c]->version;
+}
+
+#ifdef __EMSCRIPTEN__
+// Copies the MEMFS view of the mount into IndexedDB; coalesces overlapping requests.
+void syncToStorage() {
+    EM_ASM({
+        if (Module.sandboxSyncing) { Module.sandboxSyncAgain = 1; return; }
+        Module.sandboxSyncing = 1;
+        var run = function() {
+            FS.syncfs(false, function(err) {
+                if (err) console.log('[autosave] IndexedDB sync failed: ' + err);
+                if (Module.sandboxSyncAgain) { Module.sandboxSyncAgain = 0; run(); }
+                else Module.sandboxSyncing = 0;
+            });
+        };
+        run();
+    });
+}
+#endif
+
+void finishedSave(const SaveWriter& wr) {
+    stats.workerMs = wr.workMs;
+    stats.regionsWritten = wr.regionsWritten;
+    stats.bytesWritten = wr.bytesWritten;
+    if (!wr.failed) stats.savedVersion = wr.jobVersion;
+    ++stats.saves;
+#ifdef __EMSCRIPTEN__
+    if (wr.regionsWritten > 0) syncToStorage();
+#endif
+    printf("[autosave] %d regions (%.1f KiB) in %.2f ms off the main loop, stall %.3f ms\n",
+           wr.regionsWritten, wr.bytesWritten / 1024.0, wr.workMs, stats.stallMs);
+}
+
+#if SANDBOX_HAS_THREADS
+
+// The worker parks on these forever; allocated once and leaked like the jobs.cpp pool.
+struct SaveWorker {
+    std::mutex mtx;
+    std::condition_variable wake, idle;
+    SaveJob pending;
+    bool hasPending = false;
+    bool busy = false;
+    int completed = 0, reported = 0;
+    SaveWriter writer;     // worker-owned while busy
+    SaveWriter finished;   // copy of the last completed writer's stats
+};
+SaveWorker* worker = nullptr;
+
+void saveWorkerMain() {
+#if defined(__linux__)
+    // Only use otherwise idle CPU time so waking the worker never preempts the game loop.
+    sched_param idle = {};
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &idle);
+#endif
+    for (;;) {
+        SaveJob job;
+        {
+            std::unique_lock<std::mutex> lock(worker->mtx);
+            worker->wake.wait(lock, []{ return worker->hasPending; });
+            job = std::move(worker->pending);
+            worker->pending = SaveJob();
+            worker->hasPending = false;
+            worker->busy = true;
+        }
+        startWriter(worker->writer, job);
+        while (stepWriter(worker->writer, job)) {}
+        job.snap.reset();  // release the snapshot before reporting, so edits stop copying
+        std::lock_guard<std::mutex> lock(worker->mtx);
+        worker->busy = false;
+        ++worker->completed;
+        worker->finished.regionsWritten = worker->writer.regionsWritten;
+        worker->finished.bytesWritten = worker->writer.bytesWritten;
+        worker->finished.workMs = worker->writer.workMs;
+        worker->finished.jobVersion = worker->writer.jobVersion;
+        worker->finished.failed = worker->writer.failed;
+        worker->idle.notify_all();
+    }
+}
+
+void submit(SaveJob&& job) {
+    SaveJob superseded;  // a newer snapshot replaces one not yet started; freed outside the lock
+    {
+        std::lock_guard<std::mutex> lock(worker->mtx);
+        superseded = std::move(worker->pending);
+        worker->pending = std::move(job);
+        worker->hasPending = true;
+    }
+    worker->wake.notify_one();
+}
+
+void reportCompleted() {
+    SaveWriter done;
+    {
+        std::lock_guard<std::mutex> lock(worker->mtx);
+        if (worker->reported == worker->completed) return;
+        worker->reported = worker->completed;
+        done.regionsWritten = worker->finished.regionsWritten;
+        done.bytesWritten = worker->finished.bytesWritten;
+        done.workMs = worker->finished.workMs;
+        done.jobVersion = worker->finished.jobVersion;
+        done.failed = worker->finished.failed;
+    }
+    finishedSave(done);
+}
+
+void waitIdle() {
+    std::unique_lock<std::mutex> lock(worker->mtx);
+    worker->idle.wait(lock, []{ return !worker->hasPending && !worker->busy; });
+}
+
+#else
+
+// No threads: the job advances a few steps per frame from autosaveUpdate().
+const double SLICE_BUDGET_MS = 0.3;
+SaveJob active;
+bool activeRunning = false;
+SaveWriter sliceWriter;
+
+void submit(SaveJob&& job) {
+    active = std::move(job);
+    activeRunning = true;
+    startWriter(sliceWriter, active);
+}
+
+void runSlice(double budgetMs) {
+    if (!activeRunning) return;
+    double start = profilerNowMs();
+    bool more;
+    do {
+        more = stepWriter(sliceWriter, active);
+    } while (more && profilerNowMs() - start < budgetMs);
+    if (!more) {
+        activeRunning = false;
+        active = SaveJob();
+        finishedSave(sliceWriter);
+    }
+}
+
+#endif
+
+} // namespace
+
+void autosaveInit(const char* dir) {
+    saveDir = dir;
+    profStall = profilerSlot("save.stall");
+#ifdef __EMSCRIPTEN__
+    EM_ASM({
+        var dir = UTF8ToString($0);
+        try { FS.mkdir(dir); } catch (e) {}
+        FS.mount(IDBFS, {}, dir);
+        Module.sandboxSaveReady = 0;
+        FS.syncfs(true, function(err) {
+            if (err) console.log('[autosave] IndexedDB load failed: ' + err);
+            Module.sandboxSaveReady = 1;
+        });
+    }, dir);
+#else
+    mkdir(dir, 0755);
+    ready = true;
+#endif
+#if SANDBOX_HAS_THREADS
+    if (!worker) {
+        worker = new SaveWorker();
+        std::thread(saveWorkerMain).detach();
+    }
+#endif
+}
+
+bool autosaveReady() {
+#ifdef __EMSCRIPTEN__
+    if (!ready) ready = EM_ASM_INT({ return Module.sandboxSaveReady | 0; }) != 0;
+#endif
+    return ready;
+}
+
+int autosaveLoad(World& w, uint32_t seed) {
+    autosaveFlush();
+    int loaded = 0;
+    std::vector<uint8_t> data;
+    char path[512];
+    worldBeginEdits(w);
+    for (int rz=0; rz<regionCountZ(w); ++rz) for (int rx=0; rx<regionCountX(w); ++rx) {
+        regionFileName(path, sizeof(path), saveDir.c_str(), seed, rx, rz);
+        if (!saveReadFile(path, data)) continue;
+        if (regionDecode(data.data(), data.size(), w, seed, rx, rz)) ++loaded;
+        else printf("[autosave] ignoring unreadable %s\n", path);
+    }
+    worldEndEdits(w);
+#if SANDBOX_HAS_THREADS
+    setBaseline(worker->writer, w, seed);
+#else
+    setBaseline(sliceWriter, w, seed);
+#endif
+    requestedVersion = w.version;
+    requestedSeed = seed;
+    requestedAny = true;
+    stats.savedVersion = w.version;
+    return loaded;
+}
+
+void autosaveRequest(const World& w, uint32_t seed) {
+    if (requestedAny && requestedVersion == w.version && requestedSeed == seed) return;
+    double start = profilerNowMs();
+    SaveJob job;
+    job.snap = worldSnapshot(w);
+    job.seed = seed;
+    job.version = w.version;
+    submit(std::move(job));
+    requestedVersion = w.version;
+    requestedSeed = seed;
+    requestedAny = true;
+    stats.stallMs = profilerNowMs() - start;
+    stats.maxStallMs = std::max(stats.maxStallMs, stats.stallMs);
+    profilerAddTime(profStall, stats.stallMs);
+}
+
+void autosaveUpdate(const World& w, uint32_t seed, double nowMs) {
+    if (!ready) return;
+    if (lastSaveMs < 0.0) lastSaveMs = nowMs;
+    if (nowMs - lastSaveMs >= AUTOSAVE_INTERVAL_MS) {
+        lastSaveMs = nowMs;
+        autosaveRequest(w, seed);
+    }
+    autosavePoll();
+}
+
+void autosavePoll() {
+#if SANDBOX_HAS_THREADS
+    if (worker) reportCompleted();
+#else
+    double start = profilerNowMs();
+    runSlice(SLICE_BUDGET_MS);
+    profilerAddTime(profStall, profilerNowMs() - start);
+#endif
+}
+
+void autosaveFlush() {
+#if SANDBOX_HAS_THREADS
+    if (!worker) return;
+    waitIdle();
+    reportCompleted();
+#else
+    while (activeRunning) runSlice(1e9);
+#endif
+}
+
+const AutosaveStats& autosaveStats() {
+    return stats;
+}
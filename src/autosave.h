@@ -0,0 +1,47 @@
+// Periodic background autosave.
+//
+// The editing thread only takes a copy-on-write snapshot of the world (microseconds) and
+// hands it off; a worker thread compares chunk versions against what it last wrote, encodes
+// the changed regions (region_file.h) and replaces their files atomically. On the web the
+// save directory is an IDBFS mount that is flushed to IndexedDB after each save. Builds
+// without threads run the same steps in small slices from autosaveUpdate().
+#pragma once
+
+#include "world.h"
+
+#include <cstddef>
+#include <cstdint>
+
+const double AUTOSAVE_INTERVAL_MS = 10000.0;
+
+struct AutosaveStats {
+    double stallMs = 0.0;      // editing-thread cost of the last save request
+    double maxStallMs = 0.0;
+    double workerMs = 0.0;     // encode + write time of the last completed save
+    int regionsWritten = 0;    // by the last completed save
+    size_t bytesWritten = 0;
+    int saves = 0;             // completed saves
+    uint64_t savedVersion = 0; // world version captured by the last completed save
+};
+
+// Creates/mounts the save directory; on the web also starts loading it from IndexedDB.
+void autosaveInit(const char* dir);
+// True once the save directory can be read (immediately on native builds).
+bool autosaveReady();
+
+// Restores the saved regions of this seed on top of the world (batched edits); returns the
+// number of regions loaded. The result becomes the baseline for the next incremental save.
+int autosaveLoad(World& w, uint32_t seed);
+
+// Called every frame from the editing thread: starts a save when the interval has passed
+// and the world changed, then autosavePoll().
+void autosaveUpdate(const World& w, uint32_t seed, double nowMs);
+// Finishes bookkeeping of completed saves (stats, IndexedDB sync) and, without threads,
+// advances the running save by one slice.
+void autosavePoll();
+// Starts a save now (no-op when nothing changed since the last one).
+void autosaveRequest(const World& w, uint32_t seed);
+// Blocks until every requested save is on disk.
+void autosaveFlush();
+
+const AutosaveStats& autosaveStats();
@@ -0,0 +1,2356 @@
+/*
+ Native micro-benchmarks for the portable parts of the sandbox (no GL, no browser).
+
+ Build with a regular host toolchain:
+   cmake -S . -B build-native -DCMAKE_BUILD_TYPE=Release
+   cmake --build build-native -j
+   ./build-native/sandbox_bench            (all benchmarks)
+   ./build-native/sandbox_bench world      (one by name)
+*/
+
+#include "aabb_tree.h"
+#include "animation.h"
+#include "audio.h"
+#include "autosave.h"
+#include "decorations.h"
+#include "demo.h"
+#include "det_physics.h"
+#include "game_rules.h"
+#include "hitboxes.h"
+#include "journal.h"
+#include "move_check.h"
+#include "profiler.h"
+#include "region_file.h"
+#include "relay.h"
+#include "script.h"
+#include "session.h"
+#include "undo.h"
+#include "world.h"
+#include "worldgen_pipeline.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Every heap allocation in the process, so a bench can show a path stays off the heap.
+static std::atomic<uint64_t> benchAllocations{0};
+
+// All the replaceable forms go through here, so new[] and over-aligned types count too and
+// every delete matches its new.
+static void* benchAllocate(size_t size, size_t align = 0) {
+    benchAllocations.fetch_add(1, std::memory_order_relaxed);
+    size = size ? size : 1;
+    void* p = align ? aligned_alloc(align, (size + align - 1) / align * align) : malloc(size);
+    if (p) return p;
+    fprintf(stderr, "out of memory\n");
+    abort();
+}
+
+void* operator new(size_t size) { return benchAllocate(size); }
+void* operator new[](size_t size) { return benchAllocate(size); }
+void* operator new(size_t size, std::align_val_t a) { return benchAllocate(size, size_t(a)); }
+void* operator new[](size_t size, std::align_val_t a) { return benchAllocate(size, size_t(a)); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { free(p); }
+
+namespace {
+
+// Keeps results alive so the optimiser cannot drop the measured loops.
+volatile uint64_t benchSink = 0;
+
+// Small deterministic generator so every kernel sees the same inputs.
+struct BenchRng {
+    uint32_t s;
+    uint32_t next() { s ^= s << 13; s ^= s >> 17; s ^= s << 5; return s; }
+    float unit() { return (next() >> 8) * (1.0f / 16777216.0f); }
+};
+
+// ----------------- World kernels: specialized vs runtime-parametric -----------------
+struct KernelTimes {
+    double heightNs, collideNs, raycastNs, meshMs;
+    uint64_t check;
+};
+
+KernelTimes runWorldKernels(World& w, const WorldKernels& k) {
+    w.kernels = &k;
+    KernelTimes t = {};
+    const int lookups = 4000000, collides = 400000, rays = 20000;
+    const int gridW = w.cfg.gridW, gridH = w.cfg.gridH;
+
+    BenchRng rng = { 12345u };
+    uint64_t sum = 0;
+    double start = profilerNowMs();
+    for (int i=0; i<lookups; ++i) {
+        int gx = int(rng.next() % uint32_t(gridW)), gz = int(rng.next() % uint32_t(gridH));
+        sum += uint64_t(k.heightAt(w, gx, gz));
+    }
+    t.heightNs = (profilerNowMs() - start) * 1e6 / lookups;
+
+    rng.s = 777u;
+    start = profilerNowMs();
+    for (int i=0; i<collides; ++i) {
+        Vec3 pos((rng.unit() - 0.5f) * gridW, 1.0f + rng.unit() * 5.0f, (rng.unit() - 0.5f) * gridH);
+        Vec3 vel(0, -1, 0);
+        bool onGround = false;
+        k.collide(w, pos, vel, onGround);
+        sum += uint64_t(onGround) + uint64_t(int(pos.y * 16.0f));
+    }
+    t.collideNs = (profilerNowMs() - start) * 1e6 / collides;
+
+    rng.s = 4242u;
+    start = profilerNowMs();
+    for (int i=0; i<rays; ++i) {
+        Vec3 origin((rng.unit() - 0.5f) * gridW, 6.0f, (rng.unit() - 0.5f) * gridH);
+        float a = rng.unit() * 6.2831853f;
+        Vec3 dir = normalize(Vec3(cosf(a), -0.15f, sinf(a)));
+        RayHit hit;
+        if (k.raycast(w, origin, dir, 30.0f, hit)) sum += uint64_t(hit.gx * 31 + hit.gz + hit.h);
+    }
+    t.raycastNs = (profilerNowMs() - start) * 1e6 / rays;
+
+    std::vector<float> mesh;
+    start = profilerNowMs();
+    for (int c=0; c<int(w.chunks.size()); ++c) {
+        k.buildMesh(w, c, mesh);
+        sum += mesh.size();
+    }
+    t.meshMs = profilerNowMs() - start;
+    t.check = sum;
+    return t;
+}
+
+// 1024x1024 island in 16^2 chunks, shared by the world benchmarks.
+void makeBenchWorld(World& w) {
+    WorldConfig cfg;
+    cfg.gridW = 1024;
+    cfg.gridH = 1024;
+    cfg.maxStack = 16;
+    cfg.chunkSize = 16;
+    worldInit(w, cfg);
+    worldGenerate(w, 7u);
+}
+
+int benchWorld() {
+    World w;
+    makeBenchWorld(w);
+    const WorldConfig& cfg = w.cfg;
+    printf("world: %dx%d columns, %d chunks of %d^2\n", cfg.gridW, cfg.gridH, int(w.chunks.size()), cfg.chunkSize);
+
+    const WorldKernels* special = worldSpecializedKernels(cfg.chunkSize);
+    const WorldKernels& generic = worldRuntimeKernels();
+    KernelTimes s = runWorldKernels(w, *special);
+    KernelTimes g = runWorldKernels(w, generic);
+    printf("  %-10s %12s %12s %12s %12s\n", "kernels", "height ns", "collide ns", "raycast ns", "mesh ms");
+    printf("  %-10s %12.2f %12.2f %12.1f %12.2f\n", special->name, s.heightNs, s.collideNs, s.raycastNs, s.meshMs);
+    printf("  %-10s %12.2f %12.2f %12.1f %12.2f\n", generic.name, g.heightNs, g.collideNs, g.raycastNs, g.meshMs);
+    printf("  %-10s %11.2fx %11.2fx %11.2fx %11.2fx\n", "speedup", g.heightNs / s.heightNs,
+           g.collideNs / s.collideNs, g.raycastNs / s.raycastNs, g.meshMs / s.meshMs);
+    benchSink += s.check + g.check;
+    if (s.check != g.check) {
+        printf("  MISMATCH: specialized and runtime kernels disagree (%llu vs %llu)\n",
+               (unsigned long long)s.check, (unsigned long long)g.check);
+        return 1;
+    }
+    return 0;
+}
+
+// ----------------- Layered generation with per-layer tile caches -----------------
+int benchWorldgen() {
+    const int N = 1024, S = 16, maxStack = 16;
+    const int perRow = N / S, chunks = perRow * perRow;
+    std::vector<int> raster(chunks), shuffled(chunks);
+    for (int i=0; i<chunks; ++i) raster[i] = shuffled[i] = i;
+    BenchRng rng = { 4242u };
+    for (int i=chunks-1; i>0; --i) std::swap(shuffled[i], shuffled[rng.next() % uint32_t(i + 1)]);
+
+    struct Run {
+        const char* name;
+        int cacheTiles;
+        const std::vector<int>* order;
+    };
+    const Run runs[] = {
+        { "cache 128, raster", GEN_CACHE_TILES, &raster },
+        { "cache 128, random", GEN_CACHE_TILES, &shuffled },
+        { "cache 16, raster", 16, &raster },
+        { "cache 1, raster", 1, &raster },
+    };
+    printf("worldgen: %dx%d columns, %d chunk requests of %d^2, layer tiles of %d^2\n", N, N, chunks, S, GEN_TILE);
+    printf("  %-18s", "");
+    for (int l=0; l<GEN_LAYER_COUNT; ++l) printf(" %9s", genLayerName(l));
+    printf(" %10s %10s\n", "biome hit", "chunks/s");
+
+    std::vector<uint8_t> reference, out(size_t(N) * N), cells(S * S);
+    int mismatches = 0;
+    for (const Run& r : runs) {
+        WorldGenPipeline p;
+        genPipelineInit(p, N, N, maxStack, 7u, r.cacheTiles);
+        for (int c : *r.order) {
+            int cx = c % perRow, cz = c / perRow;
+            genChunkHeights(p, cx * S, cz * S, S, S, cells.data());
+            for (int z=0; z<S; ++z) std::copy_n(&cells[z * S], S, &out[size_t(cz * S + z) * N + cx * S]);
+        }
+        printf("  %-18s", r.name);
+        for (int l=0; l<GEN_LAYER_COUNT; ++l) printf(" %6.1f ms", p.stats[l].ms);
+        const GenLayerStats& b = p.stats[GEN_BIOME];
+        printf(" %9.1f%% %10.0f\n", 100.0 * b.hits / double(b.hits + b.built), chunks / (p.ms * 0.001));
+        // caching and order must never change the result
+        if (reference.empty()) reference = out;
+        else mismatches += reference != out;
+    }
+    benchSink += reference[size_t(N/2) * N + N/2];
+    if (mismatches) {
+        printf("  MISMATCH: %d runs generated a different map\n", mismatches);
+        return 1;
+    }
+    return 0;
+}
+
+// ----------------- 3D cave density: lattice + SIMD vs per-voxel -----------------
+int benchCaves() {
+    const int N = 1024, area = 512, maxStack = 48;
+    WorldGenPipeline gen;
+    genPipelineInit(gen, N, N, maxStack, 7u);
+    CaveVolume fast, naive;
+    CaveStats fastStats, naiveStats;
+    std::vector<uint8_t> heights(GEN_TILE * GEN_TILE);
+    double fastMs = 0.0, naiveMs = 0.0;
+    uint64_t voxels = 0, solid = 0, differ = 0;
+    for (int z0=(N-area)/2; z0<(N+area)/2; z0+=GEN_TILE) for (int x0=(N-area)/2; x0<(N+area)/2; x0+=GEN_TILE) {
+        genChunkHeights(gen, x0, z0, GEN_TILE, GEN_TILE, heights.data());
+        for (uint8_t h : heights) voxels += h;
+        double start = profilerNowMs();
+        caveEvaluate(fast, x0, z0, GEN_TILE, heights.data(), maxStack, 7u, &fastStats);
+        fastMs += profilerNowMs() - start;
+        start = profilerNowMs();
+        caveEvaluateNaive(naive, x0, z0, GEN_TILE, heights.data(), maxStack, 7u, &naiveStats);
+        naiveMs += profilerNowMs() - start;
+        for (size_t i=0; i<fast.bits.size(); ++i) {
+            solid += uint64_t(__builtin_popcountll(naive.bits[i]));
+            differ += uint64_t(__builtin_popcountll(fast.bits[i] ^ naive.bits[i]));
+        }
+    }
+    benchSink += solid;
+    printf("caves: %dx%d columns, max stack %d, %.1f M voxels under the terrain\n", area, area, maxStack, voxels * 1e-6);
+    printf("  %-16s %10s %12s %12s\n", "", "ms", "noise evals", "Mvoxels/s");
+    printf("  %-16s %10.2f %12llu %12.1f\n", "per voxel", naiveMs, (unsigned long long)naiveStats.noiseEvals,
+           voxels * 1e-3 / naiveMs);
+    printf("  %-16s %10.2f %12llu %12.1f  (%.1fx)\n", "lattice + SIMD", fastMs, (unsigned long long)fastStats.noiseEvals,
+           voxels * 1e-3 / fastMs, naiveMs / fastMs);
+    printf("  sections: %llu empty, %llu solid (no tunnel in reach), %llu carved\n",
+           (unsigned long long)fastStats.sections[CAVE_EMPTY], (unsigned long long)fastStats.sections[CAVE_UNCARVED],
+           (unsigned long long)fastStats.sections[CAVE_CARVED]);
+    printf("  interpolated field agrees with the exact one on %.2f%% of solid voxels\n",
+           100.0 - 100.0 * differ / double(solid));
+    return 0;
+}
+
+// ----------------- Poisson-disk decorations, chunk by chunk -----------------
+int benchDecor() {
+    World w;
+    makeBenchWorld(w);
+    const WorldConfig& cfg = w.cfg;
+    const int S = cfg.chunkSize, chunks = int(w.chunks.size());
+
+    std::vector<Decoration> all, one;
+    DecorStats stats;
+    double total = 0.0, worst = 0.0;
+    for (int c=0; c<chunks; ++c) {
+        one.clear();
+        double start = profilerNowMs();
+        decorateArea(cfg, 7u, (c % w.chunksX) * S, (c / w.chunksX) * S, S, S, one, DECOR_ALL, &stats);
+        double ms = profilerNowMs() - start;
+        total += ms;
+        worst = std::max(worst, ms);
+        all.insert(all.end(), one.begin(), one.end());
+    }
+    printf("decor: %dx%d columns, %d chunks of %d^2\n", cfg.gridW, cfg.gridH, chunks, S);
+    printf("  %.1f us per chunk (worst %.1f us), %.0f candidates and %.0f distance tests per chunk\n",
+           total * 1000.0 / chunks, worst * 1000.0, stats.candidates / double(chunks), stats.tests / double(chunks));
+    const char* names[DECOR_KIND_COUNT] = { "prefabs", "trees", "pines", "rocks" };
+    printf("  placed:");
+    for (int k=0; k<DECOR_KIND_COUNT; ++k) printf(" %llu %s", (unsigned long long)stats.placed[k], names[k]);
+    printf("\n");
+
+    // spacing across chunk borders: bucket everything by 5 columns, prefabs pairwise
+    const float cell = 5.0f;
+    const int bw = int(cfg.gridW / cell) + 1, bh = int(cfg.gridH / cell) + 1;
+    std::vector<std::vector<int>> buckets(size_t(bw) * bh);
+    for (int i=0; i<int(all.size()); ++i) buckets[int(all[i].gz / cell) * bw + int(all[i].gx / cell)].push_back(i);
+    int tooClose = 0;
+    for (int i=0; i<int(all.size()); ++i) {
+        const Decoration& a = all[i];
+        int bx = int(a.gx / cell), bz = int(a.gz / cell);
+        for (int z=std::max(bz-1, 0); z<=std::min(bz+1, bh-1); ++z) for (int x=std::max(bx-1, 0); x<=std::min(bx+1, bw-1); ++x) {
+            for (int j : buckets[z * bw + x]) {
+                const Decoration& b = all[j];
+                if (j <= i || (a.kind == DECOR_PREFAB && b.kind == DECOR_PREFAB)) continue;
+                float dx = a.gx - b.gx, dz = a.gz - b.gz, d = decorMinDistance(a.kind, b.kind);
+                tooClose += dx*dx + dz*dz < d*d;
+            }
+        }
+        if (a.kind != DECOR_PREFAB) continue;
+        for (int j=i+1; j<int(all.size()); ++j) {
+            const Decoration& b = all[j];
+            float dx = a.gx - b.gx, dz = a.gz - b.gz, d = decorMinDistance(a.kind, b.kind);
+            tooClose += b.kind == DECOR_PREFAB && dx*dx + dz*dz < d*d;
+        }
+    }
+
+    // one big area must give exactly the union of its chunks
+    auto order = [](const Decoration& a, const Decoration& b) {
+        if (a.kind != b.kind) return a.kind < b.kind;
+        return a.gz != b.gz ? a.gz < b.gz : a.gx < b.gx;
+    };
+    const int block = 8 * S, bx0 = cfg.gridW / 2 - block / 2, bz0 = cfg.gridH / 2 - block / 2;
+    std::vector<Decoration> whole, pieces;
+    decorateArea(cfg, 7u, bx0, bz0, block, block, whole);
+    for (const Decoration& d : all) {
+        if (d.gx >= bx0 && d.gx < bx0 + block && d.gz >= bz0 && d.gz < bz0 + block) pieces.push_back(d);
+    }
+    std::sort(whole.begin(), whole.end(), order);
+    std::sort(pieces.begin(), pieces.end(), order);
+    bool agree = whole.size() == pieces.size();
+    for (size_t i=0; agree && i<whole.size(); ++i) {
+        agree = whole[i].kind == pieces[i].kind && whole[i].gx == pieces[i].gx && whole[i].gz == pieces[i].gz;
+    }
+
+    // prefab stamps are the only difference between the world and the pipeline's heights
+    WorldGenPipeline gen;
+    genPipelineInit(gen, cfg.gridW, cfg.gridH, cfg.maxStack, 7u);
+    std::vector<uint8_t> heights(size_t(S) * S);
+    int raised = 0, lowered = 0;
+    for (int c=0; c<chunks; ++c) {
+        int x0 = (c % w.chunksX) * S, z0 = (c / w.chunksX) * S;
+        genChunkHeights(gen, x0, z0, S, S, heights.data());
+        for (int z=0; z<S; ++z) for (int x=0; x<S; ++x) {
+            int h = worldHeight(w, x0 + x, z0 + z), g = heights[z * S + x];
+            raised += h > g;
+            lowered += h < g;
+        }
+    }
+    printf("  %d columns raised by prefab stamps\n", raised);
+    benchSink += all.size();
+    if (tooClose || !agree || lowered) {
+        printf("  MISMATCH: %d pairs closer than their kinds allow, %s, %d columns lowered\n", tooClose,
+               agree ? "chunks agree with the whole area" : "chunks disagree with the whole area", lowered);
+        return 1;
+    }
+    return 0;
+}
+
+// ----------------- Fixed-point lockstep physics -----------------
+// State hash of the lockstep run below; every target and build must reproduce it.
+const uint64_t LOCKSTEP_GOLDEN_HASH = 0x79fa72d2e4b23f0full;
+
+struct LockstepRun {
+    uint64_t hash;
+    double ms;
+    std::vector<DetPlayer> players;
+};
+
+LockstepRun runLockstep(const World& w, const std::vector<DetInput>& inputs, int players, int ticks) {
+    LockstepRun r = { 14695981039346656037ull, 0.0, std::vector<DetPlayer>(players) };
+    for (int i=0; i<players; ++i) r.players[i].pos = { fixInt((i % 8) * 6 - 24), fixInt(20), fixInt((i / 8) * 6 - 12) };
+    double start = profilerNowMs();
+    for (int t=0; t<ticks; ++t) {
+        for (int i=0; i<players; ++i) {
+            detStep(w, r.players[i], inputs[size_t(t / 30) * players + i]);
+            r.hash = detStateHash(r.players[i], r.hash);
+        }
+    }
+    r.ms = profilerNowMs() - start;
+    return r;
+}
+
+int benchLockstep() {
+    World w;
+    makeBenchWorld(w);
+    const int players = 32, ticks = 3600, rays = 20000;
+    // inputs change every half second, as they would arrive from peers
+    BenchRng rng = { 2024u };
+    std::vector<DetInput> inputs(size_t(ticks / 30) * players);
+    for (DetInput& in : inputs) {
+        in.yaw = uint16_t(rng.next());
+        in.pitch = uint16_t(int(rng.next() % 16384u) - 8192);
+        in.buttons = uint8_t(rng.next() & 0x1f);
+    }
+
+    LockstepRun a = runLockstep(w, inputs, players, ticks);
+    const WorldKernels* special = w.kernels;
+    w.kernels = &worldRuntimeKernels();
+    LockstepRun b = runLockstep(w, inputs, players, ticks);
+    w.kernels = special;
+
+    // the float path on the same inputs, for cost and drift
+    std::vector<Vec3> pos(players), vel(players);
+    std::vector<bool> ground(players);
+    for (int i=0; i<players; ++i) pos[i] = Vec3((i % 8) * 6.0f - 24.0f, 20.0f, (i / 8) * 6.0f - 12.0f);
+    const float dt = 1.0f / DET_TICK_HZ, angle = 6.2831853f / 65536.0f;
+    double start = profilerNowMs();
+    for (int t=0; t<ticks; ++t) for (int i=0; i<players; ++i) {
+        const DetInput& in = inputs[size_t(t / 30) * players + i];
+        float yaw = in.yaw * angle, pitch = int16_t(in.pitch) * angle;
+        Vec3 fwd(cosf(yaw) * cosf(pitch), 0.0f, sinf(yaw) * cosf(pitch)), right(-sinf(yaw), 0.0f, cosf(yaw)), move;
+        if (in.buttons & DET_FORWARD) move = move + fwd;
+        if (in.buttons & DET_BACK) move = move - fwd;
+        if (in.buttons & DET_LEFT) move = move - right;
+        if (in.buttons & DET_RIGHT) move = move + right;
+        if (length(move) > 0.01f) move = normalize(move);
+        vel[i].x = move.x * 5.0f;
+        vel[i].z = move.z * 5.0f;
+        vel[i].y += -9.8f * dt;
+        bool onGround = ground[i];
+        if ((in.buttons & DET_JUMP) && onGround) { vel[i].y = 6.0f; onGround = false; }
+        pos[i] = pos[i] + vel[i] * dt;
+        onGround = false;
+        w.kernels->collide(w, pos[i], vel[i], onGround);
+        if (pos[i].y < 1.0f) { pos[i].y = 1.0f; vel[i].y = 0.0f; onGround = true; }
+        ground[i] = onGround;
+    }
+    double floatMs = profilerNowMs() - start;
+    float drift = 0.0f;
+    for (int i=0; i<players; ++i) drift = std::max(drift, length(pos[i] - detToVec3(a.players[i].pos)));
+
+    uint64_t rayHash = 14695981039346656037ull;
+    start = profilerNowMs();
+    for (int i=0; i<rays; ++i) {
+        const DetPlayer& p = a.players[i % players];
+        RayHit hit;
+        FixVec3 dir = detAimDir(uint16_t(rng.next()), uint16_t(int(rng.next() % 12000u) - 9000));
+        bool found = detRaycast(w, p.pos, dir, fixInt(30), hit);
+        rayHash = (rayHash ^ (found ? uint64_t(hit.gx) << 32 | uint64_t(hit.gz) << 8 | uint64_t(hit.h) : 0)) * 1099511628211ull;
+    }
+    double rayUs = (profilerNowMs() - start) * 1000.0 / rays;
+    uint64_t hash = a.hash ^ rayHash;
+
+    printf("lockstep: %d players x %d ticks at %d Hz on the %dx%d bench world\n", players, ticks, DET_TICK_HZ,
+           w.cfg.gridW, w.cfg.gridH);
+    printf("  fixed point %.3f us/step, float %.3f us/step; float drifts %.2f m from fixed over %d s\n",
+           a.ms * 1000.0 / (players * ticks), floatMs * 1000.0 / (players * ticks), drift, ticks / DET_TICK_HZ);
+    printf("  fixed raycast %.2f us; state hash %016llx\n", rayUs, (unsigned long long)hash);
+    benchSink += hash;
+    if (a.hash != b.hash || hash != LOCKSTEP_GOLDEN_HASH) {
+        printf("  MISMATCH: %s\n", a.hash != b.hash ? "specialized and runtime kernels step differently"
+                                                    : "state hash differs from the recorded one");
+        return 1;
+    }
+    return 0;
+}
+
+// ----------------- Seekable demo recording -----------------
+int benchDemo() {
+    World w;
+    makeBenchWorld(w);
+    const char* path = "sandbox_bench.dem";
+    const int tickHz = 30, ticks = 1800, players = 32, editsPerTick = 20, checks = 12;
+    BenchRng rng = { 31337u };
+    std::vector<DetPlayer> bots(players);
+    std::vector<DetInput> inputs(players);
+    for (int i=0; i<players; ++i) bots[i].pos = { fixInt((i % 8) * 6 - 24), fixInt(20), fixInt((i / 8) * 6 - 12) };
+
+    // the states at a few ticks, kept to check the seeks against
+    struct Truth {
+        uint32_t tick;
+        WorldSnapshot world;
+        std::vector<DetPlayer> players;
+    };
+    std::vector<Truth> truth;
+
+    DemoRecorder rec;
+    rec.queueLimit = ticks;  // the seeks are checked against exact ticks, so keep every capture
+    if (!demoRecordStart(rec, path, w, 7u, tickHz)) return 1;
+    double start = profilerNowMs();
+    for (int t=0; t<ticks; ++t) {
+        if (t % 15 == 0) for (DetInput& in : inputs) {
+            in.yaw = uint16_t(rng.next());
+            in.buttons = uint8_t(rng.next() & 0x1f);
+        }
+        for (int i=0; i<players; ++i) for (int s=0; s<DET_TICK_HZ / tickHz; ++s) detStep(w, bots[i], inputs[i]);
+        worldBeginEdits(w);
+        for (int e=0; e<editsPerTick; ++e) {
+            int gx = int(rng.next() % uint32_t(w.cfg.gridW)), gz = int(rng.next() % uint32_t(w.cfg.gridH));
+            worldSetHeight(w, gx, gz, int(rng.next() % uint32_t(w.cfg.maxStack + 1)));
+        }
+        worldEndEdits(w);
+        demoRecordTick(rec, w, uint32_t(t), bots.data(), players);
+        if (t % (ticks / checks) == ticks / checks / 2) truth.push_back({ uint32_t(t), worldSnapshot(w), bots });
+    }
+    double recordMs = profilerNowMs() - start;
+    bool saved = demoRecordStop(rec);
+    const DemoRecordStats& d = rec.stats;
+
+    DemoReader rd;
+    if (!saved || !demoOpen(rd, path)) {
+        unlink(path);
+        return 1;
+    }
+    // seek in shuffled order, so some go back and some forward
+    for (size_t i=truth.size(); i>1; --i) std::swap(truth[i - 1], truth[rng.next() % i]);
+    int wrong = 0;
+    double seekMs = 0.0, maxSeekMs = 0.0;
+    for (const Truth& tr : truth) {
+        start = profilerNowMs();
+        bool ok = demoSeek(rd, tr.tick);
+        double ms = profilerNowMs() - start;
+        seekMs += ms;
+        maxSeekMs = std::max(maxSeekMs, ms);
+        if (!ok || rd.tick != tr.tick || rd.players.size() != tr.players.size()) {
+            ++wrong;
+            continue;
+        }
+        for (int i=0; i<players; ++i) {
+            if (detStateHash(rd.players[i]) != detStateHash(tr.players[i])) ++wrong;
+        }
+        for (int z=0; z<w.cfg.gridH; ++z) for (int x=0; x<w.cfg.gridW; ++x) {
+            if (worldHeight(rd.world, x, z) != worldHeight(*tr.world, x, z)) ++wrong;
+        }
+    }
+
+    // headless playback of the whole match
+    start = profilerNowMs();
+    demoSeek(rd, 0);
+    uint64_t frames = 1;
+    while (demoNext(rd)) ++frames;
+    double playMs = profilerNowMs() - start;
+    bool complete = rd.tick == uint32_t(ticks - 1) && !rd.indexRebuilt;
+    benchSink += rd.tick + frames;
+    demoClose(rd);
+    unlink(path);
+
+    printf("demo: %d ticks at %d Hz, %d players, %d edits per tick on the %dx%d bench world\n", ticks, tickHz,
+           players, editsPerTick, w.cfg.gridW, w.cfg.gridH);
+    printf("  capture %.1f us avg, %.1f us max on the tick (%.1f ms per tick in total); encode %.2f ms per frame "
+           "on the worker, at most %zu queued\n", d.captureMs * 1000.0 / ticks, d.maxCaptureMs * 1000.0,
+           recordMs / ticks, d.encodeMs / std::max<uint64_t>(d.frames, 1), d.maxQueued);
+    printf("  %.1f KiB: %llu frames, %llu keyframes, %.1f chunks per delta\n", d.bytes / 1024.0,
+           (unsigned long long)d.frames, (unsigned long long)d.keyframes,
+           double(d.chunks - d.keyframes * w.chunks.size()) / std::max<uint64_t>(d.frames - d.keyframes, 1));
+    printf("  seek %.2f ms avg, %.2f ms max over %zu seeks; playback %.0fx realtime (%llu frames in %.1f ms)\n",
+           seekMs / truth.size(), maxSeekMs, truth.size(), ticks * 1000.0 / tickHz / playMs,
+           (unsigned long long)frames, playMs);
+    if (wrong || !complete) {
+        printf("  FAILED: %d mismatches after seeking%s\n", wrong, complete ? "" : ", playback stopped early");
+        return 1;
+    }
+    return 0;
+}
+
+// ----------------- Spectator relay -----------------
+struct RelayRun {
+    double relayMs;
+    uint64_t datagrams, sendCalls, dropped, resyncs;
+    int wrong;
+    uint64_t probeSent, probeReceived;  // bytes to and from the prober
+};
+
+// A match streamed through a relay on loopback; half the viewers join after the second keyframe.
+// A prober sends requests with made-up cookies every tick, as from a forged source address.
+RelayRun runRelay(int viewerCount, const NetIoBackend& io, int ticks) {
+    World w;
+    WorldConfig cfg;
+    cfg.gridW = 256;
+    cfg.gridH = 256;
+    cfg.maxStack = 16;
+    cfg.chunkSize = 16;
+    worldInit(w, cfg);
+    worldGenerate(w, 7u);
+    const int tickHz = 30, players = 16, editsPerTick = 10, lateJoin = tickHz * DEMO_KEYFRAME_SECONDS + 50;
+    RelayRun run = {};
+
+    Relay relay;
+    RelayConfig rc;
+    netParseAddr("127.0.0.1:0", rc.upstream);
+    netParseAddr("127.0.0.1:0", rc.viewers);
+    rc.io = &io;
+    rc.verbose = false;
+    if (!relayOpen(relay, rc)) return { 0, 0, 0, 0, 0, -1, 0, 0 };
+    sockaddr_in upstream = rc.upstream, spectate = rc.viewers;
+    upstream.sin_port = htons(netLocalPort(relay.listenFd));
+    spectate.sin_port = htons(netLocalPort(relay.io.fd));
+    DemoRecorder rec;
+    int fd = netTcpConnect(upstream);
+    if (fd < 0 || !demoStreamStart(rec, fd, w, 7u, tickHz, DEMO_KEYFRAME_SECONDS, 0)) return { 0, 0, 0, 0, 0, -1, 0, 0 };
+    int probe = netUdpOpen(rc.viewers);
+    if (probe < 0) return { 0, 0, 0, 0, 0, -1, 0, 0 };
+    uint8_t reply[NET_MAX_DATAGRAM];
+
+    std::vector<RelayViewer> viewers(viewerCount);
+    std::vector<DetPlayer> bots(players);
+    std::vector<DetInput> inputs(players);
+    for (int i=0; i<players; ++i) bots[i].pos = { fixInt(i * 3 - 24), fixInt(20), fixInt(i % 4 * 3) };
+    BenchRng rng = { 555u };
+    auto pumpAll = [&](double now) {
+        relayPump(relay, now);
+        for (RelayViewer& v : viewers) if (v.fd >= 0) relayViewerPump(v, now);
+    };
+    for (int t=0; t<ticks; ++t) {
+        // simulated time, so keep-alives and time-outs do not depend on how fast this runs
+        double now = t * 1000.0 / tickHz;
+        if (t == 0 || t == lateJoin) {
+            for (int i=(t == 0 ? 0 : viewerCount / 2); i<(t == 0 ? viewerCount / 2 : viewerCount); ++i) {
+                relayViewerOpen(viewers[i], spectate);
+            }
+        }
+        if (t % 15 == 0) for (DetInput& in : inputs) {
+            in.yaw = uint16_t(rng.next());
+            in.buttons = uint8_t(rng.next() & 0x1f);
+        }
+        for (int i=0; i<players; ++i) for (int k=0; k<DET_TICK_HZ / tickHz; ++k) detStep(w, bots[i], inputs[i]);
+        worldBeginEdits(w);
+        for (int e=0; e<editsPerTick; ++e) {
+            int gx = int(rng.next() % uint32_t(cfg.gridW)), gz = int(rng.next() % uint32_t(cfg.gridH));
+            worldSetHeight(w, gx, gz, int(rng.next() % uint32_t(cfg.maxStack + 1)));
+        }
+        worldEndEdits(w);
+        demoRecordTick(rec, w, uint32_t(t), bots.data(), players);
+        uint8_t request[RELAY_REQUEST_BYTES] = { uint8_t(t % 2 ? RELAY_HELLO : RELAY_RESYNC) };
+        sessionPutU32(request + 1, rng.next());
+        run.probeSent += sendto(probe, request, sizeof(request), 0, reinterpret_cast<const sockaddr*>(&spectate),
+                                sizeof(spectate));
+        pumpAll(now);
+        for (ssize_t n; (n = recv(probe, reply, sizeof(reply), 0)) > 0; ) run.probeReceived += n;
+    }
+    demoRecordStop(rec);
+    // drain: everything the worker sent, and the late viewers' catch-up
+    double now = ticks * 1000.0 / tickHz;
+    for (int round=0; round<2000; ++round) {
+        pumpAll(now);
+        bool done = relay.upstreamFd < 0;
+        for (const RelayViewer& v : viewers) done = done && v.synced && v.state.tick == uint32_t(ticks - 1);
+        if (done) break;
+        usleep(500);
+    }
+    run.relayMs = relay.stats.pumpMs;
+    run.datagrams = relay.io.stats.sent;
+    run.sendCalls = relay.io.stats.sendCalls;
+    run.dropped = relay.io.stats.dropped;
+
+    uint64_t expect = 14695981039346656037ull;
+    for (const DetPlayer& p : bots) expect = detStateHash(p, expect);
+    for (RelayViewer& v : viewers) {
+        run.resyncs += v.resyncs;
+        uint64_t hash = 14695981039346656037ull;
+        for (const DetPlayer& p : v.state.players) hash = detStateHash(p, hash);
+        bool same = v.synced && v.state.tick == uint32_t(ticks - 1) && hash == expect;
+        for (int z=0; z<cfg.gridH && same; ++z) for (int x=0; x<cfg.gridW; ++x) {
+            if (worldHeight(v.state.world, x, z) != worldHeight(w, x, z)) {
+                same = false;
+                break;
+            }
+        }
+        run.wrong += !same;
+        relayViewerClose(v);
+    }
+    for (ssize_t n; (n = recv(probe, reply, sizeof(reply), 0)) > 0; ) run.probeReceived += n;
+    close(probe);
+    relayClose(relay);
+    return run;
+}
+
+int benchRelay() {
+    const int ticks = 300;
+    printf("relay: %d s match on a 256x256 world, 16 players, 10 edits per tick; half of the viewers join "
+           "%d s in\n", ticks / 30, DEMO_KEYFRAME_SECONDS + 1);
+    printf("  %8s %6s %14s %16s %10s %10s %8s\n", "viewers", "i/o", "relay us/tick", "us/viewer/tick",
+           "datagrams", "syscalls", "resyncs");
+    struct Case { int viewers; const NetIoBackend* io; };
+    const Case cases[] = { { 1, &netMmsgBackend() }, { 16, &netMmsgBackend() }, { 128, &netMmsgBackend() },
+                           { 512, &netMmsgBackend() }, { 512, &netSocketBackend() }, { 512, netUringBackend() } };
+    int failed = 0;
+    for (const Case& c : cases) {
+        if (!c.io) continue;
+        RelayRun r = runRelay(c.viewers, *c.io, ticks);
+        if (r.wrong < 0) return 1;
+        printf("  %8d %6s %14.1f %16.3f %10llu %10llu %8llu\n", c.viewers, c.io->name, r.relayMs * 1000.0 / ticks,
+               r.relayMs * 1000.0 / ticks / c.viewers, (unsigned long long)r.datagrams,
+               (unsigned long long)r.sendCalls, (unsigned long long)r.resyncs);
+        if (r.wrong) printf("  FAILED: %d of %d viewers did not end on the match state (%llu datagrams dropped)\n",
+                            r.wrong, c.viewers, (unsigned long long)r.dropped);
+        if (r.probeReceived > r.probeSent) {
+            printf("  FAILED: requests with made-up cookies drew %llu bytes for %llu sent\n",
+                   (unsigned long long)r.probeReceived, (unsigned long long)r.probeSent);
+            ++failed;
+        }
+        failed += r.wrong;
+    }
+    return failed ? 1 : 0;
+}
+
+// ----------------- Batched datagram I/O -----------------
+struct EchoRun {
+    double serverMs, totalMs;
+    uint64_t echoed, recvCalls, sendCalls, dropped, poolEmpty;
+};
+
+// A generator floods an echo server on loopback a batch at a time; the server turns every
+// datagram around in its own pool buffer. Both ends share the one thread, so totalMs is what a
+// core spends on both, serverMs what it spends in the server's receive-process-send.
+EchoRun runEcho(const NetIoBackend& io, int datagrams, int size) {
+    NetIo server, gen;
+    sockaddr_in local;
+    netParseAddr("127.0.0.1:0", local);
+    if (!netIoOpen(server, local, io) || !netIoOpen(gen, local, netMmsgBackend())) return { -1, 0, 0, 0, 0, 0, 0 };
+    sockaddr_in to = local;
+    to.sin_port = htons(netLocalPort(server.fd));
+    std::vector<uint8_t> payload(size_t(NET_BATCH) * size);
+    EchoRun run = {};
+    uint64_t sum = 0, expectSum = 0;
+    double start = profilerNowMs();
+    for (int sent=0; sent<datagrams; ) {
+        int batch = std::min(NET_BATCH, datagrams - sent);
+        for (int i=0; i<batch; ++i) {
+            uint8_t* d = &payload[size_t(i) * size];
+            memcpy(d, &sent, sizeof(sent));
+            expectSum += uint32_t(sent++) ^ 0xffu;
+            netIoSend(gen, d, size, to);
+        }
+        netIoFlush(gen);
+
+        double t0 = profilerNowMs();
+        // loopback delivers during the generator's send, but the uring receives may still be completing
+        int got = 0;
+        for (int spin=0; got < batch && spin < 1000; ++spin) {
+            if (netIoReceive(server) == 0) continue;
+            for (NetPacket* p : server.received) {
+                p->data[0] ^= 0xff;  // processed in place and sent back as it is
+                netIoSendPacket(server, p);
+            }
+            got += int(server.received.size());
+        }
+        netIoFlush(server);
+        run.serverMs += profilerNowMs() - t0;
+
+        while (netIoReceive(gen) > 0) {
+            for (NetPacket* p : gen.received) {
+                uint32_t v;
+                memcpy(&v, p->data, sizeof(v));
+                sum += v;
+                ++run.echoed;
+                netIoRelease(gen, p);
+            }
+        }
+    }
+    run.totalMs = profilerNowMs() - start;
+    run.recvCalls = server.stats.recvCalls;
+    run.sendCalls = server.stats.sendCalls;
+    run.dropped = gen.stats.dropped + server.stats.dropped + (datagrams - server.stats.received);
+    run.poolEmpty = server.stats.poolEmpty;
+    if (sum != expectSum && run.echoed == uint64_t(datagrams)) run.echoed = 0;  // corrupted on the way
+    netIoClose(server);
+    netIoClose(gen);
+    return run;
+}
+
+struct SessionRun {
+    double receiveUs, stepUs, snapshotUs;  // per tick
+    double connectMs;                      // WebSocket connects and handshakes, all of them
+    uint64_t datagrams, sendCalls, wsWrites;
+    int wrong;
+};
+
+// Clients on loopback, over UDP and then WebSocket, send an input every tick; every client must
+// end on the full last snapshot, and a WebSocket client must have had every part of every tick.
+SessionRun runSessions(const World& w, int udpClients, int wsClients, const NetIoBackend& io, int ticks) {
+    const int tickHz = 30, bots = 16;
+    const SessionRun failed = { 0, 0, 0, 0, 0, 0, 0, -1 };
+    const int clientCount = udpClients + wsClients;
+    SessionServer server;
+    SessionConfig sc;
+    netParseAddr("127.0.0.1:0", sc.bind);
+    sc.io = &io;
+    sc.webSocket = wsClients > 0;
+    sc.webSocketBind = sc.bind;
+    sc.tickHz = tickHz;
+    sc.verbose = false;
+    if (!sessionOpen(server, sc)) return failed;
+    sockaddr_in addr = sc.bind, wsAddr = sc.bind;
+    addr.sin_port = htons(netLocalPort(server.io.fd));
+    if (wsClients > 0) wsAddr.sin_port = htons(netLocalPort(server.wsListenFd));
+    std::vector<SessionClient> clients(clientCount);
+    double connectStart = profilerNowMs();
+    for (int i=0; i<clientCount; ++i) {
+        if (!(i < udpClients ? sessionClientOpen(clients[i], addr) : sessionClientOpenWebSocket(clients[i], wsAddr))) {
+            return failed;
+        }
+    }
+    for (int round=0; round<200; ++round) {
+        double now = round * 1000.0;
+        bool all = true;
+        for (SessionClient& c : clients) {
+            sessionClientPump(c, now);
+            all = all && c.joined;
+        }
+        if (all) break;
+        usleep(1000);
+        sessionReceive(server, w, now);
+    }
+    double connectMs = profilerNowMs() - connectStart;
+    SessionStats joined = server.stats;
+    NetIoStats joinedIo = server.io.stats;
+
+    std::vector<DetPlayer> botPlayers(bots);
+    BenchRng rng = { 99u };
+    for (int t=0; t<ticks; ++t) {
+        double now = t * 1000.0 / tickHz;
+        for (SessionClient& c : clients) {
+            DetInput in;
+            in.yaw = uint16_t(rng.next());
+            in.buttons = uint8_t(rng.next() & 0x1f);
+            sessionClientSendInput(c, uint32_t(t), in);
+        }
+        sessionReceive(server, w, now);
+        sessionStep(server, w, DET_TICK_HZ / tickHz);
+        sessionSnapshot(server, uint32_t(t), botPlayers.data(), bots);
+        for (SessionClient& c : clients) sessionClientPump(c, now);
+    }
+    const uint64_t parts = (clientCount + bots + SESSION_PLAYERS_PER_PART - 1) / SESSION_PLAYERS_PER_PART;
+    for (int round=0; round<100; ++round) {
+        bool all = true;
+        for (SessionClient& c : clients) {
+            sessionClientPump(c, ticks * 1000.0 / tickHz);
+            all = all && (!c.webSocket || c.snapshots == parts * ticks);
+        }
+        if (all) break;
+        usleep(1000);
+    }
+    SessionRun run = {};
+    run.connectMs = connectMs;
+    run.receiveUs = (server.stats.receiveMs - joined.receiveMs) * 1000.0 / ticks;
+    run.stepUs = (server.stats.stepMs - joined.stepMs) * 1000.0 / ticks;
+    run.snapshotUs = (server.stats.snapshotMs - joined.snapshotMs) * 1000.0 / ticks;
+    run.datagrams = server.io.stats.received - joinedIo.received + server.io.stats.sent - joinedIo.sent;
+    run.wsWrites = server.stats.wsWrites - joined.wsWrites;
+    run.sendCalls = server.io.stats.recvCalls - joinedIo.recvCalls + server.io.stats.sendCalls - joinedIo.sendCalls;
+    for (SessionClient& c : clients) {
+        bool self = false;
+        for (const SessionPlayerState& ps : c.players) self = self || ps.id == c.id;
+        run.wrong += !(c.joined && c.tick == uint32_t(ticks - 1) && int(c.players.size()) == clientCount + bots && self &&
+                       (!c.webSocket || c.snapshots == parts * ticks));
+        sessionClientClose(c);
+    }
+    if (server.stats.inputs != uint64_t(clientCount) * ticks) ++run.wrong;
+    sessionClose(server);
+    return run;
+}
+
+// UDP joins with made-up cookies, as from a forged source that never sees the challenge,
+// then one real client. Returns the slots the flood took (-1 if the run failed) and the
+// biggest reply it drew.
+struct FloodRun {
+    int slots;
+    size_t biggestReply;
+    bool realJoined;
+};
+
+FloodRun runJoinFlood(const World& w, int joins) {
+    const FloodRun failed = { -1, 0, false };
+    SessionServer server;
+    SessionConfig sc;
+    netParseAddr("127.0.0.1:0", sc.bind);
+    sc.maxClients = 8;
+    sc.verbose = false;
+    if (!sessionOpen(server, sc)) return failed;
+    sockaddr_in addr = sc.bind;
+    addr.sin_port = htons(netLocalPort(server.io.fd));
+    int fd = netUdpOpen(sc.bind);
+    if (fd < 0) return failed;
+    FloodRun run = {};
+    BenchRng rng = { 5150u };
+    uint8_t buf[NET_MAX_DATAGRAM];
+    for (int k=0; k<joins; k += 100) {
+        for (int i=k; i<std::min(k + 100, joins); ++i) {
+            uint8_t join[SESSION_JOIN_BYTES] = { SESSION_JOIN, SESSION_JOIN_WORLD };
+            sessionPutU32(join + 2, rng.next());
+            sendto(fd, join, sizeof(join), 0, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+        }
+        usleep(1000);
+        sessionReceive(server, w, 0.0);
+        sessionTransfer(server, w, 0.0);
+        for (ssize_t n; (n = recv(fd, buf, sizeof(buf), 0)) > 0; ) {
+            run.biggestReply = std::max(run.biggestReply, size_t(n));
+        }
+    }
+    run.slots = int(server.clients.size());
+    SessionClient real;
+    if (!sessionClientOpen(real, addr)) return failed;
+    for (int round=0; round<50 && !real.joined; ++round) {
+        sessionClientPump(real, round * 1000.0);
+        usleep(1000);
+        sessionReceive(server, w, round * 1000.0);
+    }
+    run.realJoined = real.joined;
+    sessionClientClose(real);
+    close(fd);
+    sessionClose(server);
+    return run;
+}
+
+int benchNetIo() {
+    const int datagrams = 200000, size = 64;
+    const NetIoBackend* backends[] = { &netSocketBackend(), &netMmsgBackend(), netUringBackend() };
+    printf("netio: %d-byte datagrams echoed on loopback, %d per batch (%d datagrams; one core for both ends)\n",
+           size, NET_BATCH, datagrams);
+    printf("  %6s %14s %16s %14s %12s %8s\n", "i/o", "server pps", "server ns/pkt", "echo pps", "syscalls/pkt",
+           "dropped");
+    int failed = 0;
+    for (const NetIoBackend* io : backends) {
+        if (!io) {
+            printf("  %6s (not available)\n", "uring");
+            continue;
+        }
+        EchoRun r = runEcho(*io, datagrams, size);
+        if (r.serverMs < 0) return 1;
+        // every datagram is received and sent once by the server
+        printf("  %6s %14.0f %16.1f %14.0f %12.3f %8llu\n", io->name, 2.0 * datagrams / (r.serverMs * 0.001),
+               r.serverMs * 1e6 / (2.0 * datagrams), r.echoed / (r.totalMs * 0.001),
+               double(r.recvCalls + r.sendCalls) / (2.0 * datagrams), (unsigned long long)r.dropped);
+        if (r.echoed + r.dropped < uint64_t(datagrams)) {
+            printf("  FAILED: %llu of %d echoed back intact\n", (unsigned long long)r.echoed, datagrams);
+            ++failed;
+        }
+    }
+
+    World w;
+    WorldConfig cfg;
+    cfg.gridW = 256;
+    cfg.gridH = 256;
+    cfg.maxStack = 16;
+    cfg.chunkSize = 16;
+    worldInit(w, cfg);
+    worldGenerate(w, 7u);
+    const int ticks = 60;
+    printf("sessions: clients sending an input every tick plus 16 bots, %d ticks at 30 Hz (server side)\n", ticks);
+    printf("  %8s %6s %12s %12s %14s %16s %12s\n", "clients", "i/o", "receive us", "step us", "snapshot us",
+           "us/client/tick", "syscalls/t");
+    struct Case { int clients; const NetIoBackend* io; };
+    const Case cases[] = { { 16, &netMmsgBackend() }, { 128, &netMmsgBackend() }, { 512, &netMmsgBackend() },
+                           { 512, &netSocketBackend() }, { 512, netUringBackend() } };
+    for (const Case& c : cases) {
+        if (!c.io) continue;
+        SessionRun r = runSessions(w, c.clients, 0, *c.io, ticks);
+        if (r.wrong < 0) return 1;
+        printf("  %8d %6s %12.1f %12.1f %14.1f %16.3f %12.1f\n", c.clients, c.io->name, r.receiveUs, r.stepUs,
+               r.snapshotUs, (r.receiveUs + r.stepUs + r.snapshotUs) / c.clients, double(r.sendCalls) / ticks);
+        if (r.wrong) printf("  FAILED: %d of %d clients missed inputs or the last snapshot\n", r.wrong, c.clients);
+        failed += r.wrong;
+    }
+
+    FloodRun flood = runJoinFlood(w, 1000);
+    if (flood.slots < 0) return 1;
+    printf("  1000 joins with made-up cookies: %d slots taken, replies of at most %zu bytes to %d-byte joins\n",
+           flood.slots, flood.biggestReply, SESSION_JOIN_BYTES);
+    if (flood.slots || flood.biggestReply > size_t(SESSION_JOIN_BYTES) || !flood.realJoined) {
+        printf("  FAILED: unproven joins took slots or drew bigger replies, or a real client could not join\n");
+        ++failed;
+    }
+    return failed ? 1 : 0;
+}
+
+// ----------------- WebSocket transport -----------------
+// The browser path on loopback: native clients doing what the web client does (handshake,
+// masked frames), next to UDP clients on the same server.
+int benchWebSocket() {
+    World w;
+    WorldConfig cfg;
+    cfg.gridW = 256;
+    cfg.gridH = 256;
+    cfg.maxStack = 16;
+    cfg.chunkSize = 16;
+    worldInit(w, cfg);
+    worldGenerate(w, 7u);
+    const int ticks = 60;
+    printf("websocket: clients sending an input every tick plus 16 bots, %d ticks at 30 Hz (server side)\n", ticks);
+    printf("  %6s %6s %12s %12s %14s %16s %12s %12s\n", "udp", "ws", "join ms", "receive us", "snapshot us",
+           "us/client/tick", "udp calls/t", "ws writes/t");
+    struct Case { int udp, ws; };
+    const Case cases[] = { { 0, 16 }, { 0, 128 }, { 0, 512 }, { 256, 256 }, { 512, 0 } };
+    int failed = 0;
+    for (const Case& c : cases) {
+        SessionRun r = runSessions(w, c.udp, c.ws, netMmsgBackend(), ticks);
+        if (r.wrong < 0) return 1;
+        int clients = c.udp + c.ws;
+        printf("  %6d %6d %12.1f %12.1f %14.1f %16.3f %12.1f %12.1f\n", c.udp, c.ws, r.connectMs, r.receiveUs,
+               r.snapshotUs, (r.receiveUs + r.stepUs + r.snapshotUs) / clients, double(r.sendCalls) / ticks,
+               double(r.wsWrites) / ticks);
+        if (r.wrong) printf("  FAILED: %d of %d clients missed inputs or snapshots\n", r.wrong, clients);
+        failed += r.wrong;
+    }
+
+    // a connection that never upgrades is closed after the time-out instead of holding its fd
+    SessionServer server;
+    SessionConfig sc;
+    netParseAddr("127.0.0.1:0", sc.bind);
+    sc.webSocket = true;
+    sc.webSocketBind = sc.bind;
+    sc.verbose = false;
+    if (!sessionOpen(server, sc)) return 1;
+    sockaddr_in addr = sc.bind;
+    addr.sin_port = htons(netLocalPort(server.wsListenFd));
+    int idle = netTcpConnect(addr);
+    for (int i=0; i<100 && server.conns.empty(); ++i) {
+        sessionReceive(server, w, 0.0);
+        usleep(1000);
+    }
+    bool accepted = !server.conns.empty();
+    sessionReceive(server, w, sc.timeoutMs + 1.0);
+    if (!accepted || !server.conns.empty()) {
+        printf("  FAILED: an idle connection was %s\n", accepted ? "still open after the time-out" : "never accepted");
+        ++failed;
+    }
+    if (idle >= 0) close(idle);
+    sessionClose(server);
+    return failed ? 1 : 0;
+}
+
+// ----------------- World transfer -----------------
+struct TransferRun {
+    double nearMs, doneMs;  // at the server's tick rate, after the first tick of the transfer
+    double serverUs;        // receive + transfer, per tick while any transfer runs
+    uint64_t bytes, messages, resent;
+    int wrong;              // clients whose copy of the map differs; -1 if the run failed
+};
+
+// clients join asking for the world; stalled ones take nothing for the first few ticks, so
+// their first window times out and goes again.
+TransferRun runTransfer(const World& w, int clientCount, bool webSocket, int stallTicks) {
+    const int tickHz = 30, nearRadius = 64, maxTicks = 600;
+    const TransferRun failed = { 0, 0, 0, 0, 0, 0, -1 };
+    SessionServer server;
+    SessionConfig sc;
+    netParseAddr("127.0.0.1:0", sc.bind);
+    sc.webSocket = webSocket;
+    sc.webSocketBind = sc.bind;
+    sc.tickHz = tickHz;
+    sc.verbose = false;
+    if (!sessionOpen(server, sc)) return failed;
+    sockaddr_in addr = sc.bind;
+    addr.sin_port = htons(webSocket ? netLocalPort(server.wsListenFd) : netLocalPort(server.io.fd));
+    std::vector<SessionClient> clients(clientCount);
+    for (SessionClient& c : clients) {
+        c.wantsWorld = true;
+        if (!(webSocket ? sessionClientOpenWebSocket(c, addr) : sessionClientOpen(c, addr))) return failed;
+    }
+
+    // chunks within nearRadius columns of the middle, where every player spawns
+    std::vector<uint32_t> order, nearChunks;
+    transferOrder(w, w.cfg.gridW / 2, w.cfg.gridH / 2, order);
+    for (uint32_t c : order) {
+        int S = w.cfg.chunkSize, gx = int(c) % w.chunksX * S, gz = int(c) / w.chunksX * S;
+        int dx = std::max({ gx - w.cfg.gridW / 2, w.cfg.gridW / 2 - (gx + S - 1), 0 });
+        int dz = std::max({ gz - w.cfg.gridH / 2, w.cfg.gridH / 2 - (gz + S - 1), 0 });
+        if (dx * dx + dz * dz <= nearRadius * nearRadius) nearChunks.push_back(c);
+    }
+
+    int startTick = -1, nearTick = -1, doneTick = -1, busyTicks = 0;
+    double serverMs = 0.0;
+    for (int t=0; t<maxTicks && doneTick < 0; ++t) {
+        double now = t * 1000.0 / tickHz;
+        for (SessionClient& c : clients) if (t >= stallTicks || !c.joined) sessionClientPump(c, now);
+        double start = profilerNowMs();
+        sessionReceive(server, w, now);
+        sessionTransfer(server, w, now);
+        double ms = profilerNowMs() - start;
+        if (server.stats.transfers > server.stats.transfersDone) {
+            serverMs += ms;
+            ++busyTicks;
+        }
+        if (startTick < 0 && server.stats.transfers == uint64_t(clientCount)) startTick = t;
+        if (startTick < 0) usleep(1000);  // still connecting
+        for (SessionClient& c : clients) if (t >= stallTicks || !c.joined) sessionClientPump(c, now);
+        bool near = startTick >= 0, done = startTick >= 0;
+        for (const SessionClient& c : clients) {
+            for (uint32_t n : nearChunks) near = near && c.transfer.have.size() == w.chunks.size() && c.transfer.have[n];
+            done = done && c.joined && transferDone(c.world, c.transfer);
+        }
+        if (near && nearTick < 0) nearTick = t;
+        if (done && server.stats.transfersDone == uint64_t(clientCount)) doneTick = t;
+    }
+
+    TransferRun run = {};
+    if (doneTick < 0) {
+        run.wrong = clientCount;
+    } else {
+        for (const SessionClient& c : clients) {
+            bool same = c.world.cfg.gridW == w.cfg.gridW && c.world.cfg.gridH == w.cfg.gridH;
+            for (int z=0; same && z<w.cfg.gridH; ++z) {
+                for (int x=0; x<w.cfg.gridW; ++x) same = same && worldHeight(c.world, x, z) == worldHeight(w, x, z);
+            }
+            run.wrong += !same;
+        }
+    }
+    run.nearMs = (nearTick - startTick + 1) * 1000.0 / tickHz;
+    run.doneMs = (doneTick - startTick + 1) * 1000.0 / tickHz;
+    run.serverUs = serverMs * 1000.0 / std::max(busyTicks, 1);
+    run.bytes = server.stats.transferBytes / clientCount;
+    run.messages = server.stats.transferMessages / clientCount;
+    run.resent = server.stats.transferResent;
+    for (SessionClient& c : clients) sessionClientClose(c);
+    sessionClose(server);
+    return run;
+}
+
+int benchTransfer() {
+    World w;
+    makeBenchWorld(w);
+    const size_t raw = size_t(w.cfg.gridW) * w.cfg.gridH;
+    printf("transfer: the %dx%d map (%d chunks, %.0f KiB of raw columns) to joining clients, window of %d "
+           "messages, 30 Hz ticks\n", w.cfg.gridW, w.cfg.gridH, int(w.chunks.size()), raw / 1024.0,
+           SessionConfig().transferWindow);
+    printf("  %8s %5s %6s %10s %10s %12s %12s %10s %8s %14s\n", "clients", "via", "stall", "near ms", "join ms",
+           "KiB/client", "vs raw", "msgs", "resent", "server us/t");
+    struct Case { int clients; bool webSocket; int stall; };
+    const Case cases[] = { { 1, false, 0 }, { 16, false, 0 }, { 64, false, 0 }, { 1, true, 0 }, { 16, true, 0 },
+                           { 16, false, 10 } };
+    int failed = 0;
+    for (const Case& c : cases) {
+        TransferRun r = runTransfer(w, c.clients, c.webSocket, c.stall);
+        if (r.wrong < 0) return 1;
+        printf("  %8d %5s %6d %10.0f %10.0f %12.1f %11.1f%% %10llu %8llu %14.1f\n", c.clients,
+               c.webSocket ? "ws" : "udp", c.stall, r.nearMs, r.doneMs, r.bytes / 1024.0, 100.0 * r.bytes / raw,
+               (unsigned long long)r.messages, (unsigned long long)r.resent, r.serverUs);
+        if (r.wrong) printf("  FAILED: %d of %d clients did not end up with the server's map\n", r.wrong, c.clients);
+        failed += r.wrong;
+    }
+    return failed ? 1 : 0;
+}
+
+// ----------------- Movement validation -----------------
+enum MoveKind { MOVE_HONEST, MOVE_SPEEDER, MOVE_FLYER, MOVE_TELEPORTER, MOVE_KINDS };
+const char* const kMoveKindNames[MOVE_KINDS] = { "honest", "speed x1.6", "flying", "teleport" };
+
+// A client moving itself with main_loop()'s float physics (and world collision) at 60 Hz,
+// cheating the way its kind says.
+struct MovingClient {
+    int kind;
+    Vec3 pos, vel;
+    bool onGround = false;
+    DetInput in;
+    DetPlayer server;  // the server's accepted state
+    float debt = 0.0f;
+};
+
+void moveClientFrame(const World& w, MovingClient& m, float dt, int tick) {
+    float yaw = m.in.yaw * (6.2831853f / 65536.0f), pitch = int16_t(m.in.pitch) * (6.2831853f / 65536.0f);
+    Vec3 forward = normalize(Vec3(cosf(yaw) * cosf(pitch), sinf(pitch), sinf(yaw) * cosf(pitch)));
+    Vec3 right = normalize(Vec3(-sinf(yaw), 0.0f, cosf(yaw)));
+    Vec3 moveDir(0, 0, 0);
+    if (m.in.buttons & DET_FORWARD) moveDir = moveDir + forward;
+    if (m.in.buttons & DET_BACK) moveDir = moveDir - forward;
+    if (m.in.buttons & DET_LEFT) moveDir = moveDir - right;
+    if (m.in.buttons & DET_RIGHT) moveDir = moveDir + right;
+    moveDir.y = 0.0f;
+    if (length(moveDir) > 0.01f) moveDir = normalize(moveDir);
+    float speed = m.kind == MOVE_SPEEDER ? 8.0f : 5.0f;
+    m.vel.x = moveDir.x * speed;
+    m.vel.z = moveDir.z * speed;
+    m.vel.y += -9.8f * dt;
+    if ((m.in.buttons & DET_JUMP) && m.onGround) { m.vel.y = 6.0f; m.onGround = false; }
+    if (m.kind == MOVE_FLYER) m.vel.y = std::max(m.vel.y, 3.0f);
+    m.pos = m.pos + m.vel * dt;
+    m.onGround = false;
+    w.kernels->collide(w, m.pos, m.vel, m.onGround);
+    if (m.pos.y < 1.0f) { m.pos.y = 1.0f; m.vel.y = 0.0f; m.onGround = true; }
+    if (m.kind == MOVE_TELEPORTER && tick % 30 == 29) m.pos.x += 4.0f;
+}
+
+struct MoveRun {
+    double scalarNs, simdNs;  // per claim
+    uint64_t claims[MOVE_KINDS], flagged[MOVE_KINDS];
+    int mismatches;
+};
+
+MoveRun runMoveCheck(const World& w, int players, int ticks, bool cheaters) {
+    const int steps = DET_TICK_HZ / 30;
+    MoveRun run = {};
+    BenchRng rng = { 4242u + uint32_t(players) };
+    std::vector<MovingClient> clients(players);
+    for (int i=0; i<players; ++i) {
+        MovingClient& m = clients[i];
+        m.kind = cheaters && i % 8 == 7 ? MOVE_SPEEDER + i / 8 % 3 : MOVE_HONEST;
+        float span = w.cfg.gridW * w.cfg.blockSize * 0.4f;
+        m.pos = Vec3((rng.unit() - 0.5f) * span, 20.0f, (rng.unit() - 0.5f) * span);
+        m.vel = Vec3(0, 0, 0);
+        m.server.pos = detVec(m.pos);
+    }
+    MoveRules rules;
+    MoveBatch batch, scalar;
+    double scalarMs = 0.0, simdMs = 0.0;
+    for (int t=0; t<ticks; ++t) {
+        for (int i=0; i<players; ++i) {
+            MovingClient& m = clients[i];
+            // inputs change every second or so, with short jump taps in between
+            if (t % 30 == i % 30) {
+                m.in.yaw = uint16_t(rng.next());
+                m.in.pitch = uint16_t(int(rng.next() % 16384u) - 8192);
+                m.in.buttons = uint8_t(rng.next() & 0x0f);
+            }
+            m.in.buttons = uint8_t((m.in.buttons & ~DET_JUMP) | (rng.next() % 16u == 0 ? DET_JUMP : 0));
+            for (int k=0; k<steps; ++k) moveClientFrame(w, m, 1.0f / DET_TICK_HZ, t);
+        }
+        moveBatchResize(batch, players);
+        for (int i=0; i<players; ++i) {
+            moveSetLane(batch, i, clients[i].server, clients[i].debt, clients[i].in, steps, detVec(clients[i].pos));
+        }
+        scalar = batch;
+        double start = profilerNowMs();
+        moveCheckScalar(w, scalar, rules);
+        scalarMs += profilerNowMs() - start;
+        start = profilerNowMs();
+        moveCheck(w, batch, rules);
+        simdMs += profilerNowMs() - start;
+        for (int i=0; i<players; ++i) {
+            MovingClient& m = clients[i];
+            run.mismatches += batch.flags[i] != scalar.flags[i] || batch.px[i] != scalar.px[i] ||
+                              batch.py[i] != scalar.py[i] || batch.pz[i] != scalar.pz[i] ||
+                              batch.vy[i] != scalar.vy[i] || batch.ground[i] != scalar.ground[i] ||
+                              batch.debt[i] != scalar.debt[i];
+            ++run.claims[m.kind];
+            run.flagged[m.kind] += batch.flags[i] != MOVE_OK;
+            moveGetLane(batch, i, m.server, &m.debt);
+        }
+    }
+    run.scalarNs = scalarMs * 1e6 / (double(players) * ticks);
+    run.simdNs = simdMs * 1e6 / (double(players) * ticks);
+    return run;
+}
+
+// Self-moving clients play through a session server: an honest one, one whose tick counter
+// runs `rate` times fast (its physics too, so each claim is legal for the ticks it names) and
+// one that starts somewhere other than where the server put it.
+enum ClaimClient { CLAIM_HONEST, CLAIM_FAST_CLOCK, CLAIM_ELSEWHERE, CLAIM_CLIENTS };
+
+struct ClaimRun {
+    bool joined;
+    uint64_t flagged[CLAIM_CLIENTS];
+};
+
+ClaimRun runSessionClaims(const World& w, uint32_t rate, int ticks) {
+    const int steps = DET_TICK_HZ / 30;
+    ClaimRun run = {};
+    SessionServer server;
+    SessionConfig sc;
+    if (!netParseAddr("127.0.0.1:0", sc.bind)) return run;
+    sc.tickHz = 30;
+    sc.verbose = false;
+    if (!sessionOpen(server, sc)) return run;
+    sockaddr_in addr = sc.bind;
+    addr.sin_port = htons(netLocalPort(server.io.fd));
+    SessionClient clients[CLAIM_CLIENTS];
+    for (SessionClient& c : clients) if (!sessionClientOpen(c, addr)) return run;
+    for (int round=0; round<200; ++round) {
+        bool all = true;
+        for (SessionClient& c : clients) {
+            sessionClientPump(c, round * 1000.0);
+            all = all && c.joined;
+        }
+        if (all) break;
+        usleep(1000);
+        sessionReceive(server, w, round * 1000.0);
+    }
+    MovingClient moving[CLAIM_CLIENTS];
+    int slots[CLAIM_CLIENTS];
+    for (int k=0; k<CLAIM_CLIENTS; ++k) {
+        slots[k] = -1;
+        for (int i=0; i<int(server.clients.size()); ++i) if (server.clients[i].id == clients[k].id) slots[k] = i;
+        if (!clients[k].joined || slots[k] < 0) return run;
+        moving[k].kind = MOVE_HONEST;
+        moving[k].pos = detToVec3(server.clients[slots[k]].player.pos);
+        moving[k].vel = Vec3(0, 0, 0);
+    }
+    moving[CLAIM_ELSEWHERE].pos.x += 20.0f;
+    run.joined = true;
+    BenchRng rng = { 77u };
+    for (int t=1; t<=ticks; ++t) {
+        double now = 200000.0 + t * 1000.0 / 30;
+        if (t % 30 == 1) {
+            DetInput in;
+            in.yaw = uint16_t(rng.next());
+            in.buttons = DET_FORWARD;
+            for (MovingClient& m : moving) m.in = in;
+        }
+        for (int k=0; k<CLAIM_CLIENTS; ++k) {
+            uint32_t ticksRun = k == CLAIM_FAST_CLOCK ? rate : 1;
+            for (int f=0; f<steps * int(ticksRun); ++f) moveClientFrame(w, moving[k], 1.0f / DET_TICK_HZ, t);
+            FixVec3 claim = detVec(moving[k].pos);
+            sessionClientSendInput(clients[k], uint32_t(t) * ticksRun, moving[k].in, &claim);
+        }
+        sessionReceive(server, w, now);
+        sessionStep(server, w, steps);
+        for (SessionClient& c : clients) sessionClientPump(c, now);
+    }
+    for (int k=0; k<CLAIM_CLIENTS; ++k) run.flagged[k] = server.clients[slots[k]].flagged;
+    for (SessionClient& c : clients) sessionClientClose(c);
+    sessionClose(server);
+    return run;
+}
+
+int benchMoveCheck() {
+    World w;
+    WorldConfig cfg;
+    cfg.gridW = 256;
+    cfg.gridH = 256;
+    cfg.maxStack = 16;
+    cfg.chunkSize = 16;
+    worldInit(w, cfg);
+    worldGenerate(w, 7u);
+    const int ticks = 300;
+    printf("movecheck: claimed positions checked against the movement rules, %d ticks at 30 Hz\n", ticks);
+    printf("  %8s %16s %16s %10s\n", "players", "scalar ns/claim", "simd ns/claim", "speedup");
+    int failed = 0;
+    for (int players : { 64, 512, 4096 }) {
+        MoveRun r = runMoveCheck(w, players, ticks, false);
+        printf("  %8d %16.1f %16.1f %9.2fx\n", players, r.scalarNs, r.simdNs, r.scalarNs / r.simdNs);
+        if (r.mismatches) printf("  MISMATCH: %d claims judged differently by the scalar and SIMD paths\n", r.mismatches);
+        if (r.flagged[MOVE_HONEST]) {
+            printf("  FAILED: %llu of %llu honest claims flagged\n", (unsigned long long)r.flagged[MOVE_HONEST],
+                   (unsigned long long)r.claims[MOVE_HONEST]);
+        }
+        failed += r.mismatches + (r.flagged[MOVE_HONEST] != 0);
+    }
+
+    // one in eight players cheats; honest ones must never be flagged, cheaters once they gain
+    MoveRun r = runMoveCheck(w, 512, ticks, true);
+    printf("  %12s %10s %10s\n", "client", "claims", "flagged");
+    for (int k=0; k<MOVE_KINDS; ++k) {
+        printf("  %12s %10llu %9.1f%%\n", kMoveKindNames[k], (unsigned long long)r.claims[k],
+               100.0 * r.flagged[k] / std::max<uint64_t>(r.claims[k], 1));
+    }
+    if (r.mismatches) printf("  MISMATCH: %d claims judged differently by the scalar and SIMD paths\n", r.mismatches);
+    if (r.flagged[MOVE_HONEST]) printf("  FAILED: honest claims flagged\n");
+    failed += r.mismatches + (r.flagged[MOVE_HONEST] != 0);
+
+    // through a session: a client counting its ticks 4x fast gets only the server's ticks of
+    // movement, and one starting away from its spawn is caught on its first claim
+    ClaimRun claims = runSessionClaims(w, 4, ticks);
+    printf("  through a session, %d claims each: honest %llu flagged, ticks 4x fast %llu, elsewhere %llu\n",
+           ticks, (unsigned long long)claims.flagged[CLAIM_HONEST],
+           (unsigned long long)claims.flagged[CLAIM_FAST_CLOCK], (unsigned long long)claims.flagged[CLAIM_ELSEWHERE]);
+    if (!claims.joined || claims.flagged[CLAIM_HONEST] || !claims.flagged[CLAIM_FAST_CLOCK] ||
+        !claims.flagged[CLAIM_ELSEWHERE]) {
+        printf("  FAILED: an honest client flagged or a cheating one let through\n");
+        ++failed;
+    }
+    return failed ? 1 : 0;
+}
+
+// ----------------- Dynamic AABB tree -----------------
+struct TreeMover {
+    Aabb box;
+    Vec3 vel;
+    int proxy;
+};
+
+// Nearest hit over every box, the reference for the tree's queries (same slab arithmetic).
+float bruteRay(const std::vector<TreeMover>& movers, const AabbRay& ray) {
+    float best = ray.maxDist;
+    bool any = false;
+    for (const TreeMover& m : movers) {
+        float d;
+        Vec3 n;
+        if (aabbRayBox(m.box, ray.origin, ray.dir, best, &d, &n) && (d < best || !any)) { best = d; any = true; }
+    }
+    return any ? best : -1.0f;
+}
+
+float bruteSweep(const std::vector<TreeMover>& movers, const Aabb& box, const Vec3& delta) {
+    Vec3 centre = (box.min + box.max) * 0.5f, half = (box.max - box.min) * 0.5f;
+    float best = 1.0f;
+    bool any = false;
+    for (const TreeMover& m : movers) {
+        float d;
+        Vec3 n;
+        Aabb grown = { m.box.min - half, m.box.max + half };
+        // a zero normal: the box starts inside, which sweeps ignore
+        if (aabbRayBox(grown, centre, delta, best, &d, &n) && dot(n, n) > 0.0f && (d < best || !any)) {
+            best = d;
+            any = true;
+        }
+    }
+    return any ? best : -1.0f;
+}
+
+int benchAabbTree() {
+    const int frames = 120, queries = 256;
+    printf("aabbtree: movers on a 256 x 256 map, %d frames, %d rays/boxes/sweeps per frame\n", frames, queries);
+    printf("  %8s %6s %10s %10s %10s %12s %12s %12s %12s\n", "movers", "depth", "update us", "reinserts",
+           "rotations", "ray ns", "brute ns", "overlap ns", "sweep ns");
+    int failed = 0;
+    for (int count : { 1000, 10000, 50000 }) {
+        BenchRng rng = { 777u + uint32_t(count) };
+        AabbTree tree;
+        std::vector<TreeMover> movers(count);
+        for (TreeMover& m : movers) {
+            Vec3 c((rng.unit() - 0.5f) * 256.0f, rng.unit() * 20.0f, (rng.unit() - 0.5f) * 256.0f);
+            Vec3 half(0.15f + rng.unit() * 1.5f, 0.15f + rng.unit() * 1.5f, 0.15f + rng.unit() * 1.5f);
+            m.box = { c - half, c + half };
+            // half stand still, the rest wander at up to 4 blocks/s
+            m.vel = rng.next() % 2 ? Vec3((rng.unit() - 0.5f) * 8.0f, (rng.unit() - 0.5f) * 2.0f, (rng.unit() - 0.5f) * 8.0f)
+                                   : Vec3();
+            m.proxy = aabbInsert(tree, m.box, 1u << (rng.next() % 2), uint32_t(&m - movers.data()));
+        }
+        uint64_t reinserts0 = tree.stats.reinserts + tree.stats.refits, rotations0 = tree.stats.rotations;
+
+        std::vector<AabbRay> rays(queries);
+        std::vector<AabbRayHit> hits(queries), sweepHits(queries);
+        std::vector<Aabb> boxes(queries);
+        std::vector<Vec3> deltas(queries);
+        std::vector<AabbPair> pairs;
+        double updateMs = 0.0, rayMs = 0.0, bruteMs = 0.0, overlapMs = 0.0, sweepMs = 0.0;
+        int mismatches = 0;
+        const float dt = 1.0f / 60.0f;
+        for (int f=0; f<frames; ++f) {
+            double start = profilerNowMs();
+            for (TreeMover& m : movers) {
+                if (m.vel.x == 0.0f && m.vel.y == 0.0f && m.vel.z == 0.0f) continue;
+                if (f % 60 == m.proxy % 60) m.vel = Vec3(-m.vel.z, m.vel.y, m.vel.x);  // turn now and then
+                Vec3 d = m.vel * dt;
+                m.box = { m.box.min + d, m.box.max + d };
+                aabbMove(tree, m.proxy, m.box, d);
+            }
+            updateMs += profilerNowMs() - start;
+
+            for (int q=0; q<queries; ++q) {
+                Vec3 o((rng.unit() - 0.5f) * 256.0f, 1.0f + rng.unit() * 18.0f, (rng.unit() - 0.5f) * 256.0f);
+                float a = rng.unit() * 6.2831853f;
+                rays[q] = { o, normalize(Vec3(cosf(a), (rng.unit() - 0.5f) * 0.3f, sinf(a))), 30.0f };
+                boxes[q] = { o - Vec3(0.25f, 0.9f, 0.25f), o + Vec3(0.25f, 0.9f, 0.25f) };
+                deltas[q] = rays[q].dir * 3.0f;
+            }
+            start = profilerNowMs();
+            aabbRaycastBatch(tree, rays.data(), queries, ~0u, hits.data());
+            rayMs += profilerNowMs() - start;
+            start = profilerNowMs();
+            pairs.clear();
+            aabbOverlapBatch(tree, boxes.data(), queries, ~0u, pairs);
+            overlapMs += profilerNowMs() - start;
+            start = profilerNowMs();
+            aabbSweepBatch(tree, boxes.data(), deltas.data(), queries, ~0u, sweepHits.data());
+            sweepMs += profilerNowMs() - start;
+
+            // the same answers as testing every box, checked on a few frames
+            if (f % 20 != 0) continue;
+            start = profilerNowMs();
+            for (int q=0; q<queries; ++q) {
+                float d = bruteRay(movers, rays[q]);
+                mismatches += (d < 0.0f) != (hits[q].proxy == AABB_NULL) || (d >= 0.0f && d != hits[q].dist);
+            }
+            bruteMs += profilerNowMs() - start;
+            for (int q=0; q<queries; ++q) {
+                float d = bruteSweep(movers, boxes[q], deltas[q]);
+                mismatches += (d < 0.0f) != (sweepHits[q].proxy == AABB_NULL) || (d >= 0.0f && d != sweepHits[q].dist);
+            }
+            std::vector<int> found(queries, 0), expected(queries, 0);
+            for (const AabbPair& p : pairs) found[p.query] += aabbOverlaps(aabbTight(tree, p.proxy), boxes[p.query]);
+            for (int q=0; q<queries; ++q) for (const TreeMover& m : movers) expected[q] += aabbOverlaps(m.box, boxes[q]);
+            for (int q=0; q<queries; ++q) mismatches += found[q] != expected[q];
+        }
+        bool valid = aabbValidate(tree);
+        const double perQuery = 1e6 / (double(frames) * queries);
+        printf("  %8d %6d %10.1f %10.1f %10.1f %12.1f %12.1f %12.1f %12.1f\n", count, aabbHeight(tree),
+               updateMs * 1000.0 / frames, double(tree.stats.reinserts + tree.stats.refits - reinserts0) / frames,
+               double(tree.stats.rotations - rotations0) / frames, rayMs * perQuery,
+               bruteMs * 1e6 / (double(frames / 20) * queries), overlapMs * perQuery, sweepMs * perQuery);
+        if (mismatches) printf("  MISMATCH: %d queries answered differently than testing every box\n", mismatches);
+        if (!valid) printf("  FAILED: tree invalid after %d frames\n", frames);
+        failed += mismatches + !valid;
+    }
+
+    // boxes inserted in sorted order are the worst case for an unbalanced tree
+    AabbTree sorted;
+    for (int i=0; i<50000; ++i) {
+        Vec3 c(float(i) * 0.5f, 0.0f, 0.0f);
+        aabbInsert(sorted, { c - Vec3(0.2f, 0.2f, 0.2f), c + Vec3(0.2f, 0.2f, 0.2f) }, 1u, uint32_t(i));
+    }
+    printf("  50000 boxes in a row: depth %d after %llu rotations, quality %.1f\n", aabbHeight(sorted),
+           (unsigned long long)sorted.stats.rotations, aabbQuality(sorted));
+    if (aabbHeight(sorted) > 40 || !aabbValidate(sorted)) {
+        printf("  FAILED: sorted insertion left the tree unbalanced\n");
+        ++failed;
+    }
+    return failed ? 1 : 0;
+}
+
+// ----------------- Hitbox capsules -----------------
+// Nearest capsule over every character, the reference for the tree's candidates (the same
+// arithmetic as hitboxRaycastScalar()).
+float bruteCapsules(const HitboxSet& h, const Vec3& o, const Vec3& d, float maxDist) {
+    float best = INFINITY;
+    for (size_t i=0; i<h.radius.size(); ++i) {
+        float bax = h.bx[i] - h.ax[i], bay = h.by[i] - h.ay[i], baz = h.bz[i] - h.az[i];
+        float oax = o.x - h.ax[i], oay = o.y - h.ay[i], oaz = o.z - h.az[i];
+        float baba = bax * bax + bay * bay + baz * baz;
+        float bard = bax * d.x + bay * d.y + baz * d.z;
+        float baoa = bax * oax + bay * oay + baz * oaz;
+        float rdoa = d.x * oax + d.y * oay + d.z * oaz;
+        float oaoa = oax * oax + oay * oay + oaz * oaz;
+        float rr = h.radius[i] * h.radius[i];
+        float k2 = baba - bard * bard;
+        float k1 = baba * rdoa - baoa * bard;
+        float k0 = baba * oaoa - baoa * baoa - rr * baba;
+        float disc = k1 * k1 - k2 * k0;
+        if (!(0.0f <= disc) || !(0.0f < h.radius[i])) continue;
+        float tBody = (0.0f - k1 - sqrtf(disc > 0.0f ? disc : 0.0f)) / k2;
+        float y = baoa + tBody * bard;
+        float t;
+        if (0.0f < y && y < baba) {
+            t = tBody;
+        } else {
+            bool below = y <= 0.0f;
+            float ocx = below ? oax : o.x - h.bx[i], ocy = below ? oay : o.y - h.by[i], ocz = below ? oaz : o.z - h.bz[i];
+            float cb = d.x * ocx + d.y * ocy + d.z * ocz;
+            float capDisc = cb * cb - (ocx * ocx + ocy * ocy + ocz * ocz - rr);
+            if (!(0.0f < capDisc)) continue;
+            t = 0.0f - cb - sqrtf(capDisc);
+        }
+        if (0.0f <= t && t <= maxDist && t < best) best = t;
+    }
+    return best == INFINITY ? -1.0f : best;
+}
+
+bool sameHit(const HitboxHit& a, const HitboxHit& b) {
+    return a.character == b.character && a.bone == b.bone && a.dist == b.dist;
+}
+
+int benchHitboxes() {
+    animationInit();
+    const int frames = 30, shots = 256;
+    printf("hitbox: animated crowds, %d frames, %d shots per frame aimed at random bones\n", frames, shots);
+    printf("  %8s %10s %10s %10s %10s %10s %10s %8s   %s\n", "chars", "update us", "cands", "query ns", "simd ns",
+           "scalar ns", "brute ns", "hit %", "head/torso/arm/leg");
+    int failed = 0;
+    for (int count : { 64, 1024, 8192 }) {
+        BenchRng rng = { 4242u + uint32_t(count) };
+        // about one character per 16 square metres
+        float side = sqrtf(float(count)) * 4.0f;
+        CharacterSet set;
+        for (int i=0; i<count; ++i) {
+            Vec3 p((rng.unit() - 0.5f) * side, 0.0f, (rng.unit() - 0.5f) * side);
+            set.add(p, rng.unit() * 6.2831853f, i % 4 == 0 ? CLIP_IDLE : CLIP_WALK);
+        }
+        HitboxSet h;
+        double updateMs = 0.0, queryMs = 0.0, simdMs = 0.0, scalarMs = 0.0, bruteMs = 0.0;
+        int mismatches = 0, hits = 0, parts[HIT_PART_COUNT] = {};
+        std::vector<AabbPair> pairs;
+        std::vector<Vec3> origins(shots), dirs(shots);
+        std::vector<HitboxHit> simd(shots), scalar(shots);
+        uint64_t candidates0 = 0;
+        const float dt = 1.0f / 60.0f;
+        for (int f=0; f<frames; ++f) {
+            for (int i=0; i<count; ++i) {
+                set.posX[i] += cosf(set.heading[i]) * 1.4f * dt * (set.clip[i] == CLIP_WALK);
+                set.posZ[i] += sinf(set.heading[i]) * 1.4f * dt * (set.clip[i] == CLIP_WALK);
+            }
+            animateCharacters(set, dt, Vec3(), uint32_t(f));
+            double start = profilerNowMs();
+            hitboxUpdate(h, set);
+            updateMs += profilerNowMs() - start;
+            if (f == 0) candidates0 = h.stats.candidates;
+
+            // from head height somewhere nearby towards a bone, a little off now and then
+            for (int q=0; q<shots; ++q) {
+                int c = int(rng.next() % uint32_t(count)), lane = c * SKEL_LANES + int(rng.next() % SKEL_BONES);
+                Vec3 target((h.ax[lane] + h.bx[lane]) * 0.5f, (h.ay[lane] + h.by[lane]) * 0.5f,
+                            (h.az[lane] + h.bz[lane]) * 0.5f);
+                float a = rng.unit() * 6.2831853f, r = 3.0f + rng.unit() * 20.0f;
+                origins[q] = Vec3(target.x + cosf(a) * r, 1.6f, target.z + sinf(a) * r);
+                Vec3 jitter((rng.unit() - 0.5f) * 0.3f, (rng.unit() - 0.5f) * 0.3f, (rng.unit() - 0.5f) * 0.3f);
+                dirs[q] = normalize(target + jitter - origins[q]);
+            }
+            // the candidates alone, to tell the tree's share from the capsule tests
+            start = profilerNowMs();
+            for (int q=0; q<shots; ++q) {
+                AabbRay ray = { origins[q], dirs[q], 30.0f };
+                pairs.clear();
+                aabbRayOverlapBatch(h.tree, &ray, 1, ~0u, pairs);
+            }
+            queryMs += profilerNowMs() - start;
+            start = profilerNowMs();
+            for (int q=0; q<shots; ++q) hitboxRaycast(h, origins[q], dirs[q], 30.0f, simd[q]);
+            simdMs += profilerNowMs() - start;
+            start = profilerNowMs();
+            for (int q=0; q<shots; ++q) hitboxRaycastScalar(h, origins[q], dirs[q], 30.0f, scalar[q]);
+            scalarMs += profilerNowMs() - start;
+            for (int q=0; q<shots; ++q) {
+                mismatches += !sameHit(simd[q], scalar[q]);
+                if (simd[q].character >= 0) {
+                    ++hits;
+                    ++parts[simd[q].part];
+                }
+            }
+            // every capsule tested, on a few frames
+            if (f % 10 != 0) continue;
+            start = profilerNowMs();
+            for (int q=0; q<shots; ++q) {
+                float d = bruteCapsules(h, origins[q], dirs[q], 30.0f);
+                mismatches += (d < 0.0f) != (simd[q].character < 0) || (d >= 0.0f && d != simd[q].dist);
+            }
+            bruteMs += profilerNowMs() - start;
+        }
+
+        // shots level with a head's centre: whoever is hit first, if it is the aimed character
+        // it is in the head
+        int aimed = 0, blocked = 0, wrong = 0;
+        for (int c=0; c<count; c += std::max(1, count / 256)) {
+            int lane = c * SKEL_LANES + BONE_HEAD;
+            Vec3 head((h.ax[lane] + h.bx[lane]) * 0.5f, (h.ay[lane] + h.by[lane]) * 0.5f, (h.az[lane] + h.bz[lane]) * 0.5f);
+            float a = rng.unit() * 6.2831853f;
+            Vec3 from(head.x + cosf(a) * 8.0f, head.y, head.z + sinf(a) * 8.0f);
+            HitboxHit hit;
+            hitboxRaycast(h, from, normalize(head - from), 30.0f, hit);
+            ++aimed;
+            if (hit.character != c) ++blocked;
+            else if (hit.part != HIT_HEAD) ++wrong;
+        }
+
+        const double perShot = 1e6 / (double(frames) * shots);
+        printf("  %8d %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f %8.1f   %d/%d/%d/%d\n", count, updateMs * 1000.0 / frames,
+               double(h.stats.candidates - candidates0) / (2.0 * frames * shots), queryMs * perShot, simdMs * perShot,
+               scalarMs * perShot,
+               bruteMs * 1e6 / (double(frames / 10) * shots), 100.0 * hits / (frames * shots), parts[HIT_HEAD],
+               parts[HIT_TORSO], parts[HIT_ARM], parts[HIT_LEG]);
+        printf("           head shots: %d aimed, %d stopped by someone in front, %d in another part\n", aimed, blocked,
+               wrong);
+        if (mismatches) printf("  MISMATCH: %d shots answered differently by the lanes, the scalar path or every capsule\n",
+                               mismatches);
+        if (wrong) printf("  FAILED: %d head shots hit another part of the aimed character\n", wrong);
+        failed += mismatches + wrong;
+    }
+    return failed ? 1 : 0;
+}
+
+// ----------------- Audio mixer -----------------
+struct AudioScene {
+    BenchRng rng;
+    int voices;
+};
+
+// Keeps `voices` sounds playing around a listener walking in a circle: mostly footsteps and
+// impacts, some shots, a few beyond earshot.
+void audioScene(AudioMixer& m, int block, void* user) {
+    AudioScene& s = *static_cast<AudioScene*>(user);
+    float a = block * 0.002f;
+    m.listener.pos = Vec3(cosf(a) * 10.0f, 1.7f, sinf(a) * 10.0f);
+    m.listener.right = Vec3(-sinf(a * 3.0f), 0.0f, cosf(a * 3.0f));
+    while (m.voices < s.voices) {
+        uint32_t kind = s.rng.next() % 10;
+        SoundId id = kind < 4 ? SOUND_STEP : kind < 7 ? SOUND_IMPACT : kind < 9 ? SOUND_SHOT : SOUND_PICKUP;
+        float angle = s.rng.unit() * 6.2831853f, dist = s.rng.unit() * 70.0f;
+        Vec3 pos = m.listener.pos + Vec3(cosf(angle) * dist, s.rng.unit() * 4.0f - 2.0f, sinf(angle) * dist);
+        audioMixerPlay(m, id, pos, 0.3f + 0.7f * s.rng.unit());
+    }
+}
+
+int benchAudio() {
+    const int blocks = 2000;  // 10.7 s of audio
+    const double blockUs = 1e6 * AUDIO_BLOCK / AUDIO_RATE;
+    printf("audio: %d blocks of %d frames at %d Hz (%.0f us each), listener walking through the voices\n", blocks,
+           AUDIO_BLOCK, AUDIO_RATE, blockUs);
+    printf("  %8s %12s %12s %8s %10s %8s\n", "voices", "simd us", "scalar us", "speedup", "realtime", "culled");
+    int failed = 0;
+    std::vector<float> a(AUDIO_BLOCK * 2), b(AUDIO_BLOCK * 2);
+    for (int voices : { 64, 256, AUDIO_MAX_VOICES }) {
+        AudioMixer simd, scalar;
+        audioMixerInit(simd, 5u);
+        audioMixerInit(scalar, 5u);
+        AudioScene sa = { { 99u }, voices }, sb = { { 99u }, voices };
+        double simdMs = 0.0, scalarMs = 0.0;
+        int mismatches = 0;
+        for (int k=0; k<blocks; ++k) {
+            audioScene(simd, k, &sa);
+            audioScene(scalar, k, &sb);
+            double start = profilerNowMs();
+            audioMixBlock(simd, a.data());
+            simdMs += profilerNowMs() - start;
+            start = profilerNowMs();
+            audioMixBlockScalar(scalar, b.data());
+            scalarMs += profilerNowMs() - start;
+            mismatches += memcmp(a.data(), b.data(), a.size() * sizeof(float)) != 0;
+        }
+        double simdUs = simdMs * 1000.0 / blocks, scalarUs = scalarMs * 1000.0 / blocks;
+        printf("  %8d %12.2f %12.2f %7.2fx %9.0fx %7.1f%%\n", voices, simdUs, scalarUs, scalarUs / simdUs,
+               blockUs / simdUs, 100.0 * simd.stats.culled / double(simd.stats.culled + simd.stats.voicesMixed));
+        if (mismatches) printf("  MISMATCH: %d blocks mixed differently by the lanes and the scalar path\n", mismatches);
+        failed += mismatches;
+    }
+
+    // a burst of shots with every voice busy: each steals a different voice
+    {
+        AudioMixer m;
+        audioMixerInit(m, 5u);
+        for (int i=0; i<AUDIO_MAX_VOICES; ++i) {
+            audioMixerPlay(m, SOUND_STEP, Vec3(float(i % 32), 0.0f, float(i / 32)), 1.0f);
+        }
+        audioMixBlock(m, a.data());
+        std::vector<int> stolen;
+        for (int i=0; i<16; ++i) stolen.push_back(audioMixerPlay(m, SOUND_SHOT, Vec3(0.0f, 0.0f, 0.0f), 1.0f));
+        std::sort(stolen.begin(), stolen.end());
+        if (std::unique(stolen.begin(), stolen.end()) != stolen.end()) {
+            printf("  FAILED: a burst of 16 shots stole a voice another shot of the burst had taken\n");
+            ++failed;
+        }
+    }
+
+    // offline: a scripted scene straight to a file, as fast as it mixes; in the temp directory,
+    // not wherever the bench was started
+    const char* tmp = getenv("TMPDIR");
+    std::string wavPath = std::string(tmp && *tmp ? tmp : "/tmp") + "/sandbox_bench_audio.wav";
+    const char* path = wavPath.c_str();
+    const int wavBlocks = AUDIO_RATE * 10 / AUDIO_BLOCK;
+    AudioScene scene = { { 7u }, 256 };
+    double mixMs = 0.0, start = profilerNowMs();
+    bool wrote = audioRenderWav(path, wavBlocks, 5u, audioScene, &scene, &mixMs);
+    double totalMs = profilerNowMs() - start;
+    struct stat st = {};
+    long expected = 44 + long(wavBlocks) * AUDIO_BLOCK * 4;
+    bool sized = wrote && stat(path, &st) == 0 && long(st.st_size) == expected;
+    unlink(path);
+    printf("  offline: 10 s of 256 voices to %s in %.1f ms (%.1f ms mixing), %.0fx real time\n", path, totalMs, mixMs,
+           10000.0 / totalMs);
+    if (!sized) {
+        printf("  FAILED: %s is %ld bytes, expected %ld\n", path, long(st.st_size), expected);
+        ++failed;
+    }
+
+    // the ring between threads: everything arrives, in order
+    AudioRing<uint32_t> ring;
+    ring.init(1024);
+    const uint32_t items = 2000000;
+    std::thread producer([&] {
+        uint32_t next = 0, chunk[97];
+        BenchRng rng = { 3u };
+        while (next < items) {
+            uint32_t n = std::min(1u + rng.next() % 97u, items - next);
+            for (uint32_t i=0; i<n; ++i) chunk[i] = next + i;
+            uint32_t pushed = ring.push(chunk, n);
+            next += pushed;
+            if (pushed == 0) std::this_thread::yield();
+        }
+    });
+    uint32_t expect = 0, got[64], disorder = 0;
+    start = profilerNowMs();
+    while (expect < items) {
+        uint32_t n = ring.pop(got, 64);
+        for (uint32_t i=0; i<n; ++i) disorder += got[i] != expect++;
+        if (n == 0) std::this_thread::yield();
+    }
+    producer.join();
+    printf("  ring: %u items across threads in %.1f ms, %u out of order\n", items, profilerNowMs() - start, disorder);
+    if (disorder) {
+        printf("  FAILED: the ring lost or reordered items\n");
+        ++failed;
+    }
+
+    // the whole path: game thread -> mixer thread -> an output pulling at the real-time rate
+    audioInit(audioOutputNull, 5u);
+    BenchRng rng = { 11u };
+    for (int frame=0; frame<30; ++frame) {
+        audioSetListener(Vec3(0.0f, 1.7f, 0.0f), frame * 0.05f);
+        for (int i=0; i<10; ++i) {
+            audioPlay(SoundId(rng.next() % SOUND_COUNT), Vec3(rng.unit() * 40.0f - 20.0f, 1.0f, rng.unit() * 40.0f - 20.0f));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(16));
+    }
+    AudioStats as = audioStats();
+    audioShutdown();
+    printf("  threaded: %llu blocks in 0.5 s, %d voices at the end, mix %.1f us (max %.1f), %llu underrun frames, "
+           "%llu dropped\n", (unsigned long long)as.blocks, as.voices, as.mixUs, as.maxMixUs,
+           (unsigned long long)as.underruns, (unsigned long long)as.dropped);
+    if (as.blocks == 0) {
+        printf("  FAILED: the mixer thread produced nothing\n");
+        ++failed;
+    }
+    return failed ? 1 : 0;
+}
+
+// ----------------- Gameplay scripts -----------------
+const char* const kScriptLoops = R"(
+func loop(n) {
+    let sum = 0
+    let i = 0
+    while (i < n) {
+        sum = sum * 0.5 + i
+        if (sum > 1000) { sum = sum - 1000 }
+        i = i + 1
+    }
+    return sum
+}
+
+func fib(n) {
+    if (n < 2) { return n }
+    return fib(n - 1) + fib(n - 2)
+}
+)";
+
+double nativeLoop(double n) {
+    double sum = 0.0;
+    for (double i=0.0; i<n; i = i + 1.0) {
+        sum = sum * 0.5 + i;
+        if (sum > 1000.0) sum = sum - 1000.0;
+    }
+    return sum;
+}
+
+double nativeFib(double n) { return n < 2.0 ? n : nativeFib(n - 1.0) + nativeFib(n - 2.0); }
+
+// A crowd as the rules see it, entity 1 + i being member i.
+struct ScriptBenchStore {
+    std::vector<float> health, x, y, z;
+    int respawns = 0, sounds = 0;
+};
+
+double storeGet(void* user, int e, int field) {
+    ScriptBenchStore& s = *static_cast<ScriptBenchStore*>(user);
+    if (e < 1 || e > int(s.health.size())) return 0.0;
+    const std::vector<float>* fields[FIELD_COUNT] = { &s.health, &s.x, &s.y, &s.z };
+    return (*fields[field])[e - 1];
+}
+
+void storeSet(void* user, int e, int field, double value) {
+    ScriptBenchStore& s = *static_cast<ScriptBenchStore*>(user);
+    if (e < 1 || e > int(s.health.size())) return;
+    std::vector<float>* fields[FIELD_COUNT] = { &s.health, &s.x, &s.y, &s.z };
+    (*fields[field])[e - 1] = float(value);
+}
+
+void storeRespawnAt(ScriptBenchStore& s, int e) {
+    if (e < 1 || e > int(s.health.size())) return;
+    s.x[e - 1] = -s.x[e - 1];
+    s.z[e - 1] = -s.z[e - 1];
+    ++s.respawns;
+}
+
+double storePlay(void* user, const double*) {
+    ++static_cast<ScriptBenchStore*>(user)->sounds;
+    return 0.0;
+}
+
+double storeRespawn(void* user, const double* args) {
+    storeRespawnAt(*static_cast<ScriptBenchStore*>(user), int(args[0]));
+    return 0.0;
+}
+
+// gameRulesSource written in C++, the baseline for the script's overhead.
+struct NativeWeapon {
+    double ammo = 30.0, magazine = 30.0, reloadUntil = 0.0;
+};
+
+bool nativeFire(NativeWeapon& w, ScriptBenchStore& s, double now) {
+    if (now < w.reloadUntil) return false;
+    w.ammo = w.ammo - 1.0;
+    if (w.ammo <= 0.0) {
+        w.ammo = w.magazine;
+        w.reloadUntil = now + 1.5;
+        ++s.sounds;
+    }
+    return true;
+}
+
+double nativeDamage(int part) { return part == HIT_HEAD ? 34.0 * 3.0 : part == HIT_TORSO ? 34.0 : 34.0 * 0.6; }
+
+double nativeHit(ScriptBenchStore& s, int target, int part) {
+    double dealt = nativeDamage(part);
+    double health = double(s.health[target - 1]) - dealt;
+    if (health <= 0.0) {
+        s.health[target - 1] = RULES_MAX_HEALTH;
+        storeRespawnAt(s, target);
+        return -dealt;
+    }
+    s.health[target - 1] = float(health);
+    return dealt;
+}
+
+int benchScript() {
+    int failed = 0;
+    ScriptHost bare;
+    ScriptProgram loops;
+    double start = profilerNowMs();
+    if (!scriptCompile(loops, kScriptLoops, bare)) return 1;
+    double compileUs = (profilerNowMs() - start) * 1000.0;
+    ScriptVM vm;
+    scriptVmInit(vm, loops, bare);
+    printf("script: register bytecode, %zu words compiled in %.1f us; best of 3 runs\n", loops.code.size(), compileUs);
+    printf("  %-10s %12s %12s %12s %10s %10s\n", "", "instructions", "threaded M/s", "switch M/s", "ms", "native ms");
+    struct Case {
+        const char* name;
+        const char* fn;
+        double arg;
+        double (*native)(double);
+    };
+    const Case cases[] = { { "loop 1M", "loop", 1e6, nativeLoop }, { "fib 25", "fib", 25.0, nativeFib } };
+    for (const Case& c : cases) {
+        int fn = scriptFunction(loops, c.fn);
+        double counted = 0.0, threaded = 0.0, switched = 0.0;
+        vm.instructions = 0;
+        bool ok = scriptCall(vm, fn, &c.arg, 1, &counted, SCRIPT_COUNTING);
+        uint64_t ops = vm.instructions;
+        double threadedMs = 1e30, switchMs = 1e30, nativeMs = 1e30, expected = 0.0;
+        for (int run=0; run<3; ++run) {
+            start = profilerNowMs();
+            ok &= scriptCall(vm, fn, &c.arg, 1, &threaded);
+            threadedMs = std::min(threadedMs, profilerNowMs() - start);
+            start = profilerNowMs();
+            ok &= scriptCall(vm, fn, &c.arg, 1, &switched, SCRIPT_SWITCH);
+            switchMs = std::min(switchMs, profilerNowMs() - start);
+            volatile double arg = c.arg;
+            start = profilerNowMs();
+            expected = c.native(arg);
+            nativeMs = std::min(nativeMs, profilerNowMs() - start);
+        }
+        printf("  %-10s %12llu %12.0f %12.0f %10.2f %10.2f\n", c.name, (unsigned long long)ops,
+               ops / (threadedMs * 1000.0), ops / (switchMs * 1000.0), threadedMs, nativeMs);
+        if (!ok || counted != expected || threaded != expected || switched != expected) {
+            printf("  MISMATCH: %s returned %.17g / %.17g / %.17g, native %.17g\n", c.name, counted, threaded, switched,
+                   expected);
+            ++failed;
+        }
+    }
+
+    // the built-in weapon rules against the same rules in C++, on copies of one crowd
+    const int members = 64, calls = 1000000;
+    ScriptBenchStore scripted, native;
+    BenchRng rng = { 17u };
+    for (int i=0; i<members; ++i) {
+        scripted.health.push_back(RULES_MAX_HEALTH);
+        scripted.x.push_back(rng.unit() * 200.0f - 100.0f);
+        scripted.y.push_back(rng.unit() * 10.0f);
+        scripted.z.push_back(rng.unit() * 200.0f - 100.0f);
+    }
+    native = scripted;
+    std::vector<int> targets(calls);
+    std::vector<uint8_t> parts(calls);
+    for (int i=0; i<calls; ++i) {
+        targets[i] = 1 + int(rng.next() % uint32_t(members));
+        parts[i] = uint8_t(rng.next() % HIT_PART_COUNT);
+    }
+    GameRules rules;
+    ScriptEntities entities = { rulesFieldNames, FIELD_COUNT, storeGet, storeSet };
+    if (!gameRulesInit(rules, gameRulesSource, storePlay, storeRespawn, entities, &scripted)) return 1;
+    NativeWeapon weapon;
+
+    uint64_t allocations = benchAllocations.load();
+    start = profilerNowMs();
+    double scriptDealt = 0.0;
+    for (int i=0; i<calls; ++i) scriptDealt += gameRulesHit(rules, targets[i], parts[i]);
+    double scriptHitMs = profilerNowMs() - start;
+    start = profilerNowMs();
+    int scriptShots = 0;
+    for (int i=0; i<calls; ++i) scriptShots += gameRulesFire(rules, i * 0.01);
+    double scriptFireMs = profilerNowMs() - start;
+    allocations = benchAllocations.load() - allocations;
+
+    start = profilerNowMs();
+    double nativeDealt = 0.0;
+    for (int i=0; i<calls; ++i) nativeDealt += nativeHit(native, targets[i], parts[i]);
+    double nativeHitMs = profilerNowMs() - start;
+    start = profilerNowMs();
+    int nativeShots = 0;
+    for (int i=0; i<calls; ++i) nativeShots += nativeFire(weapon, native, i * 0.01);
+    double nativeFireMs = profilerNowMs() - start;
+    benchSink = benchSink + uint64_t(nativeDealt) + uint64_t(nativeShots);
+
+    bool same = scriptDealt == nativeDealt && scriptShots == nativeShots && scripted.respawns == native.respawns &&
+                scripted.sounds == native.sounds && scripted.health == native.health && scripted.x == native.x &&
+                scripted.z == native.z;
+
+    // instructions per call, counted on a further stretch of the same calls
+    const int counted = 10000;
+    uint64_t hitOps = 0, fireOps = 0;
+    for (int i=0; i<counted; ++i) {
+        double args[2] = { double(targets[i]), double(parts[i]) }, now = (calls + i) * 0.01, r;
+        rules.vm.instructions = 0;
+        scriptCall(rules.vm, rules.hit, args, 2, &r, SCRIPT_COUNTING);
+        hitOps += rules.vm.instructions;
+        rules.vm.instructions = 0;
+        scriptCall(rules.vm, rules.fire, &now, 1, &r, SCRIPT_COUNTING);
+        fireOps += rules.vm.instructions;
+    }
+
+    const double ns = 1e6 / calls;
+    printf("  weapon rules, %d calls each: %llu heap allocations in the scripted calls\n", calls,
+           (unsigned long long)allocations);
+    printf("  %-10s %12s %12s %12s %12s\n", "", "instructions", "script ns", "native ns", "overhead ns");
+    printf("  %-10s %12.1f %12.1f %12.1f %12.1f\n", "hit", double(hitOps) / counted, scriptHitMs * ns, nativeHitMs * ns,
+           (scriptHitMs - nativeHitMs) * ns);
+    printf("  %-10s %12.1f %12.1f %12.1f %12.1f\n", "fire", double(fireOps) / counted, scriptFireMs * ns,
+           nativeFireMs * ns, (scriptFireMs - nativeFireMs) * ns);
+    printf("  %d shots, %d respawns, %d reload sounds\n", scriptShots, scripted.respawns, scripted.sounds);
+    if (!same) {
+        printf("  MISMATCH: the weapon script and its C++ twin left different crowds\n");
+        ++failed;
+    }
+    if (allocations) {
+        printf("  FAILED: the scripted calls allocated\n");
+        ++failed;
+    }
+
+    // the pickup rule: the player takes one and has a full magazine, the crowd walks past
+    gameRulesFire(rules, 1e9);
+    int sounds = scripted.sounds, ammo = gameRulesAmmo(rules);
+    bool playerTook = gameRulesPickup(rules, 0), crowdTook = gameRulesPickup(rules, 1);
+    printf("  pickups: the player takes one (ammo %d -> %d), the crowd %s\n", ammo, gameRulesAmmo(rules),
+           crowdTook ? "does too" : "walks past");
+    if (!playerTook || crowdTook || gameRulesAmmo(rules) != 30 || scripted.sounds != sounds + 1) {
+        printf("  FAILED: the pickup rule gave the wrong pickups\n");
+        ++failed;
+    }
+    return failed ? 1 : 0;
+}
+
+// ----------------- Copy-on-write snapshots -----------------
+int benchSnapshot() {
+    World w;
+    makeBenchWorld(w);
+    const int snapshots = 2000, edits = 1000;
+
+    double start = profilerNowMs();
+    for (int i=0; i<snapshots; ++i) {
+        WorldSnapshot s = worldSnapshot(w);
+        benchSink += s->chunks.size();
+    }
+    double snapUs = (profilerNowMs() - start) * 1000.0 / snapshots;
+
+    // edits while a snapshot is alive: the first touch of a chunk copies it, later ones don't
+    WorldSnapshot before = worldSnapshot(w);
+    uint64_t copies0 = w.chunkCopies;
+    BenchRng rng = { 99u };
+    std::vector<int> gx(edits), gz(edits);
+    for (int i=0; i<edits; ++i) {
+        gx[i] = 384 + int(rng.next() % 256u);
+        gz[i] = 384 + int(rng.next() % 256u);
+    }
+    start = profilerNowMs();
+    for (int i=0; i<edits; ++i) worldSetHeight(w, gx[i], gz[i], worldHeight(w, gx[i], gz[i]) + 1);
+    double editUs = (profilerNowMs() - start) * 1000.0 / edits;
+    uint64_t copies = w.chunkCopies - copies0;
+
+    // the snapshot must still see the old heights, the live world the new ones
+    int stale = 0;
+    for (int i=0; i<edits; ++i) {
+        int old = worldHeight(*before, gx[i], gz[i]);
+        if (worldHeight(w, gx[i], gz[i]) <= old) ++stale;
+    }
+    World fresh;
+    makeBenchWorld(fresh);
+    int leaked = 0;
+    for (int z=0; z<w.cfg.gridH; z += 7) for (int x=0; x<w.cfg.gridW; x += 7) {
+        if (worldHeight(*before, x, z) != worldHeight(fresh, x, z)) ++leaked;
+    }
+    printf("snapshot: %d chunks, %.2f us per snapshot\n", int(w.chunks.size()), snapUs);
+    printf("  %d edits under a live snapshot: %.3f us/edit, %llu chunk copies (%.1f KiB)\n", edits, editUs,
+           (unsigned long long)copies, copies * w.cfg.chunkSize * w.cfg.chunkSize / 1024.0);
+    if (stale || leaked) {
+        printf("  FAILED: %d edits missing from the live world, %d leaked into the snapshot\n", stale, leaked);
+        return 1;
+    }
+    return 0;
+}
+
+// ----------------- Autosave -----------------
+int benchAutosave() {
+    World w;
+    makeBenchWorld(w);
+    const char* dir = "sandbox_bench_save";
+    const uint32_t seed = 7u;
+    autosaveInit(dir);
+
+    double start = profilerNowMs();
+    autosaveRequest(w, seed);
+    autosaveFlush();
+    AutosaveStats full = autosaveStats();
+    printf("autosave: full save of %d regions, %.1f KiB (raw %.1f KiB) in %.1f ms wall\n", full.regionsWritten,
+           full.bytesWritten / 1024.0, w.cfg.gridW * w.cfg.gridH / 1024.0, profilerNowMs() - start);
+
+    // play-like rounds around one spot: edits, a save request, more edits while the worker writes
+    const int rounds = 20, editsPerRound = 200;
+    BenchRng rng = { 31337u };
+    double stallSum = 0.0, stallMax = 0.0, workSum = 0.0;
+    int regionsSum = 0;
+    for (int r=0; r<rounds; ++r) {
+        for (int i=0; i<editsPerRound; ++i) {
+            int gx = int(rng.next() % 128u) + 448, gz = int(rng.next() % 128u) + 448;
+            worldSetHeight(w, gx, gz, int(rng.next() % 8u));
+        }
+        autosaveRequest(w, seed);
+        double stall = autosaveStats().stallMs;
+        for (int i=0; i<editsPerRound; ++i) {
+            int gx = int(rng.next() % 128u) + 448, gz = int(rng.next() % 128u) + 448;
+            worldSetHeight(w, gx, gz, int(rng.next() % 8u));
+        }
+        autosaveFlush();
+        stallSum += stall;
+        stallMax = std::max(stallMax, stall);
+        workSum += autosaveStats().workerMs;
+        regionsSum += autosaveStats().regionsWritten;
+    }
+    autosaveRequest(w, seed);
+    autosaveFlush();
+    printf("  %d incremental saves: stall avg %.3f ms max %.3f ms, worker %.2f ms avg, %.1f regions avg\n",
+           rounds, stallSum / rounds, stallMax, workSum / rounds, double(regionsSum) / rounds);
+
+    // reload into a fresh copy of the generated map and compare
+    World loaded;
+    makeBenchWorld(loaded);
+    int regions = autosaveLoad(loaded, seed);
+    int diff = 0;
+    for (int z=0; z<w.cfg.gridH; ++z) for (int x=0; x<w.cfg.gridW; ++x) {
+        diff += worldHeight(w, x, z) != worldHeight(loaded, x, z);
+    }
+    printf("  reloaded %d regions, %d mismatching columns\n", regions, diff);
+
+    // builds without threads save in slices that stop between chunk rows: the longest row is
+    // how far a slice can overrun its budget
+    std::vector<uint8_t> encoded;
+    start = profilerNowMs();
+    regionEncode(w, seed, 0, 0, encoded);
+    double regionMs = profilerNowMs() - start, rowMax = 0.0;
+    regionEncodeBegin(w, seed, 0, 0, encoded);
+    for (int lz=0; lz<REGION_CHUNKS; ++lz) {
+        start = profilerNowMs();
+        regionEncodeRow(w, 0, 0, lz, encoded);
+        rowMax = std::max(rowMax, profilerNowMs() - start);
+    }
+    printf("  sliced encoding: a region in %.3f ms, the longest chunk row %.3f ms\n", regionMs, rowMax);
+
+    char path[512];
+    for (int rz=0; rz<regionCountZ(w); ++rz) for (int rx=0; rx<regionCountX(w); ++rx) {
+        regionFileName(path, sizeof(path), dir, seed, rx, rz);
+        remove(path);
+    }
+    rmdir(dir);
+    if (diff || stallMax >= 0.5) {
+        printf("  FAILED%s\n", diff ? ": saved world does not round-trip" : ": stall over 0.5 ms");
+        return 1;
+    }
+    return 0;
+}
+
+// ----------------- Write-ahead journal -----------------
+int benchJournal() {
+    World w;
+    makeBenchWorld(w);
+    World base;
+    makeBenchWorld(base);
+    const char* dir = "sandbox_bench_journal";
+    const uint32_t seed = 7u;
+    mkdir(dir, 0755);
+    Journal j;
+    if (!journalOpen(j, dir, seed, 1)) return 1;
+    int sub = worldSubscribe(w, journalOnEdit, &j);
+
+    // sustained edits with durability on: each "tick" is a batch of edits plus one commit
+    printf("journal: fsync on every commit, 1 s per batch size\n");
+    printf("  %8s %12s %12s %12s %12s\n", "batch", "edits/s", "commits/s", "fsync ms", "bytes/edit");
+    BenchRng rng = { 2024u };
+    const int batches[] = { 1, 16, 256 };
+    for (int batch : batches) {
+        uint64_t edits0 = j.editsLogged, commits0 = j.commits, bytes0 = j.bytesLogged;
+        double sync0 = j.syncMs;
+        double start = profilerNowMs(), elapsed = 0.0;
+        while (elapsed < 1000.0) {
+            for (int i=0; i<batch; ++i) {
+                int gx = int(rng.next() % uint32_t(w.cfg.gridW)), gz = int(rng.next() % uint32_t(w.cfg.gridH));
+                worldSetHeight(w, gx, gz, (worldHeight(w, gx, gz) + 1) % 9);
+            }
+            journalCommit(j);
+            elapsed = profilerNowMs() - start;
+        }
+        uint64_t edits = j.editsLogged - edits0, commits = j.commits - commits0;
+        printf("  %8d %12.0f %12.0f %12.3f %12.1f\n", batch, edits * 1000.0 / elapsed, commits * 1000.0 / elapsed,
+               (j.syncMs - sync0) / double(commits), double(j.bytesLogged - bytes0) / double(edits));
+    }
+
+    // a disk that takes a few bytes of a record and then fails: the commit reports it, and
+    // the retry and everything after it must still replay
+    worldSetHeight(w, 10, 10, (worldHeight(w, 10, 10) + 1) % 9);
+    j.writeFn = [](int fd, const void* data, size_t size) -> ssize_t {
+        static bool tookSome = false;
+        tookSome = !tookSome;
+        if (tookSome) return write(fd, data, std::min<size_t>(size, 5));
+        errno = ENOSPC;
+        return -1;
+    };
+    bool injected = !journalCommit(j);
+    j.writeFn = write;
+    bool retried = journalCommit(j);
+    for (int i=0; i<64; ++i) {
+        worldSetHeight(w, 20 + i, 20, (worldHeight(w, 20 + i, 20) + 1) % 9);
+        journalCommit(j);
+    }
+    uint64_t segment = journalRotate(j);
+    journalClose(j);
+    worldUnsubscribe(w, sub);
+
+    // recovery: replay everything on top of the freshly generated map
+    JournalRecovery rec = journalRecover(dir, seed, base);
+    int diff = 0;
+    for (int z=0; z<w.cfg.gridH; ++z) for (int x=0; x<w.cfg.gridW; ++x) {
+        diff += worldHeight(w, x, z) != worldHeight(base, x, z);
+    }
+    printf("  recovery: %llu records, %llu edits, %.1f MiB in %.1f ms (%.0f edits/s), %d mismatching columns\n",
+           (unsigned long long)rec.records, (unsigned long long)rec.edits, rec.bytes / 1048576.0, rec.ms,
+           rec.edits * 1000.0 / std::max(rec.ms, 1e-3), diff);
+    journalDropSegments(j, segment + 1);
+    rmdir(dir);
+    if (!injected || !retried) {
+        printf("  FAILED: a short write was %s\n", injected ? "not recovered from" : "reported as committed");
+        return 1;
+    }
+    if (diff) {
+        printf("  FAILED: replayed journal does not reproduce the world\n");
+        return 1;
+    }
+    return 0;
+}
+
+// ----------------- Undo history -----------------
+int benchUndo() {
+    World w;
+    makeBenchWorld(w);
+    World reference;
+    makeBenchWorld(reference);
+    UndoHistory h;
+    size_t fullCopy = size_t(w.cfg.gridW) * w.cfg.gridH;
+
+    // single-column edits, a 256x256 area edit and a full regeneration, like the editor makes
+    BenchRng rng = { 5u };
+    double start = profilerNowMs();
+    for (int i=0; i<200; ++i) {
+        undoBegin(h, w, "block edit");
+        worldSetHeight(w, int(rng.next() % 1024u), int(rng.next() % 1024u), int(rng.next() % 16u));
+        undoEnd(h, w);
+    }
+    double singleUs = (profilerNowMs() - start) * 1000.0 / 200;
+    size_t singleBytes = h.usedBytes;
+
+    start = profilerNowMs();
+    undoBegin(h, w, "area edit");
+    worldBeginEdits(w);
+    for (int z=300; z<556; ++z) for (int x=300; x<556; ++x) worldSetHeight(w, x, z, worldHeight(w, x, z) + 1);
+    worldEndEdits(w);
+    undoEnd(h, w);
+    double areaMs = profilerNowMs() - start;
+    size_t areaBytes = h.undo.back().data.size();
+    int areaChunks = h.undo.back().chunks;
+
+    undoBegin(h, w, "regenerate");
+    worldGenerate(w, 99u);
+    undoEnd(h, w);
+    size_t regenBytes = h.undo.back().data.size();
+
+    // undo everything, counting the edit events (one per chunk and step = one remesh each)
+    int events = 0;
+    int sub = worldSubscribe(w, [](const World&, const WorldEdit&, void* n) { ++*static_cast<int*>(n); }, &events);
+    start = profilerNowMs();
+    undoApply(h, w);  // regenerate
+    double undoRegenMs = profilerNowMs() - start;
+    int regenEvents = events;
+    events = 0;
+    start = profilerNowMs();
+    undoApply(h, w);  // area
+    double undoAreaMs = profilerNowMs() - start;
+    int areaEvents = events;
+    while (undoApply(h, w)) {}
+    worldUnsubscribe(w, sub);
+    int diff = 0;
+    for (int z=0; z<w.cfg.gridH; ++z) for (int x=0; x<w.cfg.gridW; ++x) {
+        diff += worldHeight(w, x, z) != worldHeight(reference, x, z);
+    }
+    while (redoApply(h, w)) {}
+    World seed99;
+    makeBenchWorld(seed99);
+    worldGenerate(seed99, 99u);
+    int redoDiff = 0;  // everything redone: the map is the seed 99 one again
+    for (int z=300; z<556; ++z) for (int x=300; x<556; ++x) {
+        redoDiff += worldHeight(w, x, z) != worldHeight(seed99, x, z);
+    }
+
+    printf("undo: full world copy would be %.1f KiB per step\n", fullCopy / 1024.0);
+    printf("  200 single edits: %.2f us each, %.1f bytes/step\n", singleUs, double(singleBytes) / 200);
+    printf("  256x256 area: %d chunks, %.1f KiB, recorded in %.2f ms, undone in %.2f ms with %d edit events\n",
+           areaChunks, areaBytes / 1024.0, areaMs, undoAreaMs, areaEvents);
+    printf("  regeneration: %.1f KiB, undone in %.2f ms with %d edit events\n", regenBytes / 1024.0, undoRegenMs,
+           regenEvents);
+
+    // ring budget: keep recording area edits into a small budget
+    UndoHistory ring;
+    ring.budgetBytes = 256u << 10;
+    for (int i=0; i<200; ++i) {
+        undoBegin(ring, w, "area edit");
+        worldBeginEdits(w);
+        int x0 = int(rng.next() % 900u), z0 = int(rng.next() % 900u);
+        for (int z=z0; z<z0+64; ++z) for (int x=x0; x<x0+64; ++x) worldSetHeight(w, x, z, int(rng.next() % 16u));
+        worldEndEdits(w);
+        undoEnd(ring, w);
+    }
+    printf("  ring: 200 random 64x64 edits into a 256 KiB budget keep %zu steps in %.1f KiB\n", ring.undo.size(),
+           ring.usedBytes / 1024.0);
+    if (diff || redoDiff || areaEvents != areaChunks || ring.usedBytes > ring.budgetBytes) {
+        printf("  FAILED: undo %d / redo %d mismatching columns, %d events for %d chunks\n", diff, redoDiff,
+               areaEvents, areaChunks);
+        return 1;
+    }
+    return 0;
+}
+
+struct Bench {
+    const char* name;
+    int (*run)();
+};
+
+const Bench benches[] = {
+    { "world", benchWorld },
+    { "worldgen", benchWorldgen },
+    { "caves", benchCaves },
+    { "decor", benchDecor },
+    { "lockstep", benchLockstep },
+    { "demo", benchDemo },
+    { "relay", benchRelay },
+    { "netio", benchNetIo },
+    { "websocket", benchWebSocket },
+    { "transfer", benchTransfer },
+    { "movecheck", benchMoveCheck },
+    { "aabbtree", benchAabbTree },
+    { "hitbox", benchHitboxes },
+    { "audio", benchAudio },
+    { "script", benchScript },
+    { "snapshot", benchSnapshot },
+    { "autosave", benchAutosave },
+    { "journal", benchJournal },
+    { "undo", benchUndo },
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int failed = 0, ran = 0;
+    for (const Bench& b : benches) {
+        bool selected = argc < 2;
+        for (int i=1; i<argc; ++i) selected = selected || strcmp(argv[i], b.name) == 0;
+        if (!selected) continue;
+        failed += b.run() != 0;
+        ++ran;
+    }
+    if (ran == 0) {
+        printf("unknown benchmark; available:");
+        for (const Bench& b : benches) printf(" %s", b.name);
+        printf("\n");
+        return 1;
+    }
+    return failed ? 1 : 0;
+}
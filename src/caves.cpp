@@ -0,0 +1,176 @@
+#include "caves.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+static_assert(CAVE_LATTICE == 4, "one lattice cell spans the four SIMD lanes");
+
+float hash3(int x, int y, int z, uint32_t seed) {
+    uint32_t n = uint32_t(x) * 73856093u ^ uint32_t(y) * 19349663u ^ uint32_t(z) * 83492791u ^ seed * 2654435761u;
+    n = (n << 13) ^ n;
+    uint32_t m = (n * (n * n * 15731u + 789221u) + 1376312589u) & 0x7fffffffu;
+    return 1.0f - float(m) / 1073741824.0f;
+}
+
+int floorDiv(int a, int b) {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+float smooth(float t) {
+    return t * t * (3.0f - 2.0f * t);
+}
+
+float valueNoise3(int x, int y, int z, int cell, uint32_t seed) {
+    int cx = floorDiv(x, cell), cy = floorDiv(y, cell), cz = floorDiv(z, cell);
+    float inv = 1.0f / float(cell);
+    float fx = smooth((x - cx * cell) * inv), fy = smooth((y - cy * cell) * inv), fz = smooth((z - cz * cell) * inv);
+    float c[2][2];
+    for (int j=0; j<2; ++j) for (int k=0; k<2; ++k) {
+        float a = hash3(cx, cy + j, cz + k, seed), b = hash3(cx + 1, cy + j, cz + k, seed);
+        c[j][k] = a + (b - a) * fx;
+    }
+    float lo = c[0][0] + (c[0][1] - c[0][0]) * fz, hi = c[1][0] + (c[1][1] - c[1][0]) * fz;
+    return lo + (hi - lo) * fy;
+}
+
+void prepare(CaveVolume& v, int x0, int z0, int size, const uint8_t* heights, int maxStack) {
+    v.x0 = x0;
+    v.z0 = z0;
+    v.size = size;
+    v.sections = (maxStack + WORLD_SECTION_LEVELS - 1) / WORLD_SECTION_LEVELS;
+    v.state.assign(v.sections, CAVE_EMPTY);
+    v.bits.assign((size_t(v.sections) * WORLD_SECTION_LEVELS * size * size + 63) / 64, 0);
+    v.heights.assign(heights, heights + size_t(size) * size);
+}
+
+void setBits(CaveVolume& v, int level, int z, int x, int mask) {
+    size_t bit = (size_t(level) * v.size + z) * v.size + x;
+    v.bits[bit >> 6] |= uint64_t(mask) << (bit & 63);
+}
+
+} // namespace
+
+float caveBand(int height, int level) {
+    return CAVE_TUNNEL * std::min(1.0f, float(height - level) * (1.0f / CAVE_ROOF_FADE));
+}
+
+float caveNoise(int x, int level, int z, uint32_t seed) {
+    // levels count double so the tunnels run flatter than they are wide
+    return 0.65f * valueNoise3(x, level * 2, z, 32, seed + 101u) + 0.35f * valueNoise3(x, level * 2, z, 16, seed + 202u);
+}
+
+void caveEvaluate(CaveVolume& v, int x0, int z0, int size, const uint8_t* heights, int maxStack, uint32_t seed,
+                  CaveStats* stats) {
+    prepare(v, x0, z0, size, heights, maxStack);
+    int maxH = 0;
+    for (float h : v.heights) maxH = std::max(maxH, int(h));
+
+    const int L = CAVE_LATTICE, n = size / L + 1, stride = (n + 3) & ~3, ny = WORLD_SECTION_LEVELS / L + 1;
+    // lattice of one section (ny rows of n x n points, rows padded to whole F4s), then one line
+    v.lattice.assign(size_t(ny) * n * stride + stride, 0.0f);
+    float* line = &v.lattice[size_t(ny) * n * stride];
+    auto row = [&](int j, int k) { return &v.lattice[(size_t(j) * n + k) * stride]; };
+    v.reach.resize(size_t(ny - 1) * (n - 1) * (n - 1));
+    uint8_t* reach = v.reach.data();
+    const F4 laneT = f4Set(0.0f, 0.25f, 0.5f, 0.75f), band = f4Splat(CAVE_TUNNEL);
+    const F4 roofFade = f4Splat(1.0f / CAVE_ROOF_FADE);
+
+    for (int s=0; s<v.sections; ++s) {
+        int base = s * WORLD_SECTION_LEVELS;
+        if (base >= maxH) {
+            if (stats) ++stats->sections[CAVE_EMPTY];
+            continue;
+        }
+        // the bottom lattice row is the top row of the section below when that was evaluated
+        int firstRow = 0;
+        if (s > 0 && v.state[s - 1] != CAVE_EMPTY) {
+            std::copy_n(row(ny - 1, 0), size_t(n) * stride, row(0, 0));
+            firstRow = 1;
+        }
+        for (int j=firstRow; j<ny; ++j) for (int k=0; k<n; ++k) {
+            float* r = row(j, k);
+            for (int i=0; i<n; ++i) r[i] = caveNoise(x0 + i * L, base + j * L, z0 + k * L, seed);
+        }
+        if (stats) stats->noiseEvals += uint64_t(ny - firstRow) * n * n;
+        float lo = 1e9f, hi = -1e9f;
+        for (int j=0; j<ny; ++j) for (int k=0; k<n; ++k) {
+            const float* r = row(j, k);
+            for (int i=0; i<n; ++i) {
+                lo = std::min(lo, r[i]);
+                hi = std::max(hi, r[i]);
+            }
+        }
+        bool carve = lo < CAVE_TUNNEL && hi > -CAVE_TUNNEL;
+        v.state[s] = carve ? CAVE_CARVED : CAVE_UNCARVED;
+        if (stats) ++stats->sections[v.state[s]];
+        // the same bound per lattice cell: most cells of a carved section are far from a tunnel
+        for (int j=0; j<ny-1; ++j) for (int k=0; k<n-1; ++k) for (int i=0; i<n-1; ++i) {
+            float clo = 1e9f, chi = -1e9f;
+            for (int c=0; c<8; ++c) {
+                float val = row(j + (c >> 2), k + ((c >> 1) & 1))[i + (c & 1)];
+                clo = std::min(clo, val);
+                chi = std::max(chi, val);
+            }
+            reach[(j * (n - 1) + k) * (n - 1) + i] = clo < CAVE_TUNNEL && chi > -CAVE_TUNNEL;
+        }
+
+        for (int ly=0; ly<WORLD_SECTION_LEVELS && base + ly < maxH; ++ly) {
+            int level = base + ly, j = ly / L;
+            F4 levelF = f4Splat(float(level)), ty = f4Splat(float(ly % L) / L);
+            bool carveLevel = carve && level > 0;  // the bottom level is bedrock
+            for (int lz=0; lz<size; ++lz) {
+                int k = lz / L;
+                if (carveLevel) {
+                    // bilinear in level and z for every lattice column, four at a time
+                    F4 tz = f4Splat(float(lz % L) / L);
+                    const float *a = row(j, k), *b = row(j, k + 1), *c = row(j + 1, k), *d = row(j + 1, k + 1);
+                    for (int i=0; i<stride; i+=4) {
+                        F4 near = f4Load(a + i) + (f4Load(b + i) - f4Load(a + i)) * tz;
+                        F4 far = f4Load(c + i) + (f4Load(d + i) - f4Load(c + i)) * tz;
+                        f4Store(line + i, near + (far - near) * ty);
+                    }
+                }
+                const float* hrow = &v.heights[size_t(lz) * size];
+                for (int cx=0; cx<size/L; ++cx) {
+                    F4 h = f4Load(hrow + cx * L);
+                    int mask = f4MoveMask(f4Less(levelF, h));
+                    if (mask && carveLevel && reach[(j * (n - 1) + k) * (n - 1) + cx]) {
+                        F4 a = f4Splat(line[cx]), b = f4Splat(line[cx + 1]);
+                        F4 noise = a + (b - a) * laneT;
+                        F4 width = band * f4Min(f4Splat(1.0f), (h - levelF) * roofFade);
+                        mask &= ~f4MoveMask(f4Less(f4Abs(noise), width));
+                    }
+                    if (mask) setBits(v, level, lz, cx * L, mask);
+                }
+            }
+        }
+    }
+}
+
+void caveEvaluateNaive(CaveVolume& v, int x0, int z0, int size, const uint8_t* heights, int maxStack,
+                       uint32_t seed, CaveStats* stats) {
+    prepare(v, x0, z0, size, heights, maxStack);
+    for (int z=0; z<size; ++z) for (int x=0; x<size; ++x) {
+        int h = heights[z * size + x];
+        for (int level=0; level<h; ++level) {
+            bool carved = false;
+            if (level > 0) {
+                carved = fabsf(caveNoise(x0 + x, level, z0 + z, seed)) < caveBand(h, level);
+                if (stats) ++stats->noiseEvals;
+            }
+            if (!carved) setBits(v, level, z, x, 1);
+            v.state[level / WORLD_SECTION_LEVELS] = CAVE_CARVED;
+        }
+    }
+    if (stats) for (uint8_t s : v.state) ++stats->sections[s];
+}
+
+void caveApplyToHeights(const CaveVolume& v, uint8_t* heights) {
+    for (int z=0; z<v.size; ++z) for (int x=0; x<v.size; ++x) {
+        uint8_t& h = heights[z * v.size + x];
+        while (h > 1 && !caveSolid(v, x, h - 1, z)) --h;
+    }
+}
@@ -0,0 +1,69 @@
+// Caves from a 3D density field, carved out of the generated terrain.
+//
+// The density is two octaves of 3D value noise; a voxel under the terrain surface is carved
+// where |noise| < caveBand(), which gives connected, winding tunnels. Noise per voxel is the
+// dominant cost, so caveEvaluate() computes it on a lattice every CAVE_LATTICE voxels and
+// interpolates trilinearly, four voxels per SIMD operation (simd.h). Vertical sections of
+// WORLD_SECTION_LEVELS levels skip the interpolation when they lie above the terrain (empty)
+// or when the lattice values around them cannot reach the tunnel band (solid up to the
+// surface), and so do the lattice cells inside a section. An interpolated value never
+// leaves the range of its corners, so these early-outs are exact. caveEvaluateNaive()
+// evaluates the noise at every voxel, as the reference.
+//
+// The world keeps one height per column, so caveApplyToHeights() can only show the caves
+// that break through the surface: each column drops to its topmost solid voxel below the
+// open air. Tunnels under a solid roof stay in the volume.
+#pragma once
+
+#include "world.h"
+
+#include <cstdint>
+#include <vector>
+
+const int CAVE_LATTICE = 4;        // voxels between lattice points on every axis
+const int CAVE_MIN_STACK = 16;     // maps with less headroom are not carved
+const float CAVE_TUNNEL = 0.09f;   // half width of the carved noise band
+const float CAVE_ROOF_FADE = 6.0f; // the band narrows over this many levels below the surface
+
+enum CaveSectionState : uint8_t {
+    CAVE_EMPTY,      // above the terrain, nothing evaluated
+    CAVE_UNCARVED,   // lattice out of the tunnel band: solid up to the surface
+    CAVE_CARVED,     // interpolated voxel by voxel
+    CAVE_STATE_COUNT
+};
+
+// Solid voxels of size x size columns, bit ((level * size + z) * size + x).
+struct CaveVolume {
+    int x0 = 0, z0 = 0, size = 0, sections = 0;
+    std::vector<uint8_t> state;     // CaveSectionState per section
+    std::vector<uint64_t> bits;
+    std::vector<float> lattice, heights;  // scratch
+    std::vector<uint8_t> reach;
+};
+
+struct CaveStats {
+    uint64_t sections[CAVE_STATE_COUNT] = {};
+    uint64_t noiseEvals = 0;
+};
+
+// Density noise at one voxel, roughly in [-1, 1].
+float caveNoise(int x, int level, int z, uint32_t seed);
+// Half width of the tunnel band at a level of a column; tunnels pinch towards the surface so
+// only a few break through it.
+float caveBand(int height, int level);
+
+// Fills v for the columns [x0, x0+size) x [z0, z0+size) with the given terrain heights
+// (row-major). x0, z0 and size must be multiples of CAVE_LATTICE.
+void caveEvaluate(CaveVolume& v, int x0, int z0, int size, const uint8_t* heights, int maxStack, uint32_t seed,
+                  CaveStats* stats = nullptr);
+void caveEvaluateNaive(CaveVolume& v, int x0, int z0, int size, const uint8_t* heights, int maxStack,
+                       uint32_t seed, CaveStats* stats = nullptr);
+
+inline bool caveSolid(const CaveVolume& v, int x, int level, int z) {
+    size_t bit = (size_t(level) * v.size + z) * v.size + x;
+    return (v.bits[bit >> 6] >> (bit & 63)) & 1;
+}
+
+// Lowers every column of heights (same layout as evaluated) to the top of its solid voxels
+// below the open air.
+void caveApplyToHeights(const CaveVolume& v, uint8_t* heights);
@@ -0,0 +1,91 @@
+#include "chunk_codec.h"
+
+#include <algorithm>
+
+namespace {
+
+const uint8_t MODE_RLE = 0;  // 1..8: bit-packed with that many bits per cell
+
+size_t packedBytes(int count, int bits) { return (size_t(count) * bits + 7) / 8; }
+
+} // namespace
+
+void chunkEncode(const uint8_t* cells, int count, std::vector<uint8_t>& out) {
+    size_t start = out.size();
+    out.push_back(MODE_RLE);
+    uint8_t maxValue = 0;
+    int i = 0;
+    while (i < count) {
+        uint8_t v = cells[i];
+        int run = 1;
+        while (i + run < count && cells[i + run] == v) ++run;
+        out.push_back(v);
+        putVarint(out, uint32_t(run));
+        maxValue = std::max(maxValue, v);
+        i += run;
+    }
+    int bits = 1;
+    while (bits < 8 && (maxValue >> bits) != 0) ++bits;
+    if (1 + packedBytes(count, bits) >= out.size() - start) return;
+
+    out.resize(start);
+    out.push_back(uint8_t(bits));
+    uint32_t acc = 0;
+    int filled = 0;
+    for (int k=0; k<count; ++k) {
+        acc |= uint32_t(cells[k]) << filled;
+        filled += bits;
+        while (filled >= 8) { out.push_back(uint8_t(acc)); acc >>= 8; filled -= 8; }
+    }
+    if (filled > 0) out.push_back(uint8_t(acc));
+}
+
+size_t chunkDecode(const uint8_t* data, size_t size, uint8_t* cells, int count) {
+    if (size < 1) return 0;
+    uint8_t mode = data[0];
+    size_t pos = 1;
+    if (mode != MODE_RLE) {
+        if (mode > 8 || size < 1 + packedBytes(count, mode)) return 0;
+        uint32_t acc = 0, mask = (1u << mode) - 1;
+        int filled = 0;
+        for (int k=0; k<count; ++k) {
+            while (filled < mode) { acc |= uint32_t(data[pos++]) << filled; filled += 8; }
+            cells[k] = uint8_t(acc & mask);
+            acc >>= mode;
+            filled -= mode;
+        }
+        return pos;
+    }
+    int i = 0;
+    while (i < count) {
+        if (pos >= size) return 0;
+        uint8_t v = data[pos++];
+        uint32_t run;
+        if (!getVarint(data, size, &pos, &run) || run == 0 || run > uint32_t(count - i)) return 0;
+        for (uint32_t k=0; k<run; ++k) cells[i++] = v;
+    }
+    return pos;
+}
+
+namespace {
+
+struct Crc32Table {
+    uint32_t t[256];
+    Crc32Table() {
+        for (uint32_t i=0; i<256; ++i) {
+            uint32_t c = i;
+            for (int k=0; k<8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+    }
+};
+
+} // namespace
+
+uint32_t crc32(const void* data, size_t size, uint32_t crc) {
+    static const Crc32Table table;
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    crc = ~crc;
+    for (size_t i=0; i<size; ++i) crc = table.t[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
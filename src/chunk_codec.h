@@ -0,0 +1,46 @@
+// Compact byte encodings shared by saves, undo history and network transfer.
+//
+// Chunk cells are stored either run-length encoded as (value, varint run) pairs, which wins
+// on flat ground and open water, or bit-packed with just enough bits for the largest value,
+// which wins on noisy terrain. The encoder keeps whichever is smaller (one mode byte).
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+inline void putVarint(std::vector<uint8_t>& out, uint32_t v) {
+    while (v >= 0x80) { out.push_back(uint8_t(v | 0x80)); v >>= 7; }
+    out.push_back(uint8_t(v));
+}
+
+// Returns false on truncated or over-long input; advances *pos past the varint.
+inline bool getVarint(const uint8_t* data, size_t size, size_t* pos, uint32_t* v) {
+    uint32_t r = 0;
+    for (int shift=0; shift<35; shift+=7) {
+        if (*pos >= size) return false;
+        uint8_t b = data[(*pos)++];
+        r |= uint32_t(b & 0x7f) << shift;
+        if (!(b & 0x80)) { *v = r; return true; }
+    }
+    return false;
+}
+
+inline void putU32(std::vector<uint8_t>& out, uint32_t v) {
+    for (int i=0; i<4; ++i) out.push_back(uint8_t(v >> (8*i)));
+}
+// Overwrites four bytes already in a buffer, little-endian like putU32().
+inline void setU32(uint8_t* p, uint32_t v) {
+    for (int i=0; i<4; ++i) p[i] = uint8_t(v >> (8*i));
+}
+inline uint32_t getU32(const uint8_t* p) {
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+// Appends the encoding of count cells to out.
+void chunkEncode(const uint8_t* cells, int count, std::vector<uint8_t>& out);
+// Decodes exactly count cells; returns the number of input bytes used, 0 on malformed input.
+size_t chunkDecode(const uint8_t* data, size_t size, uint8_t* cells, int count);
+
+// CRC-32 (IEEE), chainable: crc32(b, nb, crc32(a, na)) == crc32(a+b).
+uint32_t crc32(const void* data, size_t size, uint32_t crc = 0);
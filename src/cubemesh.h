@@ -0,0 +1,36 @@
+// Precomputed unit-cube tables shared by every box/voxel mesher.
+#pragma once
+
+// Corner index bits: bit0 = +x, bit1 = +y, bit2 = +z.
+struct CubeFace {
+    int nx, ny, nz;          // outward normal, also the neighbour that hides this face
+    unsigned char corner[4]; // counter-clockwise seen from outside
+    float shade;             // fixed directional shading baked into vertex colours
+};
+
+constexpr CubeFace kCubeFaces[6] = {
+    {  1, 0, 0, {1,3,7,5}, 0.8f },
+    { -1, 0, 0, {0,4,6,2}, 0.8f },
+    {  0, 1, 0, {2,6,7,3}, 1.0f },
+    {  0,-1, 0, {0,1,5,4}, 0.5f },
+    {  0, 0, 1, {4,5,7,6}, 0.9f },
+    {  0, 0,-1, {0,2,3,1}, 0.7f },
+};
+
+// Face corners of a unit cube spanning [0,1]^3, 6 faces x 4 corners x xyz.
+struct CubeFaceCorners { float v[6][4][3]; };
+
+constexpr CubeFaceCorners buildCubeFaceCorners() {
+    CubeFaceCorners t{};
+    for (int f=0; f<6; ++f) for (int k=0; k<4; ++k) {
+        int c = kCubeFaces[f].corner[k];
+        t.v[f][k][0] = (c & 1) ? 1.0f : 0.0f;
+        t.v[f][k][1] = (c & 2) ? 1.0f : 0.0f;
+        t.v[f][k][2] = (c & 4) ? 1.0f : 0.0f;
+    }
+    return t;
+}
+inline constexpr CubeFaceCorners kCubeFaceCorners = buildCubeFaceCorners();
+
+// Two triangles per face quad.
+constexpr unsigned short kQuadIndices[6] = { 0, 1, 2, 2, 3, 0 };
@@ -0,0 +1,252 @@
+#include "decoration_render.h"
+#include "cubemesh.h"
+#include "decorations.h"
+#include "glutil.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+const char* decorVertexSrc = R"(#version 300 es
+in vec3 aPos;
+in vec3 aColor;
+in vec4 aInst;    // position, scale
+in vec2 aInst2;   // yaw, brightness
+uniform mat4 uVP;
+out vec3 vColor;
+void main() {
+    float c = cos(aInst2.x), s = sin(aInst2.x);
+    vec3 p = aPos * aInst.w;
+    p = vec3(c * p.x - s * p.z, p.y, s * p.x + c * p.z);
+    vColor = aColor * aInst2.y;
+    gl_Position = uVP * vec4(aInst.xyz + p, 1.0);
+}
+)";
+
+const char* decorFragSrc = R"(#version 300 es
+precision mediump float;
+in vec3 vColor;
+out vec4 fragColor;
+void main(){
+    fragColor = vec4(vColor, 1.0);
+}
+)";
+
+// Kinds drawn here; prefabs are part of the terrain.
+const int FIRST_DRAWN = DECOR_TREE;
+const int DRAWN_KINDS = DECOR_KIND_COUNT - FIRST_DRAWN;
+const uint32_t DRAWN_MASK = DECOR_ALL & ~(1u << DECOR_PREFAB);
+const int INSTANCE_FLOATS = 6;
+
+// Models in block units, standing on y = 0.
+struct DecorBox {
+    Vec3 lo, hi, color;
+};
+
+const Vec3 kBark(0.45f, 0.3f, 0.15f), kLeaves(0.25f, 0.55f, 0.2f), kNeedles(0.12f, 0.35f, 0.2f);
+const Vec3 kStone(0.5f, 0.5f, 0.52f);
+const DecorBox kTreeBoxes[] = {
+    { Vec3(-0.12f, 0.0f, -0.12f), Vec3(0.12f, 1.1f, 0.12f), kBark },
+    { Vec3(-0.55f, 0.9f, -0.55f), Vec3(0.55f, 1.9f, 0.55f), kLeaves },
+    { Vec3(-0.35f, 1.9f, -0.35f), Vec3(0.35f, 2.3f, 0.35f), kLeaves },
+};
+const DecorBox kPineBoxes[] = {
+    { Vec3(-0.1f, 0.0f, -0.1f), Vec3(0.1f, 0.6f, 0.1f), kBark },
+    { Vec3(-0.55f, 0.5f, -0.55f), Vec3(0.55f, 1.2f, 0.55f), kNeedles },
+    { Vec3(-0.4f, 1.1f, -0.4f), Vec3(0.4f, 1.8f, 0.4f), kNeedles },
+    { Vec3(-0.22f, 1.7f, -0.22f), Vec3(0.22f, 2.4f, 0.22f), kNeedles },
+};
+const DecorBox kRockBoxes[] = {
+    { Vec3(-0.35f, -0.05f, -0.28f), Vec3(0.35f, 0.3f, 0.28f), kStone },
+    { Vec3(0.1f, -0.05f, -0.1f), Vec3(0.45f, 0.18f, 0.25f), kStone },
+};
+
+struct DecorModel {
+    const DecorBox* boxes;
+    int count;
+};
+const DecorModel kModels[DRAWN_KINDS] = {
+    { kTreeBoxes, int(sizeof(kTreeBoxes) / sizeof(kTreeBoxes[0])) },
+    { kPineBoxes, int(sizeof(kPineBoxes) / sizeof(kPineBoxes[0])) },
+    { kRockBoxes, int(sizeof(kRockBoxes) / sizeof(kRockBoxes[0])) },
+};
+
+struct ChunkDecor {
+    bool generated = false;
+    bool stale = false;                         // column heights changed since the instances were built
+    std::vector<Decoration> items;
+    std::vector<float> instances[DRAWN_KINDS];  // INSTANCE_FLOATS per decoration still standing
+};
+
+GLuint decorProg = 0;
+GLint locVP = -1, attrPos = -1, attrColor = -1, attrInst = -1, attrInst2 = -1;
+GLuint meshVbo = 0, meshIbo = 0, instanceVbo = 0;
+GLsizei modelFirstIndex[DRAWN_KINDS], modelIndexCount[DRAWN_KINDS];
+GLsizei kindFirst[DRAWN_KINDS], kindCount[DRAWN_KINDS];
+
+std::vector<ChunkDecor> chunks;
+uint32_t decoratedSeed = 0;
+int undecorated = 0;
+bool started = false, dirty = false;
+std::vector<float> staging;
+int profDecor = -1, profChunks = -1, profDraw = -1;
+
+void buildModels() {
+    std::vector<float> verts;
+    std::vector<unsigned short> idx;
+    for (int m=0; m<DRAWN_KINDS; ++m) {
+        modelFirstIndex[m] = GLsizei(idx.size());
+        for (int b=0; b<kModels[m].count; ++b) {
+            const DecorBox& box = kModels[m].boxes[b];
+            for (int f=0; f<6; ++f) {
+                unsigned short base = (unsigned short)(verts.size() / 6);
+                for (int k=0; k<4; ++k) {
+                    int c = kCubeFaces[f].corner[k];
+                    Vec3 col = box.color * kCubeFaces[f].shade;
+                    float v[6] = { (c&1) ? box.hi.x : box.lo.x, (c&2) ? box.hi.y : box.lo.y,
+                                   (c&4) ? box.hi.z : box.lo.z, col.x, col.y, col.z };
+                    verts.insert(verts.end(), v, v + 6);
+                }
+                for (unsigned short q : kQuadIndices) idx.push_back((unsigned short)(base + q));
+            }
+        }
+        modelIndexCount[m] = GLsizei(idx.size()) - modelFirstIndex[m];
+    }
+    glGenBuffers(1, &meshVbo);
+    glBindBuffer(GL_ARRAY_BUFFER, meshVbo);
+    glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(float), verts.data(), GL_STATIC_DRAW);
+    glGenBuffers(1, &meshIbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshIbo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, idx.size() * sizeof(unsigned short), idx.data(), GL_STATIC_DRAW);
+}
+
+// Seats a chunk's decorations on the current column tops; sunk columns lose theirs.
+void buildInstances(const World& w, ChunkDecor& c) {
+    const float B = w.cfg.blockSize;
+    for (std::vector<float>& v : c.instances) v.clear();
+    for (const Decoration& d : c.items) {
+        int h = worldHeight(w, int(floorf(d.gx + 0.5f)), int(floorf(d.gz + 0.5f)));
+        if (h == 0) continue;
+        float inst[INSTANCE_FLOATS] = { (d.gx - w.cfg.gridW / 2) * B, h * B, (d.gz - w.cfg.gridH / 2) * B,
+                                        d.scale * B, d.yaw, 0.85f + 0.1f * d.variant };
+        std::vector<float>& v = c.instances[d.kind - FIRST_DRAWN];
+        v.insert(v.end(), inst, inst + INSTANCE_FLOATS);
+    }
+    c.stale = false;
+    dirty = true;
+}
+
+void decorateChunk(const World& w, uint32_t seed, int chunk) {
+    const int S = w.cfg.chunkSize;
+    ChunkDecor& c = chunks[chunk];
+    decorateArea(w.cfg, seed, (chunk % w.chunksX) * S, (chunk / w.chunksX) * S, S, S, c.items, DRAWN_MASK);
+    c.generated = true;
+    --undecorated;
+    buildInstances(w, c);
+}
+
+void onWorldEdit(const World&, const WorldEdit& e, void*) {
+    if (e.chunk < int(chunks.size()) && chunks[e.chunk].generated) chunks[e.chunk].stale = true;
+}
+
+// One buffer, kind after kind, so every kind is a single instanced draw.
+void uploadInstances() {
+    staging.clear();
+    for (int k=0; k<DRAWN_KINDS; ++k) {
+        kindFirst[k] = GLsizei(staging.size() / INSTANCE_FLOATS);
+        for (const ChunkDecor& c : chunks) staging.insert(staging.end(), c.instances[k].begin(), c.instances[k].end());
+        kindCount[k] = GLsizei(staging.size() / INSTANCE_FLOATS) - kindFirst[k];
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+    glBufferData(GL_ARRAY_BUFFER, staging.size() * sizeof(float), staging.data(), GL_DYNAMIC_DRAW);
+    dirty = false;
+}
+
+} // namespace
+
+void decorRenderInit(World& w) {
+    decorProg = buildProgram(decorVertexSrc, decorFragSrc);
+    locVP = glGetUniformLocation(decorProg, "uVP");
+    attrPos = glGetAttribLocation(decorProg, "aPos");
+    attrColor = glGetAttribLocation(decorProg, "aColor");
+    attrInst = glGetAttribLocation(decorProg, "aInst");
+    attrInst2 = glGetAttribLocation(decorProg, "aInst2");
+    buildModels();
+    glGenBuffers(1, &instanceVbo);
+    worldSubscribe(w, onWorldEdit, nullptr);
+    started = false;
+    profDecor = profilerSlot("decor");
+    profChunks = profilerSlot("decor.chunks");
+    profDraw = profilerSlot("decor.draw");
+}
+
+void decorRenderUpdate(const World& w, uint32_t seed, float playerX, float playerZ) {
+    ProfileScope scope(profDecor);
+    if (!started || seed != decoratedSeed || chunks.size() != w.chunks.size()) {
+        chunks.assign(w.chunks.size(), ChunkDecor());
+        decoratedSeed = seed;
+        undecorated = int(chunks.size());
+        started = true;
+        dirty = true;
+    }
+
+    // rings of chunks around the player's, nearest first
+    const int S = w.cfg.chunkSize;
+    int pcx = std::min(std::max(worldToGridX(w, playerX) / S, 0), w.chunksX - 1);
+    int pcz = std::min(std::max(worldToGridZ(w, playerZ) / S, 0), w.chunksZ - 1);
+    int budget = DECOR_CHUNKS_PER_FRAME, rings = std::max(w.chunksX, w.chunksZ);
+    for (int ring=0; ring<rings && undecorated > 0 && budget > 0; ++ring) {
+        for (int cz=pcz-ring; cz<=pcz+ring && budget > 0; ++cz) {
+            if (cz < 0 || cz >= w.chunksZ) continue;
+            bool edge = abs(cz - pcz) == ring;
+            for (int cx=pcx-ring; cx<=pcx+ring && budget > 0; cx += (edge || ring == 0) ? 1 : 2 * ring) {
+                if (cx < 0 || cx >= w.chunksX) continue;
+                int chunk = cz * w.chunksX + cx;
+                if (chunks[chunk].generated) continue;
+                decorateChunk(w, seed, chunk);
+                --budget;
+            }
+        }
+    }
+    profilerAddCount(profChunks, DECOR_CHUNKS_PER_FRAME - budget);
+
+    for (ChunkDecor& c : chunks) if (c.stale) buildInstances(w, c);
+    if (dirty) uploadInstances();
+}
+
+void decorRenderDraw(const Mat4& vp) {
+    if (!decorProg) return;
+    ProfileScope scope(profDraw);
+    glUseProgram(decorProg);
+    glUniformMatrix4fv(locVP, 1, GL_FALSE, vp.m);
+    glBindBuffer(GL_ARRAY_BUFFER, meshVbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshIbo);
+    glEnableVertexAttribArray(attrPos);
+    glVertexAttribPointer(attrPos, 3, GL_FLOAT, GL_FALSE, sizeof(float)*6, (void*)(0));
+    glEnableVertexAttribArray(attrColor);
+    glVertexAttribPointer(attrColor, 3, GL_FLOAT, GL_FALSE, sizeof(float)*6, (void*)(sizeof(float)*3));
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+    glEnableVertexAttribArray(attrInst);
+    glEnableVertexAttribArray(attrInst2);
+    glVertexAttribDivisor(attrInst, 1);
+    glVertexAttribDivisor(attrInst2, 1);
+    const GLsizei stride = sizeof(float) * INSTANCE_FLOATS;
+    for (int k=0; k<DRAWN_KINDS; ++k) {
+        if (kindCount[k] == 0) continue;
+        size_t base = size_t(kindFirst[k]) * stride;
+        glVertexAttribPointer(attrInst, 4, GL_FLOAT, GL_FALSE, stride, (void*)(base));
+        glVertexAttribPointer(attrInst2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(base + sizeof(float)*4));
+        glDrawElementsInstanced(GL_TRIANGLES, modelIndexCount[k], GL_UNSIGNED_SHORT,
+                                (void*)(size_t(modelFirstIndex[k]) * sizeof(unsigned short)), kindCount[k]);
+    }
+    glVertexAttribDivisor(attrInst, 0);
+    glVertexAttribDivisor(attrInst2, 0);
+    glDisableVertexAttribArray(attrPos);
+    glDisableVertexAttribArray(attrColor);
+    glDisableVertexAttribArray(attrInst);
+    glDisableVertexAttribArray(attrInst2);
+}
@@ -0,0 +1,18 @@
+// Instanced drawing of the decorations that are not part of the terrain (trees, pines and
+// rocks from decorations.h): one box mesh per kind and one instanced draw per kind.
+//
+// Chunks are decorated lazily, nearest to the player first and at most
+// DECOR_CHUNKS_PER_FRAME per frame. Placement depends only on the seed, so an edit merely
+// re-seats the decorations of its chunk on the new column heights.
+#pragma once
+
+#include "vecmath.h"
+#include "world.h"
+
+const int DECOR_CHUNKS_PER_FRAME = 16;
+
+void decorRenderInit(World& w);
+
+// Decorates chunks around the player and refreshes the instance buffer; a new seed starts over.
+void decorRenderUpdate(const World& w, uint32_t seed, float playerX, float playerZ);
+void decorRenderDraw(const Mat4& vp);
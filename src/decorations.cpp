@@ -0,0 +1,213 @@
+#include "decorations.h"
+#include "worldgen.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+struct DecorClass {
+    float radius;      // minimum distance between two decorations of the kind
+    float clearance;   // lower kinds stay at least this far away
+    float density[BIOME_COUNT];  // share of the candidates kept, per biome
+};
+
+//                                        ocean  beach  plains forest desert tundra mountains
+const DecorClass kDecorClasses[DECOR_KIND_COUNT] = {
+    { 20.0f, 5.0f, { 0.0f,  0.0f,  0.5f,  0.3f,  0.6f,  0.2f,  0.0f } },   // prefab
+    { 2.5f,  1.5f, { 0.0f,  0.0f,  0.15f, 0.85f, 0.0f,  0.0f,  0.0f } },   // tree
+    { 2.5f,  1.5f, { 0.0f,  0.0f,  0.0f,  0.15f, 0.0f,  0.5f,  0.25f } },  // pine
+    { 3.5f,  0.0f, { 0.0f,  0.15f, 0.15f, 0.1f,  0.3f,  0.4f,  0.6f } },   // rock
+};
+
+// Footprints of size x size columns, row by row: a digit raises the column by that many
+// levels, '.' leaves it alone.
+struct Prefab {
+    const char* name;
+    int size;
+    const char* rows;
+};
+
+const Prefab kPrefabs[] = {
+    { "ruin", 7, "2222.22" "2.....2" "2.....2" "......." "2.....2" "2.....2" "22.2222" },
+    { "tower", 5, ".111." "13331" "13531" "13331" ".111." },
+    { "cairn", 5, "..1.." ".121." "12321" ".121." "..1.." },
+};
+const int PREFAB_COUNT = int(sizeof(kPrefabs) / sizeof(kPrefabs[0]));
+
+struct Candidate {
+    float x, z;
+    uint32_t rank;  // priority; also feeds the filter and the variations
+    bool alive;     // passed the biome filter
+};
+
+uint32_t mix(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+uint32_t cellHash(int i, int k, int kind, uint32_t seed) {
+    return mix(mix(uint32_t(i) * 0x8da6b343u + uint32_t(k)) ^ (uint32_t(kind) * 0xcb1ab31fu + seed * 0x9e3779b9u));
+}
+
+float unit16(uint32_t bits) {
+    return float(bits & 0xffffu) * (1.0f / 65536.0f);
+}
+
+// Same as the pipeline's biome layer, for a single column.
+Biome biomeAtColumn(const WorldConfig& cfg, int x, int z, uint32_t seed) {
+    float c = continentAt(x, z, cfg.gridW, cfg.gridH, seed);
+    return biomeFor(c, climateAt(x, z, c, seed));
+}
+
+int roundColumn(float v) {
+    return int(floorf(v + 0.5f));
+}
+
+// Ties cannot depend on evaluation order, so equal ranks fall back to the position.
+bool outranks(const Candidate& a, const Candidate& b) {
+    if (a.rank != b.rank) return a.rank > b.rank;
+    if (a.x != b.x) return a.x > b.x;
+    return a.z > b.z;
+}
+
+Decoration makeDecoration(const Candidate& c, int kind) {
+    uint32_t v = mix(c.rank ^ 0x5bd1e995u);
+    Decoration d;
+    d.gx = c.x;
+    d.gz = c.z;
+    d.yaw = unit16(v) * 6.2831853f;
+    d.scale = 0.8f + 0.4f * unit16(v >> 16);
+    d.kind = uint8_t(kind);
+    d.variant = uint8_t(kind == DECOR_PREFAB ? (v >> 4) % PREFAB_COUNT : (v >> 28) & 3);
+    d.turns = uint8_t((v >> 12) & 3);
+    return d;
+}
+
+// Footprint cell (c, r) of a prefab turned by `turns` quarter turns.
+char prefabCell(const Prefab& p, int c, int r, int turns) {
+    int n = p.size - 1, sc = c, sr = r;
+    switch (turns & 3) {
+    case 1: sc = r; sr = n - c; break;
+    case 2: sc = n - c; sr = n - r; break;
+    case 3: sc = n - r; sr = c; break;
+    default: break;
+    }
+    return p.rows[sr * p.size + sc];
+}
+
+} // namespace
+
+float decorMinDistance(int kindA, int kindB) {
+    if (kindA == kindB) return kDecorClasses[kindA].radius;
+    return kDecorClasses[std::min(kindA, kindB)].clearance;
+}
+
+int decorPrefabCount() {
+    return PREFAB_COUNT;
+}
+
+const char* decorPrefabName(int prefab) {
+    return kPrefabs[prefab].name;
+}
+
+void decorateArea(const WorldConfig& cfg, uint32_t seed, int x0, int z0, int width, int depth,
+                  std::vector<Decoration>& out, uint32_t kindMask, DecorStats* stats) {
+    if (!kindMask) return;
+    int last = 31 - __builtin_clz(kindMask & DECOR_ALL);
+    // kind k is needed over the area grown by the clearances of the kinds between it and the last
+    float margin[DECOR_KIND_COUNT] = {};
+    for (int k=last-1; k>=0; --k) margin[k] = margin[k + 1] + kDecorClasses[k].clearance;
+
+    std::vector<Decoration> placed[DECOR_KIND_COUNT];
+    std::vector<Candidate> grid;
+    uint64_t candidates = 0, tests = 0;
+    for (int kind=0; kind<=last; ++kind) {
+        const DecorClass& dc = kDecorClasses[kind];
+        const float r = dc.radius, r2 = r * r, cell = r * 0.70710678f;
+        const float ax = x0 - margin[kind], bx = x0 + width + margin[kind];
+        const float az = z0 - margin[kind], bz = z0 + depth + margin[kind];
+        // every candidate that can contest one inside [ax, bx) x [az, bz)
+        const int i0 = int(floorf((ax - r) / cell)), i1 = int(floorf((bx + r) / cell));
+        const int k0 = int(floorf((az - r) / cell)), k1 = int(floorf((bz + r) / cell));
+        const int nw = i1 - i0 + 1, nh = k1 - k0 + 1, reach = int(ceilf(r / cell));
+        const float densest = *std::max_element(dc.density, dc.density + BIOME_COUNT);
+        grid.resize(size_t(nw) * nh);
+        for (int k=k0; k<=k1; ++k) for (int i=i0; i<=i1; ++i) {
+            uint32_t h = cellHash(i, k, kind, seed);
+            Candidate& c = grid[(k - k0) * nw + (i - i0)];
+            c.x = (float(i) + unit16(h)) * cell;
+            c.z = (float(k) + unit16(h >> 16)) * cell;
+            c.rank = mix(h ^ 0x27d4eb2fu);
+            // the biome costs more than everything else here, so it is looked up last
+            int gx = roundColumn(c.x), gz = roundColumn(c.z);
+            float keep = unit16(c.rank);
+            c.alive = gx >= 0 && gx < cfg.gridW && gz >= 0 && gz < cfg.gridH && keep < densest &&
+                      keep < dc.density[biomeAtColumn(cfg, gx, gz, seed)];
+        }
+        candidates += uint64_t(nw) * nh;
+
+        for (int k=0; k<nh; ++k) for (int i=0; i<nw; ++i) {
+            const Candidate& c = grid[k * nw + i];
+            if (!c.alive || c.x < ax || c.x >= bx || c.z < az || c.z >= bz) continue;
+            bool keep = true;
+            for (int dk=-reach; dk<=reach && keep; ++dk) for (int di=-reach; di<=reach && keep; ++di) {
+                int ni = i + di, nk = k + dk;
+                if ((di == 0 && dk == 0) || ni < 0 || ni >= nw || nk < 0 || nk >= nh) continue;
+                const Candidate& o = grid[nk * nw + ni];
+                if (!o.alive) continue;
+                ++tests;
+                float dx = o.x - c.x, dz = o.z - c.z;
+                keep = dx*dx + dz*dz >= r2 || !outranks(o, c);
+            }
+            for (int j=0; j<kind && keep; ++j) {
+                float c2 = kDecorClasses[j].clearance * kDecorClasses[j].clearance;
+                for (const Decoration& d : placed[j]) {
+                    ++tests;
+                    float dx = d.gx - c.x, dz = d.gz - c.z;
+                    if (dx*dx + dz*dz < c2) { keep = false; break; }
+                }
+            }
+            if (keep) placed[kind].push_back(makeDecoration(c, kind));
+        }
+    }
+
+    for (int kind=0; kind<=last; ++kind) {
+        if (!(kindMask & (1u << kind))) continue;
+        for (const Decoration& d : placed[kind]) {
+            if (d.gx < x0 || d.gx >= x0 + width || d.gz < z0 || d.gz >= z0 + depth) continue;
+            out.push_back(d);
+            if (stats) ++stats->placed[kind];
+        }
+    }
+    if (stats) {
+        ++stats->areas;
+        stats->candidates += candidates;
+        stats->tests += tests;
+    }
+}
+
+void decorStampPrefabs(World& w, uint32_t seed, int chunk, DecorStats* stats) {
+    const int S = w.cfg.chunkSize, reach = DECOR_PREFAB_SIZE / 2 + 1;
+    const int cx0 = (chunk % w.chunksX) * S, cz0 = (chunk / w.chunksX) * S;
+    // prefabs standing up to half a footprint outside the chunk still cover some of it
+    std::vector<Decoration> prefabs;
+    decorateArea(w.cfg, seed, cx0 - reach, cz0 - reach, S + 2 * reach, S + 2 * reach, prefabs,
+                 1u << DECOR_PREFAB, stats);
+    for (const Decoration& d : prefabs) {
+        const Prefab& p = kPrefabs[d.variant];
+        int ox = roundColumn(d.gx) - p.size / 2, oz = roundColumn(d.gz) - p.size / 2;
+        for (int r=0; r<p.size; ++r) for (int c=0; c<p.size; ++c) {
+            int gx = ox + c, gz = oz + r;
+            if (gx < cx0 || gx >= cx0 + S || gz < cz0 || gz >= cz0 + S) continue;
+            char raise = prefabCell(p, c, r, d.turns);
+            int h = worldHeight(w, gx, gz);
+            if (raise < '1' || raise > '9' || h == 0) continue;
+            worldSetHeight(w, gx, gz, std::min(h + (raise - '0'), w.cfg.maxStack));
+        }
+    }
+}
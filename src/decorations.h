@@ -0,0 +1,56 @@
+// Decorations: trees, rocks and prefab structures scattered over the generated terrain.
+//
+// Every kind is a Poisson-disk sample of its own: one jittered candidate per grid cell of
+// radius/sqrt(2) columns, with a priority and a biome filter that are pure functions of the
+// cell and the seed. A candidate is placed when it survives the filter and outranks every
+// surviving candidate of its kind within the radius, so no two placed decorations of a kind
+// are closer than that. Kinds are resolved in priority order (prefabs, trees, pines, rocks)
+// and a lower kind also keeps out of the clearance of the higher ones. Deciding a candidate
+// only looks at the candidates around it, never at what was placed first, so any rectangle
+// can be decorated on its own and chunks agree across their borders without generating
+// their neighbours. The work per chunk is bounded by the cells in the chunk plus a fixed margin.
+//
+// Prefabs are small relief stamps written into the column heights during generation; the
+// other kinds are only drawn (decoration_render.h), so they cost nothing in the world data.
+#pragma once
+
+#include "world.h"
+
+#include <cstdint>
+#include <vector>
+
+enum DecorKind : uint8_t { DECOR_PREFAB, DECOR_TREE, DECOR_PINE, DECOR_ROCK, DECOR_KIND_COUNT };
+const uint32_t DECOR_ALL = (1u << DECOR_KIND_COUNT) - 1;
+
+const int DECOR_PREFAB_SIZE = 7;   // prefab footprints are at most this many columns across
+
+struct Decoration {
+    float gx, gz;       // grid position; the decoration stands on column (round(gx), round(gz))
+    float yaw, scale;
+    uint8_t kind;       // DecorKind
+    uint8_t variant;    // prefab index, or model variation
+    uint8_t turns;      // prefabs: quarter turns of the footprint
+};
+
+struct DecorStats {
+    uint64_t areas = 0;
+    uint64_t candidates = 0;   // cells evaluated, margins included
+    uint64_t tests = 0;        // distance tests
+    uint64_t placed[DECOR_KIND_COUNT] = {};
+};
+
+// Closest two placed decorations of these kinds can be (the radius of a kind with itself,
+// the higher kind's clearance otherwise).
+float decorMinDistance(int kindA, int kindB);
+
+int decorPrefabCount();
+const char* decorPrefabName(int prefab);
+
+// Appends the decorations of the kinds in kindMask whose position lies in
+// [x0, x0+width) x [z0, z0+depth), in kind order.
+void decorateArea(const WorldConfig& cfg, uint32_t seed, int x0, int z0, int width, int depth,
+                  std::vector<Decoration>& out, uint32_t kindMask = DECOR_ALL, DecorStats* stats = nullptr);
+
+// Raises the columns of one chunk under the prefabs that overlap it, relative to each
+// column's generated height. Called once per chunk from worldGenerate(), inside its batch.
+void decorStampPrefabs(World& w, uint32_t seed, int chunk, DecorStats* stats = nullptr);
@@ -0,0 +1,496 @@
+#include "demo.h"
+#include "chunk_codec.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+const uint32_t DEMO_FORMAT = 1;
+const size_t HEADER_BYTES = DEMO_HEADER_BYTES;
+const size_t FRAME_HEADER_BYTES = DEMO_FRAME_HEADER_BYTES;
+const size_t TRAILER_BYTES = 8;
+const uint8_t FRAME_KEY = DEMO_FRAME_KEY, FRAME_DELTA = DEMO_FRAME_DELTA;
+const int PLAYER_FIELDS = 6;
+
+struct Capture {
+    WorldSnapshot snap;
+    uint32_t tick = 0;
+    std::vector<DetPlayer> players;
+};
+
+void playerFields(const DetPlayer& p, int32_t out[PLAYER_FIELDS]) {
+    out[0] = p.pos.x.raw; out[1] = p.pos.y.raw; out[2] = p.pos.z.raw;
+    out[3] = p.vel.x.raw; out[4] = p.vel.y.raw; out[5] = p.vel.z.raw;
+}
+
+void putZigzag(std::vector<uint8_t>& out, int32_t v) {
+    putVarint(out, (uint32_t(v) << 1) ^ uint32_t(v >> 31));
+}
+
+bool getZigzag(const uint8_t* data, size_t size, size_t* pos, int32_t* v) {
+    uint32_t u;
+    if (!getVarint(data, size, pos, &u)) return false;
+    *v = int32_t((u >> 1) ^ (0u - (u & 1)));
+    return true;
+}
+
+// Sockets get send() so a viewer or relay going away is an error rather than a SIGPIPE.
+bool writeAll(int fd, const uint8_t* data, size_t size, bool socket = false) {
+    while (size > 0) {
+        ssize_t n = socket ? send(fd, data, size, MSG_NOSIGNAL) : write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        size -= size_t(n);
+    }
+    return true;
+}
+
+bool readAt(int fd, size_t offset, uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = pread(fd, data, size, off_t(offset));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        size -= size_t(n);
+        offset += size_t(n);
+    }
+    return true;
+}
+
+} // namespace
+
+// ----------------- Recording -----------------
+struct DemoWorker {
+    int fd = -1;
+    uint32_t keyframeTicks = 0;
+    bool stream = false;       // a socket: no index, deltas ahead of keyframes
+    uint32_t delayTicks = 0;   // frames are held back this long before they are sent
+    std::thread thread;
+    std::mutex mtx;
+    std::condition_variable wake;
+    std::deque<Capture> queue;
+    bool stopping = false;
+
+    // worker-owned
+    WorldSnapshot prev;
+    std::vector<DetPlayer> prevPlayers;
+    uint32_t lastKeyTick = 0;
+    std::vector<DemoKeyframe> index;
+    size_t offset = HEADER_BYTES;
+    std::vector<uint8_t> frame;
+    std::vector<int> changed;
+    struct Held {
+        uint32_t tick;
+        bool key;
+        std::vector<uint8_t> bytes;
+    };
+    std::deque<Held> held;
+    bool failed = false;
+    DemoRecordStats stats;
+};
+
+namespace {
+
+bool samePlayers(const std::vector<DetPlayer>& a, const std::vector<DetPlayer>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i=0; i<a.size(); ++i) {
+        int32_t fa[PLAYER_FIELDS], fb[PLAYER_FIELDS];
+        playerFields(a[i], fa);
+        playerFields(b[i], fb);
+        if (memcmp(fa, fb, sizeof(fa)) != 0 || a[i].onGround != b[i].onGround) return false;
+    }
+    return true;
+}
+
+// Encodes cap into wk.frame, as a delta against wk.prev or a keyframe; false if a delta would be empty.
+bool buildFrame(DemoWorker& wk, const Capture& cap, bool key) {
+    const World& w = *cap.snap;
+    wk.changed.clear();
+    for (int c=0; c<int(w.chunks.size()); ++c) {
+        if (key || worldChunkVersion(w, c) != worldChunkVersion(*wk.prev, c)) wk.changed.push_back(c);
+    }
+    if (!key && wk.changed.empty() && samePlayers(cap.players, wk.prevPlayers)) return false;
+
+    std::vector<uint8_t>& f = wk.frame;
+    f.assign(FRAME_HEADER_BYTES, 0);
+    f.push_back(key ? FRAME_KEY : FRAME_DELTA);
+    putU32(f, cap.tick);
+    putVarint(f, uint32_t(cap.players.size()));
+    for (size_t i=0; i<cap.players.size(); ++i) {
+        int32_t cur[PLAYER_FIELDS], base[PLAYER_FIELDS] = {};
+        playerFields(cap.players[i], cur);
+        if (!key && i < wk.prevPlayers.size()) playerFields(wk.prevPlayers[i], base);
+        for (int k=0; k<PLAYER_FIELDS; ++k) putZigzag(f, int32_t(uint32_t(cur[k]) - uint32_t(base[k])));
+        f.push_back(cap.players[i].onGround ? 1 : 0);
+    }
+    putVarint(f, uint32_t(wk.changed.size()));
+    const int cellCount = w.cfg.chunkSize * w.cfg.chunkSize;
+    for (int c : wk.changed) {
+        putVarint(f, uint32_t(c));
+        chunkEncode(w.chunks[c]->heights.data(), cellCount, f);
+    }
+    uint32_t bodySize = uint32_t(f.size() - FRAME_HEADER_BYTES);
+    uint32_t crc = crc32(f.data() + FRAME_HEADER_BYTES, bodySize);
+    for (int i=0; i<4; ++i) {
+        f[i] = uint8_t(bodySize >> (8 * i));
+        f[4 + i] = uint8_t(crc >> (8 * i));
+    }
+    wk.stats.chunks += wk.changed.size();
+    return true;
+}
+
+void writeFrame(DemoWorker& wk, uint32_t tick, bool key, const std::vector<uint8_t>& f) {
+    if (wk.failed || !writeAll(wk.fd, f.data(), f.size(), wk.stream)) {
+        wk.failed = true;
+        return;
+    }
+    if (key) {
+        wk.index.push_back({ tick, uint32_t(wk.offset) });
+        ++wk.stats.keyframes;
+    }
+    wk.offset += f.size();
+    ++wk.stats.frames;
+    wk.stats.bytes += f.size();
+}
+
+void emitFrame(DemoWorker& wk, uint32_t tick, bool key) {
+    if (wk.delayTicks == 0) writeFrame(wk, tick, key, wk.frame);
+    else wk.held.push_back({ tick, key, wk.frame });
+}
+
+// Sends the held frames that are old enough (all of them with newest == UINT32_MAX).
+void releaseHeld(DemoWorker& wk, uint32_t newest) {
+    while (!wk.held.empty() && (newest == UINT32_MAX || wk.held.front().tick + wk.delayTicks <= newest)) {
+        writeFrame(wk, wk.held.front().tick, wk.held.front().key, wk.held.front().bytes);
+        wk.held.pop_front();
+    }
+}
+
+void encodeFrame(DemoWorker& wk, const Capture& cap) {
+    double start = profilerNowMs();
+    bool key = !wk.prev || cap.tick - wk.lastKeyTick >= wk.keyframeTicks;
+    // a stream also carries the keyframe tick's delta, so viewers already in sync can skip keyframes
+    if (key && wk.stream && wk.prev && buildFrame(wk, cap, false)) emitFrame(wk, cap.tick, false);
+    if (buildFrame(wk, cap, key)) emitFrame(wk, cap.tick, key);
+    if (key) wk.lastKeyTick = cap.tick;
+    wk.prev = cap.snap;
+    wk.prevPlayers = cap.players;
+    releaseHeld(wk, cap.tick);
+    wk.stats.encodeMs += profilerNowMs() - start;
+}
+
+void workerMain(DemoWorker* wk) {
+    for (;;) {
+        Capture cap;
+        {
+            std::unique_lock<std::mutex> lock(wk->mtx);
+            wk->wake.wait(lock, [&]{ return wk->stopping || !wk->queue.empty(); });
+            if (wk->queue.empty()) {  // stopping and drained
+                releaseHeld(*wk, UINT32_MAX);
+                return;
+            }
+            cap = std::move(wk->queue.front());
+            wk->queue.pop_front();
+        }
+        encodeFrame(*wk, cap);
+    }
+}
+
+} // namespace
+
+namespace {
+
+bool startWorker(DemoRecorder& r, int fd, bool stream, const World& w, uint32_t seed, int tickHz,
+                 int keyframeSeconds, int delaySeconds) {
+    std::vector<uint8_t> header;
+    header.insert(header.end(), { 'S', 'B', 'D', 'M' });
+    uint32_t blockBits;
+    memcpy(&blockBits, &w.cfg.blockSize, 4);
+    const uint32_t fields[] = { DEMO_FORMAT, seed, uint32_t(w.cfg.gridW), uint32_t(w.cfg.gridH),
+                                uint32_t(w.cfg.chunkSize), uint32_t(w.cfg.maxStack), blockBits, uint32_t(tickHz),
+                                uint32_t(std::max(keyframeSeconds, 1) * tickHz) };
+    for (uint32_t v : fields) putU32(header, v);
+    if (!writeAll(fd, header.data(), header.size(), stream)) {
+        close(fd);
+        return false;
+    }
+    r.stats = DemoRecordStats();
+    r.worker = new DemoWorker();
+    r.worker->fd = fd;
+    r.worker->stream = stream;
+    r.worker->keyframeTicks = fields[8];
+    r.worker->delayTicks = uint32_t(std::max(delaySeconds, 0) * tickHz);
+    r.worker->thread = std::thread(workerMain, r.worker);
+    return true;
+}
+
+} // namespace
+
+bool demoRecordStart(DemoRecorder& r, const char* path, const World& w, uint32_t seed, int tickHz, int keyframeSeconds) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        printf("[demo] cannot create %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    return startWorker(r, fd, false, w, seed, tickHz, keyframeSeconds, 0);
+}
+
+bool demoStreamStart(DemoRecorder& r, int fd, const World& w, uint32_t seed, int tickHz, int keyframeSeconds,
+                     int delaySeconds) {
+    return startWorker(r, fd, true, w, seed, tickHz, keyframeSeconds, delaySeconds);
+}
+
+void demoRecordTick(DemoRecorder& r, const World& w, uint32_t tick, const DetPlayer* players, int count) {
+    if (!r.worker) return;
+    double start = profilerNowMs();
+    Capture cap;
+    cap.snap = worldSnapshot(w);
+    cap.tick = tick;
+    cap.players.assign(players, players + count);
+    size_t queued;
+    {
+        std::lock_guard<std::mutex> lock(r.worker->mtx);
+        std::deque<Capture>& q = r.worker->queue;
+        if (q.size() >= std::max<size_t>(r.queueLimit, 1)) {
+            q.back() = std::move(cap);
+            ++r.stats.coalesced;
+        } else {
+            q.push_back(std::move(cap));
+        }
+        queued = q.size();
+    }
+    r.worker->wake.notify_one();
+    double ms = profilerNowMs() - start;
+    ++r.stats.captures;
+    r.stats.captureMs += ms;
+    r.stats.maxCaptureMs = std::max(r.stats.maxCaptureMs, ms);
+    r.stats.maxQueued = std::max(r.stats.maxQueued, queued);
+}
+
+bool demoRecordStop(DemoRecorder& r) {
+    DemoWorker* wk = r.worker;
+    if (!wk) return false;
+    {
+        std::lock_guard<std::mutex> lock(wk->mtx);
+        wk->stopping = true;
+    }
+    wk->wake.notify_one();
+    wk->thread.join();
+
+    std::vector<uint8_t> index;
+    if (!wk->stream) {
+        putU32(index, uint32_t(wk->index.size()));
+        for (const DemoKeyframe& k : wk->index) {
+            putU32(index, k.tick);
+            putU32(index, k.offset);
+        }
+        putU32(index, uint32_t(wk->offset));
+        index.insert(index.end(), { 'S', 'B', 'D', 'I' });
+    }
+    bool ok = !wk->failed && writeAll(wk->fd, index.data(), index.size(), wk->stream);
+    ok = close(wk->fd) == 0 && ok;
+
+    DemoRecordStats& s = r.stats;
+    s.frames = wk->stats.frames;
+    s.keyframes = wk->stats.keyframes;
+    s.chunks = wk->stats.chunks;
+    s.bytes = wk->stats.bytes + HEADER_BYTES + index.size();
+    s.encodeMs = wk->stats.encodeMs;
+    delete wk;
+    r.worker = nullptr;
+    return ok;
+}
+
+// ----------------- Playback -----------------
+namespace {
+
+// Reads the frame at offset into r.body after checking its CRC; returns its total size, 0 if torn.
+size_t readFrame(DemoReader& r, size_t offset, size_t end) {
+    uint8_t h[FRAME_HEADER_BYTES];
+    if (offset + FRAME_HEADER_BYTES > end || !readAt(r.fd, offset, h, FRAME_HEADER_BYTES)) return 0;
+    uint32_t size = getU32(h), crc = getU32(h + 4);
+    if (size < 5 || offset + FRAME_HEADER_BYTES + size > end) return 0;
+    r.body.resize(size);
+    if (!readAt(r.fd, offset + FRAME_HEADER_BYTES, r.body.data(), size)) return 0;
+    if (crc32(r.body.data(), size) != crc) return 0;
+    return FRAME_HEADER_BYTES + size;
+}
+
+bool applyBody(DemoReader& r, const uint8_t* b, size_t size) {
+    size_t pos = 5;
+    bool key = b[0] == FRAME_KEY;
+    uint32_t count;
+    if (!getVarint(b, size, &pos, &count)) return false;
+    std::vector<DetPlayer> players(count);
+    for (uint32_t i=0; i<count; ++i) {
+        int32_t base[PLAYER_FIELDS] = {}, v[PLAYER_FIELDS];
+        if (!key && i < r.players.size()) playerFields(r.players[i], base);
+        for (int k=0; k<PLAYER_FIELDS; ++k) {
+            int32_t d;
+            if (!getZigzag(b, size, &pos, &d)) return false;
+            v[k] = int32_t(uint32_t(base[k]) + uint32_t(d));
+        }
+        if (pos >= size) return false;
+        DetPlayer& p = players[i];
+        p.pos = { fixRaw(v[0]), fixRaw(v[1]), fixRaw(v[2]) };
+        p.vel = { fixRaw(v[3]), fixRaw(v[4]), fixRaw(v[5]) };
+        p.onGround = b[pos++] != 0;
+    }
+    r.players.swap(players);
+
+    World& w = r.world;
+    const int S = w.cfg.chunkSize;
+    uint32_t chunks;
+    if (!getVarint(b, size, &pos, &chunks)) return false;
+    r.cells.resize(size_t(S) * S);
+    bool ok = true;
+    worldBeginEdits(w);
+    for (uint32_t i=0; i<chunks && ok; ++i) {
+        uint32_t c;
+        size_t used = 0;
+        ok = getVarint(b, size, &pos, &c) && c < w.chunks.size() &&
+             (used = chunkDecode(b + pos, size - pos, r.cells.data(), S * S)) != 0;
+        if (!ok) break;
+        pos += used;
+        int gx0 = int(c % w.chunksX) * S, gz0 = int(c / w.chunksX) * S;
+        for (int k=0; k<S*S; ++k) worldSetHeight(w, gx0 + k % S, gz0 + k / S, r.cells[k]);
+    }
+    worldEndEdits(w);
+    r.tick = getU32(b + 1);
+    return ok;
+}
+
+// Scans the frames of a recording without an index; stops at the first torn one.
+void rebuildIndex(DemoReader& r, size_t fileSize) {
+    r.keyframes.clear();
+    size_t offset = HEADER_BYTES;
+    while (size_t n = readFrame(r, offset, fileSize)) {
+        if (r.body[0] == FRAME_KEY) r.keyframes.push_back({ getU32(r.body.data() + 1), uint32_t(offset) });
+        offset += n;
+    }
+    r.dataEnd = offset;
+    r.indexRebuilt = true;
+}
+
+bool loadIndex(DemoReader& r, size_t fileSize) {
+    uint8_t t[TRAILER_BYTES];
+    if (fileSize < HEADER_BYTES + 4 + TRAILER_BYTES || !readAt(r.fd, fileSize - TRAILER_BYTES, t, TRAILER_BYTES) ||
+        memcmp(t + 4, "SBDI", 4) != 0) {
+        return false;
+    }
+    size_t at = getU32(t);
+    uint8_t c[4];
+    if (at < HEADER_BYTES || at + 4 > fileSize || !readAt(r.fd, at, c, 4)) return false;
+    uint32_t count = getU32(c);
+    if (at + 4 + size_t(count) * 8 + TRAILER_BYTES != fileSize) return false;
+    std::vector<uint8_t> raw(size_t(count) * 8);
+    if (!readAt(r.fd, at + 4, raw.data(), raw.size())) return false;
+    r.keyframes.resize(count);
+    for (uint32_t i=0; i<count; ++i) r.keyframes[i] = { getU32(&raw[i * 8]), getU32(&raw[i * 8 + 4]) };
+    r.dataEnd = at;
+    return true;
+}
+
+} // namespace
+
+bool demoOpen(DemoReader& r, const char* path) {
+    r.fd = open(path, O_RDONLY);
+    if (r.fd < 0) {
+        printf("[demo] cannot open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    uint8_t h[HEADER_BYTES];
+    if (fstat(r.fd, &st) != 0 || !readAt(r.fd, 0, h, HEADER_BYTES) || !demoParseHeader(r, h, HEADER_BYTES)) {
+        printf("[demo] %s is not a recording\n", path);
+        demoClose(r);
+        return false;
+    }
+    r.indexRebuilt = false;
+    if (!loadIndex(r, size_t(st.st_size))) rebuildIndex(r, size_t(st.st_size));
+    r.next = HEADER_BYTES;
+    return true;
+}
+
+bool demoParseHeader(DemoReader& r, const uint8_t* h, size_t size) {
+    if (size < HEADER_BYTES || memcmp(h, "SBDM", 4) != 0 || getU32(h + 4) != DEMO_FORMAT) return false;
+    WorldConfig cfg;
+    r.seed = getU32(h + 8);
+    cfg.gridW = int(getU32(h + 12));
+    cfg.gridH = int(getU32(h + 16));
+    cfg.chunkSize = int(getU32(h + 20));
+    cfg.maxStack = int(getU32(h + 24));
+    uint32_t blockBits = getU32(h + 28);
+    memcpy(&cfg.blockSize, &blockBits, 4);
+    r.tickHz = getU32(h + 32);
+    r.keyframeTicks = getU32(h + 36);
+    // the header comes from a file or the relay: out of range it would overflow worldInit()
+    if (!worldConfigValid(cfg)) return false;
+    worldInit(r.world, cfg);
+    r.players.clear();
+    r.tick = 0;
+    r.framesRead = 0;
+    return true;
+}
+
+bool demoApplyFrame(DemoReader& r, const uint8_t* frame, size_t size) {
+    if (size < FRAME_HEADER_BYTES + 5) return false;
+    uint32_t bodySize = getU32(frame), crc = getU32(frame + 4);
+    const uint8_t* body = frame + FRAME_HEADER_BYTES;
+    if (bodySize != size - FRAME_HEADER_BYTES || crc32(body, bodySize) != crc || !applyBody(r, body, bodySize)) {
+        return false;
+    }
+    ++r.framesRead;
+    return true;
+}
+
+void demoClose(DemoReader& r) {
+    if (r.fd >= 0) close(r.fd);
+    r.fd = -1;
+}
+
+bool demoNext(DemoReader& r) {
+    size_t n = readFrame(r, r.next, r.dataEnd);
+    if (n == 0 || !applyBody(r, r.body.data(), r.body.size())) return false;
+    r.next += n;
+    ++r.framesRead;
+    return true;
+}
+
+uint32_t demoPeekTick(const DemoReader& r) {
+    uint8_t t[FRAME_HEADER_BYTES + 5];
+    if (r.next + sizeof(t) > r.dataEnd || !readAt(r.fd, r.next, t, sizeof(t))) return r.tick;
+    return getU32(t + FRAME_HEADER_BYTES + 1);
+}
+
+bool demoSeek(DemoReader& r, uint32_t tick) {
+    auto after = std::upper_bound(r.keyframes.begin(), r.keyframes.end(), tick,
+                                  [](uint32_t t, const DemoKeyframe& k) { return t < k.tick; });
+    if (after == r.keyframes.begin()) return false;
+    const DemoKeyframe& key = *(after - 1);
+    // going forward within the keyframe's interval: carry on from here instead
+    bool inInterval = r.framesRead > 0 && r.tick >= key.tick && r.tick <= tick && r.next > key.offset;
+    if (!inInterval) {
+        r.next = key.offset;
+        if (!demoNext(r)) return false;
+    }
+    while (r.next < r.dataEnd && demoPeekTick(r) <= tick) {
+        if (!demoNext(r)) return false;
+    }
+    return true;
+}
@@ -0,0 +1,97 @@
+// Seekable match recordings for the dedicated server (native only).
+//
+// Every tick the server hands the recorder a copy-on-write snapshot of the world and the
+// player states (demoRecordTick() costs microseconds); a worker thread turns them into frames
+// and appends them to the file, so encoding and disk writes never land in the tick. A frame
+// is either a keyframe, holding every chunk and player, written every keyframe interval, or
+// a delta holding the chunks whose version changed and the players' state differences since
+// the previous frame. Ticks where nothing changed write no frame. The file ends with an index
+// of the keyframes, so a reader seeks to any tick by loading the keyframe before it and at
+// most one interval of deltas. A recording cut short by a crash has no index; the reader
+// rebuilds it by scanning the frames and stops at a torn one.
+//
+// The same writer streams a live match to a socket (demoStreamStart(), for the spectator relay):
+// frames are held back by the broadcast delay, there is no index, and a keyframe tick also
+// sends its delta first, so viewers that are already in sync never need the keyframes.
+//
+// File layout (little endian):
+//   "SBDM", u32 format, u32 seed, u32 gridW, u32 gridH, u32 chunkSize, u32 maxStack,
+//   u32 blockSize bits, u32 tickHz, u32 keyframeTicks
+//   frames: u32 bodySize, u32 CRC-32 of body, body
+//     body: u8 kind, u32 tick, varint players, per player 6 zigzag varints of the raw
+//           fixed-point differences (pos, vel; against zero in keyframes) + u8 onGround,
+//           varint chunks, per chunk varint index + chunk_codec cells
+//   index: u32 count, count x { u32 tick, u32 offset }, u32 index offset, "SBDI"
+#pragma once
+
+#include "det_physics.h"
+#include "world.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+const int DEMO_KEYFRAME_SECONDS = 5;
+const size_t DEMO_QUEUE_LIMIT = 64;  // captures waiting for the worker, about two seconds at 30 Hz
+const size_t DEMO_HEADER_BYTES = 40;
+const size_t DEMO_FRAME_HEADER_BYTES = 8;
+const uint8_t DEMO_FRAME_KEY = 1, DEMO_FRAME_DELTA = 2;  // first body byte
+
+struct DemoWorker;
+
+struct DemoRecordStats {
+    uint64_t captures = 0, frames = 0, keyframes = 0, chunks = 0;
+    size_t bytes = 0;
+    double captureMs = 0.0, maxCaptureMs = 0.0;  // tick thread
+    double encodeMs = 0.0;                       // worker
+    size_t maxQueued = 0;                        // captures waiting for the worker
+    uint64_t coalesced = 0;                      // captures replaced while the queue was full
+};
+
+struct DemoRecorder {
+    DemoWorker* worker = nullptr;
+    size_t queueLimit = DEMO_QUEUE_LIMIT;
+    DemoRecordStats stats;  // up to date after demoRecordStop()
+};
+
+bool demoRecordStart(DemoRecorder& r, const char* path, const World& w, uint32_t seed, int tickHz,
+                     int keyframeSeconds = DEMO_KEYFRAME_SECONDS);
+// Writes to a connected socket and takes ownership of it; frames leave delaySeconds late.
+bool demoStreamStart(DemoRecorder& r, int fd, const World& w, uint32_t seed, int tickHz, int keyframeSeconds,
+                     int delaySeconds);
+// With queueLimit captures already waiting, this one replaces the newest of them: that tick
+// gets no frame and the next delta carries its changes, so a slow disk costs frames, not memory.
+void demoRecordTick(DemoRecorder& r, const World& w, uint32_t tick, const DetPlayer* players, int count);
+// Writes the queued frames and the index and closes the file.
+bool demoRecordStop(DemoRecorder& r);
+
+struct DemoKeyframe {
+    uint32_t tick, offset;
+};
+
+struct DemoReader {
+    int fd = -1;
+    uint32_t seed = 0, tickHz = 0, keyframeTicks = 0;
+    World world;                    // state as of the last frame read
+    std::vector<DetPlayer> players;
+    uint32_t tick = 0;              // tick of the last frame read
+    std::vector<DemoKeyframe> keyframes;
+    size_t dataEnd = 0;             // end of the frames
+    size_t next = 0;                // offset of the next frame
+    bool indexRebuilt = false;
+    uint64_t framesRead = 0;
+    std::vector<uint8_t> body, cells;
+};
+
+bool demoOpen(DemoReader& r, const char* path);
+void demoClose(DemoReader& r);
+// Reads and applies the next frame; false at the end of the recording.
+bool demoNext(DemoReader& r);
+// Brings the state to the last frame at or before tick.
+bool demoSeek(DemoReader& r, uint32_t tick);
+// Tick of the frame demoNext() would read (the last frame's tick at the end).
+uint32_t demoPeekTick(const DemoReader& r);
+
+// For readers fed from the network: the file header, then whole frames with their size and CRC.
+bool demoParseHeader(DemoReader& r, const uint8_t* header, size_t size);
+bool demoApplyFrame(DemoReader& r, const uint8_t* frame, size_t size);
@@ -0,0 +1,146 @@
+#include "det_physics.h"
+
+namespace {
+
+// The constants of the float path, rounded once to fixed point.
+const Fix kDt = fixRaw(FIX_ONE / DET_TICK_HZ);
+const Fix kWalkSpeed = fix(5.0), kGravity = fix(9.8), kJumpSpeed = fix(6.0);
+const Fix kMinMove = fix(0.01), kFloor = fix(1.0);
+const Fix kRadius = fix(0.25), kFeet = fix(0.9), kStand = fix(1.8), kSkin = fix(0.001), kLanding = fix(0.01);
+const Fix kRayStep = fix(0.1), kRaySlack = fix(0.5);
+
+Fix blockSize(const World& w) {
+    return fix(w.cfg.blockSize);
+}
+
+int gridX(const World& w, Fix x, Fix B) { return fixRound(x / B) + w.cfg.gridW / 2; }
+int gridZ(const World& w, Fix z, Fix B) { return fixRound(z / B) + w.cfg.gridH / 2; }
+
+Fix clampFix(Fix v, Fix lo, Fix hi) {
+    return fixMax(lo, fixMin(v, hi));
+}
+
+Fix absFix(Fix v) {
+    return v.raw < 0 ? -v : v;
+}
+
+void hashBytes(uint64_t& h, const void* data, size_t size) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    for (size_t i=0; i<size; ++i) {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+}
+
+void hashFix(uint64_t& h, Fix v) {
+    // byte by byte, so the hash does not depend on the target's endianness
+    uint8_t b[4] = { uint8_t(v.raw), uint8_t(v.raw >> 8), uint8_t(v.raw >> 16), uint8_t(uint32_t(v.raw) >> 24) };
+    hashBytes(h, b, 4);
+}
+
+} // namespace
+
+DetInput detQuantizeInput(float yaw, float pitch, uint8_t buttons) {
+    DetInput in;
+    in.yaw = fixAngle(yaw);
+    in.pitch = fixAngle(pitch);
+    in.buttons = buttons;
+    return in;
+}
+
+FixVec3 detAimDir(uint16_t yaw, uint16_t pitch) {
+    Fix cp = fixCos(pitch);
+    return { fixCos(yaw) * cp, fixSin(pitch), fixSin(yaw) * cp };
+}
+
+void detStep(const World& w, DetPlayer& p, const DetInput& in) {
+    // walk direction on the ground plane: forward loses its pitch, right is level
+    Fix cy = fixCos(in.yaw), sy = fixSin(in.yaw), cp = fixCos(in.pitch);
+    Fix fx = cy * cp, fz = sy * cp, mx = {}, mz = {};
+    if (in.buttons & DET_FORWARD) { mx += fx; mz += fz; }
+    if (in.buttons & DET_BACK) { mx -= fx; mz -= fz; }
+    if (in.buttons & DET_LEFT) { mx += sy; mz -= cy; }
+    if (in.buttons & DET_RIGHT) { mx -= sy; mz += cy; }
+    Fix len = fixSqrt(mx * mx + mz * mz);
+    if (len > kMinMove) {
+        mx = mx / len;
+        mz = mz / len;
+    }
+
+    p.vel.x = mx * kWalkSpeed;
+    p.vel.z = mz * kWalkSpeed;
+    p.vel.y -= kGravity * kDt;
+    if ((in.buttons & DET_JUMP) && p.onGround) {
+        p.vel.y = kJumpSpeed;
+        p.onGround = false;
+    }
+    p.pos.x += p.vel.x * kDt;
+    p.pos.y += p.vel.y * kDt;
+    p.pos.z += p.vel.z * kDt;
+
+    p.onGround = false;
+    detCollide(w, p.pos, p.vel, p.onGround);
+    if (p.pos.y < kFloor) {
+        p.pos.y = kFloor;
+        p.vel.y = Fix{};
+        p.onGround = true;
+    }
+}
+
+void detCollide(const World& w, FixVec3& pos, FixVec3& vel, bool& onGround) {
+    // the float kernel's algorithm: push the foot point out of every nearby cube
+    const Fix B = blockSize(w), half = B / fixInt(2);
+    const int halfW = w.cfg.gridW / 2, halfH = w.cfg.gridH / 2;
+    const int reach = (kRadius.raw + B.raw - 1) / B.raw + 1;
+    int cgx = gridX(w, pos.x, B), cgz = gridZ(w, pos.z, B);
+    for (int gz=cgz-reach; gz<=cgz+reach; ++gz) for (int gx=cgx-reach; gx<=cgx+reach; ++gx) {
+        int h = worldHeight(w, gx, gz);
+        Fix minX = fixInt(gx - halfW) * B - half, minZ = fixInt(gz - halfH) * B - half;
+        for (int level=0; level<h; ++level) {
+            Fix minY = fixInt(level) * B;
+            Fix footY = pos.y - kFeet;
+            Fix dx = pos.x - clampFix(pos.x, minX, minX + B);
+            Fix dy = footY - clampFix(footY, minY, minY + B);
+            Fix dz = pos.z - clampFix(pos.z, minZ, minZ + B);
+            // any axis alone out of reach rules the cube out, and keeps the squares in range
+            if (absFix(dx) >= kRadius || absFix(dy) >= kRadius || absFix(dz) >= kRadius) continue;
+            Fix dist = fixSqrt(dx * dx + dy * dy + dz * dz);
+            if (dist >= kRadius) continue;
+            Fix flat = fixSqrt(dx * dx + dz * dz);
+            if (flat.raw > 0) {
+                Fix depth = kRadius - dist + kSkin;
+                pos.x += dx / flat * depth;
+                pos.z += dz / flat * depth;
+            }
+            if (pos.y <= minY + B + kLanding) {
+                onGround = true;
+                vel.y = Fix{};
+                pos.y = minY + B + kStand;
+            }
+        }
+    }
+}
+
+bool detRaycast(const World& w, const FixVec3& origin, const FixVec3& dir, Fix maxDist, RayHit& hit) {
+    const Fix B = blockSize(w);
+    for (Fix t = {}; t < maxDist; t += kRayStep) {
+        Fix px = origin.x + dir.x * t, py = origin.y + dir.y * t, pz = origin.z + dir.z * t;
+        int gx = gridX(w, px, B), gz = gridZ(w, pz, B);
+        if (gx < 0 || gx >= w.cfg.gridW || gz < 0 || gz >= w.cfg.gridH) continue;
+        int h = worldHeight(w, gx, gz);
+        if (h == 0) continue;
+        if (py.raw >= 0 && py <= fixInt(h) * B + kRaySlack) {
+            hit = { gx, gz, h };
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t detStateHash(const DetPlayer& p, uint64_t h) {
+    const Fix v[6] = { p.pos.x, p.pos.y, p.pos.z, p.vel.x, p.vel.y, p.vel.z };
+    for (Fix f : v) hashFix(h, f);
+    uint8_t ground = p.onGround;
+    hashBytes(h, &ground, 1);
+    return h;
+}
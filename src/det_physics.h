@@ -0,0 +1,49 @@
+// Deterministic player physics for lockstep multiplayer and replay verification.
+//
+// The float path (main.cpp and the world kernels) steps with the frame time and uses
+// sinf/cosf/sqrtf, so two builds can drift apart. This mode runs the same movement, collision
+// and hitscan in Q16.16 fixed point (fixed.h) at a fixed tick from quantized inputs, which gives
+// bit-identical states on every compiler and target: peers that agree on the inputs agree
+// on detStateHash(), and a replay can be verified against a recorded hash.
+#pragma once
+
+#include "fixed.h"
+#include "world.h"
+
+#include <cstdint>
+
+const int DET_TICK_HZ = 60;
+
+struct FixVec3 {
+    Fix x, y, z;
+};
+
+enum DetButton : uint8_t {
+    DET_FORWARD = 1, DET_BACK = 2, DET_LEFT = 4, DET_RIGHT = 8, DET_JUMP = 16,
+};
+
+// Everything a tick needs from a player, as sent between lockstep peers.
+struct DetInput {
+    uint16_t yaw = 0, pitch = 0;  // binary angles
+    uint8_t buttons = 0;          // DetButton bits
+};
+
+struct DetPlayer {
+    FixVec3 pos = {}, vel = {};
+    bool onGround = false;
+};
+
+inline FixVec3 detVec(const Vec3& v) { return { fix(v.x), fix(v.y), fix(v.z) }; }
+inline Vec3 detToVec3(const FixVec3& v) { return Vec3(fixToFloat(v.x), fixToFloat(v.y), fixToFloat(v.z)); }
+
+DetInput detQuantizeInput(float yaw, float pitch, uint8_t buttons);
+// Unit view direction of a yaw and pitch.
+FixVec3 detAimDir(uint16_t yaw, uint16_t pitch);
+
+// One tick of 1/DET_TICK_HZ s: walking, gravity, jumping, collision and the ground plane.
+void detStep(const World& w, DetPlayer& p, const DetInput& in);
+void detCollide(const World& w, FixVec3& pos, FixVec3& vel, bool& onGround);
+bool detRaycast(const World& w, const FixVec3& origin, const FixVec3& dir, Fix maxDist, RayHit& hit);
+
+// FNV-1a over the raw state; pass the previous result to chain several players.
+uint64_t detStateHash(const DetPlayer& p, uint64_t h = 14695981039346656037ull);
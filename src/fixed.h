@@ -0,0 +1,95 @@
+// Q16.16 fixed-point numbers and table-based trigonometry for the deterministic physics mode
+// (det_physics.h).
+//
+// Everything at run time is integer arithmetic, so results are the same bits with every
+// compiler, optimisation level and target. The sine table is built by the compiler from a
+// Taylor series in double; basic IEEE operations are exactly rounded, so the table is identical
+// everywhere too. Angles are binary: 65536 units per turn, wrapping for free in a uint16_t.
+#pragma once
+
+#include <cstdint>
+
+const int FIX_SHIFT = 16;
+const int32_t FIX_ONE = 1 << FIX_SHIFT;
+
+struct Fix {
+    int32_t raw;
+};
+
+constexpr Fix fixRaw(int32_t raw) { return Fix{ raw }; }
+constexpr Fix fixInt(int v) { return Fix{ int32_t(uint32_t(v) << FIX_SHIFT) }; }
+// Constants and conversions of inputs; rounds to nearest.
+constexpr Fix fix(double v) { return Fix{ int32_t(v * FIX_ONE + (v < 0.0 ? -0.5 : 0.5)) }; }
+inline float fixToFloat(Fix a) { return float(a.raw) * (1.0f / FIX_ONE); }
+
+constexpr Fix operator+(Fix a, Fix b) { return Fix{ a.raw + b.raw }; }
+constexpr Fix operator-(Fix a, Fix b) { return Fix{ a.raw - b.raw }; }
+constexpr Fix operator-(Fix a) { return Fix{ -a.raw }; }
+constexpr Fix operator*(Fix a, Fix b) { return Fix{ int32_t((int64_t(a.raw) * b.raw) >> FIX_SHIFT) }; }
+constexpr Fix operator/(Fix a, Fix b) { return Fix{ int32_t((int64_t(a.raw) * FIX_ONE) / b.raw) }; }
+constexpr Fix operator*(Fix a, int b) { return Fix{ a.raw * b }; }
+inline Fix& operator+=(Fix& a, Fix b) { a.raw += b.raw; return a; }
+inline Fix& operator-=(Fix& a, Fix b) { a.raw -= b.raw; return a; }
+constexpr bool operator<(Fix a, Fix b) { return a.raw < b.raw; }
+constexpr bool operator>(Fix a, Fix b) { return a.raw > b.raw; }
+constexpr bool operator<=(Fix a, Fix b) { return a.raw <= b.raw; }
+constexpr bool operator>=(Fix a, Fix b) { return a.raw >= b.raw; }
+constexpr bool operator==(Fix a, Fix b) { return a.raw == b.raw; }
+constexpr bool operator!=(Fix a, Fix b) { return a.raw != b.raw; }
+
+constexpr Fix fixMin(Fix a, Fix b) { return a.raw < b.raw ? a : b; }
+constexpr Fix fixMax(Fix a, Fix b) { return a.raw > b.raw ? a : b; }
+constexpr int fixFloor(Fix a) { return a.raw >> FIX_SHIFT; }
+constexpr int fixRound(Fix a) { return (a.raw + FIX_ONE / 2) >> FIX_SHIFT; }
+
+// Square root to the nearest representable value below, by integer bisection of the bits.
+constexpr Fix fixSqrt(Fix a) {
+    if (a.raw <= 0) return Fix{ 0 };
+    uint64_t v = uint64_t(a.raw) << FIX_SHIFT, r = 0, bit = uint64_t(1) << 62;
+    while (bit > v) bit >>= 2;
+    while (bit) {
+        if (v >= r + bit) {
+            v -= r + bit;
+            r = (r >> 1) + bit;
+        } else {
+            r >>= 1;
+        }
+        bit >>= 2;
+    }
+    return Fix{ int32_t(r) };
+}
+
+// ----------------- Trigonometry -----------------
+const int FIX_SINE_STEPS = 1024;  // table entries per quarter turn (plus the end point)
+
+struct FixSineTable { int32_t v[FIX_SINE_STEPS + 1]; };
+
+constexpr FixSineTable buildFixSineTable() {
+    FixSineTable t{};
+    for (int i=0; i<=FIX_SINE_STEPS; ++i) {
+        double x = 1.5707963267948966 * i / FIX_SINE_STEPS, term = x, sum = x;
+        for (int n=1; n<12; ++n) {
+            term *= -x * x / ((2 * n) * (2 * n + 1));
+            sum += term;
+        }
+        t.v[i] = int32_t(sum * FIX_ONE + 0.5);
+    }
+    return t;
+}
+inline constexpr FixSineTable kFixSine = buildFixSineTable();
+
+// Sine of a binary angle, linearly interpolated between table entries.
+constexpr Fix fixSin(uint16_t angle) {
+    int quarter = angle >> 14, i = angle & 0x3fff;
+    if (quarter & 1) i = 0x4000 - i;
+    int idx = i >> 4, frac = i & 15;
+    int32_t a = kFixSine.v[idx], b = idx < FIX_SINE_STEPS ? kFixSine.v[idx + 1] : a;
+    int32_t s = a + ((b - a) * frac) / 16;
+    return Fix{ quarter & 2 ? -s : s };
+}
+constexpr Fix fixCos(uint16_t angle) { return fixSin(uint16_t(angle + 0x4000)); }
+
+// Radians to a binary angle; for quantizing float inputs at the edge of the simulation.
+inline uint16_t fixAngle(float radians) {
+    return uint16_t(int64_t(radians * (65536.0f * 0.15915494f)) & 0xffff);
+}
@@ -0,0 +1,119 @@
+#include "game_rules.h"
+#include "audio_mixer.h"
+#include "hitboxes.h"
+
+#include <cstdio>
+
+const char* const rulesFieldNames[FIELD_COUNT] = { "health", "x", "y", "z" };
+
+// Entities are PLAYER (0) and 1 + i for crowd member i.
+const char* const gameRulesSource = R"(
+var ammo = 30
+var magazine = 30
+var reloadUntil = 0
+
+// The last round starts a reload; the trigger does nothing until it is done.
+func fire(now) {
+    if (now < reloadUntil) { return 0 }
+    ammo = ammo - 1
+    if (ammo <= 0) {
+        ammo = magazine
+        reloadUntil = now + 1.5
+        play(PICKUP, PLAYER)
+    }
+    return 1
+}
+
+func damage(part) {
+    if (part == HEAD) { return 34 * 3 }
+    if (part == TORSO) { return 34 }
+    return 34 * 0.6
+}
+
+// A target out of health gets up again somewhere else, healed.
+func hit(target, part) {
+    let dealt = damage(part)
+    let health = target.health - dealt
+    if (health <= 0) {
+        target.health = MAX_HEALTH
+        respawn(target)
+        return -dealt
+    }
+    target.health = health
+    return dealt
+}
+
+// The player takes a pickup and has a full magazine again at once; the crowd walks past.
+func pickup(target) {
+    if (target != PLAYER) { return 0 }
+    ammo = magazine
+    reloadUntil = 0
+    play(PICKUP, target)
+    return 1
+}
+)";
+
+namespace {
+
+const ScriptConstant constants[] = {
+    { "HEAD", HIT_HEAD }, { "TORSO", HIT_TORSO }, { "ARM", HIT_ARM }, { "LEG", HIT_LEG },
+    { "SHOT", SOUND_SHOT }, { "IMPACT", SOUND_IMPACT }, { "STEP", SOUND_STEP }, { "PICKUP", SOUND_PICKUP },
+    { "PLAYER", 0 }, { "MAX_HEALTH", RULES_MAX_HEALTH },
+};
+
+} // namespace
+
+bool gameRulesInit(GameRules& r, const char* source, double (*play)(void* user, const double* args),
+                   double (*respawn)(void* user, const double* args), const ScriptEntities& entities, void* user) {
+    r.natives[0] = { "play", 2, play };
+    r.natives[1] = { "respawn", 1, respawn };
+    r.host.natives = r.natives;
+    r.host.nativeCount = 2;
+    r.host.constants = constants;
+    r.host.constantCount = int(sizeof(constants) / sizeof(constants[0]));
+    r.host.entities = entities;
+    r.host.user = user;
+    r.ready = false;
+    if (!scriptCompile(r.program, source, r.host)) return false;
+    r.fire = scriptFunction(r.program, "fire");
+    r.damage = scriptFunction(r.program, "damage");
+    r.hit = scriptFunction(r.program, "hit");
+    r.pickup = scriptFunction(r.program, "pickup");
+    r.ammo = scriptGlobal(r.program, "ammo");
+    if (r.fire < 0 || r.damage < 0 || r.hit < 0 || r.pickup < 0) {
+        printf("[rules] the rules need fire(now), damage(part), hit(target, part) and pickup(target)\n");
+        return false;
+    }
+    scriptVmInit(r.vm, r.program, r.host);
+    r.ready = true;
+    printf("[rules] %zu functions, %zu instruction words\n", r.program.functions.size(), r.program.code.size());
+    return true;
+}
+
+bool gameRulesFire(GameRules& r, double now) {
+    double shot = 1.0;
+    if (r.ready) scriptCall(r.vm, r.fire, &now, 1, &shot);
+    return shot != 0.0;
+}
+
+double gameRulesDamage(GameRules& r, int part) {
+    double args[1] = { double(part) }, dealt = 0.0;
+    if (r.ready) scriptCall(r.vm, r.damage, args, 1, &dealt);
+    return dealt;
+}
+
+double gameRulesHit(GameRules& r, int entity, int part) {
+    double args[2] = { double(entity), double(part) }, dealt = 0.0;
+    if (r.ready) scriptCall(r.vm, r.hit, args, 2, &dealt);
+    return dealt;
+}
+
+bool gameRulesPickup(GameRules& r, int entity) {
+    double arg = entity, taken = entity == 0 ? 1.0 : 0.0;
+    if (r.ready) scriptCall(r.vm, r.pickup, &arg, 1, &taken);
+    return taken != 0.0;
+}
+
+int gameRulesAmmo(const GameRules& r) {
+    return r.ready && r.ammo >= 0 ? int(r.vm.globals[r.ammo]) : 0;
+}
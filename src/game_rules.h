@@ -0,0 +1,43 @@
+// Game rules run as scripts (script.h) instead of being compiled into the client: the weapon,
+// which decides when a shot goes out, how much a body part takes and what happens to a target
+// that runs out of health, and the pickups, which decide who takes one and what it gives. Game
+// modes are still the client's.
+//
+// The game binds two natives, play(sound, entity) and respawn(entity), and an entity store
+// with the fields below. Scripts see the body parts (HEAD, TORSO, ARM, LEG), the sounds (SHOT,
+// IMPACT, STEP, PICKUP), PLAYER and MAX_HEALTH as constants.
+#pragma once
+
+#include "script.h"
+
+const float RULES_MAX_HEALTH = 100.0f;
+
+enum RulesField { FIELD_HEALTH, FIELD_X, FIELD_Y, FIELD_Z, FIELD_COUNT };
+extern const char* const rulesFieldNames[FIELD_COUNT];
+
+// The built-in weapon and pickups.
+extern const char* const gameRulesSource;
+
+struct GameRules {
+    ScriptNative natives[2];
+    ScriptHost host;
+    ScriptProgram program;
+    ScriptVM vm;
+    int fire = -1, damage = -1, hit = -1, pickup = -1;  // functions
+    int ammo = -1;                         // global
+    bool ready = false;
+};
+
+// Compiles source against the game's bindings; get and set give the entity store, user is
+// passed to all four. Without usable rules every shot goes out and does no damage, and only the
+// player takes pickups.
+bool gameRulesInit(GameRules& r, const char* source, double (*play)(void* user, const double* args),
+                   double (*respawn)(void* user, const double* args), const ScriptEntities& entities, void* user);
+// Trigger pulled at `now` seconds: whether a shot goes out.
+bool gameRulesFire(GameRules& r, double now);
+double gameRulesDamage(GameRules& r, int part);
+// A shot hit the entity in a body part: the damage dealt, negative when it took the target down.
+double gameRulesHit(GameRules& r, int entity, int part);
+// The entity touched or shot a pickup: whether it takes it.
+bool gameRulesPickup(GameRules& r, int entity);
+int gameRulesAmmo(const GameRules& r);
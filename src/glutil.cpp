@@ -0,0 +1,33 @@
+#include "glutil.h"
+
+#include <cstdio>
+
+GLuint compileShader(GLenum type, const char* src) {
+    GLuint s = glCreateShader(type);
+    glShaderSource(s, 1, &src, nullptr);
+    glCompileShader(s);
+    GLint ok; glGetShaderiv(s, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        GLchar buf[1024]; glGetShaderInfoLog(s, sizeof(buf), nullptr, buf);
+        printf("Shader compile error: %s\n", buf);
+    }
+    return s;
+}
+GLuint linkProgram(GLuint v, GLuint f) {
+    GLuint p = glCreateProgram();
+    glAttachShader(p, v); glAttachShader(p, f);
+    glLinkProgram(p);
+    GLint ok; glGetProgramiv(p, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        GLchar buf[1024]; glGetProgramInfoLog(p, sizeof(buf), nullptr, buf);
+        printf("Program link error: %s\n", buf);
+    }
+    return p;
+}
+GLuint buildProgram(const char* vsSrc, const char* fsSrc) {
+    GLuint vs = compileShader(GL_VERTEX_SHADER, vsSrc);
+    GLuint fs = compileShader(GL_FRAGMENT_SHADER, fsSrc);
+    GLuint p = linkProgram(vs, fs);
+    glDeleteShader(vs); glDeleteShader(fs);
+    return p;
+}
@@ -0,0 +1,9 @@
+// Simple GL helpers
+#pragma once
+
+#include <GLES3/gl3.h>
+
+GLuint compileShader(GLenum type, const char* src);
+GLuint linkProgram(GLuint v, GLuint f);
+// Compiles, links and releases the shader objects.
+GLuint buildProgram(const char* vsSrc, const char* fsSrc);
@@ -0,0 +1,225 @@
+#include "hitboxes.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
+
+const uint8_t hitboxBonePart[SKEL_BONES] = {
+    HIT_TORSO, HIT_TORSO, HIT_HEAD,
+    HIT_ARM, HIT_ARM, HIT_ARM, HIT_ARM,
+    HIT_LEG, HIT_LEG, HIT_LEG, HIT_LEG,
+};
+
+const char* hitPartName(int part) {
+    static const char* names[HIT_PART_COUNT] = { "head", "torso", "arm", "leg" };
+    return part >= 0 && part < HIT_PART_COUNT ? names[part] : "?";
+}
+
+namespace {
+
+const int kArrays = 7;  // ax, ay, az, bx, by, bz, radius
+
+// Capsules in the bind pose, fitted to the skeleton's body part boxes.
+struct BindCapsules {
+    Vec3 a[SKEL_BONES], b[SKEL_BONES];
+    float radius[SKEL_BONES];
+
+    BindCapsules() {
+        const Skeleton& s = humanSkeleton;
+        for (int i=0; i<SKEL_BONES; ++i) {
+            Vec3 size = s.boxMax[i] - s.boxMin[i], c = (s.boxMin[i] + s.boxMax[i]) * 0.5f;
+            float e[3] = { size.x, size.y, size.z };
+            int axis = e[0] >= e[1] && e[0] >= e[2] ? 0 : e[1] >= e[2] ? 1 : 2;
+            float r = 0.25f * (e[0] + e[1] + e[2] - e[axis]);
+            float half = std::max(0.5f * e[axis] - r, 0.0f);
+            Vec3 along(axis == 0 ? half : 0.0f, axis == 1 ? half : 0.0f, axis == 2 ? half : 0.0f);
+            a[i] = c - along;
+            b[i] = c + along;
+            radius[i] = r;
+        }
+    }
+};
+
+const BindCapsules& bindCapsules() {
+    static const BindCapsules capsules;
+    return capsules;
+}
+
+Vec3 transformPoint(const float* m, const Vec3& p) {
+    return Vec3(m[0]*p.x + m[1]*p.y + m[2]*p.z + m[3],
+                m[4]*p.x + m[5]*p.y + m[6]*p.z + m[7],
+                m[8]*p.x + m[9]*p.y + m[10]*p.z + m[11]);
+}
+
+// The candidates' capsules one after the other, kArrays arrays of n floats; padding lanes get
+// a negative radius and never hit.
+int gatherCandidates(HitboxSet& h, const Vec3& origin, const Vec3& dir, float maxDist) {
+    ++h.stats.rays;
+    h.pairs.clear();
+    AabbRay ray = { origin, dir, maxDist };
+    aabbRayOverlapBatch(h.tree, &ray, 1, ~0u, h.pairs);
+    int n = int(h.pairs.size()) * SKEL_LANES;
+    if (h.batch.size() < size_t(n) * kArrays) h.batch.resize(size_t(n) * kArrays);
+    h.batchOwner.resize(h.pairs.size());
+    const std::vector<float>* src[kArrays] = { &h.ax, &h.ay, &h.az, &h.bx, &h.by, &h.bz, &h.radius };
+    for (size_t k=0; k<h.pairs.size(); ++k) {
+        int c = int(aabbUser(h.tree, h.pairs[k].proxy));
+        h.batchOwner[k] = c;
+        for (int a=0; a<kArrays; ++a) {
+            std::copy_n(&(*src[a])[size_t(c) * SKEL_LANES], SKEL_LANES, &h.batch[size_t(a) * n + k * SKEL_LANES]);
+        }
+    }
+    h.stats.candidates += h.pairs.size();
+    h.stats.capsules += h.pairs.size() * SKEL_BONES;
+    return n;
+}
+
+bool finishHit(const HitboxSet& h, int best, float dist, HitboxHit& hit) {
+    if (best < 0) {
+        hit = { -1, -1, 0, dist };
+        return false;
+    }
+    int bone = best % SKEL_LANES;
+    hit = { h.batchOwner[best / SKEL_LANES], bone, hitboxBonePart[bone], dist };
+    return true;
+}
+
+} // namespace
+
+void hitboxUpdate(HitboxSet& h, const CharacterSet& set) {
+    if (h.count != set.count) {
+        // joined or left: start over
+        h.count = set.count;
+        size_t n = size_t(set.count) * SKEL_LANES;
+        for (std::vector<float>* v : { &h.ax, &h.ay, &h.az, &h.bx, &h.by, &h.bz }) v->assign(n, 0.0f);
+        h.radius.assign(n, -1.0f);
+        h.bounds.assign(set.count, Aabb());
+        h.proxies.assign(set.count, AABB_NULL);
+        h.tree = AabbTree();
+    }
+    const BindCapsules& bind = bindCapsules();
+    for (int i=0; i<set.count; ++i) {
+        const float* world = &set.gpu[size_t(i) * CHAR_GPU_FLOATS];
+        float* out[kArrays] = { &h.ax[size_t(i) * SKEL_LANES], &h.ay[size_t(i) * SKEL_LANES],
+                                &h.az[size_t(i) * SKEL_LANES], &h.bx[size_t(i) * SKEL_LANES],
+                                &h.by[size_t(i) * SKEL_LANES], &h.bz[size_t(i) * SKEL_LANES],
+                                &h.radius[size_t(i) * SKEL_LANES] };
+        Aabb box = { Vec3(1e30f, 1e30f, 1e30f), Vec3(-1e30f, -1e30f, -1e30f) };
+        for (int b=0; b<SKEL_BONES; ++b) {
+            const float* skin = characterBoneMatrix(set, i, b);
+            Vec3 a = transformPoint(world, transformPoint(skin, bind.a[b]));
+            Vec3 e = transformPoint(world, transformPoint(skin, bind.b[b]));
+            float r = bind.radius[b];
+            out[0][b] = a.x; out[1][b] = a.y; out[2][b] = a.z;
+            out[3][b] = e.x; out[4][b] = e.y; out[5][b] = e.z;
+            out[6][b] = r;
+            Vec3 pad(r, r, r);
+            box = aabbUnion(box, { Vec3(fminf(a.x, e.x), fminf(a.y, e.y), fminf(a.z, e.z)) - pad,
+                                   Vec3(fmaxf(a.x, e.x), fmaxf(a.y, e.y), fmaxf(a.z, e.z)) + pad });
+        }
+        if (h.proxies[i] == AABB_NULL) {
+            h.proxies[i] = aabbInsert(h.tree, box, 1, uint32_t(i));
+        } else {
+            aabbMove(h.tree, h.proxies[i], box, box.min - h.bounds[i].min);
+        }
+        h.bounds[i] = box;
+    }
+}
+
+// Ray against capsule: the infinite cylinder first, then the sphere at whichever end the
+// cylinder hit lies beyond. Both answers are computed in every lane and selected.
+bool hitboxRaycast(HitboxSet& h, const Vec3& origin, const Vec3& dir, float maxDist, HitboxHit& hit) {
+    int n = gatherCandidates(h, origin, dir, maxDist);
+    const float* ax = h.batch.data();
+    const float *ay = ax + n, *az = ay + n, *bx = az + n, *by = bx + n, *bz = by + n, *rad = bz + n;
+    const F4 zero = f4Splat(0.0f), limit = f4Splat(maxDist), four = f4Splat(4.0f);
+    const F4 ox = f4Splat(origin.x), oy = f4Splat(origin.y), oz = f4Splat(origin.z);
+    const F4 dx = f4Splat(dir.x), dy = f4Splat(dir.y), dz = f4Splat(dir.z);
+    F4 best = f4Splat(INFINITY), bestIndex = f4Splat(-1.0f), index = f4Set(0.0f, 1.0f, 2.0f, 3.0f);
+    for (int i=0; i<n; i += 4, index = index + four) {
+        F4 pax = f4Load(ax + i), pay = f4Load(ay + i), paz = f4Load(az + i);
+        F4 pbx = f4Load(bx + i), pby = f4Load(by + i), pbz = f4Load(bz + i), r = f4Load(rad + i);
+        F4 bax = pbx - pax, bay = pby - pay, baz = pbz - paz;
+        F4 oax = ox - pax, oay = oy - pay, oaz = oz - paz;
+        F4 baba = bax * bax + bay * bay + baz * baz;
+        F4 bard = bax * dx + bay * dy + baz * dz;
+        F4 baoa = bax * oax + bay * oay + baz * oaz;
+        F4 rdoa = dx * oax + dy * oay + dz * oaz;
+        F4 oaoa = oax * oax + oay * oay + oaz * oaz;
+        F4 rr = r * r;
+        F4 k2 = baba - bard * bard;
+        F4 k1 = baba * rdoa - baoa * bard;
+        F4 k0 = baba * oaoa - baoa * baoa - rr * baba;
+        F4 disc = k1 * k1 - k2 * k0;
+        F4 cylinder = f4LessEq(zero, disc);
+        F4 tBody = (zero - k1 - f4Sqrt(f4Max(disc, zero))) / k2;
+        F4 y = baoa + tBody * bard;
+        // a ray along the axis (k2 == 0, or rounded below) never hits the body, and tBody is
+        // NaN: it enters through the cap at the end it comes from
+        F4 parallel = f4LessEq(k2, zero);
+        F4 body = f4Select(parallel, zero, f4And(cylinder, f4And(f4Less(zero, y), f4Less(y, baba))));
+        F4 below = f4Select(parallel, f4Less(zero, bard), f4LessEq(y, zero));
+        F4 ocx = f4Select(below, oax, ox - pbx), ocy = f4Select(below, oay, oy - pby), ocz = f4Select(below, oaz, oz - pbz);
+        F4 cb = dx * ocx + dy * ocy + dz * ocz;
+        F4 cc = ocx * ocx + ocy * ocy + ocz * ocz - rr;
+        F4 capDisc = cb * cb - cc;
+        F4 cap = f4And(cylinder, f4Less(zero, capDisc));
+        F4 t = f4Select(body, tBody, zero - cb - f4Sqrt(f4Max(capDisc, zero)));
+        F4 ok = f4And(f4Or(body, cap), f4And(f4Less(zero, r), f4And(f4LessEq(zero, t), f4LessEq(t, limit))));
+        F4 closer = f4And(ok, f4Less(t, best));
+        best = f4Select(closer, t, best);
+        bestIndex = f4Select(closer, index, bestIndex);
+    }
+    // lowest distance over the lanes, the earliest capsule on a tie, as a capsule at a time would
+    alignas(16) float d[4], at[4];
+    f4Store(d, best);
+    f4Store(at, bestIndex);
+    int k = 0;
+    for (int l=1; l<4; ++l) {
+        if (at[l] >= 0.0f && (at[k] < 0.0f || d[l] < d[k] || (d[l] == d[k] && at[l] < at[k]))) k = l;
+    }
+    return finishHit(h, int(at[k]), at[k] < 0.0f ? maxDist : d[k], hit);
+}
+
+bool hitboxRaycastScalar(HitboxSet& h, const Vec3& origin, const Vec3& dir, float maxDist, HitboxHit& hit) {
+    int n = gatherCandidates(h, origin, dir, maxDist);
+    const float* ax = h.batch.data();
+    const float *ay = ax + n, *az = ay + n, *bx = az + n, *by = bx + n, *bz = by + n, *rad = bz + n;
+    float best = INFINITY;
+    int bestIndex = -1;
+    for (int i=0; i<n; ++i) {
+        float bax = bx[i] - ax[i], bay = by[i] - ay[i], baz = bz[i] - az[i];
+        float oax = origin.x - ax[i], oay = origin.y - ay[i], oaz = origin.z - az[i];
+        float baba = bax * bax + bay * bay + baz * baz;
+        float bard = bax * dir.x + bay * dir.y + baz * dir.z;
+        float baoa = bax * oax + bay * oay + baz * oaz;
+        float rdoa = dir.x * oax + dir.y * oay + dir.z * oaz;
+        float oaoa = oax * oax + oay * oay + oaz * oaz;
+        float rr = rad[i] * rad[i];
+        float k2 = baba - bard * bard;
+        float k1 = baba * rdoa - baoa * bard;
+        float k0 = baba * oaoa - baoa * baoa - rr * baba;
+        float disc = k1 * k1 - k2 * k0;
+        if (!(0.0f <= disc) || !(0.0f < rad[i])) continue;
+        float tBody = (0.0f - k1 - sqrtf(disc > 0.0f ? disc : 0.0f)) / k2;
+        float y = baoa + tBody * bard;
+        bool parallel = k2 <= 0.0f;
+        float t;
+        if (!parallel && 0.0f < y && y < baba) {
+            t = tBody;
+        } else {
+            bool below = parallel ? 0.0f < bard : y <= 0.0f;
+            float ocx = below ? oax : origin.x - bx[i], ocy = below ? oay : origin.y - by[i];
+            float ocz = below ? oaz : origin.z - bz[i];
+            float cb = dir.x * ocx + dir.y * ocy + dir.z * ocz;
+            float capDisc = cb * cb - (ocx * ocx + ocy * ocy + ocz * ocz - rr);
+            if (!(0.0f < capDisc)) continue;
+            t = 0.0f - cb - sqrtf(capDisc);
+        }
+        if (0.0f <= t && t <= maxDist && t < best) {
+            best = t;
+            bestIndex = i;
+        }
+    }
+    return finishHit(h, bestIndex, bestIndex < 0 ? maxDist : best, hit);
+}
@@ -0,0 +1,60 @@
+// Per-bone hitboxes for hitscan against characters (animation.h).
+//
+// Every bone carries a capsule fitted to its body part volume in the bind pose: a segment along
+// the volume's longest side, the radius half its mean cross-section. hitboxUpdate() moves the
+// capsules with each character's current pose (bone skinning matrix, then instance transform,
+// both read from CharacterSet::gpu) into SoA arrays, SKEL_LANES per character, and keeps one
+// leaf per character, the box around its capsules, in an AabbTree (aabb_tree.h).
+//
+// A shot asks the tree for the characters whose boxes its ray crosses, gathers their capsules
+// into one batch and tests the ray against four capsules at a time in SIMD lanes (simd.h). The
+// nearest capsule hit wins and names the bone, and through it the body part that takes the
+// damage. hitboxRaycastScalar() does the same a capsule at a time, the reference the lanes
+// must match bit for bit.
+#pragma once
+
+#include "aabb_tree.h"
+#include "animation.h"
+#include "vecmath.h"
+
+#include <cstdint>
+#include <vector>
+
+enum HitPart : uint8_t { HIT_HEAD, HIT_TORSO, HIT_ARM, HIT_LEG, HIT_PART_COUNT };
+
+extern const uint8_t hitboxBonePart[SKEL_BONES];
+const char* hitPartName(int part);
+
+struct HitboxStats {
+    uint64_t rays = 0;
+    uint64_t candidates = 0;  // characters whose capsules were tested
+    uint64_t capsules = 0;
+};
+
+struct HitboxSet {
+    int count = 0;  // characters
+    std::vector<float> ax, ay, az, bx, by, bz, radius;  // segment ends and radius, count * SKEL_LANES
+    std::vector<Aabb> bounds;                           // around each character's capsules
+    std::vector<int> proxies;                           // bounds leaves in tree
+    AabbTree tree;
+
+    // scratch of the last shot: candidates and their capsules gathered into one batch
+    std::vector<AabbPair> pairs;
+    std::vector<float> batch;
+    std::vector<int> batchOwner;
+    HitboxStats stats;
+};
+
+struct HitboxHit {
+    int character;  // -1: nothing hit
+    int bone;
+    uint8_t part;
+    float dist;     // along the unit direction
+};
+
+// Poses the capsules after animateCharacters(); the set follows the character count.
+void hitboxUpdate(HitboxSet& h, const CharacterSet& set);
+
+// Nearest capsule the ray (dir unit length) enters within maxDist.
+bool hitboxRaycast(HitboxSet& h, const Vec3& origin, const Vec3& dir, float maxDist, HitboxHit& hit);
+bool hitboxRaycastScalar(HitboxSet& h, const Vec3& origin, const Vec3& dir, float maxDist, HitboxHit& hit);
@@ -0,0 +1,258 @@
+#include "hud.h"
+#include "glutil.h"
+#include "profiler.h"
+
+#include <cmath>
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <vector>
+
+namespace {
+
+// Classic 5x7 font, ASCII 32..126. One byte per column, bit 0 is the top row.
+const uint8_t font5x7[95][5] = {
+    {0x00,0x00,0x00,0x00,0x00}, {0x00,0x00,0x5F,0x00,0x00}, {0x00,0x07,0x00,0x07,0x00}, {0x14,0x7F,0x14,0x7F,0x14},
+    {0x24,0x2A,0x7F,0x2A,0x12}, {0x23,0x13,0x08,0x64,0x62}, {0x36,0x49,0x56,0x20,0x50}, {0x00,0x05,0x03,0x00,0x00},
+    {0x00,0x1C,0x22,0x41,0x00}, {0x00,0x41,0x22,0x1C,0x00}, {0x2A,0x1C,0x7F,0x1C,0x2A}, {0x08,0x08,0x3E,0x08,0x08},
+    {0x00,0x50,0x30,0x00,0x00}, {0x08,0x08,0x08,0x08,0x08}, {0x00,0x60,0x60,0x00,0x00}, {0x20,0x10,0x08,0x04,0x02},
+    {0x3E,0x51,0x49,0x45,0x3E}, {0x00,0x42,0x7F,0x40,0x00}, {0x42,0x61,0x51,0x49,0x46}, {0x21,0x41,0x45,0x4B,0x31},
+    {0x18,0x14,0x12,0x7F,0x10}, {0x27,0x45,0x45,0x45,0x39}, {0x3C,0x4A,0x49,0x49,0x30}, {0x01,0x71,0x09,0x05,0x03},
+    {0x36,0x49,0x49,0x49,0x36}, {0x06,0x49,0x49,0x29,0x1E}, {0x00,0x36,0x36,0x00,0x00}, {0x00,0x56,0x36,0x00,0x00},
+    {0x08,0x14,0x22,0x41,0x00}, {0x14,0x14,0x14,0x14,0x14}, {0x00,0x41,0x22,0x14,0x08}, {0x02,0x01,0x51,0x09,0x06},
+    {0x32,0x49,0x79,0x41,0x3E}, {0x7E,0x11,0x11,0x11,0x7E}, {0x7F,0x49,0x49,0x49,0x36}, {0x3E,0x41,0x41,0x41,0x22},
+    {0x7F,0x41,0x41,0x22,0x1C}, {0x7F,0x49,0x49,0x49,0x41}, {0x7F,0x09,0x09,0x09,0x01}, {0x3E,0x41,0x49,0x49,0x7A},
+    {0x7F,0x08,0x08,0x08,0x7F}, {0x00,0x41,0x7F,0x41,0x00}, {0x20,0x40,0x41,0x3F,0x01}, {0x7F,0x08,0x14,0x22,0x41},
+    {0x7F,0x40,0x40,0x40,0x40}, {0x7F,0x02,0x0C,0x02,0x7F}, {0x7F,0x04,0x08,0x10,0x7F}, {0x3E,0x41,0x41,0x41,0x3E},
+    {0x7F,0x09,0x09,0x09,0x06}, {0x3E,0x41,0x51,0x21,0x5E}, {0x7F,0x09,0x19,0x29,0x46}, {0x46,0x49,0x49,0x49,0x31},
+    {0x01,0x01,0x7F,0x01,0x01}, {0x3F,0x40,0x40,0x40,0x3F}, {0x1F,0x20,0x40,0x20,0x1F}, {0x3F,0x40,0x38,0x40,0x3F},
+    {0x63,0x14,0x08,0x14,0x63}, {0x07,0x08,0x70,0x08,0x07}, {0x61,0x51,0x49,0x45,0x43}, {0x00,0x7F,0x41,0x41,0x00},
+    {0x02,0x04,0x08,0x10,0x20}, {0x00,0x41,0x41,0x7F,0x00}, {0x04,0x02,0x01,0x02,0x04}, {0x40,0x40,0x40,0x40,0x40},
+    {0x00,0x01,0x02,0x04,0x00}, {0x20,0x54,0x54,0x54,0x78}, {0x7F,0x48,0x44,0x44,0x38}, {0x38,0x44,0x44,0x44,0x20},
+    {0x38,0x44,0x44,0x48,0x7F}, {0x38,0x54,0x54,0x54,0x18}, {0x08,0x7E,0x09,0x01,0x02}, {0x0C,0x52,0x52,0x52,0x3E},
+    {0x7F,0x08,0x04,0x04,0x78}, {0x00,0x44,0x7D,0x40,0x00}, {0x20,0x40,0x44,0x3D,0x00}, {0x7F,0x10,0x28,0x44,0x00},
+    {0x00,0x41,0x7F,0x40,0x00}, {0x7C,0x04,0x18,0x04,0x78}, {0x7C,0x08,0x04,0x04,0x78}, {0x38,0x44,0x44,0x44,0x38},
+    {0x7C,0x14,0x14,0x14,0x08}, {0x08,0x14,0x14,0x18,0x7C}, {0x7C,0x08,0x04,0x04,0x08}, {0x48,0x54,0x54,0x54,0x20},
+    {0x04,0x3F,0x44,0x40,0x20}, {0x3C,0x40,0x40,0x20,0x7C}, {0x1C,0x20,0x40,0x20,0x1C}, {0x3C,0x40,0x30,0x40,0x3C},
+    {0x44,0x28,0x10,0x28,0x44}, {0x0C,0x50,0x50,0x50,0x3C}, {0x44,0x64,0x54,0x4C,0x44}, {0x00,0x08,0x36,0x41,0x00},
+    {0x00,0x00,0x7F,0x00,0x00}, {0x00,0x41,0x36,0x08,0x00}, {0x08,0x04,0x08,0x10,0x08},
+};
+
+// Atlas: 16x6 cells of 8x8 texels; the last cell (index 95) is solid and used for untextured quads.
+const int ATLAS_W = 128, ATLAS_H = 64, CELL = 8, CELLS_PER_ROW = 16, SOLID_CELL = 95;
+const int MAX_QUADS = 16384;  // 16-bit indices
+
+const char* hudVertexSrc = R"(#version 300 es
+in vec2 aPos;
+in vec2 aUV;
+in vec4 aColor;
+uniform vec2 uScreen;
+out vec2 vUV;
+out vec4 vColor;
+void main() {
+    vUV = aUV;
+    vColor = aColor;
+    gl_Position = vec4(aPos.x / uScreen.x * 2.0 - 1.0, 1.0 - aPos.y / uScreen.y * 2.0, 0.0, 1.0);
+}
+)";
+
+const char* hudFragSrc = R"(#version 300 es
+precision mediump float;
+uniform sampler2D uAtlas;
+uniform bool uImage;
+in vec2 vUV;
+in vec4 vColor;
+out vec4 fragColor;
+void main(){
+    vec4 t = texture(uAtlas, vUV);
+    fragColor = uImage ? vColor * t : vec4(vColor.rgb, vColor.a * t.r);
+}
+)";
+
+struct HudVertex {
+    float x, y;
+    uint16_t u, v;   // normalized
+    uint32_t color;
+};
+
+// Consecutive quads sampling the same texture; the atlas is 0.
+struct HudRun {
+    GLuint texture;
+    int firstQuad, quads;
+};
+
+GLuint hudProg = 0, atlasTex = 0, hudVbo = 0, hudIbo = 0;
+GLint locScreen = -1, locAtlas = -1, locImage = -1, attrPos = -1, attrUV = -1, attrColor = -1;
+std::vector<HudVertex> verts;
+std::vector<HudRun> runs;
+int screenW = 1, screenH = 1;
+int profHud = -1, profQuads = -1;
+
+bool reserveQuad(GLuint texture) {
+    if (verts.size() >= size_t(MAX_QUADS) * 4) return false;
+    int quad = int(verts.size() / 4);
+    if (runs.empty() || runs.back().texture != texture) runs.push_back({texture, quad, 0});
+    ++runs.back().quads;
+    return true;
+}
+
+void pushQuad(float x0, float y0, float x1, float y1, float x2, float y2, float x3, float y3,
+              int cell, uint32_t color) {
+    if (!reserveQuad(0)) return;
+    int cx = (cell % CELLS_PER_ROW) * CELL, cy = (cell / CELLS_PER_ROW) * CELL;
+    uint16_t u0 = uint16_t(cx * 65535 / ATLAS_W), u1 = uint16_t((cx + HUD_GLYPH_W) * 65535 / ATLAS_W);
+    uint16_t v0 = uint16_t(cy * 65535 / ATLAS_H), v1 = uint16_t((cy + HUD_GLYPH_H - 1) * 65535 / ATLAS_H);
+    if (cell == SOLID_CELL) {
+        // sample the middle of the solid cell so filtering never reaches a glyph
+        u0 = u1 = uint16_t((cx + CELL/2) * 65535 / ATLAS_W);
+        v0 = v1 = uint16_t((cy + CELL/2) * 65535 / ATLAS_H);
+    }
+    verts.push_back({x0, y0, u0, v0, color});
+    verts.push_back({x1, y1, u1, v0, color});
+    verts.push_back({x2, y2, u1, v1, color});
+    verts.push_back({x3, y3, u0, v1, color});
+}
+
+void buildAtlas() {
+    std::vector<uint8_t> pixels(ATLAS_W * ATLAS_H, 0);
+    for (int g=0; g<95; ++g) {
+        int cx = (g % CELLS_PER_ROW) * CELL, cy = (g / CELLS_PER_ROW) * CELL;
+        for (int col=0; col<5; ++col) for (int row=0; row<7; ++row) {
+            if (font5x7[g][col] & (1 << row)) pixels[(cy + row + 1) * ATLAS_W + cx + col] = 255;
+        }
+    }
+    int sx = (SOLID_CELL % CELLS_PER_ROW) * CELL, sy = (SOLID_CELL / CELLS_PER_ROW) * CELL;
+    for (int y=0; y<CELL; ++y) for (int x=0; x<CELL; ++x) pixels[(sy + y) * ATLAS_W + sx + x] = 255;
+
+    glGenTextures(1, &atlasTex);
+    glBindTexture(GL_TEXTURE_2D, atlasTex);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, ATLAS_W, ATLAS_H, 0, GL_RED, GL_UNSIGNED_BYTE, pixels.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+} // namespace
+
+void hudInit() {
+    hudProg = buildProgram(hudVertexSrc, hudFragSrc);
+    locScreen = glGetUniformLocation(hudProg, "uScreen");
+    locAtlas = glGetUniformLocation(hudProg, "uAtlas");
+    locImage = glGetUniformLocation(hudProg, "uImage");
+    attrPos = glGetAttribLocation(hudProg, "aPos");
+    attrUV = glGetAttribLocation(hudProg, "aUV");
+    attrColor = glGetAttribLocation(hudProg, "aColor");
+    buildAtlas();
+
+    // every quad uses the same 0,1,2 2,3,0 pattern, so the index buffer is static
+    std::vector<uint16_t> idx(MAX_QUADS * 6);
+    for (int q=0; q<MAX_QUADS; ++q) {
+        uint16_t b = uint16_t(q * 4);
+        uint16_t* o = &idx[q * 6];
+        o[0] = b; o[1] = b + 1; o[2] = b + 2; o[3] = b + 2; o[4] = b + 3; o[5] = b;
+    }
+    glGenBuffers(1, &hudIbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, hudIbo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, idx.size() * sizeof(uint16_t), idx.data(), GL_STATIC_DRAW);
+    glGenBuffers(1, &hudVbo);
+    glBindBuffer(GL_ARRAY_BUFFER, hudVbo);
+    glBufferData(GL_ARRAY_BUFFER, MAX_QUADS * 4 * sizeof(HudVertex), nullptr, GL_DYNAMIC_DRAW);
+    verts.reserve(MAX_QUADS * 4);
+
+    profHud = profilerSlot("hud");
+    profQuads = profilerSlot("hud.quads");
+}
+
+void hudBegin(int width, int height) {
+    screenW = width; screenH = height;
+    verts.clear();
+    runs.clear();
+}
+
+void hudRect(float x, float y, float w, float h, uint32_t color) {
+    pushQuad(x, y, x + w, y, x + w, y + h, x, y + h, SOLID_CELL, color);
+}
+
+void hudLine(float x0, float y0, float x1, float y1, float thickness, uint32_t color) {
+    float dx = x1 - x0, dy = y1 - y0;
+    float len = sqrtf(dx*dx + dy*dy);
+    if (len <= 0.0f) return;
+    float nx = -dy / len * thickness * 0.5f, ny = dx / len * thickness * 0.5f;
+    pushQuad(x0 + nx, y0 + ny, x1 + nx, y1 + ny, x1 - nx, y1 - ny, x0 - nx, y0 - ny, SOLID_CELL, color);
+}
+
+void hudImage(float x, float y, float w, float h, unsigned texture,
+              float u0, float v0, float u1, float v1, uint32_t color) {
+    if (!reserveQuad(texture)) return;
+    auto unorm = [](float t) { return uint16_t(std::min(std::max(t, 0.0f), 1.0f) * 65535.0f + 0.5f); };
+    uint16_t a = unorm(u0), b = unorm(u1), c = unorm(v0), d = unorm(v1);
+    verts.push_back({x, y, a, c, color});
+    verts.push_back({x + w, y, b, c, color});
+    verts.push_back({x + w, y + h, b, d, color});
+    verts.push_back({x, y + h, a, d, color});
+}
+
+float hudText(float x, float y, const char* text, uint32_t color, float scale) {
+    float cx = x, cy = y, widest = 0.0f;
+    float gw = HUD_GLYPH_W * scale, gh = (HUD_GLYPH_H - 1) * scale;
+    for (const char* p = text; *p; ++p) {
+        unsigned char c = (unsigned char)*p;
+        if (c == '\n') {
+            widest = std::max(widest, cx - x);
+            cx = x; cy += HUD_GLYPH_H * scale;
+            continue;
+        }
+        if (c > 32 && c < 127) pushQuad(cx, cy, cx + gw, cy, cx + gw, cy + gh, cx, cy + gh, c - 32, color);
+        cx += gw;
+    }
+    return std::max(widest, cx - x);
+}
+
+float hudTextf(float x, float y, uint32_t color, float scale, const char* fmt, ...) {
+    char buf[512];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    return hudText(x, y, buf, color, scale);
+}
+
+void hudEnd() {
+    ProfileScope scope(profHud);
+    int quads = int(verts.size() / 4);
+    profilerAddCount(profQuads, quads);
+    if (quads == 0) return;
+
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glUseProgram(hudProg);
+    glUniform2f(locScreen, float(screenW), float(screenH));
+    glActiveTexture(GL_TEXTURE0);
+    glUniform1i(locAtlas, 0);
+
+    glBindBuffer(GL_ARRAY_BUFFER, hudVbo);
+    // orphan the previous frame's storage so the upload never waits on the GPU
+    glBufferData(GL_ARRAY_BUFFER, MAX_QUADS * 4 * sizeof(HudVertex), nullptr, GL_DYNAMIC_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, verts.size() * sizeof(HudVertex), verts.data());
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, hudIbo);
+    glEnableVertexAttribArray(attrPos);
+    glVertexAttribPointer(attrPos, 2, GL_FLOAT, GL_FALSE, sizeof(HudVertex), (void*)(0));
+    glEnableVertexAttribArray(attrUV);
+    glVertexAttribPointer(attrUV, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(HudVertex), (void*)(sizeof(float)*2));
+    glEnableVertexAttribArray(attrColor);
+    glVertexAttribPointer(attrColor, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(HudVertex), (void*)(sizeof(float)*2 + 4));
+    for (const HudRun& r : runs) {
+        glBindTexture(GL_TEXTURE_2D, r.texture ? r.texture : atlasTex);
+        glUniform1i(locImage, r.texture ? 1 : 0);
+        glDrawElements(GL_TRIANGLES, r.quads * 6, GL_UNSIGNED_SHORT, (void*)(size_t(r.firstQuad) * 6 * sizeof(uint16_t)));
+    }
+    glDisableVertexAttribArray(attrPos);
+    glDisableVertexAttribArray(attrUV);
+    glDisableVertexAttribArray(attrColor);
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+}
@@ -0,0 +1,29 @@
+// Immediate-mode 2D batcher for the HUD and debug overlays. Rectangles, lines, text and images
+// issued between hudBegin() and hudEnd() land in one dynamic vertex buffer and are drawn with one
+// call per run of quads sharing a texture (a single call when no images are used). Text uses a
+// 5x7 bitmap font rasterised into an atlas at startup (no asset files).
+#pragma once
+
+#include <cstdint>
+
+// Packed colour, bytes in memory order r,g,b,a.
+inline uint32_t hudRGBA(int r, int g, int b, int a = 255) {
+    return uint32_t(r) | (uint32_t(g) << 8) | (uint32_t(b) << 16) | (uint32_t(a) << 24);
+}
+
+const int HUD_GLYPH_W = 6;   // advance in atlas pixels (5 + 1 spacing)
+const int HUD_GLYPH_H = 9;   // line height in atlas pixels (7 + 2 spacing)
+
+void hudInit();
+
+// Starts a frame; coordinates are pixels with the origin at the top-left of the canvas.
+void hudBegin(int width, int height);
+void hudRect(float x, float y, float w, float h, uint32_t color);
+void hudLine(float x0, float y0, float x1, float y1, float thickness, uint32_t color);
+// Textured quad from an RGBA texture owned by the caller, modulated by color; uv in [0,1].
+void hudImage(float x, float y, float w, float h, unsigned texture,
+              float u0, float v0, float u1, float v1, uint32_t color = 0xffffffffu);
+// Draws one line of ASCII text ('\n' starts a new line); returns the widest line in pixels.
+float hudText(float x, float y, const char* text, uint32_t color, float scale = 1.0f);
+float hudTextf(float x, float y, uint32_t color, float scale, const char* fmt, ...);
+void hudEnd();
@@ -0,0 +1,102 @@
+#include "jobs.h"
+
+#if SANDBOX_HAS_THREADS
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+#if SANDBOX_HAS_THREADS
+
+namespace {
+
+struct Batch {
+    const std::function<void(int, int)>* fn = nullptr;
+    int count = 0, grain = 1;
+    std::atomic<int> next{0};
+    std::atomic<int> done{0};
+    int active = 0;  // workers holding a pointer to this batch (guarded by mtx)
+};
+
+// Workers are detached and park on these forever, so they are allocated once and never
+// destroyed (static destructors would run under their feet at exit).
+struct Pool {
+    int workers = 0;
+    std::mutex mtx;
+    std::condition_variable wake, finished;
+    Batch* current = nullptr;
+    unsigned generation = 0;
+};
+Pool* pool = nullptr;
+
+void runSlices(Batch& b) {
+    for (;;) {
+        int begin = b.next.fetch_add(b.grain);
+        if (begin >= b.count) return;
+        int end = begin + b.grain < b.count ? begin + b.grain : b.count;
+        (*b.fn)(begin, end);
+        b.done.fetch_add(end - begin);
+    }
+}
+
+void workerMain() {
+    unsigned seen = 0;
+    for (;;) {
+        Batch* b;
+        {
+            std::unique_lock<std::mutex> lock(pool->mtx);
+            pool->wake.wait(lock, [&]{ return pool->generation != seen; });
+            seen = pool->generation;
+            b = pool->current;
+            if (b) ++b->active;
+        }
+        if (!b) continue;
+        runSlices(*b);
+        std::lock_guard<std::mutex> lock(pool->mtx);
+        --b->active;
+        pool->finished.notify_all();
+    }
+}
+
+} // namespace
+
+void jobsInit(int count) {
+    if (pool) return;
+    pool = new Pool;
+    if (count < 0) count = int(std::thread::hardware_concurrency()) - 1;
+    for (int i=0; i<count; ++i) std::thread(workerMain).detach();
+    pool->workers = count > 0 ? count : 0;
+}
+
+int jobsWorkerCount() { return pool ? pool->workers : 0; }
+
+void parallelFor(int count, int grain, const std::function<void(int, int)>& fn) {
+    if (count <= 0) return;
+    if (grain < 1) grain = 1;
+    if (!pool || pool->workers == 0 || count <= grain) { fn(0, count); return; }
+
+    Batch b;
+    b.fn = &fn; b.count = count; b.grain = grain;
+    {
+        std::lock_guard<std::mutex> lock(pool->mtx);
+        pool->current = &b;
+        ++pool->generation;
+    }
+    pool->wake.notify_all();
+    runSlices(b);
+    std::unique_lock<std::mutex> lock(pool->mtx);
+    // the batch lives on this stack frame: wait for the slices and for every worker to let go
+    pool->finished.wait(lock, [&]{ return b.done.load() == b.count && b.active == 0; });
+    pool->current = nullptr;
+}
+
+#else
+
+void jobsInit(int) {}
+int jobsWorkerCount() { return 0; }
+void parallelFor(int count, int, const std::function<void(int, int)>& fn) {
+    if (count > 0) fn(0, count);
+}
+
+#endif
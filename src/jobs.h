@@ -0,0 +1,19 @@
+// Minimal fork/join worker pool. On single-threaded web builds (no -pthread) every call runs
+// inline on the caller, so code written against it works everywhere.
+#pragma once
+
+#include <functional>
+
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+#define SANDBOX_HAS_THREADS 0
+#else
+#define SANDBOX_HAS_THREADS 1
+#endif
+
+// workers < 0 picks hardware_concurrency()-1. Safe to call more than once.
+void jobsInit(int workers = -1);
+int jobsWorkerCount();
+
+// Calls fn(begin, end) over [0, count) in slices of at most `grain` items, on the workers
+// and the calling thread. Returns once every slice is done.
+void parallelFor(int count, int grain, const std::function<void(int, int)>& fn);
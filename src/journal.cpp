@@ -0,0 +1,239 @@
+#include "journal.h"
+#include "chunk_codec.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+const uint32_t JOURNAL_FORMAT = 1;
+const size_t SEGMENT_HEADER_BYTES = 24;
+const size_t RECORD_HEADER_BYTES = 16;
+
+void segmentPath(char* buf, size_t size, const std::string& dir, uint32_t seed, uint64_t n) {
+    snprintf(buf, size, "%s/w%u.j%08llu.wal", dir.c_str(), seed, (unsigned long long)n);
+}
+
+bool writeAll(int fd, const uint8_t* data, size_t size, ssize_t (*writeFn)(int, const void*, size_t) = write) {
+    while (size > 0) {
+        ssize_t n = writeFn(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        size -= size_t(n);
+    }
+    return true;
+}
+
+bool syncFile(int fd) {
+#if defined(__linux__)
+    return fdatasync(fd) == 0;
+#else
+    return fsync(fd) == 0;
+#endif
+}
+
+// Segment numbers of this seed present in dir, ascending.
+std::vector<uint64_t> listSegments(const char* dir, uint32_t seed) {
+    std::vector<uint64_t> out;
+    DIR* d = opendir(dir);
+    if (!d) return out;
+    char prefix[32];
+    snprintf(prefix, sizeof(prefix), "w%u.j", seed);
+    size_t plen = strlen(prefix);
+    while (dirent* e = readdir(d)) {
+        const char* name = e->d_name;
+        size_t len = strlen(name);
+        if (strncmp(name, prefix, plen) != 0 || len < plen + 5 || strcmp(name + len - 4, ".wal") != 0) continue;
+        char* end = nullptr;
+        unsigned long long n = strtoull(name + plen, &end, 10);
+        if (end == name + len - 4) out.push_back(n);
+    }
+    closedir(d);
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+// Applies one record body; false if it does not parse (treated like a torn record).
+bool replayBody(const uint8_t* body, size_t size, World& w, uint64_t& edits, std::vector<uint8_t>& cells) {
+    size_t pos = 0;
+    while (pos < size) {
+        uint32_t gx, gz, width, depth;
+        if (!getVarint(body, size, &pos, &gx) || !getVarint(body, size, &pos, &gz) ||
+            !getVarint(body, size, &pos, &width) || !getVarint(body, size, &pos, &depth)) return false;
+        if (width == 0 || depth == 0 || width > 4096 || depth > 4096) return false;
+        cells.resize(size_t(width) * depth);
+        size_t used = chunkDecode(body + pos, size - pos, cells.data(), int(cells.size()));
+        if (used == 0) return false;
+        pos += used;
+        for (uint32_t z=0; z<depth; ++z) for (uint32_t x=0; x<width; ++x) {
+            worldSetHeight(w, int(gx + x), int(gz + z), cells[z * width + x]);
+        }
+        ++edits;
+    }
+    return true;
+}
+
+} // namespace
+
+JournalRecovery journalRecover(const char* dir, uint32_t seed, World& w) {
+    JournalRecovery r;
+    double start = profilerNowMs();
+    std::vector<uint8_t> data, cells;
+    char path[512];
+    worldBeginEdits(w);
+    for (uint64_t n : listSegments(dir, seed)) {
+        r.lastSegment = n;
+        segmentPath(path, sizeof(path), dir, seed, n);
+        FILE* f = fopen(path, "rb");
+        if (!f) continue;
+        data.clear();
+        uint8_t buf[65536];
+        size_t got;
+        while ((got = fread(buf, 1, sizeof(buf), f)) > 0) data.insert(data.end(), buf, buf + got);
+        fclose(f);
+        ++r.segments;
+        r.bytes += data.size();
+        if (data.size() < SEGMENT_HEADER_BYTES || memcmp(data.data(), "SBWL", 4) != 0 ||
+            getU32(&data[4]) != JOURNAL_FORMAT || getU32(&data[8]) != seed) {
+            printf("[journal] %s has a bad header, skipped\n", path);
+            continue;
+        }
+        size_t pos = SEGMENT_HEADER_BYTES;
+        while (pos < data.size()) {
+            if (data.size() - pos < RECORD_HEADER_BYTES) { r.tornTail = true; break; }
+            uint32_t bodySize = getU32(&data[pos]), crc = getU32(&data[pos + 4]);
+            if (data.size() - pos - RECORD_HEADER_BYTES < bodySize ||
+                crc32(&data[pos + 8], 8 + bodySize) != crc) { r.tornTail = true; break; }
+            uint64_t seq = uint64_t(getU32(&data[pos + 8])) | (uint64_t(getU32(&data[pos + 12])) << 32);
+            if (!replayBody(&data[pos + RECORD_HEADER_BYTES], bodySize, w, r.edits, cells)) { r.tornTail = true; break; }
+            r.lastSeq = seq;
+            ++r.records;
+            pos += RECORD_HEADER_BYTES + bodySize;
+        }
+        if (r.tornTail) printf("[journal] %s: torn record at byte %zu, rest ignored\n", path, pos);
+    }
+    worldEndEdits(w);
+    r.ms = profilerNowMs() - start;
+    return r;
+}
+
+bool journalOpen(Journal& j, const char* dir, uint32_t seed, uint64_t segment, uint64_t nextSeq) {
+    journalClose(j);
+    j.dir = dir;
+    j.seed = seed;
+    j.segment = segment;
+    j.nextSeq = nextSeq;
+    char path[512];
+    segmentPath(path, sizeof(path), j.dir, seed, segment);
+    j.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (j.fd < 0) {
+        printf("[journal] cannot open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    std::vector<uint8_t> header = { 'S', 'B', 'W', 'L' };
+    putU32(header, JOURNAL_FORMAT);
+    putU32(header, seed);
+    putU32(header, 0);
+    putU32(header, uint32_t(segment));
+    putU32(header, uint32_t(segment >> 32));
+    // the header must be durable before records can be
+    if (!writeAll(j.fd, header.data(), header.size()) || !syncFile(j.fd)) {
+        printf("[journal] cannot write %s\n", path);
+        journalClose(j);
+        return false;
+    }
+    j.segmentBytes = header.size();
+    // and so must the new directory entry
+    int dfd = open(j.dir.c_str(), O_RDONLY);
+    if (dfd >= 0) {
+        fsync(dfd);
+        close(dfd);
+    }
+    return true;
+}
+
+void journalClose(Journal& j) {
+    if (j.fd >= 0) close(j.fd);
+    j.fd = -1;
+}
+
+void journalOnEdit(const World& w, const WorldEdit& e, void* journal) {
+    Journal& j = *static_cast<Journal*>(journal);
+    int width = e.maxGX - e.minGX + 1, depth = e.maxGZ - e.minGZ + 1;
+    putVarint(j.pending, uint32_t(e.minGX));
+    putVarint(j.pending, uint32_t(e.minGZ));
+    putVarint(j.pending, uint32_t(width));
+    putVarint(j.pending, uint32_t(depth));
+    // the cells after the edit; merged batch events carry the whole rectangle
+    j.scratch.resize(size_t(width) * depth);
+    for (int z=0; z<depth; ++z) for (int x=0; x<width; ++x) {
+        j.scratch[z * width + x] = uint8_t(worldHeight(w, e.minGX + x, e.minGZ + z));
+    }
+    chunkEncode(j.scratch.data(), width * depth, j.pending);
+    ++j.pendingEdits;
+}
+
+bool journalCommit(Journal& j) {
+    if (j.pendingEdits == 0 || j.fd < 0) return j.fd >= 0;
+    std::vector<uint8_t> record;
+    record.reserve(RECORD_HEADER_BYTES + j.pending.size());
+    putU32(record, uint32_t(j.pending.size()));
+    putU32(record, 0);  // crc, filled below
+    putU32(record, uint32_t(j.nextSeq));
+    putU32(record, uint32_t(j.nextSeq >> 32));
+    record.insert(record.end(), j.pending.begin(), j.pending.end());
+    setU32(&record[4], crc32(&record[8], record.size() - 8));
+
+    bool ok = writeAll(j.fd, record.data(), record.size(), j.writeFn);
+    if (ok && j.durable) {
+        double start = profilerNowMs();
+        ok = syncFile(j.fd);
+        j.syncMs += profilerNowMs() - start;
+    }
+    if (!ok) {
+        printf("[journal] commit of record %llu failed: %s\n", (unsigned long long)j.nextSeq, strerror(errno));
+        // Recovery stops at a torn record, so whatever part of it reached the file has to go
+        // before the retry appends: cut the segment back, or leave it for a fresh one.
+        if (ftruncate(j.fd, off_t(j.segmentBytes)) != 0 || !syncFile(j.fd)) {
+            uint64_t torn = j.segment;
+            std::string dir = j.dir;
+            journalOpen(j, dir.c_str(), j.seed, torn + 1, j.nextSeq);
+        }
+        return false;
+    }
+    ++j.nextSeq;
+    ++j.commits;
+    j.editsLogged += uint64_t(j.pendingEdits);
+    j.bytesLogged += record.size();
+    j.segmentBytes += record.size();
+    j.pending.clear();
+    j.pendingEdits = 0;
+    return true;
+}
+
+uint64_t journalRotate(Journal& j) {
+    journalCommit(j);
+    uint64_t closed = j.segment;
+    std::string dir = j.dir;
+    journalOpen(j, dir.c_str(), j.seed, closed + 1, j.nextSeq);
+    return closed;
+}
+
+void journalDropSegments(const Journal& j, uint64_t upTo) {
+    char path[512];
+    for (uint64_t n : listSegments(j.dir.c_str(), j.seed)) {
+        if (n > upTo || (n == j.segment && j.fd >= 0)) continue;
+        segmentPath(path, sizeof(path), j.dir, j.seed, n);
+        remove(path);
+    }
+}
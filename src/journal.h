@@ -0,0 +1,71 @@
+// Write-ahead journal of world edits for the dedicated server.
+//
+// The journal subscribes to world edits and collects everything edited during a tick into
+// one record; journalCommit() appends it with a single write and a single fsync (group
+// commit). The log is split into numbered segments: a checkpoint rotates to a new segment,
+// saves the world regions from a snapshot (autosave.h) and, once that save is on disk,
+// deletes the segments it covers. Startup recovery loads the checkpoint regions and replays
+// the remaining segments in order. Records store absolute column heights, so replaying a
+// segment on top of a newer checkpoint is harmless.
+//
+// Segment file <dir>/w<seed>.j<n>.wal:
+//   "SBWL", u32 format, u32 seed, u32 reserved, u64 n
+//   records: u32 bodySize, u32 CRC-32 of (seq + body), u64 seq, body
+//   body: entries of varint gx, gz, width, depth + chunk_codec cells of that column rectangle
+#pragma once
+
+#include "world.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+struct Journal {
+    std::string dir;
+    uint32_t seed = 0;
+    int fd = -1;
+    uint64_t segment = 0;        // open segment
+    uint64_t nextSeq = 1;
+    std::vector<uint8_t> pending;  // body of the current tick's record
+    int pendingEdits = 0;
+    std::vector<uint8_t> scratch;
+    size_t segmentBytes = 0;
+    bool durable = true;         // fsync on every commit
+    ssize_t (*writeFn)(int fd, const void* data, size_t size) = write;  // records; the bench injects failures
+    // totals for reporting
+    uint64_t commits = 0;
+    uint64_t editsLogged = 0;
+    uint64_t bytesLogged = 0;
+    double syncMs = 0.0;
+};
+
+struct JournalRecovery {
+    int segments = 0;
+    uint64_t records = 0;
+    uint64_t edits = 0;
+    size_t bytes = 0;
+    bool tornTail = false;       // stopped at an incomplete or corrupt record
+    uint64_t lastSegment = 0;    // highest segment found (0 if none)
+    uint64_t lastSeq = 0;
+    double ms = 0.0;
+};
+
+// Replays every segment of this seed, oldest first, on top of the world (batched edits).
+JournalRecovery journalRecover(const char* dir, uint32_t seed, World& w);
+
+// Opens (creates) segment `segment` for appending; sequence numbers continue from nextSeq.
+bool journalOpen(Journal& j, const char* dir, uint32_t seed, uint64_t segment, uint64_t nextSeq = 1);
+void journalClose(Journal& j);
+
+// Edit subscriber: worldSubscribe(world, journalOnEdit, &journal).
+void journalOnEdit(const World& w, const WorldEdit& e, void* journal);
+
+// Writes the pending record and fsyncs once; no-op when nothing was edited.
+bool journalCommit(Journal& j);
+
+// Commits, then continues in a new segment. Returns the last segment that is now closed.
+uint64_t journalRotate(Journal& j);
+// Deletes closed segments up to and including `upTo` (after a checkpoint covering them).
+void journalDropSegments(const Journal& j, uint64_t upTo);
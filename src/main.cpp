@@ -12,160 +12,175 @@
 
 #include <emscripten/emscripten.h>
 #include <emscripten/html5.h>
-#include <GLES2/gl2.h>
+
+#include "animation.h"
+#include "audio.h"
+#include "autosave.h"
+#include "decoration_render.h"
+#include "det_physics.h"
+#include "game_rules.h"
+#include "glutil.h"
+#include "hitboxes.h"
+#include "hud.h"
+#include "jobs.h"
+#include "minimap.h"
+#include "profiler.h"
+#include "prop_render.h"
+#include "props.h"
+#include "remote.h"
+#include "shadows.h"
+#include "skinned_mesh.h"
+#include "terrain_render.h"
+#include "undo.h"
+#include "vecmath.h"
+#include "world.h"
+#include "worldgen_pipeline.h"
 
 #include <vector>
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
 #include <cstdio>
 #include <cstring>
 #include <ctime>
 
-// ----------------- Minimal math (vec3, mat4) -----------------
-struct Vec3 {
-    float x,y,z;
-    Vec3():x(0),y(0),z(0){}
-    Vec3(float X,float Y,float Z):x(X),y(Y),z(Z){}
-    Vec3 operator+(const Vec3& o) const { return Vec3(x+o.x,y+o.y,z+o.z); }
-    Vec3 operator-(const Vec3& o) const { return Vec3(x-o.x,y-o.y,z-o.z); }
-    Vec3 operator*(float s) const { return Vec3(x*s,y*s,z*s); }
-};
-inline float dot(const Vec3& a, const Vec3& b){ return a.x*b.x + a.y*b.y + a.z*b.z; }
-inline Vec3 cross(const Vec3& a,const Vec3& b){ return Vec3(a.y*b.z-a.z*b.y, a.z*b.x-a.x*b.z, a.x*b.y-a.y*b.x); }
-inline float length(const Vec3& v){ return sqrtf(dot(v,v)); }
-inline Vec3 normalize(const Vec3& v){ float l=length(v); return l>0? v*(1.0f/l) : Vec3(0,0,0); }
-
-struct Mat4 {
-    float m[16];
-    static Mat4 identity() {
-        Mat4 r; memset(r.m,0,sizeof(r.m));
-        r.m[0]=r.m[5]=r.m[10]=r.m[15]=1.0f;
-        return r;
-    }
-};
-
-// column-major helpers
-Mat4 perspective(float fovy, float aspect, float nearv, float farv){
-    Mat4 o; memset(o.m,0,sizeof(o.m));
-    float f = 1.0f / tanf(fovy*0.5f);
-    o.m[0] = f / aspect;
-    o.m[5] = f;
-    o.m[10] = (farv + nearv) / (nearv - farv);
-    o.m[11] = -1.0f;
-    o.m[14] = (2.0f * farv * nearv) / (nearv - farv);
-    return o;
+// ----------------- World (grid of cubes, chunked; see world.h) -----------------
+World world;
+uint32_t worldSeed = DEFAULT_WORLD_SEED;
+double worldGenMs = 0.0;
+bool worldWasBaked = false;
+WorldGenPipeline worldGen;  // keeps the layer caches and per-layer stats of the last generation
+PropSet props;              // doors, platforms, pickups and triggers on top of the grid (props.h)
+
+// Cached shadow cascades redraw just the texels under the changed columns.
+void invalidateShadowsForEdit(const World& w, const WorldEdit& e, void*) {
+    float B = w.cfg.blockSize;
+    Vec3 minp(gridToWorldX(w, e.minGX) - 0.5f * B, e.minLevel * B, gridToWorldZ(w, e.minGZ) - 0.5f * B);
+    Vec3 maxp(gridToWorldX(w, e.maxGX) + 0.5f * B, e.maxLevel * B, gridToWorldZ(w, e.maxGZ) + 0.5f * B);
+    shadowsInvalidateBox(minp, maxp);
 }
 
-Mat4 lookAt(const Vec3& eye, const Vec3& center, const Vec3& up){
-    Vec3 f = normalize(center - eye);
-    Vec3 s = normalize(cross(f, up));
-    Vec3 u = cross(s, f);
-    Mat4 m = Mat4::identity();
-    m.m[0] = s.x; m.m[4] = s.y; m.m[8]  = s.z;
-    m.m[1] = u.x; m.m[5] = u.y; m.m[9]  = u.z;
-    m.m[2] = -f.x; m.m[6] = -f.y; m.m[10] = -f.z;
-    m.m[12] = -dot(s, eye);
-    m.m[13] = -dot(u, eye);
-    m.m[14] = dot(f, eye);
-    return m;
+void initWorld() {
+    WorldConfig cfg;
+    cfg.chunkSize = worldChooseChunkSize(cfg.gridW, cfg.gridH);
+    worldInit(world, cfg);
+    worldSubscribe(world, invalidateShadowsForEdit, nullptr);
 }
 
-// ----------------- Simple GL helpers -----------------
-GLuint compileShader(GLenum type, const char* src) {
-    GLuint s = glCreateShader(type);
-    glShaderSource(s, 1, &src, nullptr);
-    glCompileShader(s);
-    GLint ok; glGetShaderiv(s, GL_COMPILE_STATUS, &ok);
-    if (!ok) {
-        GLchar buf[1024]; glGetShaderInfoLog(s, sizeof(buf), nullptr, buf);
-        printf("Shader compile error: %s\n", buf);
+void generateWorld() {
+    double start = emscripten_get_now();
+    worldWasBaked = worldGenerate(world, worldSeed, &worldGen);
+    worldGenMs = emscripten_get_now() - start;
+    if (!worldWasBaked) {
+        printf("[worldgen] seed %u: %llu chunks in %.2f ms (%.0f chunks/s)\n", worldSeed,
+               (unsigned long long)worldGen.chunks, worldGen.ms, worldGen.chunks / (worldGen.ms * 0.001));
     }
-    return s;
+    propsSpawn(props, world, worldSeed);
 }
-GLuint linkProgram(GLuint v, GLuint f) {
-    GLuint p = glCreateProgram();
-    glAttachShader(p, v); glAttachShader(p, f);
-    glLinkProgram(p);
-    GLint ok; glGetProgramiv(p, GL_LINK_STATUS, &ok);
-    if (!ok) {
-        GLchar buf[1024]; glGetProgramInfoLog(p, sizeof(buf), nullptr, buf);
-        printf("Program link error: %s\n", buf);
-    }
-    return p;
+
+// Saved edits for this seed go on top of the generated map once the save dir is readable
+// (IndexedDB loads asynchronously); until then nothing is saved so the save isn't clobbered.
+bool saveLoaded = false;
+bool onlineWorld = false;  // the map has been switched over to the server's
+
+// Online the map is the server's: the local save is neither applied nor written.
+void restoreSave() {
+    saveLoaded = true;
+    if (onlineWorld) return;
+    int regions = autosaveLoad(world, worldSeed);
+    if (regions > 0) printf("[autosave] restored %d regions for seed %u\n", regions, worldSeed);
 }
 
-// Simple vertex + fragment shader (colored)
-const char* vertexSrc = R"(
-attribute vec3 aPos;
-attribute vec3 aColor;
-uniform mat4 uMVP;
-varying vec3 vColor;
-void main() {
-    vColor = aColor;
-    gl_Position = uMVP * vec4(aPos, 1.0);
+// Top of the column under a world position (0 off the island).
+float groundHeightAt(float x, float z) {
+    return worldHeight(world, worldToGridX(world, x), worldToGridZ(world, z)) * world.cfg.blockSize;
 }
-)";
 
-const char* fragSrc = R"(
-precision mediump float;
-varying vec3 vColor;
-void main(){
-    gl_FragColor = vec4(vColor, 1.0);
+// ----------------- Characters (wandering crowd until AI/multiplayer drive them) -----------------
+CharacterSet crowd;
+HitboxSet crowdHitboxes;      // posed capsules for hitscan (hitboxes.h)
+std::vector<float> crowdHealth;
+std::vector<float> crowdStride;  // metres walked since the last footstep
+uint32_t frameIndex = 0;
+const int CROWD_SIZE = 64;
+
+void spawnCrowd() {
+    float radius = std::min(world.cfg.gridW, world.cfg.gridH) * 0.35f * world.cfg.blockSize;
+    for (int i=0; i<CROWD_SIZE; ++i) {
+        float a = i * 2.39996f;  // golden angle spiral
+        float r = radius * sqrtf((i + 0.5f) / CROWD_SIZE);
+        Vec3 p(cosf(a) * r, 0.0f, sinf(a) * r);
+        p.y = groundHeightAt(p.x, p.z);
+        crowd.add(p, a + 1.5707963f, (i % 5 == 0) ? CLIP_IDLE : CLIP_WALK);
+        crowdHealth.push_back(RULES_MAX_HEALTH);
+        crowdStride.push_back(0.37f * i);  // out of step with each other
+    }
 }
-)";
-
-// ----------------- Cube mesh (one unit cube centered on origin) -----------------
-static const float cubeVerts[] = {
-    // positions        // color per-vertex (we will ignore per-vertex and use per-instance color via attribute)
-    -0.5f,-0.5f,-0.5f,  0.8f,0.8f,0.8f,
-     0.5f,-0.5f,-0.5f,  0.8f,0.8f,0.8f,
-     0.5f, 0.5f,-0.5f,  0.8f,0.8f,0.8f,
-    -0.5f, 0.5f,-0.5f,  0.8f,0.8f,0.8f,
-    -0.5f,-0.5f, 0.5f,  0.6f,0.6f,0.9f,
-     0.5f,-0.5f, 0.5f,  0.6f,0.6f,0.9f,
-     0.5f, 0.5f, 0.5f,  0.6f,0.6f,0.9f,
-    -0.5f, 0.5f, 0.5f,  0.6f,0.6f,0.9f
-};
-static const unsigned short cubeIdx[] = {
-    0,1,2, 2,3,0, // back
-    4,5,6, 6,7,4, // front
-    0,4,7, 7,3,0, // left
-    1,5,6, 6,2,1, // right
-    3,2,6, 6,7,3, // top
-    0,1,5, 5,4,0  // bottom
-};
-
-// ----------------- World (grid of cubes) -----------------
-struct Block {
-    int gx, gz; // grid coordinates
-    int h;      // height (stacked cubes)
-};
-
-std::vector<Block> blocks;
-int GRID_W = 32;
-int GRID_H = 32;
-int MAX_STACK = 4;
-float BLOCK_SIZE = 1.0f;
-
-// Procedural generation: simple island-like falloff and noise
-static float pseudoNoise(int x, int z) {
-    int n = x + z * 57;
-    n = (n<<13) ^ n;
-    return (1.0f - float((n*(n*n*15731 + 789221) + 1376312589) & 0x7fffffff) / 1073741824.0f);
+
+void updateCrowd(float dt, float time) {
+    float radius = std::min(world.cfg.gridW, world.cfg.gridH) * 0.4f * world.cfg.blockSize;
+    for (int i=0; i<crowd.count; ++i) {
+        if (crowd.clip[i] != CLIP_WALK) continue;
+        float x = crowd.posX[i], z = crowd.posZ[i];
+        crowd.heading[i] += 0.4f * sinf(time * 0.3f + i) * dt;
+        if (x*x + z*z > radius*radius) {
+            // steer back towards the middle of the island
+            float home = atan2f(-z, -x);
+            float diff = remainderf(home - crowd.heading[i], 6.2831853f);
+            crowd.heading[i] += diff * std::min(1.0f, 2.0f * dt);
+        }
+        crowd.posX[i] = x + cosf(crowd.heading[i]) * 1.4f * dt;
+        crowd.posZ[i] = z + sinf(crowd.heading[i]) * 1.4f * dt;
+        crowd.posY[i] = groundHeightAt(crowd.posX[i], crowd.posZ[i]);
+        crowdStride[i] += 1.4f * dt;
+        if (crowdStride[i] > 0.8f) {
+            crowdStride[i] -= 0.8f;
+            audioPlay(SOUND_STEP, Vec3(crowd.posX[i], crowd.posY[i], crowd.posZ[i]), 0.5f);
+        }
+    }
 }
-void generateWorld() {
-    blocks.clear();
-    int cx = GRID_W/2, cz = GRID_H/2;
-    float radius = std::min(GRID_W, GRID_H) * 0.45f;
-    for (int z=0; z<GRID_H; ++z) for (int x=0; x<GRID_W; ++x) {
-        float dx = (x - cx), dz = (z - cz);
-        float d = sqrtf(dx*dx + dz*dz);
-        float mask = 1.0f - (d / radius);
-        if (mask <= 0.0f) continue;
-        float n = pseudoNoise(x*3, z*3) * 0.6f + pseudoNoise(x*7, z*7) * 0.4f;
-        float v = mask * (0.5f + n*0.5f);
-        int h = int(floorf(v * MAX_STACK + 0.001f));
-        if (h > 0) blocks.push_back({x,z,h});
+
+// ----------------- Props (doors, platforms, pickups, triggers; props.h) -----------------
+std::vector<Aabb> propActors;  // the player, then the crowd
+
+// Movers go first, so the player is carried and stopped by where they are this frame.
+void updateProps(const Vec3& player, float time, float dt) {
+    propActors.clear();
+    propActors.push_back(propBodyBox(player));
+    for (int i=0; i<crowd.count; ++i) {
+        Vec3 feet(crowd.posX[i], crowd.posY[i], crowd.posZ[i]);
+        propActors.push_back({ feet - Vec3(0.3f, 0.0f, 0.3f), feet + Vec3(0.3f, 1.8f, 0.3f) });
+    }
+    propsUpdate(props, time, dt, propActors.data(), int(propActors.size()));
+}
+
+// ----------------- Other players (multiplayer, remote.h) -----------------
+CharacterSet others;
+HitboxSet otherHitboxes;
+std::vector<uint16_t> otherIds;
+
+// Follows the latest snapshot; the set is rebuilt when somebody joins or leaves.
+void updateOthers() {
+    bool same = otherIds.size() == remote.players.size();
+    for (size_t i=0; same && i<otherIds.size(); ++i) same = otherIds[i] == remote.players[i].id;
+    if (!same) {
+        others = CharacterSet();
+        otherIds.clear();
+        for (const RemotePlayer& p : remote.players) {
+            others.add(detToVec3(p.player.pos), 0.0f, CLIP_IDLE);
+            otherIds.push_back(p.id);
+        }
+    }
+    for (int i=0; i<others.count; ++i) {
+        const DetPlayer& p = remote.players[i].player;
+        Vec3 pos = detToVec3(p.pos), vel = detToVec3(p.vel);
+        // the position is the foot point the collision pushes out of the cubes
+        others.posX[i] = pos.x;
+        others.posY[i] = pos.y;
+        others.posZ[i] = pos.z;
+        bool moving = vel.x*vel.x + vel.z*vel.z > 0.25f;
+        if (moving) others.heading[i] = atan2f(vel.z, vel.x);
+        others.clip[i] = moving ? CLIP_WALK : CLIP_IDLE;
     }
 }
 
@@ -175,6 +190,15 @@ float yaw = 0.0f; // rotation around up
 float pitch = 0.0f;
 Vec3 playerVel(0,0,0);
 bool onGround = false;
+float playerStride = 0.0f;  // metres walked since the last footstep
+
+#if SANDBOX_DETERMINISTIC
+// Lockstep mode: the player runs in fixed-point ticks (det_physics.h) and playerPos/playerVel
+// only mirror it for the camera and the HUD.
+DetPlayer detPlayer = { detVec(Vec3(0.0f, 1.8f, 0.0f)) };
+uint32_t detTick = 0;
+double detAccumulator = 0.0;
+#endif
 
 // Input state
 bool keyW=false,keyA=false,keyS=false,keyD=false, keySpace=false;
@@ -182,130 +206,212 @@ double mouseX=0, mouseY=0;
 bool pointerLocked = false;
 int canvasWidth=1280, canvasHeight=720;
 
-// Shooting / world interaction
-void raycastShoot() {
+// Every edit goes into the undo history (Ctrl+Z / Ctrl+Y)
+UndoHistory history;
+
+Vec3 aimDir() { return normalize(Vec3(cosf(yaw)*cosf(pitch), sinf(pitch), sinf(yaw)*cosf(pitch))); }
+
+// Column under the crosshair
+bool aimedColumn(RayHit& hit) {
     // Ray origin at eye
     Vec3 eye(playerPos.x, playerPos.y, playerPos.z);
-    Vec3 forward(cosf(yaw)*cosf(pitch), sinf(pitch), sinf(yaw)*cosf(pitch));
-    forward = normalize(forward);
-    // Step along ray and detect block intersection
-    float maxDist = 30.0f;
-    float step = 0.1f;
-    for (float t=0.0f; t<maxDist; t += step) {
-        Vec3 p = eye + forward * t;
-        // convert world x,z to grid coords
-        int gx = int(roundf(p.x / BLOCK_SIZE)) + GRID_W/2;
-        int gz = int(roundf(p.z / BLOCK_SIZE)) + GRID_H/2;
-        if (gx < 0 || gx >= GRID_W || gz < 0 || gz >= GRID_H) continue;
-        // find a block at (gx,gz) with any height hitting p.y
-        for (auto it = blocks.begin(); it != blocks.end(); ++it) {
-            if (it->gx == gx && it->gz == gz) {
-                // block base height is 0; block top is it->h * BLOCK_SIZE
-                float hTop = it->h * BLOCK_SIZE;
-                if (p.y >= 0.0f && p.y <= hTop + 0.5f) {
-                    // remove block entirely
-                    blocks.erase(it);
-                    return;
-                }
-            }
-        }
+    Vec3 forward = aimDir();
+#if SANDBOX_DETERMINISTIC
+    (void)eye;
+    (void)forward;
+    return detRaycast(world, detPlayer.pos, detAimDir(fixAngle(yaw), fixAngle(pitch)), fixInt(30), hit);
+#else
+    return world.kernels->raycast(world, eye, forward, 30.0f, hit);
+#endif
+}
+
+// ----------------- Game rules (weapon script, game_rules.h) -----------------
+GameRules rules;
+
+Vec3 entityPos(int e) {
+    if (e > 0 && e <= crowd.count) return Vec3(crowd.posX[e - 1], crowd.posY[e - 1], crowd.posZ[e - 1]);
+    return playerPos;
+}
+
+// Entity 0 is the player, whose health the rules do not touch yet; 1 + i is crowd member i.
+double entityGet(void*, int e, int field) {
+    if (field == FIELD_HEALTH) return e > 0 && e <= crowd.count ? crowdHealth[e - 1] : RULES_MAX_HEALTH;
+    Vec3 p = entityPos(e);
+    return field == FIELD_X ? p.x : field == FIELD_Y ? p.y : p.z;
+}
+
+void entitySet(void*, int e, int field, double value) {
+    if (e <= 0 || e > crowd.count) return;
+    int i = e - 1;
+    if (field == FIELD_HEALTH) crowdHealth[i] = float(value);
+    else if (field == FIELD_X) crowd.posX[i] = float(value);
+    else if (field == FIELD_Y) crowd.posY[i] = float(value);
+    else crowd.posZ[i] = float(value);
+}
+
+double rulesPlay(void*, const double* args) {
+    if (args[0] >= 0.0 && args[0] < SOUND_COUNT) audioPlay(SoundId(int(args[0])), entityPos(int(args[1])));
+    return 0.0;
+}
+
+// Crowd members get up again across the island.
+double rulesRespawn(void*, const double* args) {
+    int e = int(args[0]);
+    if (e <= 0 || e > crowd.count) return 0.0;
+    int i = e - 1;
+    crowd.posX[i] = -crowd.posX[i];
+    crowd.posZ[i] = -crowd.posZ[i];
+    crowd.posY[i] = groundHeightAt(crowd.posX[i], crowd.posZ[i]);
+    return 0.0;
+}
+
+void initRules() {
+    ScriptEntities entities;
+    entities.fields = rulesFieldNames;
+    entities.fieldCount = FIELD_COUNT;
+    entities.get = entityGet;
+    entities.set = entitySet;
+    gameRulesInit(rules, gameRulesSource, rulesPlay, rulesRespawn, entities, nullptr);
+}
+
+// The rules decide who takes a touched pickup; the prop actors are in entity order.
+void takePickups() {
+    for (const PropTouch& t : props.touches) {
+        if (props.props[t.prop].taken || !gameRulesPickup(rules, t.actor)) continue;
+        propsTake(props, t.prop);
+        printf("[props] pickup %d collected\n", props.taken);
     }
 }
 
-// ----------------- Collision (capsule vs stacked cubes) -----------------
-void resolveCollisions(float dt) {
-    // simple: for each block, for each cube level, treat AABB and push player out if overlapping in x/z and y.
-    float radius = 0.25f;
-    for (const Block& b : blocks) {
-        for (int level=0; level < b.h; ++level) {
-            Vec3 minp( (b.gx - GRID_W/2 - 0.5f) * BLOCK_SIZE,
-                       level * BLOCK_SIZE,
-                       (b.gz - GRID_H/2 - 0.5f) * BLOCK_SIZE );
-            Vec3 maxp = minp + Vec3(BLOCK_SIZE, BLOCK_SIZE, BLOCK_SIZE);
-            // player capsule center
-            Vec3 pc(playerPos.x, playerPos.y-0.9f, playerPos.z); // approximate foot-level
-            // clamp pc to AABB
-            float cx = std::max(minp.x, std::min(pc.x, maxp.x));
-            float cy = std::max(minp.y, std::min(pc.y, maxp.y));
-            float cz = std::max(minp.z, std::min(pc.z, maxp.z));
-            Vec3 closest(cx,cy,cz);
-            Vec3 diff = pc - closest;
-            float dist = length(diff);
-            if (dist < radius) {
-                // push player out along horizontal plane mostly
-                Vec3 push = normalize(Vec3(diff.x, 0.0f, diff.z)) * (radius - dist + 0.001f);
-                if (isnan(push.x) || isnan(push.y) || isnan(push.z)) {
-                    // degenerate; separate vertically
-                    push = Vec3(0, (radius-dist)+0.001f, 0);
-                }
-                playerPos.x += push.x;
-                playerPos.z += push.z;
-                // if push y positive and small, set onGround
-                if (playerPos.y <= maxp.y + 0.01f) {
-                    onGround = true;
-                    playerVel.y = 0.0f;
-                    playerPos.y = maxp.y + 1.8f; // stand on top of cube
-                }
-            }
-        }
+// Shooting / world interaction
+void raycastShoot() {
+    if (!gameRulesFire(rules, emscripten_get_now() * 0.001)) return;
+    RayHit hit;
+    bool column = aimedColumn(hit);
+    Vec3 dir = aimDir();
+    float reach = 30.0f;
+    audioPlay(SOUND_SHOT, playerPos, 0.8f);
+    if (column) {
+        float B = world.cfg.blockSize, x = gridToWorldX(world, hit.gx), z = gridToWorldZ(world, hit.gz);
+        Aabb box = { Vec3(x - 0.5f * B, 0.0f, z - 0.5f * B), Vec3(x + 0.5f * B, hit.h * B, z + 0.5f * B) };
+        float columnDist;
+        Vec3 normal;
+        if (aabbRayBox(box, playerPos, dir, reach, &columnDist, &normal)) reach = columnDist;
     }
+    // whatever is nearest takes the shot, each test cut off at the nearest so far: a prop in
+    // front of the column (pickups go to whoever the rules give them, doors and platforms only stop it), then a
+    // character in front of either
+    int prop;
+    float propDist;
+    bool propHit = propsRaycast(props, playerPos, dir, reach, &prop, &propDist);
+    if (propHit) reach = propDist;
+    HitboxHit person, other;
+    bool crowdHit = hitboxRaycast(crowdHitboxes, playerPos, dir, reach, person);
+    if (crowdHit) reach = person.dist;
+    bool otherHit = hitboxRaycast(otherHitboxes, playerPos, dir, reach, other);
+    if (otherHit) reach = other.dist;
+    if (otherHit || crowdHit || propHit || column) audioPlay(SOUND_IMPACT, playerPos + dir * reach);
+    if (otherHit) {
+        // damage between players is not part of the protocol yet
+        printf("[hit] player %u %s: %.0f damage\n", unsigned(otherIds[other.character]), hitPartName(other.part),
+               gameRulesDamage(rules, other.part));
+        return;
+    }
+    if (crowdHit) {
+        int i = person.character;
+        double dealt = gameRulesHit(rules, i + 1, person.part);
+        printf("[hit] crowd %d %s: %.0f damage, %.0f left\n", i, hitPartName(person.part), fabs(dealt),
+               dealt < 0.0 ? 0.0 : crowdHealth[i]);
+        return;
+    }
+    if (propHit) {
+        if (props.props[prop].kind == PROP_PICKUP && gameRulesPickup(rules, 0)) propsTake(props, prop);
+        return;
+    }
+    if (!column) return;
+    // remove the column entirely; meshes and shadows follow the version bump
+    undoBegin(history, world, "shot");
+    worldSetHeight(world, hit.gx, hit.gz, 0);
+    undoEnd(history, world);
 }
 
-// ----------------- GL program and buffers -----------------
-GLuint prog=0;
-GLint locMVP= -1;
-GLuint vbo=0, ibo=0, vao=0;
+// ----------------- Editor (creative mode) -----------------
+bool editorMode = false;
+const int BRUSH_RADIUS = 3;
+
+// Highest column the editor builds (and the shadow cascades cover).
+int buildLimit() { return world.cfg.maxStack * 2; }
+
+// Left click digs, right click builds one level; shift applies it to a square brush.
+void editorStroke(bool build, bool area) {
+    RayHit hit;
+    if (!aimedColumn(hit)) return;
+    int r = area ? BRUSH_RADIUS : 0;
+    undoBegin(history, world, area ? "area edit" : "block edit");
+    worldBeginEdits(world);
+    for (int z=hit.gz-r; z<=hit.gz+r; ++z) for (int x=hit.gx-r; x<=hit.gx+r; ++x) {
+        int h = worldHeight(world, x, z);
+        worldSetHeight(world, x, z, build ? std::min(h + 1, buildLimit()) : 0);
+    }
+    worldEndEdits(world);
+    undoEnd(history, world);
+}
+
+void editorUndo(bool redo) {
+    const char* label = redo ? redoApply(history, world) : undoApply(history, world);
+    if (label) printf("[editor] %s %s (%zu undo / %zu redo steps, %.1f KiB)\n", redo ? "redo" : "undo", label,
+                      history.undo.size(), history.redo.size(), history.usedBytes / 1024.0);
+}
+
+// ----------------- GL setup -----------------
+const Vec3 sunDir(-0.45f, -1.0f, -0.3f);
 void setupGL() {
-    GLuint vs = compileShader(GL_VERTEX_SHADER, vertexSrc);
-    GLuint fs = compileShader(GL_FRAGMENT_SHADER, fragSrc);
-    prog = linkProgram(vs, fs);
-    glDeleteShader(vs); glDeleteShader(fs);
-    locMVP = glGetUniformLocation(prog, "uMVP");
-
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVerts), cubeVerts, GL_STATIC_DRAW);
-
-    glGenBuffers(1, &ibo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cubeIdx), cubeIdx, GL_STATIC_DRAW);
+    terrainRenderInit(world);
+    skinnedInit();
+    hudInit();
+    minimapInit(world);
+    decorRenderInit(world);
+    propRenderInit();
+    const WorldConfig& cfg = world.cfg;
+    shadowsInit(normalize(sunDir), buildLimit() * cfg.blockSize, float(std::max(cfg.gridW, cfg.gridH)) * cfg.blockSize * 2.0f);
 }
 
-// Utility to draw a box at world position with scale and color
-void drawCubeInstance(const Mat4& vp, const Vec3& pos, float scale, const Vec3& color) {
-    glUseProgram(prog);
-    // Build model matrix (translate then scale)
-    Mat4 model = Mat4::identity();
-    // column-major manual
-    model.m[0] = scale; model.m[5] = scale; model.m[10] = scale;
-    model.m[12] = pos.x;
-    model.m[13] = pos.y;
-    model.m[14] = pos.z;
-    // mvp = vp * model
-    Mat4 mvp; memset(mvp.m,0,sizeof(mvp.m));
-    for (int r=0;r<4;++r) for(int c=0;c<4;++c) {
-        float sum = 0.0f;
-        for (int k=0;k<4;++k) sum += vp.m[k*4 + r] * model.m[c*4 + k];
-        mvp.m[c*4 + r] = sum;
+// ----------------- Debug overlay -----------------
+bool showDebug = true;
+bool showMinimap = true;
+
+void drawDebugOverlay(float dt) {
+    uint32_t white = hudRGBA(255, 255, 255), dim = hudRGBA(200, 220, 255);
+    float x = 8.0f, y = 8.0f, line = HUD_GLYPH_H * 2.0f;
+    int slots = profilerSlotCount();
+    hudRect(x - 4.0f, y - 4.0f, 330.0f, line * (3 + (remote.connected ? 1 : 0) + slots) + 8.0f, hudRGBA(0, 0, 0, 110));
+    hudTextf(x, y, white, 2.0f, "%.1f fps  %.2f ms", dt > 0 ? 1.0f / dt : 0.0f, dt * 1000.0f); y += line;
+    hudTextf(x, y, white, 2.0f, "pos %.1f %.1f %.1f  ammo %d", playerPos.x, playerPos.y, playerPos.z,
+             gameRulesAmmo(rules)); y += line;
+#if SANDBOX_DETERMINISTIC
+    hudTextf(x, y, white, 2.0f, "lockstep tick %u  state %016llx", detTick,
+             (unsigned long long)detStateHash(detPlayer)); y += line;
+#endif
+    hudTextf(x, y, white, 2.0f, "world %s %dx%d  chars %d  props %d (depth %d)  pickups %d", world.kernels->name,
+             world.chunksX, world.chunksZ, crowd.count, props.tree.proxies, aabbHeight(props.tree), props.taken); y += line;
+    AudioStats audio = audioStats();
+    hudTextf(x, y, white, 2.0f, "audio %d voices  %.0f us/block  %llu underrun frames", audio.voices, audio.mixUs,
+             (unsigned long long)audio.underruns); y += line;
+    if (remote.connected) {
+        hudTextf(x, y, white, 2.0f, "online #%u  %zu others  tick %u  %.0f/%.0f KiB  map %d/%zu", unsigned(remote.id),
+                 remote.players.size(), remote.tick, remote.bytesIn / 1024.0, remote.bytesOut / 1024.0,
+                 remote.transfer.chunks, world.chunks.size()); y += line;
+    }
+    for (int i=0; i<slots; ++i, y += line) {
+        hudTextf(x, y, dim, 2.0f, profilerSlotIsTimer(i) ? "%-16s %7.3f ms" : "%-16s %9.1f",
+                 profilerSlotName(i), profilerAverage(i));
     }
-    glUniformMatrix4fv(locMVP, 1, GL_FALSE, mvp.m);
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-    GLint aPos = glGetAttribLocation(prog, "aPos");
-    GLint aColor = glGetAttribLocation(prog, "aColor");
-    glEnableVertexAttribArray(aPos);
-    glVertexAttribPointer(aPos, 3, GL_FLOAT, GL_FALSE, sizeof(float)*6, (void*)(0));
-    glEnableVertexAttribArray(aColor);
-    glVertexAttribPointer(aColor, 3, GL_FLOAT, GL_FALSE, sizeof(float)*6, (void*)(sizeof(float)*3));
-    // Draw
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0);
-    glDisableVertexAttribArray(aPos);
-    glDisableVertexAttribArray(aColor);
 }
 
 // ----------------- Main loop -----------------
 double lastTime = 0.0;
+double startupTime = 0.0;
+bool firstFrameDone = false;
 void main_loop();
 
 EM_BOOL mouse_move_cb(int eventType, const EmscriptenMouseEvent* e, void* userData) {
@@ -321,8 +427,10 @@ EM_BOOL mouse_move_cb(int eventType, const EmscriptenMouseEvent* e, void* userDa
     return EM_TRUE;
 }
 EM_BOOL mouse_click_cb(int eventType, const EmscriptenMouseEvent* e, void* userData) {
-    // Left click shoots (button 0)
-    if (e->button == 0) {
+    // Left click shoots (button 0); the editor digs with the left and builds with the right button
+    if (editorMode && pointerLocked && (e->button == 0 || e->button == 2)) {
+        editorStroke(e->button == 2, e->shiftKey);
+    } else if (e->button == 0) {
         raycastShoot();
     }
     // Request pointer lock on canvas
@@ -342,12 +450,33 @@ EM_BOOL key_cb(int eventType, const EmscriptenKeyboardEvent* e, void* userData)
     if (strcmp(e->key, "s")==0 || strcmp(e->key, "S")==0) keyS = down;
     if (strcmp(e->key, "d")==0 || strcmp(e->key, "D")==0) keyD = down;
     if (strcmp(e->key, " " )==0) keySpace = down;
+    if (strcmp(e->key, "F3")==0 && down) showDebug = !showDebug;
+    if ((strcmp(e->key, "m")==0 || strcmp(e->key, "M")==0) && down && !e->repeat) showMinimap = !showMinimap;
+    if ((strcmp(e->key, "e")==0 || strcmp(e->key, "E")==0) && down && !e->repeat) editorMode = !editorMode;
+    if ((strcmp(e->key, "z")==0 || strcmp(e->key, "Z")==0) && down && e->ctrlKey) editorUndo(e->shiftKey);
+    if ((strcmp(e->key, "y")==0 || strcmp(e->key, "Y")==0) && down && e->ctrlKey) editorUndo(true);
+    if ((strcmp(e->key, "g")==0 || strcmp(e->key, "G")==0) && down && !e->repeat && editorMode) {
+        // back to the generated map for this seed, as one undoable step
+        undoBegin(history, world, "regenerate");
+        generateWorld();
+        undoEnd(history, world);
+    }
     if (strcmp(e->key, "r")==0 || strcmp(e->key, "R")==0) {
         if (down) {
-            // respawn
-            generateWorld();
+            // respawn; shift+R rolls a new seed (runtime generation instead of the baked map).
+            // Edits are saved first, so they come back with their seed.
+            if (saveLoaded && !onlineWorld) autosaveRequest(world, worldSeed);
+            if (e->shiftKey) {
+                worldSeed = uint32_t(rand());
+                generateWorld();
+                undoClear(history);
+                if (saveLoaded) restoreSave();
+            }
             playerPos = Vec3(0.0f, 1.8f, 0.0f);
             playerVel = Vec3(0,0,0);
+#if SANDBOX_DETERMINISTIC
+            detPlayer = { detVec(playerPos) };
+#endif
         }
     }
     return EM_TRUE;
@@ -359,11 +488,29 @@ void main_loop() {
     if (dt <= 0 || dt > 0.05f) dt = 1.0f/60.0f;
     lastTime = now;
 
+    updateProps(playerPos, float(now), dt);
+    takePickups();
+
     // Physics
     Vec3 forward(cosf(yaw)*cosf(pitch), sinf(pitch), sinf(yaw)*cosf(pitch));
     Vec3 right(-sinf(yaw), 0.0f, cosf(yaw));
     forward = normalize(forward);
     right = normalize(right);
+#if SANDBOX_DETERMINISTIC
+    // whole ticks only; a frame may run none or several
+    uint8_t buttons = (keyW ? DET_FORWARD : 0) | (keyS ? DET_BACK : 0) | (keyA ? DET_LEFT : 0) |
+                      (keyD ? DET_RIGHT : 0) | (keySpace ? DET_JUMP : 0);
+    DetInput input = detQuantizeInput(yaw, pitch, buttons);
+    detAccumulator = std::min(detAccumulator + dt, 0.25);
+    while (detAccumulator >= 1.0 / DET_TICK_HZ) {
+        detStep(world, detPlayer, input);
+        detAccumulator -= 1.0 / DET_TICK_HZ;
+        ++detTick;
+    }
+    playerPos = detToVec3(detPlayer.pos);
+    playerVel = detToVec3(detPlayer.vel);
+    onGround = detPlayer.onGround;
+#else
     Vec3 moveDir(0,0,0);
     if (keyW) moveDir = moveDir + forward;
     if (keyS) moveDir = moveDir - forward;
@@ -381,72 +528,132 @@ void main_loop() {
     if (keySpace && onGround) { playerVel.y = 6.0f; onGround=false; }
 
     // integrate
+    Vec3 from = playerPos;
     playerPos.x += playerVel.x * dt;
     playerPos.y += playerVel.y * dt;
     playerPos.z += playerVel.z * dt;
 
     // collisions
     onGround = false;
-    resolveCollisions(dt);
+    world.kernels->collide(world, playerPos, playerVel, onGround);
 
     // ground plane
     if (playerPos.y < 1.0f) { playerPos.y = 1.0f; playerVel.y = 0.0f; onGround = true; }
 
+    // doors and platforms, after the grid
+    propsCollide(props, from, playerPos, playerVel, onGround);
+#endif
+
+    // Multiplayer: the world is the server's (streamed in, or generated from its seed when the
+    // maps differ in size), and the other players come from its snapshots
+    if (remote.joined && !onlineWorld) {
+        if (saveLoaded) autosaveRequest(world, worldSeed);  // the local edits, before they are replaced
+        onlineWorld = true;
+        worldSeed = remote.seed;
+        if (!remote.streaming) generateWorld();
+        undoClear(history);
+    }
+    Vec3 spawn;
+    if (remotePlace(&spawn)) {
+        playerPos = spawn;
+        playerVel = Vec3(0,0,0);
+#if SANDBOX_DETERMINISTIC
+        detPlayer = { detVec(playerPos) };
+#endif
+    }
+    remoteUpdate(dt, detQuantizeInput(yaw, pitch, uint8_t((keyW ? DET_FORWARD : 0) | (keyS ? DET_BACK : 0) |
+                                                          (keyA ? DET_LEFT : 0) | (keyD ? DET_RIGHT : 0) |
+                                                          (keySpace ? DET_JUMP : 0))), playerPos);
+
+    // Characters
+    Vec3 eye(playerPos.x, playerPos.y+0.5f, playerPos.z);
+    updateCrowd(dt, float(now));
+    animateCharacters(crowd, dt, eye, frameIndex);
+    hitboxUpdate(crowdHitboxes, crowd);
+    updateOthers();
+    if (others.count > 0) animateCharacters(others, dt, eye, frameIndex);
+    hitboxUpdate(otherHitboxes, others);
+    ++frameIndex;
+
+    // Audio: footsteps while walking on something, everything heard from the eye
+    if (onGround) {
+        playerStride += sqrtf(playerVel.x*playerVel.x + playerVel.z*playerVel.z) * dt;
+        if (playerStride > 1.6f) {
+            playerStride -= 1.6f;
+            audioPlay(SOUND_STEP, playerPos - Vec3(0.0f, 1.7f, 0.0f), 0.7f);
+        }
+    }
+    audioSetListener(playerPos, yaw);
+    audioUpdate();
+
     // Rendering
+    terrainUpdateMeshes(world);
+    minimapUpdate(world, playerPos.x, playerPos.z);
+    decorRenderUpdate(world, worldSeed, playerPos.x, playerPos.z);
+    shadowsUpdate(eye, terrainDrawShadowCasters);
+
     glViewport(0,0,canvasWidth,canvasHeight);
     glClearColor(0.53f, 0.81f, 0.92f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glEnable(GL_DEPTH_TEST);
 
     Mat4 proj = perspective(60.0f * (3.14159265f/180.0f), float(canvasWidth)/float(canvasHeight), 0.1f, 200.0f);
-    Vec3 eye(playerPos.x, playerPos.y+0.5f, playerPos.z);
     Vec3 center = eye + forward;
     Mat4 view = lookAt(eye, center, Vec3(0,1,0));
     // vp = proj * view
-    Mat4 vp; memset(vp.m,0,sizeof(vp.m));
-    for (int r=0;r<4;++r) for (int c=0;c<4;++c) {
-        float sum=0.0f;
-        for (int k=0;k<4;++k) sum += proj.m[k*4 + r] * view.m[c*4 + k];
-        vp.m[c*4 + r] = sum;
+    Mat4 vp = mul(proj, view);
+
+    terrainDraw(vp);
+    decorRenderDraw(vp);
+    propRenderDraw(props, vp);
+    skinnedDraw(crowd, vp);
+    if (others.count > 0) skinnedDraw(others, vp);
+
+    // HUD: crosshair, minimap and debug overlay, batched into one draw per texture
+    hudBegin(canvasWidth, canvasHeight);
+    float cx = canvasWidth * 0.5f, cy = canvasHeight * 0.5f;
+    uint32_t crossColor = hudRGBA(0, 0, 0, 204);
+    hudRect(cx - 5.0f, cy - 5.0f, 2.0f, 10.0f, crossColor);
+    hudRect(cx - 5.0f, cy - 5.0f, 10.0f, 2.0f, crossColor);
+    if (showDebug) drawDebugOverlay(dt);
+    if (showMinimap) {
+        float size = std::min(256.0f, std::min(canvasWidth, canvasHeight) * 0.3f);
+        minimapDraw(world, canvasWidth - size - 12.0f, 12.0f, size, playerPos.x, playerPos.z, yaw);
     }
-
-    // draw blocks
-    for (const Block& b : blocks) {
-        for (int level=0; level < b.h; ++level) {
-            Vec3 pos( (b.gx - GRID_W/2) * BLOCK_SIZE,
-                      level * BLOCK_SIZE + BLOCK_SIZE*0.5f,
-                      (b.gz - GRID_H/2) * BLOCK_SIZE );
-            // color varies with height
-            Vec3 color(0.2f + 0.08f*level, 0.6f - 0.05f*level, 0.2f);
-            drawCubeInstance(vp, pos, BLOCK_SIZE, color);
-        }
+    if (editorMode) {
+        hudTextf(8.0f, canvasHeight - HUD_GLYPH_H * 2.0f - 8.0f, hudRGBA(255, 230, 120), 2.0f,
+                 "EDITOR  LMB dig  RMB build  shift brush  ctrl+Z/Y  G regen  undo %zu redo %zu %.1f KiB",
+                 history.undo.size(), history.redo.size(), history.usedBytes / 1024.0);
     }
+    hudEnd();
 
-    // simple crosshair - use HTML overlay via JS
-    EM_ASM({
-        let el = document.getElementById('crosshair');
-        if (!el) {
-            el = document.createElement('div');
-            el.id = 'crosshair';
-            el.style.position = 'absolute';
-            el.style.left = '50%';
-            el.style.top = '50%';
-            el.style.width = '10px';
-            el.style.height = '10px';
-            el.style.marginLeft = '-5px';
-            el.style.marginTop = '-5px';
-            el.style.borderLeft = '2px solid rgba(0,0,0,0.8)';
-            el.style.borderTop = '2px solid rgba(0,0,0,0.8)';
-            el.style.pointerEvents = 'none';
-            document.body.appendChild(el);
-        }
-    });
+    if (!saveLoaded && autosaveReady()) restoreSave();
+    if (saveLoaded && !onlineWorld) autosaveUpdate(world, worldSeed, emscripten_get_now());
+    else if (saveLoaded) autosavePoll();  // finishes the save started on joining
+
+    if (!firstFrameDone) {
+        firstFrameDone = true;
+        printf("[startup] first frame after %.2f ms (world %s in %.3f ms)\n",
+               emscripten_get_now() - startupTime, worldWasBaked ? "baked" : "generated", worldGenMs);
+    }
+    profilerEndFrame();
 }
 
 // ----------------- Initialization -----------------
 int main() {
+    startupTime = emscripten_get_now();
     srand((unsigned)time(NULL));
+    initWorld();
     generateWorld();
+    autosaveInit("/save");
+    jobsInit();
+    animationInit();
+    spawnCrowd();
+    initRules();
+    audioInit(audioOutputWeb, worldSeed);
+    // ?server=ws://host:port joins a sandbox_server
+    const char* server = emscripten_run_script_string("new URLSearchParams(location.search).get('server') || ''");
+    if (server && server[0]) remoteConnect(server, world);
     // create GL context on default canvas (#canvas)
     EmscriptenWebGLContextAttributes attr;
     emscripten_webgl_init_context_attributes(&attr);
@@ -0,0 +1,166 @@
+#include "minimap.h"
+#include "glutil.h"
+#include "hud.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <deque>
+#include <vector>
+
+namespace {
+
+// Inclusive range of world columns.
+struct ColumnRect {
+    int x0, z0, x1, z1;
+};
+
+GLuint mapTex = 0;
+int texSize = 0;                 // window edge in columns = texture edge in texels
+int originX = 0, originZ = 0;    // column at the window's top-left corner
+bool placed = false;
+std::deque<ColumnRect> pending;  // columns whose texels are out of date, oldest first
+std::vector<uint32_t> staging;
+int profMinimap = -1, profTexels = -1;
+
+uint32_t columnColor(const World& w, int gx, int gz) {
+    int h = worldHeight(w, gx, gz);
+    if (h == 0) return hudRGBA(40, 62, 84);
+    // the top face tint of the terrain, lit from the -x,-z side so steps read as relief
+    int relief = h - worldHeight(w, gx - 1, gz - 1);
+    float shade = std::min(std::max(1.0f + 0.15f * relief, 0.7f), 1.3f);
+    Vec3 c = worldLevelTint(h - 1) * (shade * 255.0f);
+    auto byte = [](float v) { return int(std::min(std::max(v, 0.0f), 255.0f)); };
+    return hudRGBA(byte(c.x), byte(c.y), byte(c.z));
+}
+
+bool clipToWindow(ColumnRect& r) {
+    r.x0 = std::max(r.x0, originX);
+    r.z0 = std::max(r.z0, originZ);
+    r.x1 = std::min(r.x1, originX + texSize - 1);
+    r.z1 = std::min(r.z1, originZ + texSize - 1);
+    return r.x0 <= r.x1 && r.z0 <= r.z1;
+}
+
+// Uploads a rectangle of the window, split where it wraps around the texture edges.
+int uploadColumns(const World& w, const ColumnRect& r) {
+    int mask = texSize - 1;
+    for (int z=r.z0; z<=r.z1; ) {
+        int tz = z & mask, rows = std::min(r.z1 - z + 1, texSize - tz);
+        for (int x=r.x0; x<=r.x1; ) {
+            int tx = x & mask, cols = std::min(r.x1 - x + 1, texSize - tx);
+            staging.resize(size_t(cols) * rows);
+            for (int j=0; j<rows; ++j) for (int i=0; i<cols; ++i) {
+                staging[j * cols + i] = columnColor(w, x + i, z + j);
+            }
+            glTexSubImage2D(GL_TEXTURE_2D, 0, tx, tz, cols, rows, GL_RGBA, GL_UNSIGNED_BYTE, staging.data());
+            x += cols;
+        }
+        z += rows;
+    }
+    return (r.x1 - r.x0 + 1) * (r.z1 - r.z0 + 1);
+}
+
+void onWorldEdit(const World&, const WorldEdit& e, void*) {
+    if (!placed) return;  // the whole window is queued once it is placed
+    // the relief shading of the +x,+z neighbours depends on these columns too
+    ColumnRect r = { e.minGX, e.minGZ, e.maxGX + 1, e.maxGZ + 1 };
+    if (clipToWindow(r)) pending.push_back(r);
+}
+
+// Keeps the window centred on the player unless the whole map fits.
+void windowOriginFor(const World& w, float playerX, float playerZ, int& ox, int& oz) {
+    if (w.cfg.gridW <= texSize && w.cfg.gridH <= texSize) {
+        ox = oz = 0;
+        return;
+    }
+    ox = worldToGridX(w, playerX) - texSize / 2;
+    oz = worldToGridZ(w, playerZ) - texSize / 2;
+}
+
+} // namespace
+
+void minimapInit(World& w) {
+    texSize = 16;
+    while (texSize < MINIMAP_MAX_TEXELS && texSize < std::max(w.cfg.gridW, w.cfg.gridH)) texSize *= 2;
+    glGenTextures(1, &mapTex);
+    glBindTexture(GL_TEXTURE_2D, mapTex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, texSize, texSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    worldSubscribe(w, onWorldEdit, nullptr);
+    placed = false;
+    pending.clear();
+    profMinimap = profilerSlot("minimap");
+    profTexels = profilerSlot("minimap.texels");
+}
+
+void minimapUpdate(const World& w, float playerX, float playerZ) {
+    ProfileScope scope(profMinimap);
+    int nx, nz;
+    windowOriginFor(w, playerX, playerZ, nx, nz);
+    int dx = nx - originX, dz = nz - originZ;
+    if (!placed || abs(dx) >= texSize || abs(dz) >= texSize) {
+        originX = nx;
+        originZ = nz;
+        placed = true;
+        pending.clear();
+        pending.push_back({ nx, nz, nx + texSize - 1, nz + texSize - 1 });
+    } else if (dx != 0 || dz != 0) {
+        // scroll: only the strips entering the window need texels, and they go first
+        originX = nx;
+        originZ = nz;
+        int x1 = nx + texSize - 1, z1 = nz + texSize - 1;
+        if (dx > 0) pending.push_front({ x1 - dx + 1, nz, x1, z1 });
+        if (dx < 0) pending.push_front({ nx, nz, nx - dx - 1, z1 });
+        if (dz > 0) pending.push_front({ nx, z1 - dz + 1, x1, z1 });
+        if (dz < 0) pending.push_front({ nx, nz, x1, nz - dz - 1 });
+    }
+
+    if (pending.empty()) return;
+    glBindTexture(GL_TEXTURE_2D, mapTex);
+    int budget = MINIMAP_UPLOAD_BUDGET, uploaded = 0;
+    while (!pending.empty() && budget > 0) {
+        ColumnRect& r = pending.front();
+        if (!clipToWindow(r)) {
+            pending.pop_front();
+            continue;
+        }
+        // a rectangle larger than the remaining budget goes up a band of rows at a time
+        int width = r.x1 - r.x0 + 1;
+        int rows = std::min(std::max(budget / width, 1), r.z1 - r.z0 + 1);
+        int texels = uploadColumns(w, { r.x0, r.z0, r.x1, r.z0 + rows - 1 });
+        budget -= texels;
+        uploaded += texels;
+        if (r.z0 + rows > r.z1) pending.pop_front();
+        else r.z0 += rows;
+    }
+    profilerAddCount(profTexels, uploaded);
+}
+
+void minimapDraw(const World& w, float x, float y, float size, float playerX, float playerZ, float yaw) {
+    if (!mapTex) return;
+    hudRect(x - 2.0f, y - 2.0f, size + 4.0f, size + 4.0f, hudRGBA(0, 0, 0, 160));
+    // the window starts at texel (tx0, tz0) and wraps around, so it is up to four quads
+    float px = size / texSize, inv = 1.0f / texSize;
+    int mask = texSize - 1, tx0 = originX & mask, tz0 = originZ & mask;
+    const int spanX[2][2] = { { tx0, texSize }, { 0, tx0 } };
+    const int spanZ[2][2] = { { tz0, texSize }, { 0, tz0 } };
+    for (int j=0; j<2; ++j) for (int i=0; i<2; ++i) {
+        int xa = spanX[i][0], xb = spanX[i][1], za = spanZ[j][0], zb = spanZ[j][1];
+        if (xb <= xa || zb <= za) continue;
+        float sx = i == 0 ? 0.0f : (texSize - tx0) * px, sz = j == 0 ? 0.0f : (texSize - tz0) * px;
+        hudImage(x + sx, y + sz, (xb - xa) * px, (zb - za) * px, mapTex, xa * inv, za * inv, xb * inv, zb * inv);
+    }
+
+    // player: column centres are at integer grid coordinates
+    float gx = playerX * w.invBlockSize + w.cfg.gridW / 2, gz = playerZ * w.invBlockSize + w.cfg.gridH / 2;
+    float mx = x + std::min(std::max((gx - originX + 0.5f) * px, 0.0f), size);
+    float my = y + std::min(std::max((gz - originZ + 0.5f) * px, 0.0f), size);
+    uint32_t marker = hudRGBA(255, 255, 255);
+    hudLine(mx, my, mx + cosf(yaw) * 10.0f, my + sinf(yaw) * 10.0f, 2.0f, marker);
+    hudRect(mx - 2.0f, my - 2.0f, 4.0f, 4.0f, marker);
+}
@@ -0,0 +1,21 @@
+// Top-down minimap of the column heights, drawn through the HUD.
+//
+// One texel per column in an RGBA texture that covers a window of MINIMAP_MAX_TEXELS columns
+// around the player (the whole map when it fits). The texture is addressed toroidally, texel =
+// column mod size, so when the window follows the player only the columns scrolling in are
+// uploaded, and edits only re-upload the texels of the columns they changed (edit subscription,
+// world.h). Uploads go through glTexSubImage2D under a per-frame texel budget, so the per-frame
+// cost depends on what moved or changed, not on the size of the map.
+#pragma once
+
+#include "world.h"
+
+const int MINIMAP_MAX_TEXELS = 256;          // window edge in columns (power of two)
+const int MINIMAP_UPLOAD_BUDGET = 16384;     // texels uploaded per frame at most
+
+// Creates the texture and subscribes to edits of w; the first frames upload the window.
+void minimapInit(World& w);
+// Scrolls the window to the player and uploads pending texels within the budget.
+void minimapUpdate(const World& w, float playerX, float playerZ);
+// Draws the map as a size x size pixel square at (x, y) with the player marker (HUD frame).
+void minimapDraw(const World& w, float x, float y, float size, float playerX, float playerZ, float yaw);
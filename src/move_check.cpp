@@ -0,0 +1,207 @@
+#include "move_check.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const float kGroundSlack = 0.05f;  // a claim this close above its stand height is standing
+
+// Column heights read straight from the chunks, shifts and masks for the usual power-of-two
+// chunk sizes: a claim reads up to a dozen columns, so the kernel call per column would
+// cost more than the arithmetic.
+struct Columns {
+    const World& w;
+    int shift;  // -1: not a power of two
+
+    explicit Columns(const World& world) : w(world), shift(-1) {
+        for (int s=0; s<16; ++s) if ((1 << s) == w.cfg.chunkSize) shift = s;
+    }
+    // worldToGridX/Z() without the roundf() call: adding just under a half and truncating
+    // rounds halves away from zero the same way
+    int gridX(float x) const { float g = x * w.invBlockSize; return int(g + copysignf(0.49999997f, g)) + w.cfg.gridW/2; }
+    int gridZ(float z) const { float g = z * w.invBlockSize; return int(g + copysignf(0.49999997f, g)) + w.cfg.gridH/2; }
+    int height(int gx, int gz) const {
+        if (gx < 0 || gx >= w.cfg.gridW || gz < 0 || gz >= w.cfg.gridH) return 0;
+        if (shift < 0) return worldHeight(w, gx, gz);
+        int mask = (1 << shift) - 1;
+        const Chunk& c = *w.chunks[(gz >> shift) * w.chunksX + (gx >> shift)];
+        return c.heights[((gz & mask) << shift) | (gx & mask)];
+    }
+};
+
+// Where a player at (x, z) comes to rest: on the highest column the foot touches, else the
+// ground plane. The one scalar part of the check.
+float standAt(const Columns& cols, float x, float z, const MoveRules& r) {
+    int x0 = cols.gridX(x - r.radius), x1 = cols.gridX(x + r.radius);
+    int z0 = cols.gridZ(z - r.radius), z1 = cols.gridZ(z + r.radius);
+    int top = cols.height(x0, z0);
+    if (x1 != x0) top = std::max(top, cols.height(x1, z0));
+    if (z1 != z0) top = std::max(top, cols.height(x0, z1));
+    if (x1 != x0 && z1 != z0) top = std::max(top, cols.height(x1, z1));
+    return top > 0 ? float(top) * cols.w.cfg.blockSize + r.stand : r.floor;
+}
+
+F4 standAt4(const Columns& cols, F4 x, F4 z, const MoveRules& r) {
+    alignas(16) float xs[4], zs[4], out[4];
+    f4Store(xs, x);
+    f4Store(zs, z);
+    for (int i=0; i<4; ++i) out[i] = standAt(cols, xs[i], zs[i], r);
+    return f4Load(out);
+}
+
+} // namespace
+
+void moveBatchResize(MoveBatch& b, int count) {
+    size_t n = size_t((count + 3) & ~3);
+    b.count = count;
+    for (std::vector<float>* v : { &b.px, &b.py, &b.pz, &b.vy, &b.ground, &b.debt, &b.dirX, &b.dirZ, &b.steps,
+                                   &b.cx, &b.cy, &b.cz }) {
+        v->assign(n, 0.0f);
+    }
+    b.flags.assign(n, 0);
+}
+
+void moveSetLane(MoveBatch& b, int i, const DetPlayer& p, float debt, const DetInput& in, int steps,
+                 const FixVec3& claim) {
+    // detStep's walk direction: forward loses its pitch, right is level
+    float cy = fixToFloat(fixCos(in.yaw)), sy = fixToFloat(fixSin(in.yaw)), cp = fixToFloat(fixCos(in.pitch));
+    float mx = 0.0f, mz = 0.0f;
+    if (in.buttons & DET_FORWARD) { mx += cy * cp; mz += sy * cp; }
+    if (in.buttons & DET_BACK) { mx -= cy * cp; mz -= sy * cp; }
+    if (in.buttons & DET_LEFT) { mx += sy; mz -= cy; }
+    if (in.buttons & DET_RIGHT) { mx -= sy; mz += cy; }
+    float len = sqrtf(mx * mx + mz * mz);
+    if (len > 0.01f) { mx /= len; mz /= len; }
+    b.px[i] = fixToFloat(p.pos.x);
+    b.py[i] = fixToFloat(p.pos.y);
+    b.pz[i] = fixToFloat(p.pos.z);
+    b.vy[i] = fixToFloat(p.vel.y);
+    b.ground[i] = p.onGround ? 1.0f : 0.0f;
+    b.debt[i] = debt;
+    b.dirX[i] = mx;
+    b.dirZ[i] = mz;
+    b.steps[i] = float(steps);
+    b.cx[i] = fixToFloat(claim.x);
+    b.cy[i] = fixToFloat(claim.y);
+    b.cz[i] = fixToFloat(claim.z);
+    b.flags[i] = MOVE_OK;
+}
+
+void moveGetLane(const MoveBatch& b, int i, DetPlayer& p, float* debt) {
+    float t = std::max(b.steps[i], 1.0f) / DET_TICK_HZ;
+    Vec3 start = detToVec3(p.pos);
+    p.pos = { fix(b.px[i]), fix(b.py[i]), fix(b.pz[i]) };
+    p.vel = { fix((b.px[i] - start.x) / t), fix(b.vy[i]), fix((b.pz[i] - start.z) / t) };
+    p.onGround = b.ground[i] > 0.5f;
+    *debt = b.debt[i];
+}
+
+int moveCheck(const World& w, MoveBatch& b, const MoveRules& r) {
+    const Columns cols(w);
+    const F4 zero = f4Splat(0.0f), one = f4Splat(1.0f), half = f4Splat(0.5f);
+    const F4 dt = f4Splat(r.dt), speed = f4Splat(r.speed), gravity = f4Splat(r.gravity), jump = f4Splat(r.jump);
+    const F4 slackXZ = f4Splat(r.slackXZ), slackY = f4Splat(r.slackY), groundSlack = f4Splat(kGroundSlack);
+    const F4 leak = f4Splat(r.leak), creep = f4Splat(r.creep);
+    int flagged = 0;
+    for (int i=0; i<b.count; i += 4) {
+        const F4 px0 = f4Load(&b.px[i]), py0 = f4Load(&b.py[i]), pz0 = f4Load(&b.pz[i]);
+        const F4 steps = f4Load(&b.steps[i]);
+        const F4 stepX = f4Load(&b.dirX[i]) * speed * dt, stepZ = f4Load(&b.dirZ[i]) * speed * dt;
+        int maxSteps = int(std::max(std::max(b.steps[i], b.steps[i+1]), std::max(b.steps[i+2], b.steps[i+3])));
+
+        // the highest path: walking on, jumping whenever the feet are down
+        F4 x = px0, y = py0, z = pz0, vy = f4Load(&b.vy[i]), ground = f4Load(&b.ground[i]);
+        for (int k=0; k<maxSteps; ++k) {
+            F4 active = f4Less(f4Splat(float(k)), steps);
+            F4 nvy = f4Select(f4Less(half, ground), jump, vy + gravity * dt);
+            F4 nx = x + stepX, nz = z + stepZ, ny = y + nvy * dt;
+            F4 stand = standAt4(cols, nx, nz, r);
+            F4 land = f4LessEq(ny, stand);
+            ny = f4Select(land, stand, ny);
+            nvy = f4Select(land, zero, nvy);
+            x = f4Select(active, nx, x);
+            y = f4Select(active, ny, y);
+            z = f4Select(active, nz, z);
+            vy = f4Select(active, nvy, vy);
+            ground = f4Select(active, f4And(land, one), ground);
+        }
+
+        // the claim against that path
+        F4 t = f4Max(steps, one) * dt;
+        F4 walk = speed * t, debt = f4Load(&b.debt[i]) * leak;
+        F4 reach = walk + f4Max(slackXZ - debt, zero);
+        F4 dx = f4Load(&b.cx[i]) - px0, dz = f4Load(&b.cz[i]) - pz0, cy = f4Load(&b.cy[i]);
+        F4 dist = f4Sqrt(dx * dx + dz * dz);
+        F4 tooFar = f4Less(reach, dist);
+        F4 standClaim = standAt4(cols, f4Load(&b.cx[i]), f4Load(&b.cz[i]), r);
+        F4 maxY = f4Max(y, standClaim) + slackY;
+        F4 tooHigh = f4Less(maxY, cy);
+
+        // accepted as claimed, or pulled back to the edge of the possible
+        F4 scale = f4Select(tooFar, reach / dist, one);
+        F4 ay = f4Min(cy, maxY);
+        F4 standing = f4LessEq(ay, standClaim + groundSlack);
+        F4 vEnd = (ay - py0) / t + gravity * t * half;
+        f4Store(&b.px[i], px0 + dx * scale);
+        f4Store(&b.py[i], ay);
+        f4Store(&b.pz[i], pz0 + dz * scale);
+        f4Store(&b.vy[i], f4Select(standing, zero, f4Min(vEnd, vy)));
+        f4Store(&b.ground[i], f4And(standing, one));
+        f4Store(&b.debt[i], f4Max(debt + f4Min(dist, reach) - walk - creep, zero));
+        int far = f4MoveMask(tooFar), high = f4MoveMask(tooHigh);
+        for (int l=0; l<4 && i + l < b.count; ++l) {
+            b.flags[i + l] = uint8_t(((far >> l) & 1) * MOVE_TOO_FAR | ((high >> l) & 1) * MOVE_TOO_HIGH);
+            flagged += b.flags[i + l] != MOVE_OK;
+        }
+    }
+    return flagged;
+}
+
+int moveCheckScalar(const World& w, MoveBatch& b, const MoveRules& r) {
+    const Columns cols(w);
+    int flagged = 0;
+    for (int i=0; i<b.count; ++i) {
+        const float px0 = b.px[i], py0 = b.py[i], pz0 = b.pz[i];
+        const float stepX = b.dirX[i] * r.speed * r.dt, stepZ = b.dirZ[i] * r.speed * r.dt;
+        float x = px0, y = py0, z = pz0, vy = b.vy[i], ground = b.ground[i];
+        for (int k=0; float(k)<b.steps[i]; ++k) {
+            float nvy = 0.5f < ground ? r.jump : vy + r.gravity * r.dt;
+            float nx = x + stepX, nz = z + stepZ, ny = y + nvy * r.dt;
+            float stand = standAt(cols, nx, nz, r);
+            bool land = ny <= stand;
+            x = nx;
+            y = land ? stand : ny;
+            z = nz;
+            vy = land ? 0.0f : nvy;
+            ground = land ? 1.0f : 0.0f;
+        }
+
+        float t = std::max(b.steps[i], 1.0f) * r.dt;
+        float walk = r.speed * t, debt = b.debt[i] * r.leak;
+        float spare = r.slackXZ - debt;
+        float reach = walk + (spare > 0.0f ? spare : 0.0f);
+        float dx = b.cx[i] - px0, dz = b.cz[i] - pz0, cy = b.cy[i];
+        float dist = sqrtf(dx * dx + dz * dz);
+        bool tooFar = reach < dist;
+        float standClaim = standAt(cols, b.cx[i], b.cz[i], r);
+        float maxY = (y < standClaim ? standClaim : y) + r.slackY;
+        bool tooHigh = maxY < cy;
+
+        float scale = tooFar ? reach / dist : 1.0f;
+        float ay = cy < maxY ? cy : maxY;
+        bool standing = ay <= standClaim + kGroundSlack;
+        float vEnd = (ay - py0) / t + r.gravity * t * 0.5f;
+        b.px[i] = px0 + dx * scale;
+        b.py[i] = ay;
+        b.pz[i] = pz0 + dz * scale;
+        b.vy[i] = standing ? 0.0f : (vEnd < vy ? vEnd : vy);
+        b.ground[i] = standing ? 1.0f : 0.0f;
+        float owed = debt + (dist < reach ? dist : reach) - walk - r.creep;
+        b.debt[i] = owed > 0.0f ? owed : 0.0f;
+        b.flags[i] = uint8_t((tooFar ? MOVE_TOO_FAR : 0) | (tooHigh ? MOVE_TOO_HIGH : 0));
+        flagged += b.flags[i] != MOVE_OK;
+    }
+    return flagged;
+}
@@ -0,0 +1,67 @@
+// Server-side validation of client-claimed movement.
+//
+// Clients that move themselves with main_loop()'s float physics (walk speed 5, gravity -9.8,
+// jump 6, standing 1.8 above the top of the column underneath or on the ground plane at 1)
+// send where they ended up with each input. The server steps the same rules for every claiming
+// player and flags claims that got further than the rules allow: sideways (speed hacks,
+// teleports) or upwards (flying, jumping in mid-air). A flagged claim is pulled back to the
+// edge of what was possible.
+//
+// Sideways, what a claim goes beyond the walking distance is kept as a debt that leaks away
+// claim by claim; the claim is flagged once the debt passes the slack. A player slightly too
+// fast every tick is caught that way as surely as one that jumps ahead at once.
+//
+// The rules give a bound rather than one answer: input may change between claims and jumps
+// fall between ticks, so the vertical reference jumps whenever it stands (the highest any
+// player could be) and the horizontal one is the walking distance in any direction. Pushes
+// out of walls are not modelled, hence the slack.
+//
+// Players are checked four at a time in SIMD lanes (simd.h) from SoA arrays. Only the column
+// heights under each lane are read one by one; moveCheckScalar() is the same arithmetic a
+// player at a time, the reference the lanes must match bit for bit.
+#pragma once
+
+#include "det_physics.h"
+#include "world.h"
+
+#include <cstdint>
+#include <vector>
+
+enum MoveViolation : uint8_t {
+    MOVE_OK = 0, MOVE_TOO_FAR = 1, MOVE_TOO_HIGH = 2,
+};
+
+struct MoveRules {
+    float speed = 5.0f, gravity = -9.8f, jump = 6.0f;
+    float stand = 1.8f;     // above the top of a column
+    float floor = 1.0f;     // the ground plane
+    float radius = 0.25f;   // the foot touches columns this far to the side
+    float dt = 1.0f / DET_TICK_HZ;
+    float slackXZ = 0.5f, slackY = 0.35f;
+    float creep = 0.04f;    // sideways excess per claim that is not held against the player
+    float leak = 0.9f;      // of the sideways debt left after each claim
+};
+
+// One claim per lane; arrays padded to a multiple of 4. State is in and out: the accepted (or
+// corrected) position, vertical velocity and ground contact.
+struct MoveBatch {
+    int count = 0;
+    std::vector<float> px, py, pz, vy, ground;  // ground: 1 or 0
+    std::vector<float> debt;                    // sideways distance beyond the rules
+    std::vector<float> dirX, dirZ;              // walk direction of the latest input (unit or 0)
+    std::vector<float> steps;                   // physics steps since the last claim
+    std::vector<float> cx, cy, cz;              // claimed position
+    std::vector<uint8_t> flags;                 // MoveViolation bits
+};
+
+void moveBatchResize(MoveBatch& b, int count);
+// Fills lane i; steps is how many 1/DET_TICK_HZ steps the claim covers.
+void moveSetLane(MoveBatch& b, int i, const DetPlayer& p, float debt, const DetInput& in, int steps,
+                 const FixVec3& claim);
+// The lane's state back into the player it was filled from; the horizontal velocity is the
+// distance covered over the steps.
+void moveGetLane(const MoveBatch& b, int i, DetPlayer& p, float* debt);
+
+// Checks every lane; returns the number of flagged claims.
+int moveCheck(const World& w, MoveBatch& b, const MoveRules& rules);
+int moveCheckScalar(const World& w, MoveBatch& b, const MoveRules& rules);
@@ -0,0 +1,156 @@
+#include "net.h"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <random>
+#include <unistd.h>
+
+namespace {
+
+int failed(const char* what, int fd) {
+    printf("[net] %s: %s\n", what, strerror(errno));
+    if (fd >= 0) close(fd);
+    return -1;
+}
+
+uint64_t rotl(uint64_t x, int b) {
+    return x << b | x >> (64 - b);
+}
+
+// SipHash-2-4 of two words, the second (with the length, 16) in the final block.
+uint64_t sipHash(const NetCookieKey& key, uint64_t m0, uint64_t m1) {
+    uint64_t v0 = key.k0 ^ 0x736f6d6570736575ull, v1 = key.k1 ^ 0x646f72616e646f6dull;
+    uint64_t v2 = key.k0 ^ 0x6c7967656e657261ull, v3 = key.k1 ^ 0x7465646279746573ull;
+    auto round = [&]() {
+        v0 += v1; v1 = rotl(v1, 13); v1 ^= v0; v0 = rotl(v0, 32);
+        v2 += v3; v3 = rotl(v3, 16); v3 ^= v2;
+        v0 += v3; v3 = rotl(v3, 21); v3 ^= v0;
+        v2 += v1; v1 = rotl(v1, 17); v1 ^= v2; v2 = rotl(v2, 32);
+    };
+    const uint64_t blocks[3] = { m0, m1, uint64_t(16) << 56 };
+    for (uint64_t m : blocks) {
+        v3 ^= m;
+        round();
+        round();
+        v0 ^= m;
+    }
+    v2 ^= 0xff;
+    for (int i=0; i<4; ++i) round();
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+} // namespace
+
+bool netParseAddr(const char* text, sockaddr_in& out) {
+    memset(&out, 0, sizeof(out));
+    out.sin_family = AF_INET;
+    out.sin_addr.s_addr = htonl(INADDR_ANY);
+    const char* colon = strrchr(text, ':');
+    const char* port = colon ? colon + 1 : text;
+    char* end;
+    long p = strtol(port, &end, 10);
+    if (*port == '\0' || *end != '\0' || p < 0 || p > 65535) return false;
+    out.sin_port = htons(uint16_t(p));
+    if (!colon || colon == text) return true;
+
+    char host[256];
+    size_t n = size_t(colon - text);
+    if (n >= sizeof(host)) return false;
+    memcpy(host, text, n);
+    host[n] = '\0';
+    if (inet_pton(AF_INET, host, &out.sin_addr) == 1) return true;
+    addrinfo hints = {}, *found = nullptr;
+    hints.ai_family = AF_INET;
+    if (getaddrinfo(host, nullptr, &hints, &found) != 0 || !found) return false;
+    out.sin_addr = reinterpret_cast<sockaddr_in*>(found->ai_addr)->sin_addr;
+    freeaddrinfo(found);
+    return true;
+}
+
+const char* netAddrString(const sockaddr_in& a) {
+    static char text[32];
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &a.sin_addr, ip, sizeof(ip));
+    snprintf(text, sizeof(text), "%s:%u", ip, unsigned(ntohs(a.sin_port)));
+    return text;
+}
+
+uint64_t netAddrKey(const sockaddr_in& a) {
+    return uint64_t(a.sin_addr.s_addr) << 16 | a.sin_port;
+}
+
+NetCookieKey netCookieKey() {
+    std::random_device random;
+    NetCookieKey key;
+    key.k0 = uint64_t(random()) << 32 | random();
+    key.k1 = uint64_t(random()) << 32 | random();
+    return key;
+}
+
+uint32_t netCookie(const NetCookieKey& key, const sockaddr_in& a, double nowMs) {
+    return uint32_t(sipHash(key, netAddrKey(a), uint64_t(nowMs / NET_COOKIE_MS)));
+}
+
+bool netCookieValid(const NetCookieKey& key, const sockaddr_in& a, uint32_t cookie, double nowMs) {
+    return cookie == netCookie(key, a, nowMs) || cookie == netCookie(key, a, nowMs - NET_COOKIE_MS);
+}
+
+uint16_t netLocalPort(int fd) {
+    sockaddr_in a = {};
+    socklen_t len = sizeof(a);
+    if (getsockname(fd, reinterpret_cast<sockaddr*>(&a), &len) != 0) return 0;
+    return ntohs(a.sin_port);
+}
+
+void netSetNonBlocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+int netUdpOpen(const sockaddr_in& bind) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) return failed("udp socket", fd);
+    int size = NET_SOCKET_BUFFER;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    if (::bind(fd, reinterpret_cast<const sockaddr*>(&bind), sizeof(bind)) != 0) return failed("udp bind", fd);
+    netSetNonBlocking(fd);
+    return fd;
+}
+
+int netTcpListen(const sockaddr_in& bind) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return failed("tcp socket", fd);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (::bind(fd, reinterpret_cast<const sockaddr*>(&bind), sizeof(bind)) != 0) return failed("tcp bind", fd);
+    if (listen(fd, SOMAXCONN) != 0) return failed("listen", fd);
+    netSetNonBlocking(fd);
+    return fd;
+}
+
+int netTcpConnect(const sockaddr_in& to) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return failed("tcp socket", fd);
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&to), sizeof(to)) != 0) return failed("connect", fd);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+int netAccept(int listener) {
+    int fd = accept(listener, nullptr, nullptr);
+    if (fd < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) failed("accept", -1);
+        return -1;
+    }
+    netSetNonBlocking(fd);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
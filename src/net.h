@@ -0,0 +1,40 @@
+// Socket helpers for the native server tools (POSIX, IPv4; not part of the web client).
+//
+// UDP sockets are non-blocking; batched datagram I/O on top of them is in net_io.h.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+const int NET_BATCH = 256;              // datagrams per batch (net_io.h)
+const int NET_MAX_DATAGRAM = 1200;      // stays under every path MTU
+const int NET_SOCKET_BUFFER = 4 << 20;  // requested UDP buffers (the kernel caps them at rmem/wmem_max)
+
+// "host:port", or just "port" for every local address.
+bool netParseAddr(const char* text, sockaddr_in& out);
+// Formatted into a static buffer.
+const char* netAddrString(const sockaddr_in& a);
+uint64_t netAddrKey(const sockaddr_in& a);
+uint16_t netLocalPort(int fd);
+
+// Stateless return-routability cookies: a keyed hash (SipHash-2-4) of the address and the time,
+// learnt only by whoever receives at that address. A server answers an unproven source with a
+// cookie no bigger than its request and does real work only for requests echoing one, so a
+// forged source address gets nothing worth forging it for. Cookies change every NET_COOKIE_MS;
+// the previous one is still taken.
+const double NET_COOKIE_MS = 30000.0;
+struct NetCookieKey {
+    uint64_t k0 = 0, k1 = 0;
+};
+NetCookieKey netCookieKey();  // random
+uint32_t netCookie(const NetCookieKey& key, const sockaddr_in& a, double nowMs);
+bool netCookieValid(const NetCookieKey& key, const sockaddr_in& a, uint32_t cookie, double nowMs);
+void netSetNonBlocking(int fd);
+
+// All of these return -1 (after printing why) on failure.
+int netUdpOpen(const sockaddr_in& bind);
+int netTcpListen(const sockaddr_in& bind);   // non-blocking, for netAccept()
+int netTcpConnect(const sockaddr_in& to);    // blocking
+int netAccept(int listener);                 // -1 when nobody is waiting as well
@@ -0,0 +1,479 @@
+#include "net_io.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifndef SANDBOX_IO_URING
+#define SANDBOX_IO_URING 0
+#endif
+
+#if SANDBOX_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace {
+
+bool wouldBlock() {
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+void finishSend(NetIo& io, const NetSend& s, bool ok) {
+    ++(ok ? io.stats.sent : io.stats.dropped);
+    if (ok) io.stats.bytesSent += s.size;
+    if (s.owned) netIoRelease(io, s.owned);
+}
+
+// ----------------- socket: one system call per datagram -----------------
+bool socketOpen(NetIo&) { return true; }
+void socketClose(NetIo&) {}
+
+void socketReceive(NetIo& io, int max) {
+    while (int(io.received.size()) < max) {
+        NetPacket* p = netIoAlloc(io);
+        if (!p) {
+            ++io.stats.poolEmpty;
+            return;
+        }
+        socklen_t len = sizeof(p->addr);
+        ssize_t n = recvfrom(io.fd, p->data, NET_MAX_DATAGRAM, 0, reinterpret_cast<sockaddr*>(&p->addr), &len);
+        ++io.stats.recvCalls;
+        if (n < 0) {
+            netIoRelease(io, p);
+            if (errno == EINTR) continue;
+            return;
+        }
+        p->size = uint32_t(n);
+        io.received.push_back(p);
+    }
+}
+
+void socketFlush(NetIo& io) {
+    for (const NetSend& s : io.outgoing) {
+        ssize_t n;
+        do {
+            n = sendto(io.fd, s.data, s.size, 0, reinterpret_cast<const sockaddr*>(&s.to), sizeof(s.to));
+            ++io.stats.sendCalls;
+        } while (n < 0 && errno == EINTR);
+        finishSend(io, s, n >= 0);
+    }
+}
+
+const NetIoBackend kSocketBackend = { "socket", socketOpen, socketClose, socketReceive, socketFlush };
+
+// ----------------- mmsg: one system call per batch -----------------
+struct MmsgState {
+    mmsghdr msgs[NET_BATCH];
+    iovec iovs[NET_BATCH];
+    NetPacket* packets[NET_BATCH];
+};
+
+bool mmsgOpen(NetIo& io) {
+    io.impl = new MmsgState();
+    return true;
+}
+
+void mmsgClose(NetIo& io) {
+    delete static_cast<MmsgState*>(io.impl);
+}
+
+void mmsgReceive(NetIo& io, int max) {
+    MmsgState& m = *static_cast<MmsgState*>(io.impl);
+    for (;;) {
+        int want = std::min(max - int(io.received.size()), NET_BATCH), count = 0;
+        for (; count < want; ++count) {
+            NetPacket* p = netIoAlloc(io);
+            if (!p) {
+                ++io.stats.poolEmpty;
+                break;
+            }
+            m.packets[count] = p;
+            m.iovs[count] = { p->data, size_t(NET_MAX_DATAGRAM) };
+            msghdr& h = m.msgs[count].msg_hdr;
+            h = msghdr();
+            h.msg_name = &p->addr;
+            h.msg_namelen = sizeof(p->addr);
+            h.msg_iov = &m.iovs[count];
+            h.msg_iovlen = 1;
+        }
+        if (count == 0) return;
+        int n = recvmmsg(io.fd, m.msgs, unsigned(count), MSG_DONTWAIT, nullptr);
+        ++io.stats.recvCalls;
+        for (int i=0; i<std::max(n, 0); ++i) {
+            m.packets[i]->size = m.msgs[i].msg_len;
+            io.received.push_back(m.packets[i]);
+        }
+        for (int i=std::max(n, 0); i<count; ++i) netIoRelease(io, m.packets[i]);
+        // a full batch may mean more is waiting
+        if (n < count || int(io.received.size()) >= max) return;
+    }
+}
+
+void mmsgFlush(NetIo& io) {
+    MmsgState& m = *static_cast<MmsgState*>(io.impl);
+    int count = int(io.outgoing.size());
+    for (int i=0; i<count; ++i) {
+        NetSend& s = io.outgoing[i];
+        m.iovs[i] = { const_cast<uint8_t*>(s.data), s.size };
+        msghdr& h = m.msgs[i].msg_hdr;
+        h = msghdr();
+        h.msg_name = &s.to;
+        h.msg_namelen = sizeof(s.to);
+        h.msg_iov = &m.iovs[i];
+        h.msg_iovlen = 1;
+    }
+    int done = 0;
+    while (done < count) {
+        int n = sendmmsg(io.fd, m.msgs + done, unsigned(count - done), 0);
+        ++io.stats.sendCalls;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (wouldBlock()) break;  // buffer full: the rest is lost, as on the wire
+            finishSend(io, io.outgoing[done++], false);  // this one cannot be sent (bad address)
+            continue;
+        }
+        for (int i=done; i<done+n; ++i) finishSend(io, io.outgoing[i], true);
+        done += n;
+    }
+    for (int i=done; i<count; ++i) finishSend(io, io.outgoing[i], false);
+}
+
+const NetIoBackend kMmsgBackend = { "mmsg", mmsgOpen, mmsgClose, mmsgReceive, mmsgFlush };
+
+// ----------------- uring: shared submission and completion rings -----------------
+#if SANDBOX_IO_URING
+const unsigned URING_ENTRIES = 2 * NET_BATCH;  // posted receives plus one batch of sends
+const int URING_RECEIVES = NET_BATCH;
+
+struct UringOp {
+    NetPacket* packet;       // receive buffer
+    bool isSend;
+    NetSend send;            // or the send it carries
+    msghdr msg;
+    iovec iov;
+    sockaddr_in addr;
+};
+
+struct UringState {
+    int ring = -1;
+    unsigned *sqHead = nullptr, *sqTail = nullptr, *sqMask = nullptr, *sqArray = nullptr, sqEntries = 0;
+    unsigned *cqHead = nullptr, *cqTail = nullptr, *cqMask = nullptr;
+    io_uring_sqe* sqes = nullptr;
+    io_uring_cqe* cqes = nullptr;
+    void* rings = MAP_FAILED;
+    size_t ringsSize = 0;
+    void* sqeMap = MAP_FAILED;
+    size_t sqeSize = 0;
+    unsigned toSubmit = 0;
+    int postedReceives = 0, pendingSends = 0;
+    std::vector<UringOp> ops;
+    std::vector<int> freeOps;
+    std::vector<NetPacket*> ready;  // completed receives not handed out yet
+};
+
+int uringEnter(UringState& u, unsigned submit, unsigned wait) {
+    int n;
+    do {
+        n = int(syscall(__NR_io_uring_enter, u.ring, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+    } while (n < 0 && errno == EINTR);
+    if (n > 0) u.toSubmit -= unsigned(n);
+    return n;
+}
+
+io_uring_sqe* uringSqe(UringState& u) {
+    unsigned tail = *u.sqTail;
+    if (tail - __atomic_load_n(u.sqHead, __ATOMIC_ACQUIRE) >= u.sqEntries) return nullptr;
+    unsigned i = tail & *u.sqMask;
+    io_uring_sqe* sqe = &u.sqes[i];
+    memset(sqe, 0, sizeof(*sqe));
+    u.sqArray[i] = i;
+    return sqe;
+}
+
+void uringPush(UringState& u) {
+    __atomic_store_n(u.sqTail, *u.sqTail + 1, __ATOMIC_RELEASE);
+    ++u.toSubmit;
+}
+
+void uringReap(NetIo& io, UringState& u) {
+    unsigned head = *u.cqHead, tail = __atomic_load_n(u.cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+        const io_uring_cqe& c = u.cqes[head & *u.cqMask];
+        if (c.user_data == UINT64_MAX) continue;  // a cancel request
+        UringOp& op = u.ops[size_t(c.user_data)];
+        if (op.isSend) {
+            --u.pendingSends;
+            finishSend(io, op.send, c.res >= 0);
+        } else {
+            --u.postedReceives;
+            if (c.res >= 0) {
+                op.packet->size = uint32_t(c.res);
+                op.packet->addr = op.addr;
+                u.ready.push_back(op.packet);
+            } else {
+                netIoRelease(io, op.packet);
+            }
+        }
+        u.freeOps.push_back(int(c.user_data));
+    }
+    __atomic_store_n(u.cqHead, head, __ATOMIC_RELEASE);
+}
+
+int uringOp(UringState& u) {
+    int i = u.freeOps.back();
+    u.freeOps.pop_back();
+    UringOp& op = u.ops[i];
+    op.msg = msghdr();
+    op.msg.msg_name = &op.addr;
+    op.msg.msg_namelen = sizeof(op.addr);
+    op.msg.msg_iov = &op.iov;
+    op.msg.msg_iovlen = 1;
+    return i;
+}
+
+// Keeps URING_RECEIVES receives posted on pool buffers; they complete without a system call.
+void uringPostReceives(NetIo& io, UringState& u) {
+    while (u.postedReceives < URING_RECEIVES && !u.freeOps.empty()) {
+        io_uring_sqe* sqe = uringSqe(u);
+        if (!sqe) return;
+        NetPacket* p = netIoAlloc(io);
+        if (!p) {
+            ++io.stats.poolEmpty;
+            return;
+        }
+        int i = uringOp(u);
+        UringOp& op = u.ops[i];
+        op.packet = p;
+        op.isSend = false;
+        op.iov = { p->data, size_t(NET_MAX_DATAGRAM) };
+        sqe->opcode = IORING_OP_RECVMSG;
+        sqe->fd = io.fd;
+        sqe->addr = uint64_t(uintptr_t(&op.msg));
+        sqe->len = 1;
+        sqe->user_data = uint64_t(i);
+        uringPush(u);
+        ++u.postedReceives;
+    }
+}
+
+void uringClose(NetIo& io) {
+    UringState* u = static_cast<UringState*>(io.impl);
+    if (!u) return;
+    if (u->sqes) {
+        // take the posted receives back before their buffers go away
+        for (size_t i=0; i<u->ops.size(); ++i) {
+            if (std::find(u->freeOps.begin(), u->freeOps.end(), int(i)) != u->freeOps.end()) continue;
+            io_uring_sqe* sqe = uringSqe(*u);
+            if (!sqe) break;
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = uint64_t(i);
+            sqe->user_data = UINT64_MAX;
+            uringPush(*u);
+        }
+        while (u->postedReceives > 0 && uringEnter(*u, u->toSubmit, 1) >= 0) uringReap(io, *u);
+        for (NetPacket* p : u->ready) netIoRelease(io, p);
+    }
+    if (u->sqeMap != MAP_FAILED) munmap(u->sqeMap, u->sqeSize);
+    if (u->rings != MAP_FAILED) munmap(u->rings, u->ringsSize);
+    if (u->ring >= 0) close(u->ring);
+    delete u;
+    io.impl = nullptr;
+}
+
+bool uringOpen(NetIo& io) {
+    UringState* u = new UringState();
+    io.impl = u;
+    io_uring_params p = {};
+    u->ring = int(syscall(__NR_io_uring_setup, URING_ENTRIES, &p));
+    if (u->ring < 0 || !(p.features & IORING_FEAT_SINGLE_MMAP)) {
+        printf("[net] io_uring unavailable: %s\n", u->ring < 0 ? strerror(errno) : "kernel too old");
+        uringClose(io);
+        return false;
+    }
+    u->ringsSize = std::max(p.sq_off.array + p.sq_entries * sizeof(unsigned),
+                            p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe));
+    u->rings = mmap(nullptr, u->ringsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->ring, IORING_OFF_SQ_RING);
+    u->sqeSize = p.sq_entries * sizeof(io_uring_sqe);
+    u->sqeMap = mmap(nullptr, u->sqeSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->ring, IORING_OFF_SQES);
+    if (u->rings == MAP_FAILED || u->sqeMap == MAP_FAILED) {
+        printf("[net] io_uring mmap failed: %s\n", strerror(errno));
+        uringClose(io);
+        return false;
+    }
+    uint8_t* base = static_cast<uint8_t*>(u->rings);
+    u->sqHead = reinterpret_cast<unsigned*>(base + p.sq_off.head);
+    u->sqTail = reinterpret_cast<unsigned*>(base + p.sq_off.tail);
+    u->sqMask = reinterpret_cast<unsigned*>(base + p.sq_off.ring_mask);
+    u->sqArray = reinterpret_cast<unsigned*>(base + p.sq_off.array);
+    u->sqEntries = p.sq_entries;
+    u->cqHead = reinterpret_cast<unsigned*>(base + p.cq_off.head);
+    u->cqTail = reinterpret_cast<unsigned*>(base + p.cq_off.tail);
+    u->cqMask = reinterpret_cast<unsigned*>(base + p.cq_off.ring_mask);
+    u->cqes = reinterpret_cast<io_uring_cqe*>(base + p.cq_off.cqes);
+    u->sqes = static_cast<io_uring_sqe*>(u->sqeMap);
+    // the completion ring must hold every operation in flight
+    u->ops.resize(std::min(p.sq_entries, p.cq_entries));
+    for (int i=int(u->ops.size())-1; i>=0; --i) u->freeOps.push_back(i);
+    // a non-blocking socket would fail posted receives with EAGAIN instead of waiting on them
+    fcntl(io.fd, F_SETFL, fcntl(io.fd, F_GETFL, 0) & ~O_NONBLOCK);
+    return true;
+}
+
+void uringReceive(NetIo& io, int max) {
+    UringState& u = *static_cast<UringState*>(io.impl);
+    uringReap(io, u);
+    uringPostReceives(io, u);
+    if (u.toSubmit > 0) {
+        uringEnter(u, u.toSubmit, 0);
+        ++io.stats.recvCalls;
+        uringReap(io, u);
+    }
+    int n = std::min(max, int(u.ready.size()));
+    io.received.insert(io.received.end(), u.ready.begin(), u.ready.begin() + n);
+    u.ready.erase(u.ready.begin(), u.ready.begin() + n);
+}
+
+void uringFlush(NetIo& io) {
+    UringState& u = *static_cast<UringState*>(io.impl);
+    for (const NetSend& s : io.outgoing) {
+        io_uring_sqe* sqe;
+        while (u.freeOps.empty() || !(sqe = uringSqe(u))) {
+            uringEnter(u, u.toSubmit, 1);
+            ++io.stats.sendCalls;
+            uringReap(io, u);
+        }
+        int i = uringOp(u);
+        UringOp& op = u.ops[i];
+        op.packet = nullptr;
+        op.isSend = true;
+        op.send = s;
+        op.addr = s.to;
+        op.iov = { const_cast<uint8_t*>(s.data), s.size };
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = io.fd;
+        sqe->addr = uint64_t(uintptr_t(&op.msg));
+        sqe->len = 1;
+        sqe->user_data = uint64_t(i);
+        uringPush(u);
+        ++u.pendingSends;
+    }
+    // the bytes may change after the flush, so wait until the kernel is done with them
+    while (u.pendingSends > 0) {
+        if (uringEnter(u, u.toSubmit, unsigned(u.pendingSends)) < 0) break;
+        ++io.stats.sendCalls;
+        uringReap(io, u);
+    }
+}
+
+const NetIoBackend kUringBackend = { "uring", uringOpen, uringClose, uringReceive, uringFlush };
+
+// Probes once whether this kernel lets us set up a ring at all.
+bool uringUsable() {
+    static int usable = -1;
+    if (usable < 0) {
+        io_uring_params p = {};
+        int fd = int(syscall(__NR_io_uring_setup, 4, &p));
+        usable = fd >= 0 && (p.features & IORING_FEAT_SINGLE_MMAP);
+        if (fd >= 0) close(fd);
+    }
+    return usable != 0;
+}
+#endif
+
+} // namespace
+
+bool netIoOpen(NetIo& io, const sockaddr_in& bind, const NetIoBackend& backend, int poolPackets) {
+    io.fd = netUdpOpen(bind);
+    if (io.fd < 0) return false;
+    io.storage.assign(size_t(poolPackets) * NET_MAX_DATAGRAM, 0);
+    io.packets.resize(poolPackets);
+    io.freeList.clear();
+    for (int i=poolPackets-1; i>=0; --i) {
+        io.packets[i] = { &io.storage[size_t(i) * NET_MAX_DATAGRAM], 0, sockaddr_in() };
+        io.freeList.push_back(&io.packets[i]);
+    }
+    io.received.reserve(NET_BATCH);
+    io.outgoing.reserve(NET_BATCH);
+    io.stats = NetIoStats();
+    io.backend = &backend;
+    if (!backend.open(io)) {
+        close(io.fd);
+        io.fd = -1;
+        return false;
+    }
+    return true;
+}
+
+void netIoClose(NetIo& io) {
+    if (io.fd < 0) return;
+    netIoFlush(io);
+    io.backend->close(io);
+    close(io.fd);
+    io.fd = -1;
+    io.impl = nullptr;
+    io.received.clear();
+}
+
+int netIoReceive(NetIo& io, int max) {
+    io.received.clear();
+    io.backend->receive(io, max);
+    io.stats.received += io.received.size();
+    return int(io.received.size());
+}
+
+NetPacket* netIoAlloc(NetIo& io) {
+    if (io.freeList.empty()) return nullptr;
+    NetPacket* p = io.freeList.back();
+    io.freeList.pop_back();
+    p->size = 0;
+    return p;
+}
+
+void netIoRelease(NetIo& io, NetPacket* p) {
+    io.freeList.push_back(p);
+}
+
+void netIoSend(NetIo& io, const uint8_t* data, size_t size, const sockaddr_in& to) {
+    io.outgoing.push_back({ data, uint32_t(size), to, nullptr });
+    if (int(io.outgoing.size()) >= NET_BATCH) netIoFlush(io);
+}
+
+void netIoSendPacket(NetIo& io, NetPacket* p) {
+    io.outgoing.push_back({ p->data, p->size, p->addr, p });
+    if (int(io.outgoing.size()) >= NET_BATCH) netIoFlush(io);
+}
+
+void netIoFlush(NetIo& io) {
+    if (io.outgoing.empty()) return;
+    io.backend->flush(io);
+    io.outgoing.clear();
+}
+
+const NetIoBackend& netSocketBackend() {
+    return kSocketBackend;
+}
+
+const NetIoBackend& netMmsgBackend() {
+    return kMmsgBackend;
+}
+
+const NetIoBackend* netUringBackend() {
+#if SANDBOX_IO_URING
+    return uringUsable() ? &kUringBackend : nullptr;
+#else
+    return nullptr;
+#endif
+}
+
+const NetIoBackend* netFindBackend(const char* name) {
+    if (strcmp(name, "socket") == 0) return &netSocketBackend();
+    if (strcmp(name, "mmsg") == 0) return &netMmsgBackend();
+    if (strcmp(name, "uring") == 0) return netUringBackend();
+    return nullptr;
+}
@@ -0,0 +1,89 @@
+// Batched datagram I/O with a preallocated packet pool (native only).
+//
+// A NetIo owns one UDP socket and a pool of NET_MAX_DATAGRAM buffers. netIoReceive() lands a
+// whole batch of datagrams directly in pool buffers; the caller parses them in place and either
+// releases them or fills in a reply and sends the same buffer back, so nothing is copied or
+// allocated per packet. Outgoing datagrams queue up, either pool packets or any bytes that stay
+// put until the flush (the relay's log, a snapshot shared by every client), and go out a batch
+// at a time.
+//
+// How a batch reaches the kernel is a pluggable backend (the same idea as WorldKernels):
+//   socket  one recvfrom()/sendto() per datagram; the baseline, and portable
+//   mmsg    one recvmmsg()/sendmmsg() per batch
+//   uring   io_uring: receives stay posted on pool buffers and complete into the shared ring
+//           without a system call, a flush submits every send with one io_uring_enter()
+//           (built when the headers exist, SANDBOX_IO_URING; used when the kernel allows it)
+#pragma once
+
+#include "net.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+const int NET_POOL_PACKETS = 4096;
+
+struct NetPacket {
+    uint8_t* data;      // NET_MAX_DATAGRAM bytes of pool storage
+    uint32_t size;
+    sockaddr_in addr;   // source once received, destination to send
+};
+
+struct NetSend {
+    const uint8_t* data;
+    uint32_t size;
+    sockaddr_in to;
+    NetPacket* owned;   // back to the pool once sent
+};
+
+struct NetIoStats {
+    uint64_t received = 0, sent = 0, dropped = 0, bytesSent = 0;
+    uint64_t recvCalls = 0, sendCalls = 0;  // system calls
+    uint64_t poolEmpty = 0;                 // receives cut short for want of buffers
+};
+
+struct NetIo;
+
+struct NetIoBackend {
+    const char* name;
+    bool (*open)(NetIo& io);
+    void (*close)(NetIo& io);
+    // Appends up to max datagrams to io.received.
+    void (*receive)(NetIo& io, int max);
+    // Sends io.outgoing and returns the owned packets to the pool.
+    void (*flush)(NetIo& io);
+};
+
+struct NetIo {
+    int fd = -1;
+    const NetIoBackend* backend = nullptr;
+    std::vector<uint8_t> storage;
+    std::vector<NetPacket> packets;
+    std::vector<NetPacket*> freeList;
+    std::vector<NetPacket*> received;  // filled by netIoReceive()
+    std::vector<NetSend> outgoing;
+    void* impl = nullptr;              // backend state
+    NetIoStats stats;
+};
+
+bool netIoOpen(NetIo& io, const sockaddr_in& bind, const NetIoBackend& backend, int poolPackets = NET_POOL_PACKETS);
+void netIoClose(NetIo& io);
+
+// Receives what is waiting, up to max datagrams, into io.received. The packets belong to the
+// caller until netIoRelease() or netIoSendPacket().
+int netIoReceive(NetIo& io, int max = NET_BATCH);
+NetPacket* netIoAlloc(NetIo& io);  // nullptr when the pool is empty
+void netIoRelease(NetIo& io, NetPacket* p);
+
+// Queues bytes that stay valid until the next flush; full batches flush by themselves.
+void netIoSend(NetIo& io, const uint8_t* data, size_t size, const sockaddr_in& to);
+// Queues a pool packet to p->addr; it goes back to the pool once sent.
+void netIoSendPacket(NetIo& io, NetPacket* p);
+void netIoFlush(NetIo& io);
+
+const NetIoBackend& netSocketBackend();
+const NetIoBackend& netMmsgBackend();
+// nullptr when io_uring is not built in or the kernel refuses it.
+const NetIoBackend* netUringBackend();
+// "socket", "mmsg" or "uring"; nullptr if unknown or unavailable.
+const NetIoBackend* netFindBackend(const char* name);
@@ -0,0 +1,70 @@
+#include "profiler.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Slot {
+    std::string name;
+    bool timer;
+    double accum;    // sum over the current window
+    double average;  // per-frame average of the last window
+};
+
+std::vector<Slot> slots;
+int windowFrames = 0;
+double windowStart = -1.0;
+
+} // namespace
+
+double profilerNowMs() {
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+int profilerSlot(const char* name) {
+    for (size_t i=0; i<slots.size(); ++i) {
+        if (slots[i].name == name) return int(i);
+    }
+    slots.push_back({name, false, 0.0, 0.0});
+    return int(slots.size()) - 1;
+}
+
+void profilerAddTime(int slot, double ms) {
+    slots[slot].timer = true;
+    slots[slot].accum += ms;
+}
+
+void profilerAddCount(int slot, double n) {
+    slots[slot].accum += n;
+}
+
+void profilerEndFrame() {
+    double now = profilerNowMs();
+    if (windowStart < 0.0) windowStart = now;
+    ++windowFrames;
+    if (now - windowStart < 1000.0) return;
+
+    char line[1024];
+    int len = snprintf(line, sizeof(line), "[profile] %d frames:", windowFrames);
+    for (Slot& s : slots) {
+        s.average = s.accum / windowFrames;
+        s.accum = 0.0;
+        if (len < int(sizeof(line))) {
+            len += snprintf(line + len, sizeof(line) - len, s.timer ? " %s %.3fms" : " %s %.1f",
+                            s.name.c_str(), s.average);
+        }
+    }
+    printf("%s\n", line);
+    windowFrames = 0;
+    windowStart = now;
+}
+
+double profilerAverage(int slot) { return slots[slot].average; }
+int profilerSlotCount() { return int(slots.size()); }
+const char* profilerSlotName(int slot) { return slots[slot].name.c_str(); }
+bool profilerSlotIsTimer(int slot) { return slots[slot].timer; }
@@ -0,0 +1,29 @@
+// Tiny frame profiler: named timing/counter slots averaged over one-second windows.
+#pragma once
+
+// Wall clock in milliseconds (steady, arbitrary epoch).
+double profilerNowMs();
+
+// Returns a stable slot id for a name; registering the same name twice returns the same slot.
+int profilerSlot(const char* name);
+
+void profilerAddTime(int slot, double ms);
+void profilerAddCount(int slot, double n);
+
+// Closes the current frame. Once per second the per-frame averages are printed and
+// made available through profilerAverage().
+void profilerEndFrame();
+
+// Per-frame average of a slot over the last completed window (ms for timers).
+double profilerAverage(int slot);
+int profilerSlotCount();
+const char* profilerSlotName(int slot);
+bool profilerSlotIsTimer(int slot);
+
+// Scoped timer: adds the elapsed time to a slot on destruction.
+struct ProfileScope {
+    int slot;
+    double start;
+    explicit ProfileScope(int s) : slot(s), start(profilerNowMs()) {}
+    ~ProfileScope() { profilerAddTime(slot, profilerNowMs() - start); }
+};
@@ -0,0 +1,117 @@
+#include "prop_render.h"
+#include "cubemesh.h"
+#include "glutil.h"
+#include "profiler.h"
+
+#include <vector>
+
+namespace {
+
+const char* propVertexSrc = R"(#version 300 es
+in vec3 aPos;
+in float aShade;
+in vec3 aMin;
+in vec3 aSize;
+in vec3 aColor;
+uniform mat4 uVP;
+out vec3 vColor;
+void main() {
+    vColor = aColor * aShade;
+    gl_Position = uVP * vec4(aMin + aPos * aSize, 1.0);
+}
+)";
+
+const char* propFragSrc = R"(#version 300 es
+precision mediump float;
+in vec3 vColor;
+out vec4 fragColor;
+void main(){
+    fragColor = vec4(vColor, 1.0);
+}
+)";
+
+const int INSTANCE_FLOATS = 9;  // min, size, colour
+const Vec3 kColors[PROP_KIND_COUNT] = {
+    Vec3(0.55f, 0.35f, 0.2f),   // door
+    Vec3(0.45f, 0.5f, 0.6f),    // platform
+    Vec3(0.95f, 0.8f, 0.2f),    // pickup
+    Vec3(0.0f, 0.0f, 0.0f),     // trigger (not drawn)
+};
+
+GLuint propProg = 0;
+GLint locVP = -1, attrPos = -1, attrShade = -1, attrMin = -1, attrSize = -1, attrColor = -1;
+GLuint cubeVbo = 0, cubeIbo = 0, instanceVbo = 0;
+std::vector<float> staging;
+int profDraw = -1;
+
+} // namespace
+
+void propRenderInit() {
+    propProg = buildProgram(propVertexSrc, propFragSrc);
+    locVP = glGetUniformLocation(propProg, "uVP");
+    attrPos = glGetAttribLocation(propProg, "aPos");
+    attrShade = glGetAttribLocation(propProg, "aShade");
+    attrMin = glGetAttribLocation(propProg, "aMin");
+    attrSize = glGetAttribLocation(propProg, "aSize");
+    attrColor = glGetAttribLocation(propProg, "aColor");
+
+    // unit cube, position and face shade per vertex
+    std::vector<float> verts;
+    std::vector<unsigned short> idx;
+    for (int f=0; f<6; ++f) {
+        unsigned short base = (unsigned short)(verts.size() / 4);
+        for (int k=0; k<4; ++k) {
+            const float* v = kCubeFaceCorners.v[f][k];
+            float vert[4] = { v[0], v[1], v[2], kCubeFaces[f].shade };
+            verts.insert(verts.end(), vert, vert + 4);
+        }
+        for (unsigned short q : kQuadIndices) idx.push_back((unsigned short)(base + q));
+    }
+    glGenBuffers(1, &cubeVbo);
+    glBindBuffer(GL_ARRAY_BUFFER, cubeVbo);
+    glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(float), verts.data(), GL_STATIC_DRAW);
+    glGenBuffers(1, &cubeIbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cubeIbo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, idx.size() * sizeof(unsigned short), idx.data(), GL_STATIC_DRAW);
+    glGenBuffers(1, &instanceVbo);
+    profDraw = profilerSlot("props.draw");
+}
+
+void propRenderDraw(const PropSet& s, const Mat4& vp) {
+    if (!propProg) return;
+    ProfileScope scope(profDraw);
+    staging.clear();
+    for (const Prop& p : s.props) {
+        if (p.kind == PROP_TRIGGER || p.taken) continue;
+        Vec3 size = p.box.max - p.box.min, c = kColors[p.kind];
+        float inst[INSTANCE_FLOATS] = { p.box.min.x, p.box.min.y, p.box.min.z, size.x, size.y, size.z, c.x, c.y, c.z };
+        staging.insert(staging.end(), inst, inst + INSTANCE_FLOATS);
+    }
+    GLsizei count = GLsizei(staging.size() / INSTANCE_FLOATS);
+    if (count == 0) return;
+
+    glUseProgram(propProg);
+    glUniformMatrix4fv(locVP, 1, GL_FALSE, vp.m);
+    glBindBuffer(GL_ARRAY_BUFFER, cubeVbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cubeIbo);
+    glEnableVertexAttribArray(attrPos);
+    glVertexAttribPointer(attrPos, 3, GL_FLOAT, GL_FALSE, sizeof(float)*4, (void*)(0));
+    glEnableVertexAttribArray(attrShade);
+    glVertexAttribPointer(attrShade, 1, GL_FLOAT, GL_FALSE, sizeof(float)*4, (void*)(sizeof(float)*3));
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+    glBufferData(GL_ARRAY_BUFFER, staging.size() * sizeof(float), staging.data(), GL_STREAM_DRAW);
+    const GLsizei stride = sizeof(float) * INSTANCE_FLOATS;
+    GLint attrs[3] = { attrMin, attrSize, attrColor };
+    for (int k=0; k<3; ++k) {
+        glEnableVertexAttribArray(attrs[k]);
+        glVertexAttribPointer(attrs[k], 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)*3*k));
+        glVertexAttribDivisor(attrs[k], 1);
+    }
+    glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0, count);
+    for (int k=0; k<3; ++k) {
+        glVertexAttribDivisor(attrs[k], 0);
+        glDisableVertexAttribArray(attrs[k]);
+    }
+    glDisableVertexAttribArray(attrPos);
+    glDisableVertexAttribArray(attrShade);
+}
@@ -0,0 +1,10 @@
+// Instanced drawing of the props (props.h): one unit cube stretched over each prop's box, in
+// one draw. Triggers and collected pickups are not drawn.
+#pragma once
+
+#include "props.h"
+#include "vecmath.h"
+
+void propRenderInit();
+// Refreshes the instances from the props' current boxes (a few dozen, every frame).
+void propRenderDraw(const PropSet& s, const Mat4& vp);
@@ -0,0 +1,196 @@
+#include "props.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const float kDoorSeconds = 0.6f;   // to open or close fully
+const float kSkin = 0.001f;        // left between the body and a face it stopped at
+const float kStepUp = 0.5f;        // a prop this far above the feet is stood on, not pushed off
+
+const uint32_t kLayers[PROP_KIND_COUNT] = { PROP_LAYER_SOLID, PROP_LAYER_SOLID, PROP_LAYER_PICKUP, PROP_LAYER_TRIGGER };
+
+// Top of the highest column under a box's footprint.
+float groundBelow(const World& w, const Aabb& b) {
+    int h = 0;
+    for (int gz=worldToGridZ(w, b.min.z); gz<=worldToGridZ(w, b.max.z); ++gz) {
+        for (int gx=worldToGridX(w, b.min.x); gx<=worldToGridX(w, b.max.x); ++gx) h = std::max(h, worldHeight(w, gx, gz));
+    }
+    return h * w.cfg.blockSize;
+}
+
+// The layout is one of four quarter turns around the spawn point.
+struct Layout {
+    int turn;
+    Vec3 at(float along, float side) const {
+        switch (turn & 3) {
+        case 0: return Vec3(along, 0.0f, side);
+        case 1: return Vec3(-side, 0.0f, along);
+        case 2: return Vec3(-along, 0.0f, -side);
+        default: return Vec3(side, 0.0f, -along);
+        }
+    }
+    // A box of extent (along, up, side) standing at y; turned with the layout.
+    Aabb box(float along, float side, float y, float sizeAlong, float height, float sizeSide) const {
+        Vec3 a = at(along - sizeAlong * 0.5f, side - sizeSide * 0.5f);
+        Vec3 b = at(along + sizeAlong * 0.5f, side + sizeSide * 0.5f);
+        return { Vec3(std::min(a.x, b.x), y, std::min(a.z, b.z)), Vec3(std::max(a.x, b.x), y + height, std::max(a.z, b.z)) };
+    }
+};
+
+int addProp(PropSet& s, uint8_t kind, const Aabb& box, const Vec3& travel, float period) {
+    Prop p;
+    p.kind = kind;
+    p.box = p.home = box;
+    p.travel = travel;
+    p.period = period;
+    p.open = 0.0f;
+    p.door = -1;
+    p.occupied = false;
+    p.taken = false;
+    p.moved = Vec3();
+    int i = int(s.props.size());
+    p.proxy = aabbInsert(s.tree, box, kLayers[kind], uint32_t(i));
+    s.props.push_back(p);
+    return i;
+}
+
+Aabb shifted(const Aabb& b, const Vec3& d) { return { b.min + d, b.max + d }; }
+
+} // namespace
+
+void propsSpawn(PropSet& s, const World& w, uint32_t seed) {
+    s = PropSet();
+    Layout l = { int(seed % 4u) };
+
+    // a door across the way out, opened from either side
+    Aabb door = l.box(9.0f, 0.0f, 0.0f, 0.3f, 2.4f, 1.6f);
+    float y = groundBelow(w, door);
+    door = shifted(door, Vec3(0.0f, y, 0.0f));
+    int d = addProp(s, PROP_DOOR, door, Vec3(0.0f, 2.3f, 0.0f), 0.0f);
+    Aabb trigger = l.box(9.0f, 0.0f, y, 5.0f, 2.5f, 3.0f);
+    s.props[addProp(s, PROP_TRIGGER, trigger, Vec3(), 0.0f)].door = d;
+
+    // an elevator and two sliders
+    Aabb lift = l.box(-6.0f, 4.0f, 0.0f, 2.0f, 0.4f, 2.0f);
+    lift = shifted(lift, Vec3(0.0f, groundBelow(w, lift) + 0.2f, 0.0f));
+    addProp(s, PROP_PLATFORM, lift, Vec3(0.0f, 4.0f, 0.0f), 8.0f);
+    for (int k=0; k<2; ++k) {
+        Aabb slider = l.box(k ? 4.0f : -3.0f, k ? -9.0f : 7.0f, 0.0f, 2.0f, 0.4f, 2.0f);
+        Vec3 travel = l.at(k ? 6.0f : 0.0f, k ? 0.0f : 6.0f);
+        Aabb path = aabbUnion(slider, shifted(slider, travel));
+        slider = shifted(slider, Vec3(0.0f, groundBelow(w, path) + 1.2f, 0.0f));
+        addProp(s, PROP_PLATFORM, slider, travel, 10.0f + 2.0f * k);
+    }
+
+    // a ring of pickups
+    for (int k=0; k<8; ++k) {
+        float a = k * 0.7853982f;
+        Vec3 c(cosf(a) * 5.0f, 0.0f, sinf(a) * 5.0f);
+        Aabb p = { Vec3(c.x - 0.2f, 0.0f, c.z - 0.2f), Vec3(c.x + 0.2f, 0.4f, c.z + 0.2f) };
+        addProp(s, PROP_PICKUP, shifted(p, Vec3(0.0f, groundBelow(w, p) + 0.5f, 0.0f)), Vec3(), 0.0f);
+    }
+}
+
+int propsUpdate(PropSet& s, float time, float dt, const Aabb* actors, int actorCount) {
+    // who stands where: one batch for the player and the crowd
+    for (Prop& p : s.props) p.occupied = false;
+    s.pairs.clear();
+    s.touches.clear();
+    aabbOverlapBatch(s.tree, actors, actorCount, PROP_LAYER_TRIGGER | PROP_LAYER_PICKUP, s.pairs);
+    for (const AabbPair& pair : s.pairs) {
+        int i = int(aabbUser(s.tree, pair.proxy));
+        Prop& p = s.props[i];
+        if (p.taken || !aabbOverlaps(p.box, actors[pair.query])) continue;  // fat box only
+        if (p.kind == PROP_TRIGGER) {
+            p.occupied = true;
+            if (p.door >= 0) s.props[p.door].occupied = true;
+        }
+        if (p.kind == PROP_PICKUP) s.touches.push_back({ i, pair.query });
+    }
+
+    for (Prop& p : s.props) {
+        Vec3 before = p.box.min;
+        if (p.kind == PROP_DOOR) {
+            p.open = std::min(std::max(p.open + (p.occupied ? dt : -dt) / kDoorSeconds, 0.0f), 1.0f);
+            p.box = shifted(p.home, p.travel * p.open);
+        } else if (p.kind == PROP_PLATFORM) {
+            float phase = 0.5f - 0.5f * cosf(time * 6.2831853f / p.period);
+            p.box = shifted(p.home, p.travel * phase);
+        }
+        p.moved = p.box.min - before;
+        if (p.proxy != AABB_NULL && dot(p.moved, p.moved) > 0.0f) aabbMove(s.tree, p.proxy, p.box, p.moved);
+    }
+    return int(s.touches.size());
+}
+
+void propsCollide(PropSet& s, const Vec3& from, Vec3& pos, Vec3& vel, bool& onGround) {
+    Vec3 start = from;
+    if (s.riding >= 0) {
+        // the platform stood on carries the whole move
+        const Vec3& carry = s.props[s.riding].moved;
+        start = start + carry;
+        pos = pos + carry;
+    }
+    s.riding = -1;
+
+    // stop at the first face in the way and slide along it, a few times over
+    Vec3 delta = pos - start;
+    for (int slide=0; slide<3 && dot(delta, delta) > 1e-12f; ++slide) {
+        AabbRayHit hit;
+        if (!aabbSweep(s.tree, propBodyBox(start), delta, PROP_LAYER_SOLID, hit)) break;
+        start = start + delta * hit.dist + hit.normal * kSkin;
+        Vec3 rest = delta * (1.0f - hit.dist);
+        delta = rest - hit.normal * dot(rest, hit.normal);
+        float into = dot(vel, hit.normal);
+        if (into < 0.0f) vel = vel - hit.normal * into;
+        if (hit.normal.y > 0.5f) {
+            onGround = true;
+            s.riding = int(aabbUser(s.tree, hit.proxy));
+        }
+    }
+    pos = start + delta;
+
+    // props that moved into the body: stepped onto when low enough, pushed off sideways otherwise
+    Aabb body = propBodyBox(pos);
+    s.pairs.clear();
+    aabbOverlapBatch(s.tree, &body, 1, PROP_LAYER_SOLID, s.pairs);
+    for (const AabbPair& pair : s.pairs) {
+        const Aabb& b = aabbTight(s.tree, pair.proxy);
+        body = propBodyBox(pos);
+        if (!aabbOverlaps(b, body)) continue;
+        float up = b.max.y - body.min.y;
+        if (up < kStepUp) {
+            pos.y += up + kSkin;
+            vel.y = std::max(vel.y, 0.0f);
+            onGround = true;
+            s.riding = int(aabbUser(s.tree, pair.proxy));
+            continue;
+        }
+        float px = std::min(body.max.x - b.min.x, b.max.x - body.min.x);
+        float pz = std::min(body.max.z - b.min.z, b.max.z - body.min.z);
+        if (px < pz) {
+            pos.x += (pos.x < (b.min.x + b.max.x) * 0.5f ? -1.0f : 1.0f) * (px + kSkin);
+        } else {
+            pos.z += (pos.z < (b.min.z + b.max.z) * 0.5f ? -1.0f : 1.0f) * (pz + kSkin);
+        }
+    }
+}
+
+bool propsRaycast(const PropSet& s, const Vec3& origin, const Vec3& dir, float maxDist, int* prop, float* dist) {
+    AabbRayHit hit;
+    if (!aabbRaycast(s.tree, { origin, dir, maxDist }, PROP_LAYER_SOLID | PROP_LAYER_PICKUP, hit)) return false;
+    *prop = int(aabbUser(s.tree, hit.proxy));
+    *dist = hit.dist;
+    return true;
+}
+
+void propsTake(PropSet& s, int prop) {
+    Prop& p = s.props[prop];
+    if (p.kind != PROP_PICKUP || p.taken) return;
+    p.taken = true;
+    aabbRemove(s.tree, p.proxy);
+    p.proxy = AABB_NULL;
+    ++s.taken;
+}
@@ -0,0 +1,80 @@
+// Props: the collidable things that are not grid columns. Doors slide up while something
+// stands in their trigger volume, platforms ride back and forth or up and down, and pickups
+// hover until the player touches (or shoots) them.
+//
+// Every prop is a box in one AabbTree (aabb_tree.h), on the layer of its kind. Each frame the
+// movers report their displacement to the tree, the player and the crowd are checked against
+// triggers and pickups in one overlap batch, the player's movement is swept against the solid
+// props after the grid collision, and hitscan asks the tree for the nearest prop before the
+// column behind it.
+#pragma once
+
+#include "aabb_tree.h"
+#include "world.h"
+
+#include <cstdint>
+#include <vector>
+
+enum PropKind : uint8_t { PROP_DOOR, PROP_PLATFORM, PROP_PICKUP, PROP_TRIGGER, PROP_KIND_COUNT };
+
+// Tree layers.
+const uint32_t PROP_LAYER_SOLID = 1;  // doors, platforms
+const uint32_t PROP_LAYER_TRIGGER = 2;
+const uint32_t PROP_LAYER_PICKUP = 4;
+
+struct Prop {
+    uint8_t kind;
+    Aabb box;         // where it is now
+    Aabb home;        // doors: closed; platforms: one end of the ride
+    Vec3 travel;      // doors: opening; platforms: home to the other end
+    float period;     // platforms: seconds per round trip
+    float open;       // doors: 0 closed .. 1 open
+    int door;         // triggers: the door they open, -1 none
+    bool occupied;    // triggers: something stands in it this frame; doors: in one of their triggers
+    bool taken;       // pickups
+    Vec3 moved;       // displacement over the last update
+    int proxy;        // in PropSet::tree, AABB_NULL once taken
+};
+
+// A pickup an actor touched.
+struct PropTouch {
+    int prop, actor;
+};
+
+struct PropSet {
+    std::vector<Prop> props;
+    AabbTree tree;
+    int riding = -1;  // platform the player stood on last frame
+    int taken = 0;    // pickups collected
+    std::vector<AabbPair> pairs;
+    std::vector<PropTouch> touches;  // pickups touched in the last update
+};
+
+// Dimensions of the player's body around the eye position main_loop() moves.
+const float PROP_BODY_RADIUS = 0.25f;
+const float PROP_BODY_FEET = 1.8f;   // eye above the feet, the height collision stands at
+const float PROP_BODY_HEAD = 0.1f;
+
+inline Aabb propBodyBox(const Vec3& eye) {
+    return { Vec3(eye.x - PROP_BODY_RADIUS, eye.y - PROP_BODY_FEET, eye.z - PROP_BODY_RADIUS),
+             Vec3(eye.x + PROP_BODY_RADIUS, eye.y + PROP_BODY_HEAD, eye.z + PROP_BODY_RADIUS) };
+}
+
+// Places a door with its trigger, a few platforms and a ring of pickups around the spawn point,
+// on the current column heights; replaces whatever was there.
+void propsSpawn(PropSet& s, const World& w, uint32_t seed);
+
+// Moves platforms and doors to time and updates their leaves. actors are the boxes of whatever
+// can stand in triggers or touch pickups; who takes a touched pickup is the game's to decide
+// (game_rules.h), so the touches only go into s.touches. Returns how many there were.
+int propsUpdate(PropSet& s, float time, float dt, const Aabb* actors, int actorCount);
+
+// Continues the player's move from `from` to pos against the solid props: carried along by the
+// platform it stands on, stopped and slid along faces it runs into, and pushed out of props
+// that moved into it.
+void propsCollide(PropSet& s, const Vec3& from, Vec3& pos, Vec3& vel, bool& onGround);
+
+// Nearest prop the ray enters within maxDist (solids and pickups; triggers are not hit).
+bool propsRaycast(const PropSet& s, const Vec3& origin, const Vec3& dir, float maxDist, int* prop, float* dist);
+// Removes a pickup that was taken; other props are left alone.
+void propsTake(PropSet& s, int prop);
@@ -0,0 +1,126 @@
+#include "region_file.h"
+#include "chunk_codec.h"
+
+#include <cstdio>
+#include <cstring>
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+namespace {
+
+const uint32_t REGION_FORMAT = 1;
+const size_t HEADER_BYTES = 4 + 9 * 4;
+const size_t TABLE_BYTES = size_t(REGION_CHUNKS) * REGION_CHUNKS * 8;
+
+} // namespace
+
+void regionEncodeBegin(const World& w, uint32_t seed, int rx, int rz, std::vector<uint8_t>& out) {
+    const WorldConfig& cfg = w.cfg;
+    static const uint8_t magic[4] = { 'S', 'B', 'R', 'G' };
+    out.assign(magic, magic + 4);
+    const uint32_t header[9] = { REGION_FORMAT, seed, uint32_t(cfg.gridW), uint32_t(cfg.gridH),
+                                 uint32_t(cfg.chunkSize), uint32_t(cfg.maxStack), uint32_t(rx), uint32_t(rz),
+                                 0 };  // reserved
+    for (uint32_t v : header) putU32(out, v);
+    out.resize(HEADER_BYTES + TABLE_BYTES, 0);
+}
+
+void regionEncodeRow(const World& w, int rx, int rz, int lz, std::vector<uint8_t>& out) {
+    const int cells = w.cfg.chunkSize * w.cfg.chunkSize;
+    int cz = rz * REGION_CHUNKS + lz;
+    if (cz >= w.chunksZ) return;
+    for (int lx=0; lx<REGION_CHUNKS; ++lx) {
+        int cx = rx * REGION_CHUNKS + lx;
+        if (cx >= w.chunksX) break;
+        size_t start = out.size();
+        chunkEncode(w.chunks[cz * w.chunksX + cx]->heights.data(), cells, out);
+        uint8_t* entry = &out[HEADER_BYTES + size_t(lz * REGION_CHUNKS + lx) * 8];
+        setU32(entry, uint32_t(start));
+        setU32(entry + 4, uint32_t(out.size() - start));
+    }
+}
+
+void regionEncodeEnd(std::vector<uint8_t>& out) {
+    putU32(out, crc32(out.data(), out.size()));
+}
+
+void regionEncode(const World& w, uint32_t seed, int rx, int rz, std::vector<uint8_t>& out) {
+    regionEncodeBegin(w, seed, rx, rz, out);
+    for (int lz=0; lz<REGION_CHUNKS; ++lz) regionEncodeRow(w, rx, rz, lz, out);
+    regionEncodeEnd(out);
+}
+
+bool regionDecode(const uint8_t* data, size_t size, World& w, uint32_t seed, int rx, int rz) {
+    const WorldConfig& cfg = w.cfg;
+    if (size < HEADER_BYTES + TABLE_BYTES + 4 || memcmp(data, "SBRG", 4) != 0) return false;
+    if (crc32(data, size - 4) != getU32(data + size - 4)) return false;
+    const uint8_t* h = data + 4;
+    if (getU32(h) != REGION_FORMAT || getU32(h + 4) != seed ||
+        getU32(h + 8) != uint32_t(cfg.gridW) || getU32(h + 12) != uint32_t(cfg.gridH) ||
+        getU32(h + 16) != uint32_t(cfg.chunkSize) || getU32(h + 20) != uint32_t(cfg.maxStack) ||
+        getU32(h + 24) != uint32_t(rx) || getU32(h + 28) != uint32_t(rz)) return false;
+
+    // decode everything before touching the world so a bad chunk leaves it unchanged
+    const int S = cfg.chunkSize, cells = S * S;
+    const uint8_t* table = data + HEADER_BYTES;
+    std::vector<uint8_t> decoded(size_t(REGION_CHUNKS) * REGION_CHUNKS * cells, 0);
+    std::vector<bool> present(size_t(REGION_CHUNKS) * REGION_CHUNKS, false);
+    for (int i=0; i<REGION_CHUNKS*REGION_CHUNKS; ++i) {
+        uint32_t off = getU32(table + i*8), len = getU32(table + i*8 + 4);
+        if (len == 0) continue;
+        if (off < HEADER_BYTES + TABLE_BYTES || size_t(off) + len > size - 4) return false;
+        if (chunkDecode(data + off, len, &decoded[size_t(i) * cells], cells) != len) return false;
+        present[i] = true;
+    }
+
+    worldBeginEdits(w);
+    for (int i=0; i<REGION_CHUNKS*REGION_CHUNKS; ++i) {
+        if (!present[i]) continue;
+        int gx0 = (rx * REGION_CHUNKS + i % REGION_CHUNKS) * S, gz0 = (rz * REGION_CHUNKS + i / REGION_CHUNKS) * S;
+        const uint8_t* c = &decoded[size_t(i) * cells];
+        for (int lz=0; lz<S; ++lz) for (int lx=0; lx<S; ++lx) {
+            worldSetHeight(w, gx0 + lx, gz0 + lz, c[lz * S + lx]);
+        }
+    }
+    worldEndEdits(w);
+    return true;
+}
+
+void regionFileName(char* buf, size_t size, const char* dir, uint32_t seed, int rx, int rz) {
+    snprintf(buf, size, "%s/w%u.r%d.%d.sbr", dir, seed, rx, rz);
+}
+
+bool saveWriteAtomic(const char* path, const std::vector<uint8_t>& data) {
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE* f = fopen(tmp, "wb");
+    if (!f) {
+        printf("[save] cannot open %s\n", tmp);
+        return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    ok = fflush(f) == 0 && ok;
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+    ok = fsync(fileno(f)) == 0 && ok;
+#endif
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp, path) != 0) {
+        printf("[save] failed writing %s\n", path);
+        remove(tmp);
+        return false;
+    }
+    return true;
+}
+
+bool saveReadFile(const char* path, std::vector<uint8_t>& data) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    data.clear();
+    uint8_t buf[16384];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) data.insert(data.end(), buf, buf + n);
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
@@ -0,0 +1,42 @@
+// On-disk world format: the map is cut into regions of REGION_CHUNKS x REGION_CHUNKS chunks,
+// one file each, so a save only rewrites the regions whose chunks changed.
+//
+// File layout (little endian):
+//   "SBRG", u32 format, u32 seed, u32 gridW, u32 gridH, u32 chunkSize, u32 maxStack, u32 rx, u32 rz,
+//   u32 reserved
+//   REGION_CHUNKS^2 x { u32 offset, u32 size }   (size 0: chunk lies outside the map)
+//   chunk payloads (chunk_codec.h)
+//   u32 CRC-32 of everything before it
+#pragma once
+
+#include "world.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+const int REGION_CHUNKS = 16;
+
+inline int regionCountX(const World& w) { return (w.chunksX + REGION_CHUNKS - 1) / REGION_CHUNKS; }
+inline int regionCountZ(const World& w) { return (w.chunksZ + REGION_CHUNKS - 1) / REGION_CHUNKS; }
+inline int regionOfChunk(const World& w, int chunk) {
+    return (chunk / w.chunksX / REGION_CHUNKS) * regionCountX(w) + (chunk % w.chunksX) / REGION_CHUNKS;
+}
+
+void regionEncode(const World& w, uint32_t seed, int rx, int rz, std::vector<uint8_t>& out);
+// The same in steps, for callers that must be able to stop between chunk rows: the header,
+// then rows lz = 0 .. REGION_CHUNKS-1 in order, then the CRC.
+void regionEncodeBegin(const World& w, uint32_t seed, int rx, int rz, std::vector<uint8_t>& out);
+void regionEncodeRow(const World& w, int rx, int rz, int lz, std::vector<uint8_t>& out);
+void regionEncodeEnd(std::vector<uint8_t>& out);
+// Applies a region's chunks through worldSetHeight. Returns false (world untouched) if the
+// data is corrupt or belongs to a different map/seed.
+bool regionDecode(const uint8_t* data, size_t size, World& w, uint32_t seed, int rx, int rz);
+
+// <dir>/w<seed>.r<rx>.<rz>.sbr
+void regionFileName(char* buf, size_t size, const char* dir, uint32_t seed, int rx, int rz);
+
+// Writes <path>.tmp, flushes it to disk and renames it over path, so readers (and a crash
+// mid-write) only ever see the old or the new file.
+bool saveWriteAtomic(const char* path, const std::vector<uint8_t>& data);
+bool saveReadFile(const char* path, std::vector<uint8_t>& data);
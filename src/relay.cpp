@@ -0,0 +1,380 @@
+#include "relay.h"
+#include "chunk_codec.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+namespace {
+
+const size_t MAX_FRAME_BYTES = 64u << 20;
+const size_t PAYLOAD_BYTES = NET_MAX_DATAGRAM - RELAY_DATA_HEADER_BYTES;
+const size_t UPSTREAM_READ_BYTES = 4u << 20;  // per pump, so a burst cannot starve the viewers
+
+void putU16(std::vector<uint8_t>& out, uint16_t v) {
+    out.push_back(uint8_t(v));
+    out.push_back(uint8_t(v >> 8));
+}
+
+uint16_t getU16(const uint8_t* p) {
+    return uint16_t(p[0] | p[1] << 8);
+}
+
+// ----------------- Sending -----------------
+// Everything each viewer is due: the header, then its part of the log. Catching-up viewers
+// get at most one burst; the queue always ends up flushed, so nothing points into the log
+// when it changes.
+void sendDue(Relay& r) {
+    for (RelayViewerSlot& v : r.viewers) {
+        if (v.needHeader) {
+            if (r.headerPacket.empty()) continue;
+            netIoSend(r.io, r.headerPacket.data(), r.headerPacket.size(), v.addr);
+            v.needHeader = false;
+        }
+        size_t end = v.live ? r.packets.size() : std::min(r.packets.size(), v.cursor + size_t(r.cfg.burst));
+        for (; v.cursor < end; ++v.cursor) {
+            netIoSend(r.io, &r.log[r.packets[v.cursor].offset], r.packets[v.cursor].size, v.addr);
+        }
+        if (!r.packets.empty() && v.cursor == r.packets.size()) v.live = true;
+    }
+    netIoFlush(r.io);
+}
+
+// ----------------- Upstream -----------------
+void addFrame(Relay& r, const uint8_t* frame, size_t size) {
+    bool key = frame[DEMO_FRAME_HEADER_BYTES] == DEMO_FRAME_KEY;
+    uint32_t seq = key ? r.deltaSeq : ++r.deltaSeq;
+    if (key) {
+        // the old log goes out in full first; then it restarts at this keyframe
+        sendDue(r);
+        r.log.clear();
+        r.packets.clear();
+        ++r.stats.keyframes;
+    }
+    uint16_t fragments = uint16_t((size + PAYLOAD_BYTES - 1) / PAYLOAD_BYTES);
+    for (uint16_t i=0; i<fragments; ++i) {
+        size_t at = i * PAYLOAD_BYTES, n = std::min(PAYLOAD_BYTES, size - at);
+        RelayPacket p = { uint32_t(r.log.size()), uint16_t(RELAY_DATA_HEADER_BYTES + n) };
+        r.log.push_back(RELAY_DATA);
+        r.log.push_back(key ? 1 : 0);
+        putU32(r.log, seq);
+        putU16(r.log, i);
+        putU16(r.log, fragments);
+        r.log.insert(r.log.end(), frame + at, frame + at + n);
+        r.packets.push_back(p);
+    }
+    if (key) {
+        // live viewers already have this state from the tick's delta
+        r.keyPackets = r.packets.size();
+        for (RelayViewerSlot& v : r.viewers) v.cursor = v.live ? r.keyPackets : 0;
+    }
+    ++r.stats.frames;
+}
+
+void resetStream(Relay& r) {
+    r.inbox.clear();
+    r.headerPacket.clear();
+    r.log.clear();
+    r.packets.clear();
+    r.keyPackets = 0;
+    r.deltaSeq = 0;
+    for (RelayViewerSlot& v : r.viewers) {
+        v.needHeader = true;
+        v.cursor = 0;
+        v.live = false;
+    }
+}
+
+void closeUpstream(Relay& r, const char* why) {
+    if (r.cfg.verbose) printf("[relay] match stream %s after %llu frames\n", why, (unsigned long long)r.stats.frames);
+    close(r.upstreamFd);
+    r.upstreamFd = -1;
+    r.inbox.clear();
+}
+
+void readUpstream(Relay& r) {
+    if (r.upstreamFd < 0) {
+        // one match at a time; a new one replaces whatever is cached
+        r.upstreamFd = netAccept(r.listenFd);
+        if (r.upstreamFd < 0) return;
+        resetStream(r);
+        if (r.cfg.verbose) printf("[relay] match stream connected\n");
+    }
+    size_t got = 0;
+    const char* ended = nullptr;  // frames read before the end still count
+    while (got < UPSTREAM_READ_BYTES) {
+        size_t old = r.inbox.size();
+        r.inbox.resize(old + 65536);
+        ssize_t n = recv(r.upstreamFd, r.inbox.data() + old, 65536, 0);
+        r.inbox.resize(old + size_t(std::max<ssize_t>(n, 0)));
+        if (n > 0) {
+            got += size_t(n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) ended = n == 0 ? "ended" : "failed";
+        break;
+    }
+
+    size_t pos = 0;
+    if (r.headerPacket.empty()) {
+        if (r.inbox.size() < DEMO_HEADER_BYTES) {
+            if (ended) closeUpstream(r, ended);
+            return;
+        }
+        if (memcmp(r.inbox.data(), "SBDM", 4) != 0) {
+            closeUpstream(r, "rejected (not a demo stream)");
+            return;
+        }
+        r.headerPacket.push_back(RELAY_HEADER);
+        r.headerPacket.insert(r.headerPacket.end(), r.inbox.begin(), r.inbox.begin() + DEMO_HEADER_BYTES);
+        pos = DEMO_HEADER_BYTES;
+    }
+    while (r.inbox.size() - pos >= DEMO_FRAME_HEADER_BYTES) {
+        size_t size = DEMO_FRAME_HEADER_BYTES + getU32(&r.inbox[pos]);
+        if (size > MAX_FRAME_BYTES || size < DEMO_FRAME_HEADER_BYTES + 5) {
+            closeUpstream(r, "rejected (bad frame)");
+            return;
+        }
+        if (r.inbox.size() - pos < size) break;
+        addFrame(r, &r.inbox[pos], size);
+        pos += size;
+    }
+    r.inbox.erase(r.inbox.begin(), r.inbox.begin() + pos);
+    if (ended) closeUpstream(r, ended);
+}
+
+// ----------------- Viewers -----------------
+void removeViewer(Relay& r, int i) {
+    r.byAddr.erase(netAddrKey(r.viewers[i].addr));
+    if (i != int(r.viewers.size()) - 1) {
+        r.viewers[i] = r.viewers.back();
+        r.byAddr[netAddrKey(r.viewers[i].addr)] = i;
+    }
+    r.viewers.pop_back();
+}
+
+void readViewers(Relay& r, double nowMs) {
+    while (netIoReceive(r.io) > 0) {
+        for (NetPacket* p : r.io.received) {
+            uint8_t type = p->size > 0 ? p->data[0] : 0;
+            const sockaddr_in from = p->addr;
+            if (p->size < uint32_t(RELAY_REQUEST_BYTES) ||
+                (type != RELAY_HELLO && type != RELAY_RESYNC && type != RELAY_BYE)) {
+                netIoRelease(r.io, p);
+                continue;
+            }
+            if (!netCookieValid(r.cookieKey, from, getU32(p->data + 1), nowMs)) {
+                // the cookie goes back in the request's own buffer, no bigger than it
+                ++r.stats.cookies;
+                p->data[0] = RELAY_COOKIE;
+                setU32(p->data + 1, netCookie(r.cookieKey, from, nowMs));
+                p->size = RELAY_REQUEST_BYTES;
+                netIoSendPacket(r.io, p);
+                continue;
+            }
+            netIoRelease(r.io, p);
+            uint64_t key = netAddrKey(from);
+            auto it = r.byAddr.find(key);
+            if (type == RELAY_BYE) {
+                if (it != r.byAddr.end()) removeViewer(r, it->second);
+                continue;
+            }
+            if (it == r.byAddr.end()) {
+                RelayViewerSlot v;
+                v.addr = from;
+                v.lastHeardMs = nowMs;
+                r.byAddr[key] = int(r.viewers.size());
+                r.viewers.push_back(v);
+                ++r.stats.joins;
+                continue;
+            }
+            RelayViewerSlot& v = r.viewers[it->second];
+            v.lastHeardMs = nowMs;
+            if (type == RELAY_RESYNC && !v.needHeader) {
+                v.needHeader = true;
+                v.cursor = 0;
+                v.live = false;
+                ++r.stats.resyncs;
+            }
+        }
+    }
+}
+
+void dropSilent(Relay& r, double nowMs) {
+    for (int i=int(r.viewers.size())-1; i>=0; --i) {
+        if (nowMs - r.viewers[i].lastHeardMs <= r.cfg.timeoutMs) continue;
+        removeViewer(r, i);
+        ++r.stats.timeouts;
+    }
+}
+
+} // namespace
+
+bool relayOpen(Relay& r, const RelayConfig& cfg) {
+    r.cfg = cfg;
+    r.listenFd = netTcpListen(cfg.upstream);
+    // viewers only ever send five-byte requests, so a small pool does
+    if (r.listenFd < 0 || !netIoOpen(r.io, cfg.viewers, cfg.io ? *cfg.io : netMmsgBackend(), 2 * NET_BATCH)) {
+        relayClose(r);
+        return false;
+    }
+    r.cookieKey = netCookieKey();
+    r.stats = RelayStats();
+    resetStream(r);
+    return true;
+}
+
+void relayClose(Relay& r) {
+    for (int* fd : { &r.listenFd, &r.upstreamFd }) {
+        if (*fd >= 0) close(*fd);
+        *fd = -1;
+    }
+    netIoClose(r.io);
+    r.viewers.clear();
+    r.byAddr.clear();
+}
+
+void relayPump(Relay& r, double nowMs) {
+    double start = profilerNowMs();
+    readViewers(r, nowMs);
+    dropSilent(r, nowMs);
+    readUpstream(r);
+    sendDue(r);
+    r.stats.pumpMs += profilerNowMs() - start;
+}
+
+int relayLiveViewers(const Relay& r) {
+    int live = 0;
+    for (const RelayViewerSlot& v : r.viewers) live += v.live;
+    return live;
+}
+
+// ----------------- Viewer -----------------
+namespace {
+
+void sendControl(RelayViewer& v, uint8_t type) {
+    uint8_t msg[RELAY_REQUEST_BYTES] = { type };
+    setU32(msg + 1, v.cookie);
+    send(v.fd, msg, sizeof(msg), 0);
+}
+
+// The join or keep-alive; a viewer still waiting for the header repeats its resync instead, in
+// case it got lost.
+void sendRequest(RelayViewer& v, double nowMs) {
+    sendControl(v, v.haveHeader || v.lastHelloMs < 0.0 ? RELAY_HELLO : RELAY_RESYNC);
+    v.lastHelloMs = nowMs;
+}
+
+// Back to the header and the cached keyframe; also the fallback for a lost datagram.
+void requestResync(RelayViewer& v, double nowMs) {
+    v.haveHeader = false;
+    v.synced = false;
+    v.assembling = false;
+    ++v.resyncs;
+    sendControl(v, RELAY_RESYNC);
+    v.lastHelloMs = nowMs;
+}
+
+// Applies a completed frame; false if the stream has a gap.
+bool completeFrame(RelayViewer& v) {
+    const uint8_t* f = v.frame.data();
+    if (v.frameKey) {
+        if (v.synced && v.frameSeq == v.seq) return true;  // already there through the tick's delta
+    } else {
+        if (!v.synced) return false;  // the keyframe got lost
+        if (v.frameSeq <= v.seq) return true;
+        if (v.frameSeq != v.seq + 1) return false;
+    }
+    if (!demoApplyFrame(v.state, f, v.frame.size())) return false;
+    v.synced = true;
+    v.seq = v.frameSeq;
+    ++v.framesApplied;
+    return true;
+}
+
+} // namespace
+
+bool relayViewerOpen(RelayViewer& v, const sockaddr_in& relay) {
+    sockaddr_in any = {};
+    any.sin_family = AF_INET;
+    any.sin_addr.s_addr = htonl(INADDR_ANY);
+    v.fd = netUdpOpen(any);
+    if (v.fd < 0) return false;
+    // connected, so the kernel drops datagrams from anyone but the relay: a header from
+    // elsewhere would otherwise reset the viewer's world
+    if (connect(v.fd, reinterpret_cast<const sockaddr*>(&relay), sizeof(relay)) != 0) {
+        printf("[relay] cannot connect to %s: %s\n", netAddrString(relay), strerror(errno));
+        close(v.fd);
+        v.fd = -1;
+        return false;
+    }
+    v.relay = relay;
+    v.haveHeader = v.synced = v.assembling = false;
+    v.seq = 0;
+    v.lastHelloMs = -1e9;
+    v.cookie = 0;
+    return true;
+}
+
+void relayViewerClose(RelayViewer& v) {
+    if (v.fd < 0) return;
+    sendControl(v, RELAY_BYE);
+    close(v.fd);
+    v.fd = -1;
+}
+
+int relayViewerPump(RelayViewer& v, double nowMs) {
+    if (nowMs - v.lastHelloMs >= RELAY_HELLO_MS) sendRequest(v, nowMs);
+    int applied = 0;
+    uint8_t buf[NET_MAX_DATAGRAM + 64];
+    for (;;) {
+        ssize_t n = recv(v.fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) break;
+        ++v.datagrams;
+        if (n >= RELAY_REQUEST_BYTES && buf[0] == RELAY_COOKIE) {
+            // the request it answers went nowhere; it goes again with the cookie
+            v.cookie = getU32(buf + 1);
+            sendRequest(v, nowMs);
+            continue;
+        }
+        if (n > 1 && buf[0] == RELAY_HEADER) {
+            v.haveHeader = demoParseHeader(v.state, buf + 1, size_t(n - 1));
+            v.synced = v.assembling = false;
+            continue;
+        }
+        if (!v.haveHeader || buf[0] != RELAY_DATA || n <= RELAY_DATA_HEADER_BYTES) continue;
+        bool key = buf[1] != 0;
+        uint32_t seq = getU32(buf + 2);
+        uint16_t fragment = getU16(buf + 6), fragments = getU16(buf + 8);
+        const uint8_t* payload = buf + RELAY_DATA_HEADER_BYTES;
+        if (fragment == 0) {
+            v.frame.assign(payload, payload + (n - RELAY_DATA_HEADER_BYTES));
+            v.frameKey = key;
+            v.frameSeq = seq;
+            v.fragments = fragments;
+            v.nextFragment = 1;
+            v.assembling = true;
+        } else if (v.assembling && fragment == v.nextFragment && seq == v.frameSeq && key == v.frameKey) {
+            v.frame.insert(v.frame.end(), payload, payload + (n - RELAY_DATA_HEADER_BYTES));
+            ++v.nextFragment;
+        } else {
+            // a fragment went missing; only a keyframe we would skip anyway can be let go
+            v.assembling = false;
+            if (!(key && v.synced && seq == v.seq)) requestResync(v, nowMs);
+            continue;
+        }
+        if (v.nextFragment < v.fragments) continue;
+        v.assembling = false;
+        if (!completeFrame(v)) {
+            requestResync(v, nowMs);
+            continue;
+        }
+        ++applied;
+    }
+    return applied;
+}
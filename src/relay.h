@@ -0,0 +1,114 @@
+// Spectator relay: fans one match stream out to many viewers (native only).
+//
+// The match server streams its recording (demoStreamStart(), already delayed) over one TCP
+// connection, so spectators never touch the match server. The relay cuts each frame into
+// datagrams once and keeps them in a log that starts at the latest keyframe; every viewer is
+// just a cursor into that log. Live viewers sit at the end and get each new delta. A viewer
+// that joins, or asks for a resync after a loss, gets the header and then the cached keyframe
+// and the deltas after it, RelayConfig::burst datagrams per pump, until it is live. The
+// datagrams for all viewers are queued on a NetIo (net_io.h) straight from the shared log,
+// so the per-viewer cost is one queued send per datagram, and with a batching backend the
+// number of system calls stays a handful per tick.
+//
+// Datagrams, relay -> viewer:
+//   u8 RELAY_COOKIE, u32 cookie, the answer to a request without a valid one
+//   u8 RELAY_HEADER, demo header
+//   u8 RELAY_DATA, u8 keyframe, u32 seq, u16 fragment, u16 fragments, slice of the frame
+//     seq numbers the deltas; a keyframe carries the seq of the delta before it, so a viewer
+//     that has applied that delta can skip it
+// viewer -> relay: u8 RELAY_HELLO (join, then keep-alive every second), RELAY_RESYNC or RELAY_BYE,
+//   then u32 cookie (0 until the relay sent one)
+//
+// A viewer gets the stream only for requests echoing the cookie (net.h) last sent to its
+// address. Anything else gets just the cookie, no bigger than the request, so a forged source
+// address cannot turn the relay's catch-up bursts on someone else.
+#pragma once
+
+#include "demo.h"
+#include "net_io.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+enum RelayMessage : uint8_t {
+    RELAY_HEADER = 1, RELAY_DATA = 2, RELAY_HELLO = 3, RELAY_RESYNC = 4, RELAY_BYE = 5, RELAY_COOKIE = 6,
+};
+
+const int RELAY_DATA_HEADER_BYTES = 10;
+const int RELAY_REQUEST_BYTES = 5;  // a viewer's request, and the cookie answering it
+const double RELAY_HELLO_MS = 1000.0;
+
+struct RelayConfig {
+    sockaddr_in upstream = {};   // TCP, for the match server
+    sockaddr_in viewers = {};    // UDP
+    int burst = 128;             // catch-up datagrams per viewer per pump
+    const NetIoBackend* io = nullptr;  // nullptr: mmsg
+    double timeoutMs = 5000.0;   // viewers that stay silent this long are dropped
+    bool verbose = true;         // log the upstream connecting and ending
+};
+
+struct RelayStats {
+    uint64_t frames = 0, keyframes = 0;
+    uint64_t joins = 0, resyncs = 0, timeouts = 0;
+    uint64_t cookies = 0;  // requests answered with a cookie instead
+    double pumpMs = 0.0;  // datagram counts are in Relay::io.stats
+};
+
+struct RelayViewerSlot {
+    sockaddr_in addr;
+    size_t cursor = 0;       // next datagram of the log
+    bool live = false;       // has everything up to the end of the log
+    bool needHeader = true;
+    double lastHeardMs = 0.0;
+};
+
+struct RelayPacket {
+    uint32_t offset;
+    uint16_t size;
+};
+
+struct Relay {
+    RelayConfig cfg;
+    int listenFd = -1, upstreamFd = -1;
+    NetIo io;                             // viewers
+    std::vector<uint8_t> inbox;           // upstream bytes not framed yet
+    std::vector<uint8_t> headerPacket;    // empty until the stream header arrived
+    std::vector<uint8_t> log;             // datagrams since the latest keyframe
+    std::vector<RelayPacket> packets;
+    size_t keyPackets = 0;                // datagrams of the keyframe at the start of the log
+    uint32_t deltaSeq = 0;
+    std::vector<RelayViewerSlot> viewers;
+    std::unordered_map<uint64_t, int> byAddr;
+    NetCookieKey cookieKey;
+    RelayStats stats;
+};
+
+bool relayOpen(Relay& r, const RelayConfig& cfg);
+void relayClose(Relay& r);
+// Reads the upstream, answers viewers and sends whatever is due; never blocks.
+void relayPump(Relay& r, double nowMs);
+int relayLiveViewers(const Relay& r);
+
+// ----------------- Viewer -----------------
+// A spectator: rebuilds the match state from the relay's datagrams.
+struct RelayViewer {
+    int fd = -1;
+    sockaddr_in relay = {};
+    DemoReader state;             // world and players, valid while synced
+    bool haveHeader = false, synced = false;
+    uint32_t seq = 0;             // last delta applied
+    std::vector<uint8_t> frame;   // being reassembled
+    bool frameKey = false, assembling = false;
+    uint32_t frameSeq = 0;
+    uint16_t nextFragment = 0, fragments = 0;
+    double lastHelloMs = -1e9;
+    uint32_t cookie = 0;          // the relay's latest RELAY_COOKIE
+    uint64_t framesApplied = 0, resyncs = 0, datagrams = 0;
+};
+
+bool relayViewerOpen(RelayViewer& v, const sockaddr_in& relay);
+void relayViewerClose(RelayViewer& v);
+// Drains the socket and applies every completed frame; returns how many.
+int relayViewerPump(RelayViewer& v, double nowMs);
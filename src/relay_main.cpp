@@ -0,0 +1,159 @@
+/*
+ Spectator relay (native only).
+
+   ./sandbox_relay [--upstream [HOST:]PORT] [--listen [HOST:]PORT] [--burst N] [--io socket|mmsg|uring]
+   ./sandbox_relay --watch HOST:PORT [--viewers N] [--seconds S]
+
+ Takes the delayed match stream of one sandbox_server --broadcast on the upstream port (TCP)
+ and serves it to any number of spectators on the listen port (UDP), see relay.h. Prints
+ the viewer count and its own cost every few seconds.
+
+ --watch runs N test spectators against a relay instead and prints what they see.
+*/
+
+#include "net_io.h"
+#include "profiler.h"
+#include "relay.h"
+
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <poll.h>
+#include <vector>
+
+namespace {
+
+const double REPORT_MS = 5000.0;
+const int POLL_MS = 2;
+
+volatile std::sig_atomic_t stopRequested = 0;
+void onSignal(int) { stopRequested = 1; }
+
+struct RelayOptions {
+    const char* upstream = "27016";
+    const char* listen = "27017";
+    int burst = RelayConfig().burst;
+    const char* io = "mmsg";
+    const char* watch = nullptr;
+    int viewers = 1;
+    double seconds = -1.0;  // until interrupted
+};
+
+bool parseOptions(int argc, char** argv, RelayOptions& o) {
+    for (int i=1; i<argc; ++i) {
+        bool more = i + 1 < argc;
+        if (strcmp(argv[i], "--upstream") == 0 && more) o.upstream = argv[++i];
+        else if (strcmp(argv[i], "--listen") == 0 && more) o.listen = argv[++i];
+        else if (strcmp(argv[i], "--burst") == 0 && more) o.burst = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--io") == 0 && more) o.io = argv[++i];
+        else if (strcmp(argv[i], "--watch") == 0 && more) o.watch = argv[++i];
+        else if (strcmp(argv[i], "--viewers") == 0 && more) o.viewers = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--seconds") == 0 && more) o.seconds = atof(argv[++i]);
+        else {
+            printf("usage: %s [--upstream [HOST:]PORT] [--listen [HOST:]PORT] [--burst N] [--io socket|mmsg|uring]\n"
+                   "       %s --watch HOST:PORT [--viewers N] [--seconds S]\n", argv[0], argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+int runRelay(const RelayOptions& opt) {
+    RelayConfig cfg;
+    if (!netParseAddr(opt.upstream, cfg.upstream) || !netParseAddr(opt.listen, cfg.viewers)) {
+        printf("[relay] bad address\n");
+        return 1;
+    }
+    cfg.burst = opt.burst;
+    cfg.io = netFindBackend(opt.io);
+    if (!cfg.io) {
+        printf("[relay] no %s i/o backend here\n", opt.io);
+        return 1;
+    }
+    Relay relay;
+    if (!relayOpen(relay, cfg)) return 1;
+    printf("[relay] match stream on tcp port %u, spectators on udp port %u (%s i/o)\n", netLocalPort(relay.listenFd),
+           netLocalPort(relay.io.fd), cfg.io->name);
+
+    double start = profilerNowMs(), lastReport = start;
+    RelayStats last;
+    NetIoStats lastIo;
+    while (!stopRequested && (opt.seconds < 0.0 || profilerNowMs() - start < opt.seconds * 1000.0)) {
+        pollfd fds[2] = { { relay.upstreamFd >= 0 ? relay.upstreamFd : relay.listenFd, POLLIN, 0 },
+                          { relay.io.fd, POLLIN, 0 } };
+        poll(fds, 2, POLL_MS);
+        double now = profilerNowMs();
+        relayPump(relay, now);
+        if (now - lastReport < REPORT_MS) continue;
+        const RelayStats& s = relay.stats;
+        const NetIoStats& io = relay.io.stats;
+        double seconds = (now - lastReport) * 0.001;
+        printf("[relay] %zu viewers (%d live), %.1f frames/s, %.0f datagrams/s in %.0f send calls/s (%.1f MiB/s), "
+               "%llu joins, %llu resyncs, %llu cookies, %llu dropped, relay cpu %.1f%%\n", relay.viewers.size(),
+               relayLiveViewers(relay), (s.frames - last.frames) / seconds, (io.sent - lastIo.sent) / seconds,
+               (io.sendCalls - lastIo.sendCalls) / seconds, (io.bytesSent - lastIo.bytesSent) / seconds / (1 << 20),
+               (unsigned long long)(s.joins - last.joins), (unsigned long long)(s.resyncs - last.resyncs),
+               (unsigned long long)(s.cookies - last.cookies),
+               (unsigned long long)(io.dropped - lastIo.dropped), (s.pumpMs - last.pumpMs) * 0.1 / seconds);
+        last = s;
+        lastIo = io;
+        lastReport = now;
+    }
+    relayClose(relay);
+    return 0;
+}
+
+int runWatch(const RelayOptions& opt) {
+    sockaddr_in to;
+    if (!netParseAddr(opt.watch, to)) {
+        printf("[watch] bad address %s\n", opt.watch);
+        return 1;
+    }
+    std::vector<RelayViewer> viewers(opt.viewers);
+    for (RelayViewer& v : viewers) {
+        if (!relayViewerOpen(v, to)) return 1;
+    }
+    double start = profilerNowMs(), lastReport = start;
+    while (!stopRequested && (opt.seconds < 0.0 || profilerNowMs() - start < opt.seconds * 1000.0)) {
+        std::vector<pollfd> fds;
+        for (const RelayViewer& v : viewers) fds.push_back({ v.fd, POLLIN, 0 });
+        poll(fds.data(), fds.size(), POLL_MS * 10);
+        double now = profilerNowMs();
+        for (RelayViewer& v : viewers) relayViewerPump(v, now);
+        if (now - lastReport < 1000.0) continue;
+        lastReport = now;
+        int synced = 0;
+        uint32_t lo = UINT32_MAX, hi = 0;
+        uint64_t resyncs = 0;
+        const RelayViewer* any = nullptr;
+        for (const RelayViewer& v : viewers) {
+            resyncs += v.resyncs;
+            if (!v.synced) continue;
+            ++synced;
+            lo = std::min(lo, v.state.tick);
+            hi = std::max(hi, v.state.tick);
+            any = &v;
+        }
+        if (!any) {
+            printf("[watch] waiting for the stream\n");
+            continue;
+        }
+        double hz = any->state.tickHz;
+        printf("[watch] %d/%zu in sync at %.1f-%.1f s, %zu players, %llu resyncs\n", synced, viewers.size(),
+               lo / hz, hi / hz, any->state.players.size(), (unsigned long long)resyncs);
+    }
+    for (RelayViewer& v : viewers) relayViewerClose(v);
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    RelayOptions opt;
+    if (!parseOptions(argc, argv, opt)) return 1;
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+    return opt.watch ? runWatch(opt) : runRelay(opt);
+}
@@ -0,0 +1,174 @@
+#include "remote.h"
+
+#include <emscripten/emscripten.h>
+#include <emscripten/websocket.h>
+
+#include <algorithm>
+#include <cstdio>
+
+RemoteState remote;
+
+namespace {
+
+EMSCRIPTEN_WEBSOCKET_T socket = 0;
+World* target = nullptr;
+
+void sendMessage(const uint8_t* data, size_t size) {
+    emscripten_websocket_send_binary(socket, const_cast<uint8_t*>(data), uint32_t(size));
+    remote.bytesOut += size;
+}
+
+void takeSnapshot(const uint8_t* data, size_t size) {
+    uint32_t tick;
+    int count;
+    if (!remote.joined || !sessionReadSnapshot(data, size, &tick, &count)) return;
+    if (remote.snapshots > 0 && int32_t(tick - remote.tick) < 0) return;
+    // a snapshot comes in parts; the first of a new tick replaces the old one
+    if (remote.snapshots == 0 || tick != remote.tick) remote.players.clear();
+    remote.tick = tick;
+    ++remote.snapshots;
+    const uint8_t* in = data + SESSION_SNAPSHOT_HEADER_BYTES;
+    for (int k=0; k<count; ++k) {
+        RemotePlayer p;
+        in = sessionReadPlayer(in, &p.id, &p.player);
+        if (p.id != remote.id) {
+            remote.players.push_back(p);
+        } else if (!remote.landed && p.player.onGround) {
+            remote.landed = true;
+            remote.spawn = detToVec3(p.player.pos);
+        }
+    }
+}
+
+// The map streams in only if it fits the world the renderer was set up for; otherwise the
+// client generates it from the server's seed and just acknowledges the chunks.
+void takeWorld(const uint8_t* data, size_t size) {
+    WorldConfig cfg;
+    if (!sessionReadWelcomeWorld(data, size, &cfg)) return;
+    const WorldConfig& own = target->cfg;
+    remote.streaming = cfg.gridW == own.gridW && cfg.gridH == own.gridH && cfg.chunkSize == own.chunkSize &&
+                       cfg.maxStack == own.maxStack && cfg.blockSize == own.blockSize;
+    if (!remote.streaming) {
+        printf("[remote] the server's %dx%d map does not fit this client's %dx%d; generating it from the seed\n",
+               cfg.gridW, cfg.gridH, own.gridW, own.gridH);
+        return;
+    }
+    transferReset(*target, remote.transfer, true);
+    remote.joinMs = emscripten_get_now();
+}
+
+void takeChunks(const uint8_t* data, size_t size) {
+    uint16_t seq = size >= 3 ? sessionGetU16(data + 1) : 0;
+    if (remote.streaming) {
+        bool done = transferDone(*target, remote.transfer);
+        if (!transferApply(*target, remote.transfer, data, size, &seq)) return;
+        if (!done && transferDone(*target, remote.transfer)) {
+            printf("[remote] map in after %.0f ms (%d chunks, %.1f KiB)\n", emscripten_get_now() - remote.joinMs,
+                   remote.transfer.chunks, remote.transfer.bytes / 1024.0);
+        }
+    }
+    remote.acks.push_back(seq);
+}
+
+EM_BOOL onOpen(int, const EmscriptenWebSocketOpenEvent*, void*) {
+    remote.connected = true;
+    uint8_t join[2] = { SESSION_JOIN, SESSION_JOIN_WORLD };
+    sendMessage(join, 2);
+    return EM_TRUE;
+}
+
+EM_BOOL onMessage(int, const EmscriptenWebSocketMessageEvent* e, void*) {
+    if (e->isText || e->numBytes == 0) return EM_TRUE;
+    const uint8_t* data = e->data;
+    remote.bytesIn += e->numBytes;
+    if (data[0] == SESSION_WELCOME && e->numBytes >= uint32_t(SESSION_WELCOME_BYTES)) {
+        if (!remote.joined) {
+            takeWorld(data, e->numBytes);
+            remote.landed = remote.placed = false;
+        }
+        remote.id = sessionGetU16(data + 1);
+        remote.seed = sessionGetU32(data + 3);
+        remote.tickHz = std::max<int>(sessionGetU16(data + 7), 1);
+        remote.joined = true;
+        printf("[remote] joined as player %u (seed %u, %d Hz)\n", unsigned(remote.id), remote.seed, remote.tickHz);
+    } else if (data[0] == SESSION_FULL) {
+        printf("[remote] the server is full\n");
+    } else if (data[0] == SESSION_SNAPSHOT) {
+        takeSnapshot(data, e->numBytes);
+    } else if (data[0] == SESSION_CHUNKS && remote.joined) {
+        takeChunks(data, e->numBytes);
+    }
+    return EM_TRUE;
+}
+
+EM_BOOL onClose(int, const EmscriptenWebSocketCloseEvent* e, void*) {
+    printf("[remote] disconnected (code %u)\n", unsigned(e->code));
+    remote.connected = remote.joined = false;
+    remote.players.clear();
+    return EM_TRUE;
+}
+
+EM_BOOL onError(int, const EmscriptenWebSocketErrorEvent*, void*) {
+    printf("[remote] connection failed\n");
+    return EM_TRUE;
+}
+
+} // namespace
+
+bool remoteConnect(const char* url, World& world) {
+    if (!emscripten_websocket_is_supported()) return false;
+    target = &world;
+    EmscriptenWebSocketCreateAttributes attr;
+    emscripten_websocket_init_create_attributes(&attr);
+    attr.url = url;
+    attr.protocols = "binary";
+    socket = emscripten_websocket_new(&attr);
+    if (socket <= 0) {
+        printf("[remote] cannot connect to %s\n", url);
+        return false;
+    }
+    emscripten_websocket_set_onopen_callback(socket, nullptr, onOpen);
+    emscripten_websocket_set_onmessage_callback(socket, nullptr, onMessage);
+    emscripten_websocket_set_onclose_callback(socket, nullptr, onClose);
+    emscripten_websocket_set_onerror_callback(socket, nullptr, onError);
+    printf("[remote] connecting to %s\n", url);
+    return true;
+}
+
+bool remotePlace(Vec3* pos) {
+    if (!remote.joined || !remote.landed || remote.placed) return false;
+    remote.placed = true;
+    *pos = remote.spawn;
+    return true;
+}
+
+void remoteUpdate(double dt, const DetInput& in, const Vec3& pos) {
+    if (!remote.joined) return;
+    uint8_t acks[2 + 2 * SESSION_MAX_ACKS];
+    for (size_t k=0; k<remote.acks.size(); k += SESSION_MAX_ACKS) {
+        int count = int(std::min<size_t>(remote.acks.size() - k, SESSION_MAX_ACKS));
+        acks[0] = SESSION_CHUNK_ACK;
+        acks[1] = uint8_t(count);
+        for (int i=0; i<count; ++i) sessionPutU16(acks + 2 + 2*i, remote.acks[k + i]);
+        sendMessage(acks, 2 + 2 * size_t(count));
+    }
+    remote.acks.clear();
+    double tick = 1.0 / remote.tickHz;
+    remote.accumulator = std::min(remote.accumulator + dt, 0.25);
+    if (remote.accumulator < tick) return;
+    // the server keeps applying the latest input, so ticks missed in a long frame share it
+    while (remote.accumulator >= tick) {
+        remote.accumulator -= tick;
+        ++remote.inputTick;
+    }
+    uint8_t msg[SESSION_INPUT_CLAIM_BYTES];
+    if (!remote.placed) {
+        // the server's player falls to rest at the spawn; nothing moves it until ours is there
+        DetInput still = in;
+        still.buttons = 0;
+        sendMessage(msg, sessionWriteInput(msg, remote.inputTick, still));
+        return;
+    }
+    sessionWriteInput(msg, remote.inputTick, in);
+    sendMessage(msg, sessionWriteClaim(msg, detVec(pos)));
+}
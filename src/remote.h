@@ -0,0 +1,50 @@
+// Multiplayer for the web client: a WebSocket to sandbox_server (--ws-port), since a browser
+// cannot send UDP, carrying the same session messages as the native clients
+// (session_protocol.h). The player's input goes out once per server tick; the other players
+// come from the latest snapshot. The server's map streams into the client's world, nearest the
+// spawn first (world_transfer.h), when both have the same dimensions.
+//
+// Open the page with ?server=ws://host:port to join.
+#pragma once
+
+#include "session_protocol.h"
+#include "world_transfer.h"
+
+#include <cstdint>
+#include <vector>
+
+struct RemotePlayer {
+    uint16_t id;
+    DetPlayer player;
+};
+
+struct RemoteState {
+    bool connected = false, joined = false;
+    uint16_t id = 0;
+    uint32_t seed = 0;
+    int tickHz = 0;
+    uint32_t tick = 0;                  // of the newest snapshot
+    std::vector<RemotePlayer> players;  // everyone else in it
+    uint32_t inputTick = 0;
+    double accumulator = 0.0;
+    uint64_t snapshots = 0, bytesIn = 0, bytesOut = 0;
+    bool streaming = false;             // the map is coming from the server
+    TransferState transfer;
+    std::vector<uint16_t> acks;         // SESSION_CHUNKS to acknowledge with the next input
+    double joinMs = 0.0;
+    bool landed = false, placed = false;  // the server's player has come to rest; ours was put there
+    Vec3 spawn;
+};
+
+extern RemoteState remote;
+
+// url like "ws://localhost:27015"; false if the browser cannot open it. The server's map is
+// written into world as it arrives.
+bool remoteConnect(const char* url, World& world);
+// Once per join: where the server has the player after it landed at its spawn. The server
+// checks every claim against where it had the player, so the local one must start there.
+bool remotePlace(Vec3* pos);
+// Sends the input for every server tick that has passed (one message per frame at most), with
+// where the player got to for the server to check. Until the player is placed, it stands still
+// and claims nothing.
+void remoteUpdate(double dt, const DetInput& in, const Vec3& pos);
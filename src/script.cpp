@@ -0,0 +1,863 @@
+#include "script.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cctype>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SCRIPT_COMPUTED_GOTO 1
+#else
+#define SCRIPT_COMPUTED_GOTO 0
+#endif
+
+namespace {
+
+// IFxx continue when the comparison holds and otherwise jump by the offset word that follows;
+// the K forms compare with constant c. JMP, JMPF and JMPT carry the same offset word.
+#define SCRIPT_OPS(X) \
+    X(MOVE) X(LOADK) X(LOADG) X(STOREG) \
+    X(ADD) X(SUB) X(MUL) X(DIV) X(MOD) X(ADDK) X(SUBK) X(MULK) X(DIVK) \
+    X(NEG) X(NOT) X(LT) X(LE) X(EQ) X(NE) \
+    X(JMP) X(JMPF) X(JMPT) \
+    X(IFLT) X(IFLE) X(IFGT) X(IFGE) X(IFEQ) X(IFNE) \
+    X(IFLTK) X(IFLEK) X(IFGTK) X(IFGEK) X(IFEQK) X(IFNEK) \
+    X(CALL) X(NATIVE) X(GETF) X(SETF) X(RET) X(RET0)
+
+enum Op : uint8_t {
+#define SCRIPT_ENUM(name) OP_##name,
+    SCRIPT_OPS(SCRIPT_ENUM)
+#undef SCRIPT_ENUM
+    OP_COUNT
+};
+
+// ----------------- Compiler -----------------
+enum TokenKind { TOK_END, TOK_NUMBER, TOK_NAME, TOK_PUNCT };
+
+struct Token {
+    TokenKind kind = TOK_END;
+    const char* start = nullptr;
+    int len = 0;
+    double number = 0.0;
+    int line = 1;
+};
+
+enum Cmp { CMP_LT, CMP_LE, CMP_GT, CMP_GE, CMP_EQ, CMP_NE };
+const Cmp cmpNegated[] = { CMP_GE, CMP_GT, CMP_LE, CMP_LT, CMP_NE, CMP_EQ };
+const Op cmpIf[] = { OP_IFLT, OP_IFLE, OP_IFGT, OP_IFGE, OP_IFEQ, OP_IFNE };
+const Op cmpIfK[] = { OP_IFLTK, OP_IFLEK, OP_IFGTK, OP_IFGEK, OP_IFEQK, OP_IFNEK };
+
+enum NodeKind { N_NUM, N_LOCAL, N_GLOBAL, N_ARITH, N_CMP, N_NEG, N_NOT, N_AND, N_OR, N_CALL, N_NATIVE, N_FIELD };
+
+// Expressions are parsed into a tree first, so conditions can become compare-and-jumps and
+// constant operands the K forms.
+struct Node {
+    NodeKind kind;
+    int op = 0;         // '+' '-' '*' '/' '%', or a Cmp
+    double num = 0.0;
+    int index = 0;      // register, global, function, native or field
+    int a = -1, b = -1;
+    int firstArg = 0, argc = 0;
+};
+
+const char* const keywords[] = { "var", "let", "func", "if", "else", "while", "return" };
+
+struct Compiler {
+    ScriptProgram& p;
+    const ScriptHost& host;
+    const char* src;
+    Token tok;
+    bool failed = false;
+
+    std::vector<std::string> locals;  // local i lives in register i
+    int freeReg = 0, maxReg = 0;
+    std::vector<Node> nodes;
+    std::vector<int> args;
+
+    Compiler(ScriptProgram& p, const ScriptHost& host, const char* source) : p(p), host(host), src(source) {}
+
+    void error(const char* fmt, ...) {
+        if (failed) return;
+        failed = true;
+        printf("[script] line %d: ", tok.line);
+        va_list ap;
+        va_start(ap, fmt);
+        vprintf(fmt, ap);
+        va_end(ap);
+        printf("\n");
+        tok.kind = TOK_END;
+    }
+
+    // ----------------- Tokens -----------------
+    void next() {
+        if (failed) return;
+        for (;;) {
+            while (*src == ' ' || *src == '\t' || *src == '\r' || *src == '\n') {
+                if (*src == '\n') ++tok.line;
+                ++src;
+            }
+            if (src[0] != '/' || src[1] != '/') break;
+            while (*src && *src != '\n') ++src;
+        }
+        tok.start = src;
+        if (!*src) {
+            tok.kind = TOK_END;
+            tok.len = 0;
+        } else if ((*src >= '0' && *src <= '9') || (*src == '.' && src[1] >= '0' && src[1] <= '9')) {
+            char* end;
+            tok.number = strtod(src, &end);
+            tok.kind = TOK_NUMBER;
+            tok.len = int(end - src);
+        } else if (isalpha((unsigned char)*src) || *src == '_') {
+            const char* s = src;
+            while (isalnum((unsigned char)*s) || *s == '_') ++s;
+            tok.kind = TOK_NAME;
+            tok.len = int(s - src);
+        } else {
+            static const char* const pairs[] = { "<=", ">=", "==", "!=", "&&", "||" };
+            tok.kind = TOK_PUNCT;
+            tok.len = 1;
+            for (const char* pair : pairs) {
+                if (src[0] == pair[0] && src[1] == pair[1]) tok.len = 2;
+            }
+            if (tok.len == 1 && !strchr("+-*/%<>=!(){},;.", *src)) {
+                error("unexpected '%c'", *src);
+                return;
+            }
+        }
+        src += tok.len;
+    }
+
+    bool is(const char* punct) const {
+        return tok.kind == TOK_PUNCT && tok.len == int(strlen(punct)) && memcmp(tok.start, punct, tok.len) == 0;
+    }
+    bool isWord(const char* word) const {
+        return tok.kind == TOK_NAME && tok.len == int(strlen(word)) && memcmp(tok.start, word, tok.len) == 0;
+    }
+    bool accept(const char* punct) {
+        if (!is(punct)) return false;
+        next();
+        return true;
+    }
+    void expect(const char* punct) {
+        if (!accept(punct)) error("expected '%s'", punct);
+    }
+
+    // A name being declared: not a keyword.
+    std::string declName() {
+        if (tok.kind != TOK_NAME) {
+            error("expected a name");
+            return std::string();
+        }
+        for (const char* k : keywords) {
+            if (isWord(k)) error("'%s' is a keyword", k);
+        }
+        std::string s(tok.start, tok.len);
+        next();
+        return s;
+    }
+
+    // ----------------- Names -----------------
+    int findLocal(const std::string& s) const {
+        for (int i=int(locals.size()) - 1; i>=0; --i) {
+            if (locals[i] == s) return i;
+        }
+        return -1;
+    }
+    int findNative(const std::string& s) const {
+        for (int i=0; i<host.nativeCount; ++i) {
+            if (s == host.natives[i].name) return i;
+        }
+        return -1;
+    }
+    // Calls may come before the definition; the slot is filled in when it arrives.
+    int functionSlot(const std::string& s) {
+        int i = scriptFunction(p, s.c_str());
+        if (i >= 0) return i;
+        if (p.functions.size() > 255) {
+            error("more than 256 functions");
+            return 0;
+        }
+        ScriptFunction f;
+        f.name = s;
+        p.functions.push_back(f);
+        return int(p.functions.size()) - 1;
+    }
+
+    // ----------------- Expressions -----------------
+    int add(const Node& n) {
+        nodes.push_back(n);
+        return int(nodes.size()) - 1;
+    }
+    int number(double v) {
+        Node n = { N_NUM };
+        n.num = v;
+        return add(n);
+    }
+    int binary(NodeKind kind, int op, int a, int b) {
+        Node n = { kind };
+        n.op = op;
+        n.a = a;
+        n.b = b;
+        return add(n);
+    }
+
+    int parseExpr() { return parseOr(); }
+
+    int parseOr() {
+        int l = parseAnd();
+        while (accept("||")) l = binary(N_OR, 0, l, parseAnd());
+        return l;
+    }
+    int parseAnd() {
+        int l = parseCmp();
+        while (accept("&&")) l = binary(N_AND, 0, l, parseCmp());
+        return l;
+    }
+    int parseCmp() {
+        static const char* const ops[] = { "<", "<=", ">", ">=", "==", "!=" };
+        int l = parseAdd();
+        for (;;) {
+            int op = -1;
+            for (int i=0; i<6; ++i) {
+                if (is(ops[i])) op = i;
+            }
+            if (op < 0) return l;
+            next();
+            l = binary(N_CMP, op, l, parseAdd());
+        }
+    }
+    int arith(int op, int l, int r) {
+        if (nodes[l].kind == N_NUM && nodes[r].kind == N_NUM) {
+            double a = nodes[l].num, b = nodes[r].num;
+            switch (op) {
+                case '+': return number(a + b);
+                case '-': return number(a - b);
+                case '*': return number(a * b);
+                case '/': return number(a / b);
+                default: return number(fmod(a, b));
+            }
+        }
+        return binary(N_ARITH, op, l, r);
+    }
+    int parseAdd() {
+        int l = parseMul();
+        for (;;) {
+            if (is("+") || is("-")) {
+                int op = *tok.start;
+                next();
+                l = arith(op, l, parseMul());
+            } else {
+                return l;
+            }
+        }
+    }
+    int parseMul() {
+        int l = parseUnary();
+        for (;;) {
+            if (is("*") || is("/") || is("%")) {
+                int op = *tok.start;
+                next();
+                l = arith(op, l, parseUnary());
+            } else {
+                return l;
+            }
+        }
+    }
+    int parseUnary() {
+        if (accept("-")) {
+            int n = parseUnary();
+            if (nodes[n].kind == N_NUM) return number(-nodes[n].num);
+            return binary(N_NEG, 0, n, -1);
+        }
+        if (accept("!")) {
+            int n = parseUnary();
+            if (nodes[n].kind == N_NUM) return number(nodes[n].num == 0.0 ? 1.0 : 0.0);
+            return binary(N_NOT, 0, n, -1);
+        }
+        int n = parsePrimary();
+        while (accept(".")) {
+            if (tok.kind != TOK_NAME) {
+                error("expected a field name");
+                return n;
+            }
+            std::string s(tok.start, tok.len);
+            int field = -1;
+            for (int i=0; i<host.entities.fieldCount; ++i) {
+                if (s == host.entities.fields[i]) field = i;
+            }
+            if (field < 0) error("no entity field '%s'", s.c_str());
+            next();
+            Node f = { N_FIELD };
+            f.a = n;
+            f.index = field;
+            n = add(f);
+        }
+        return n;
+    }
+    int parsePrimary() {
+        if (tok.kind == TOK_NUMBER) {
+            double v = tok.number;
+            next();
+            return number(v);
+        }
+        if (accept("(")) {
+            int n = parseExpr();
+            expect(")");
+            return n;
+        }
+        if (tok.kind != TOK_NAME) {
+            error("expected an expression");
+            return number(0.0);
+        }
+        std::string s(tok.start, tok.len);
+        next();
+        if (accept("(")) return parseCall(s);
+        int i = findLocal(s);
+        if (i >= 0) {
+            Node n = { N_LOCAL };
+            n.index = i;
+            return add(n);
+        }
+        for (size_t g=0; g<p.globalNames.size(); ++g) {
+            if (p.globalNames[g] != s) continue;
+            Node n = { N_GLOBAL };
+            n.index = int(g);
+            return add(n);
+        }
+        for (int c=0; c<host.constantCount; ++c) {
+            if (s == host.constants[c].name) return number(host.constants[c].value);
+        }
+        error("unknown name '%s'", s.c_str());
+        return number(0.0);
+    }
+    int parseCall(const std::string& s) {
+        std::vector<int> list;
+        if (!is(")")) {
+            do {
+                list.push_back(parseExpr());
+            } while (accept(",") && !failed);
+        }
+        expect(")");
+        Node n = { N_CALL };
+        n.firstArg = int(args.size());
+        n.argc = int(list.size());
+        args.insert(args.end(), list.begin(), list.end());
+        int native = findNative(s);
+        if (native >= 0) {
+            n.kind = N_NATIVE;
+            n.index = native;
+            if (host.natives[native].argc != n.argc) {
+                error("%s takes %d arguments, not %d", s.c_str(), host.natives[native].argc, n.argc);
+            }
+            return add(n);
+        }
+        n.index = functionSlot(s);
+        ScriptFunction& f = p.functions[n.index];
+        int expected = f.defined ? f.params : f.calledWith;
+        if (expected >= 0 && expected != n.argc) error("%s takes %d arguments, not %d", s.c_str(), expected, n.argc);
+        f.calledWith = n.argc;
+        return add(n);
+    }
+
+    // ----------------- Code -----------------
+    void emit(uint32_t word) { p.code.push_back(word); }
+    void emitABC(Op op, int a, int b, int c) { emit(uint32_t(op) | uint32_t(a) << 8 | uint32_t(b) << 16 | uint32_t(c) << 24); }
+    void emitABx(Op op, int a, int bx) { emit(uint32_t(op) | uint32_t(a) << 8 | uint32_t(bx) << 16); }
+    // Returns the offset word, for patch().
+    int emitJump(Op op, int a, int b) {
+        emitABC(op, a, b, 0);
+        emit(0);
+        return int(p.code.size()) - 1;
+    }
+    // Points the jump at the next instruction emitted.
+    void patch(int at) { p.code[at] = uint32_t(int32_t(p.code.size()) - (at + 1)); }
+    void patchAll(const std::vector<int>& jumps) {
+        for (int at : jumps) patch(at);
+    }
+    void jumpBack(int target) {
+        emitABC(OP_JMP, 0, 0, 0);
+        emit(uint32_t(int32_t(target - (int(p.code.size()) + 1))));
+    }
+
+    int constant(double v) {
+        for (size_t i=0; i<p.constants.size(); ++i) {
+            if (memcmp(&p.constants[i], &v, sizeof v) == 0) return int(i);
+        }
+        if (p.constants.size() >= 65536) error("more than 65536 constants");
+        p.constants.push_back(v);
+        return int(p.constants.size()) - 1;
+    }
+    // Constants the K forms can name in their 8-bit operand; -1 for the rest.
+    int smallConstant(int n) {
+        if (nodes[n].kind != N_NUM) return -1;
+        int k = constant(nodes[n].num);
+        return k < 256 ? k : -1;
+    }
+
+    int tempReg() {
+        if (freeReg >= SCRIPT_REGS) {
+            error("more than %d registers in a function", SCRIPT_REGS);
+            return 0;
+        }
+        maxReg = std::max(maxReg, freeReg + 1);
+        return freeReg++;
+    }
+
+    // A register holding the value: locals are used in place, the rest get a temporary that
+    // the caller frees by resetting freeReg.
+    int exprReg(int n) {
+        if (nodes[n].kind == N_LOCAL) return nodes[n].index;
+        int r = tempReg();
+        exprInto(n, r);
+        return r;
+    }
+
+    void exprInto(int n, int dst) {
+        const Node e = nodes[n];
+        int save = freeReg;
+        switch (e.kind) {
+        case N_NUM:
+            emitABx(OP_LOADK, dst, constant(e.num));
+            break;
+        case N_LOCAL:
+            if (e.index != dst) emitABC(OP_MOVE, dst, e.index, 0);
+            break;
+        case N_GLOBAL:
+            emitABx(OP_LOADG, dst, e.index);
+            break;
+        case N_ARITH: {
+            static const Op ops[] = { OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD };
+            int i = e.op == '+' ? 0 : e.op == '-' ? 1 : e.op == '*' ? 2 : e.op == '/' ? 3 : 4;
+            int l = exprReg(e.a);
+            int k = i < 4 ? smallConstant(e.b) : -1;
+            if (k >= 0) emitABC(Op(OP_ADDK + i), dst, l, k);
+            else emitABC(ops[i], dst, l, exprReg(e.b));
+            break;
+        }
+        case N_CMP: {
+            int l = exprReg(e.a), r = exprReg(e.b);
+            switch (Cmp(e.op)) {
+                case CMP_LT: emitABC(OP_LT, dst, l, r); break;
+                case CMP_LE: emitABC(OP_LE, dst, l, r); break;
+                case CMP_GT: emitABC(OP_LT, dst, r, l); break;
+                case CMP_GE: emitABC(OP_LE, dst, r, l); break;
+                case CMP_EQ: emitABC(OP_EQ, dst, l, r); break;
+                case CMP_NE: emitABC(OP_NE, dst, l, r); break;
+            }
+            break;
+        }
+        case N_NEG:
+        case N_NOT:
+            emitABC(e.kind == N_NEG ? OP_NEG : OP_NOT, dst, exprReg(e.a), 0);
+            break;
+        case N_AND:
+        case N_OR: {
+            // the left side is written before the right is read, so a local target waits
+            int t = dst < int(locals.size()) ? tempReg() : dst;
+            exprInto(e.a, t);
+            int skip = emitJump(e.kind == N_AND ? OP_JMPF : OP_JMPT, t, 0);
+            exprInto(e.b, t);
+            patch(skip);
+            if (t != dst) emitABC(OP_MOVE, dst, t, 0);
+            break;
+        }
+        case N_CALL:
+        case N_NATIVE: {
+            // arguments go to fresh registers, which become the callee's window
+            int base = freeReg;
+            for (int i=0; i<e.argc; ++i) exprInto(args[e.firstArg + i], tempReg());
+            if (e.argc == 0) tempReg();
+            emitABC(e.kind == N_CALL ? OP_CALL : OP_NATIVE, base, e.index, e.argc);
+            if (dst != base) emitABC(OP_MOVE, dst, base, 0);
+            break;
+        }
+        case N_FIELD:
+            emitABC(OP_GETF, dst, exprReg(e.a), e.index);
+            break;
+        }
+        freeReg = save;
+    }
+
+    void emitIf(const Node& e, Cmp cmp, std::vector<int>& jumps) {
+        int save = freeReg;
+        int l = exprReg(e.a);
+        int k = smallConstant(e.b);
+        if (k >= 0) jumps.push_back(emitJump(cmpIfK[cmp], l, k));
+        else jumps.push_back(emitJump(cmpIf[cmp], l, exprReg(e.b)));
+        freeReg = save;
+    }
+    void jumpOn(int n, Op op, std::vector<int>& jumps) {
+        int save = freeReg;
+        jumps.push_back(emitJump(op, exprReg(n), 0));
+        freeReg = save;
+    }
+    // Adds jumps taken when the condition is false (condFalse) or true (condTrue).
+    void condFalse(int n, std::vector<int>& jumps) {
+        const Node e = nodes[n];
+        if (e.kind == N_CMP) {
+            emitIf(e, Cmp(e.op), jumps);
+        } else if (e.kind == N_AND) {
+            condFalse(e.a, jumps);
+            condFalse(e.b, jumps);
+        } else if (e.kind == N_OR) {
+            std::vector<int> taken;
+            condTrue(e.a, taken);
+            condFalse(e.b, jumps);
+            patchAll(taken);
+        } else if (e.kind == N_NOT) {
+            condTrue(e.a, jumps);
+        } else {
+            jumpOn(n, OP_JMPF, jumps);
+        }
+    }
+    void condTrue(int n, std::vector<int>& jumps) {
+        const Node e = nodes[n];
+        if (e.kind == N_CMP) {
+            emitIf(e, cmpNegated[e.op], jumps);
+        } else if (e.kind == N_AND) {
+            std::vector<int> fails;
+            condFalse(e.a, fails);
+            condTrue(e.b, jumps);
+            patchAll(fails);
+        } else if (e.kind == N_OR) {
+            condTrue(e.a, jumps);
+            condTrue(e.b, jumps);
+        } else if (e.kind == N_NOT) {
+            condFalse(e.a, jumps);
+        } else {
+            jumpOn(n, OP_JMPT, jumps);
+        }
+    }
+
+    // ----------------- Statements -----------------
+    int condition() {
+        expect("(");
+        int n = parseExpr();
+        expect(")");
+        return n;
+    }
+
+    void block() {
+        expect("{");
+        size_t scope = locals.size();
+        while (tok.kind != TOK_END && !is("}")) statement();
+        expect("}");
+        locals.resize(scope);
+        freeReg = int(scope);
+    }
+
+    void statement() {
+        nodes.clear();
+        args.clear();
+        if (isWord("let")) {
+            next();
+            std::string s = declName();
+            expect("=");
+            int n = parseExpr();
+            exprInto(n, tempReg());
+            locals.push_back(s);
+        } else if (isWord("if")) {
+            next();
+            std::vector<int> skip;
+            condFalse(condition(), skip);
+            block();
+            if (isWord("else")) {
+                next();
+                int end = emitJump(OP_JMP, 0, 0);
+                patchAll(skip);
+                if (isWord("if")) statement();
+                else block();
+                patch(end);
+            } else {
+                patchAll(skip);
+            }
+        } else if (isWord("while")) {
+            next();
+            int top = int(p.code.size());
+            std::vector<int> exit;
+            condFalse(condition(), exit);
+            block();
+            jumpBack(top);
+            patchAll(exit);
+        } else if (isWord("return")) {
+            next();
+            if (is("}") || is(";")) emitABC(OP_RET0, 0, 0, 0);
+            else emitABC(OP_RET, exprReg(parseExpr()), 0, 0);
+        } else {
+            int n = parseExpr();
+            if (accept("=")) {
+                int v = parseExpr();
+                const Node target = nodes[n];
+                if (target.kind == N_LOCAL) {
+                    exprInto(v, target.index);
+                } else if (target.kind == N_GLOBAL) {
+                    emitABx(OP_STOREG, exprReg(v), target.index);
+                } else if (target.kind == N_FIELD) {
+                    int entity = exprReg(target.a);
+                    emitABC(OP_SETF, entity, exprReg(v), target.index);
+                } else {
+                    error("only locals, globals and fields can be assigned");
+                }
+            } else if (nodes[n].kind == N_CALL || nodes[n].kind == N_NATIVE) {
+                exprInto(n, tempReg());
+            } else {
+                error("expression does nothing");
+            }
+        }
+        accept(";");
+        freeReg = int(locals.size());
+    }
+
+    void global() {
+        std::string s = declName();
+        expect("=");
+        bool negative = accept("-");
+        if (tok.kind != TOK_NUMBER) {
+            error("globals start as a number");
+            return;
+        }
+        if (scriptGlobal(p, s.c_str()) >= 0) error("global '%s' declared twice", s.c_str());
+        if (p.globalNames.size() >= 65536) error("more than 65536 globals");
+        p.globalNames.push_back(s);
+        p.globalInit.push_back(negative ? -tok.number : tok.number);
+        next();
+        accept(";");
+    }
+
+    void function() {
+        std::string s = declName();
+        if (findNative(s) >= 0) error("'%s' is a native function", s.c_str());
+        int fn = functionSlot(s);
+        if (p.functions[fn].defined) error("function '%s' defined twice", s.c_str());
+        locals.clear();
+        expect("(");
+        if (!is(")")) {
+            do {
+                locals.push_back(declName());
+            } while (accept(",") && !failed);
+        }
+        expect(")");
+        int params = int(locals.size());
+        int called = p.functions[fn].calledWith;
+        if (called >= 0 && called != params) error("%s takes %d arguments, not %d", s.c_str(), params, called);
+        if (params > SCRIPT_REGS) error("too many parameters");
+        p.functions[fn].entry = uint32_t(p.code.size());
+        p.functions[fn].params = params;
+        p.functions[fn].defined = true;  // before the body, for recursion
+        freeReg = maxReg = params;
+        block();
+        emitABC(OP_RET0, 0, 0, 0);
+        p.functions[fn].regs = std::max(maxReg, 1);
+    }
+
+    bool compile() {
+        next();
+        while (tok.kind != TOK_END) {
+            if (isWord("var")) {
+                next();
+                global();
+            } else if (isWord("func")) {
+                next();
+                function();
+            } else {
+                error("expected 'var' or 'func'");
+            }
+        }
+        for (const ScriptFunction& f : p.functions) {
+            if (!f.defined) error("function '%s' is called but never defined", f.name.c_str());
+        }
+        return !failed;
+    }
+};
+
+// ----------------- Interpreter -----------------
+int entityIndex(double v) { return v >= 0.0 && v < 2147483647.0 ? int(v) : -1; }
+
+#define VA (ins >> 8 & 0xff)
+#define VB (ins >> 16 & 0xff)
+#define VC (ins >> 24)
+#define VBX (ins >> 16)
+#define OFFSET() int32_t(*pc++)
+
+#if SCRIPT_COMPUTED_GOTO
+#define NEXT() do { \
+        ins = *pc++; \
+        if (Mode == SCRIPT_COUNTING) ++count; \
+        if (Mode == SCRIPT_THREADED) goto *labels[ins & 0xff]; \
+        goto dispatch; \
+    } while (0)
+#else
+#define NEXT() do { ins = *pc++; if (Mode == SCRIPT_COUNTING) ++count; goto dispatch; } while (0)
+#endif
+
+template<int Mode>
+bool run(ScriptVM& vm, int fn, double* result) {
+#if SCRIPT_COMPUTED_GOTO
+#define SCRIPT_LABEL(name) &&L_##name,
+    static const void* const labels[OP_COUNT] = { SCRIPT_OPS(SCRIPT_LABEL) };
+#undef SCRIPT_LABEL
+#endif
+    const ScriptProgram& p = *vm.program;
+    const ScriptHost& host = *vm.host;
+    const uint32_t* code = p.code.data();
+    const double* K = p.constants.data();
+    const ScriptFunction* F = p.functions.data();
+    double* G = vm.globals.data();
+    double* stackEnd = vm.stack.data() + vm.stack.size();
+    ScriptFrame* frames = vm.frames.data();
+    ScriptFrame* lastFrame = frames + vm.frames.size() - 1;
+    ScriptFrame* frame = frames;
+    uint64_t budget = vm.budget, count = 0;
+
+    double* R = vm.stack.data();
+    const uint32_t* pc = code + F[fn].entry;
+    uint32_t ins;
+    NEXT();
+
+dispatch:
+    switch (ins & 0xff) {
+#define SCRIPT_CASE(name) case OP_##name: goto L_##name;
+    SCRIPT_OPS(SCRIPT_CASE)
+#undef SCRIPT_CASE
+    default: goto L_RET0;
+    }
+
+L_MOVE: R[VA] = R[VB]; NEXT();
+L_LOADK: R[VA] = K[VBX]; NEXT();
+L_LOADG: R[VA] = G[VBX]; NEXT();
+L_STOREG: G[VBX] = R[VA]; NEXT();
+L_ADD: R[VA] = R[VB] + R[VC]; NEXT();
+L_SUB: R[VA] = R[VB] - R[VC]; NEXT();
+L_MUL: R[VA] = R[VB] * R[VC]; NEXT();
+L_DIV: R[VA] = R[VB] / R[VC]; NEXT();
+L_MOD: R[VA] = fmod(R[VB], R[VC]); NEXT();
+L_ADDK: R[VA] = R[VB] + K[VC]; NEXT();
+L_SUBK: R[VA] = R[VB] - K[VC]; NEXT();
+L_MULK: R[VA] = R[VB] * K[VC]; NEXT();
+L_DIVK: R[VA] = R[VB] / K[VC]; NEXT();
+L_NEG: R[VA] = -R[VB]; NEXT();
+L_NOT: R[VA] = R[VB] == 0.0 ? 1.0 : 0.0; NEXT();
+L_LT: R[VA] = R[VB] < R[VC] ? 1.0 : 0.0; NEXT();
+L_LE: R[VA] = R[VB] <= R[VC] ? 1.0 : 0.0; NEXT();
+L_EQ: R[VA] = R[VB] == R[VC] ? 1.0 : 0.0; NEXT();
+L_NE: R[VA] = R[VB] != R[VC] ? 1.0 : 0.0; NEXT();
+L_JMP: {
+    int32_t off = OFFSET();
+    pc += off;
+    // loops close with a backward jump: the only place they can spin
+    if (off < 0 && --budget == 0) goto spent;
+    NEXT();
+}
+L_JMPF: { int32_t off = OFFSET(); if (R[VA] == 0.0) pc += off; NEXT(); }
+L_JMPT: { int32_t off = OFFSET(); if (R[VA] != 0.0) pc += off; NEXT(); }
+L_IFLT: { int32_t off = OFFSET(); if (!(R[VA] < R[VB])) pc += off; NEXT(); }
+L_IFLE: { int32_t off = OFFSET(); if (!(R[VA] <= R[VB])) pc += off; NEXT(); }
+L_IFGT: { int32_t off = OFFSET(); if (!(R[VA] > R[VB])) pc += off; NEXT(); }
+L_IFGE: { int32_t off = OFFSET(); if (!(R[VA] >= R[VB])) pc += off; NEXT(); }
+L_IFEQ: { int32_t off = OFFSET(); if (!(R[VA] == R[VB])) pc += off; NEXT(); }
+L_IFNE: { int32_t off = OFFSET(); if (!(R[VA] != R[VB])) pc += off; NEXT(); }
+L_IFLTK: { int32_t off = OFFSET(); if (!(R[VA] < K[VB])) pc += off; NEXT(); }
+L_IFLEK: { int32_t off = OFFSET(); if (!(R[VA] <= K[VB])) pc += off; NEXT(); }
+L_IFGTK: { int32_t off = OFFSET(); if (!(R[VA] > K[VB])) pc += off; NEXT(); }
+L_IFGEK: { int32_t off = OFFSET(); if (!(R[VA] >= K[VB])) pc += off; NEXT(); }
+L_IFEQK: { int32_t off = OFFSET(); if (!(R[VA] == K[VB])) pc += off; NEXT(); }
+L_IFNEK: { int32_t off = OFFSET(); if (!(R[VA] != K[VB])) pc += off; NEXT(); }
+L_CALL: {
+    const ScriptFunction& f = F[VB];
+    double* base = R + VA;
+    if (frame == lastFrame || base + f.regs > stackEnd) {
+        printf("[script] %s: stack overflow calling %s\n", F[fn].name.c_str(), f.name.c_str());
+        vm.instructions += count;
+        return false;
+    }
+    if (--budget == 0) goto spent;
+    ++frame;
+    frame->pc = pc;
+    frame->base = R;
+    R = base;
+    pc = code + f.entry;
+    NEXT();
+}
+L_NATIVE: R[VA] = host.natives[VB].fn(host.user, R + VA); NEXT();
+L_GETF: R[VA] = host.entities.get(host.user, entityIndex(R[VB]), int(VC)); NEXT();
+L_SETF: host.entities.set(host.user, entityIndex(R[VA]), int(VC), R[VB]); NEXT();
+L_RET: R[0] = R[VA]; goto ret;
+L_RET0: R[0] = 0.0;
+ret:
+    // the result is in the caller's register the window started at
+    if (frame == frames) {
+        *result = R[0];
+        vm.instructions += count;
+        return true;
+    }
+    pc = frame->pc;
+    R = frame->base;
+    --frame;
+    NEXT();
+
+spent:
+    printf("[script] %s: stopped after %llu backward jumps and calls\n", F[fn].name.c_str(),
+           (unsigned long long)vm.budget);
+    vm.instructions += count;
+    return false;
+}
+
+#undef VA
+#undef VB
+#undef VC
+#undef VBX
+#undef OFFSET
+#undef NEXT
+
+} // namespace
+
+bool scriptCompile(ScriptProgram& p, const char* source, const ScriptHost& host) {
+    p = ScriptProgram();
+    Compiler c(p, host, source);
+    return c.compile();
+}
+
+int scriptFunction(const ScriptProgram& p, const char* name) {
+    for (size_t i=0; i<p.functions.size(); ++i) {
+        if (p.functions[i].name == name) return int(i);
+    }
+    return -1;
+}
+
+int scriptGlobal(const ScriptProgram& p, const char* name) {
+    for (size_t i=0; i<p.globalNames.size(); ++i) {
+        if (p.globalNames[i] == name) return int(i);
+    }
+    return -1;
+}
+
+void scriptVmInit(ScriptVM& vm, const ScriptProgram& p, const ScriptHost& host) {
+    vm.program = &p;
+    vm.host = &host;
+    vm.globals = p.globalInit;
+    vm.stack.assign(SCRIPT_STACK, 0.0);
+    vm.frames.assign(SCRIPT_FRAMES, ScriptFrame());
+    vm.instructions = 0;
+}
+
+bool scriptCall(ScriptVM& vm, int fn, const double* args, int argc, double* result, ScriptDispatch dispatch) {
+    const ScriptProgram& p = *vm.program;
+    if (fn < 0 || fn >= int(p.functions.size())) {
+        printf("[script] no function %d\n", fn);
+        return false;
+    }
+    if (argc != p.functions[fn].params) {
+        printf("[script] %s takes %d arguments, not %d\n", p.functions[fn].name.c_str(), p.functions[fn].params, argc);
+        return false;
+    }
+    for (int i=0; i<argc; ++i) vm.stack[i] = args[i];
+    double ignored;
+    if (!result) result = &ignored;
+    if (dispatch == SCRIPT_THREADED) return run<SCRIPT_THREADED>(vm, fn, result);
+    if (dispatch == SCRIPT_SWITCH) return run<SCRIPT_SWITCH>(vm, fn, result);
+    return run<SCRIPT_COUNTING>(vm, fn, result);
+}
@@ -0,0 +1,118 @@
+// Gameplay scripts: game rules written in a small language, compiled to register bytecode and
+// run by a threaded interpreter.
+//
+// The language has one type, double, with zero as false:
+//
+//   var ammo = 30                  // globals: number literals, kept between calls
+//
+//   func hit(target, part) {       // functions, called by name from C++ or from each other
+//       let damage = 34 * scale(part)
+//       target.health = target.health - damage    // entity fields, through the host
+//       if (target.health <= 0 && part == HEAD) { respawn(target) }
+//       while (...) { ... }
+//       return damage
+//   }
+//
+// with + - * / % (fmod), comparisons, && || ! (short-circuit), and `;` optional. Names the
+// host gives (ScriptHost) stand for constants, native functions and entity fields, so the
+// language knows nothing about the game.
+//
+// Each function gets a window of registers: parameters first, then locals, then temporaries.
+// Instructions are 32 bits (op, a, b, c; or op, a and a 16-bit operand), plus one offset word
+// after jumps. Calls slide the window up to the arguments, so arguments are never copied and
+// the result lands where the caller wants it. Dispatch jumps from each handler straight to the
+// next one through a label table (computed goto, GCC and Clang) instead of coming back to one
+// switch; SCRIPT_SWITCH runs the same handlers through the switch for comparison.
+//
+// Compiling allocates; scriptVmInit() sizes everything a call needs, so scriptCall() never
+// does. Runaway scripts stop when `budget` backward jumps and calls run out.
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+const int SCRIPT_STACK = 4096;   // registers across all active calls
+const int SCRIPT_FRAMES = 128;   // call depth
+const int SCRIPT_REGS = 255;     // per function: register operands are 8 bits
+
+struct ScriptNative {
+    const char* name;
+    int argc;
+    double (*fn)(void* user, const double* args);
+};
+
+struct ScriptConstant {
+    const char* name;
+    double value;
+};
+
+// The game's entities as scripts see them: `e.health` reads field "health" of entity e.
+struct ScriptEntities {
+    const char* const* fields = nullptr;
+    int fieldCount = 0;
+    double (*get)(void* user, int entity, int field) = nullptr;
+    void (*set)(void* user, int entity, int field, double value) = nullptr;
+};
+
+struct ScriptHost {
+    const ScriptNative* natives = nullptr;
+    int nativeCount = 0;
+    const ScriptConstant* constants = nullptr;
+    int constantCount = 0;
+    ScriptEntities entities;
+    void* user = nullptr;  // passed to natives and entity access
+};
+
+struct ScriptFunction {
+    std::string name;
+    uint32_t entry = 0;  // into code
+    int params = 0;
+    int regs = 1;        // window size, parameters included
+    int calledWith = -1; // argument count at calls seen before the definition
+    bool defined = false;
+};
+
+struct ScriptProgram {
+    std::vector<uint32_t> code;
+    std::vector<double> constants;
+    std::vector<ScriptFunction> functions;
+    std::vector<std::string> globalNames;
+    std::vector<double> globalInit;
+};
+
+struct ScriptFrame {
+    const uint32_t* pc;  // caller's, to resume at
+    double* base;        // caller's registers
+};
+
+enum ScriptDispatch {
+    SCRIPT_THREADED,  // computed goto where the compiler has it, else the switch
+    SCRIPT_SWITCH,
+    SCRIPT_COUNTING,  // the switch, adding executed instructions to `instructions`
+};
+
+struct ScriptVM {
+    const ScriptProgram* program = nullptr;
+    const ScriptHost* host = nullptr;
+    std::vector<double> globals;
+    std::vector<double> stack;
+    std::vector<ScriptFrame> frames;
+    uint64_t budget = 10000000;  // backward jumps and calls per scriptCall()
+    uint64_t instructions = 0;   // SCRIPT_COUNTING only
+};
+
+// Compiles source against the host's names into p (replacing what it held). Prints the first
+// error with its line and returns false.
+bool scriptCompile(ScriptProgram& p, const char* source, const ScriptHost& host);
+// -1 when there is no such function or global.
+int scriptFunction(const ScriptProgram& p, const char* name);
+int scriptGlobal(const ScriptProgram& p, const char* name);
+
+// Sizes the VM for p and sets the globals to their initial values; the program and host must
+// outlive it.
+void scriptVmInit(ScriptVM& vm, const ScriptProgram& p, const ScriptHost& host);
+// Runs function fn with argc arguments; *result gets its return value (0 without one). Returns
+// false, after printing why, on a wrong argument count, stack overflow or spent budget.
+bool scriptCall(ScriptVM& vm, int fn, const double* args, int argc, double* result,
+                ScriptDispatch dispatch = SCRIPT_THREADED);
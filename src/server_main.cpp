@@ -0,0 +1,365 @@
+/*
+ Headless dedicated server (native only).
+
+   ./sandbox_server [--dir DIR] [--seed N] [--ticks N] [--no-fsync] [--bots N] [--record FILE]
+                    [--broadcast HOST:PORT] [--delay SECONDS] [--port N] [--io socket|mmsg|uring]
+                    [--ws-port N]
+   ./sandbox_server --play FILE [--from SECONDS] [--speed X]
+
+ Owns the authoritative world. Every tick's edits are group-committed to the write-ahead
+ journal (journal.h); checkpoints save the regions from a snapshot in the background and
+ drop the journal segments they cover. On startup the last checkpoint is loaded and the
+ journal tail replayed, so a crash loses at most the tick that was being committed.
+
+ --record writes a seekable recording of the match (demo.h); --play runs one back headless
+ at X times real time (0: as fast as possible) from any point, printing a summary every
+ recorded second. --bots adds wandering players, simulated with the lockstep physics.
+ --broadcast streams the same recording, held back by --delay, to a spectator relay
+ (sandbox_relay, relay.h), which serves it to any number of viewers.
+
+ --port accepts players over UDP (session.h): their inputs are read a batch at a time at the
+ start of each tick and every player gets the tick's snapshot at the end of it. --io picks how
+ the datagrams reach the kernel (net_io.h; mmsg by default). --ws-port also accepts browsers,
+ which cannot send UDP, over WebSocket (ws.h) with the same messages. Players that ask for it
+ get the map streamed to them after joining, nearest their spawn first (world_transfer.h).
+ Players that move themselves have their claimed positions checked against the movement rules
+ every tick, all of them in one SIMD batch (move_check.h).
+*/
+
+#include "autosave.h"
+#include "demo.h"
+#include "det_physics.h"
+#include "journal.h"
+#include "net.h"
+#include "profiler.h"
+#include "session.h"
+#include "world.h"
+#include "worldgen_pipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int TICK_HZ = 30;
+const double CHECKPOINT_INTERVAL_MS = 60000.0;
+const size_t CHECKPOINT_JOURNAL_BYTES = 8u << 20;
+const int BROADCAST_DELAY_SECONDS = 3;
+
+volatile std::sig_atomic_t stopRequested = 0;
+void onSignal(int) { stopRequested = 1; }
+
+struct ServerOptions {
+    const char* dir = "server_data";
+    uint32_t seed = DEFAULT_WORLD_SEED;
+    long ticks = -1;  // run until interrupted
+    bool durable = true;
+    int bots = 0;
+    const char* record = nullptr;
+    const char* broadcast = nullptr;
+    int delay = BROADCAST_DELAY_SECONDS;
+    int port = -1;         // no player sessions
+    const char* io = "mmsg";
+    int wsPort = -1;
+    const char* play = nullptr;
+    float from = 0.0f;     // seconds into the recording
+    float speed = 10.0f;   // playback rate, 0 = unpaced
+};
+
+World world;
+Journal journal;
+
+// Checkpoint in flight: segments up to dropUpTo can go once the save of version `version` is on disk.
+struct PendingCheckpoint {
+    bool active = false;
+    uint64_t dropUpTo = 0;
+    uint64_t version = 0;
+};
+PendingCheckpoint checkpoint;
+double lastCheckpointMs = 0.0;
+
+void startCheckpoint(uint32_t seed) {
+    checkpoint.dropUpTo = journalRotate(journal);
+    checkpoint.version = world.version;
+    checkpoint.active = true;
+    autosaveRequest(world, seed);
+}
+
+void finishCheckpoint() {
+    autosavePoll();
+    if (!checkpoint.active || autosaveStats().savedVersion < checkpoint.version) return;
+    journalDropSegments(journal, checkpoint.dropUpTo);
+    checkpoint.active = false;
+}
+
+bool parseOptions(int argc, char** argv, ServerOptions& o) {
+    for (int i=1; i<argc; ++i) {
+        bool more = i + 1 < argc;
+        if (strcmp(argv[i], "--dir") == 0 && more) o.dir = argv[++i];
+        else if (strcmp(argv[i], "--seed") == 0 && more) o.seed = uint32_t(strtoul(argv[++i], nullptr, 10));
+        else if (strcmp(argv[i], "--ticks") == 0 && more) o.ticks = strtol(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--no-fsync") == 0) o.durable = false;
+        else if (strcmp(argv[i], "--bots") == 0 && more) o.bots = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--record") == 0 && more) o.record = argv[++i];
+        else if (strcmp(argv[i], "--broadcast") == 0 && more) o.broadcast = argv[++i];
+        else if (strcmp(argv[i], "--delay") == 0 && more) o.delay = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--port") == 0 && more) o.port = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--io") == 0 && more) o.io = argv[++i];
+        else if (strcmp(argv[i], "--ws-port") == 0 && more) o.wsPort = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--play") == 0 && more) o.play = argv[++i];
+        else if (strcmp(argv[i], "--from") == 0 && more) o.from = float(atof(argv[++i]));
+        else if (strcmp(argv[i], "--speed") == 0 && more) o.speed = float(atof(argv[++i]));
+        else {
+            printf("usage: %s [--dir DIR] [--seed N] [--ticks N] [--no-fsync] [--bots N] [--record FILE]\n"
+                   "                 [--broadcast HOST:PORT] [--delay SECONDS] [--port N] [--io socket|mmsg|uring]\n"
+                   "                 [--ws-port N]\n"
+                   "       %s --play FILE [--from SECONDS] [--speed X]\n", argv[0], argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+// ----------------- Bots -----------------
+std::vector<DetPlayer> bots;
+
+void spawnBots(int count) {
+    bots.assign(count, DetPlayer());
+    for (int i=0; i<count; ++i) {
+        uint16_t a = uint16_t(i * 40503u);  // golden angle
+        Fix r = fixInt(2 + i % 8);
+        bots[i].pos = { fixCos(a) * r, fixInt(world.cfg.maxStack + 2), fixSin(a) * r };
+    }
+}
+
+// A new heading and button set every second, from a hash of the bot and the second.
+DetInput botInput(int bot, long tick) {
+    uint32_t h = uint32_t(bot) * 2654435761u ^ uint32_t(tick / TICK_HZ) * 40503u;
+    h = (h ^ (h >> 15)) * 2246822519u;
+    h ^= h >> 13;
+    DetInput in;
+    in.yaw = uint16_t(h);
+    in.buttons = uint8_t(DET_FORWARD | ((h >> 16) & 3) << 2 | ((h >> 20) % 5 == 0 ? DET_JUMP : 0));
+    return in;
+}
+
+void stepBots(long tick) {
+    for (int i=0; i<int(bots.size()); ++i) {
+        DetInput in = botInput(i, tick);
+        for (int k=0; k<DET_TICK_HZ / TICK_HZ; ++k) detStep(world, bots[i], in);
+    }
+}
+
+// ----------------- Headless playback -----------------
+int playDemo(const ServerOptions& opt) {
+    DemoReader r;
+    if (!demoOpen(r, opt.play)) return 1;
+    const double hz = r.tickHz;
+    printf("[play] %s: seed %u, %dx%d, %zu keyframes every %.1f s%s\n", opt.play, r.seed, r.world.cfg.gridW,
+           r.world.cfg.gridH, r.keyframes.size(), r.keyframeTicks / hz, r.indexRebuilt ? " (index rebuilt)" : "");
+    if (r.keyframes.empty()) return 1;
+
+    double start = profilerNowMs();
+    uint32_t from = uint32_t(opt.from * hz);
+    if (!demoSeek(r, std::max(from, r.keyframes[0].tick))) {
+        printf("[play] seek failed\n");
+        return 1;
+    }
+    printf("[play] at %.1f s after %llu frames in %.2f ms\n", r.tick / hz, (unsigned long long)r.framesRead,
+           profilerNowMs() - start);
+
+    using clock = std::chrono::steady_clock;
+    auto wallStart = clock::now();
+    uint32_t firstTick = r.tick, reported = r.tick;
+    uint64_t frames0 = r.framesRead, edits = 0;
+    auto countEdits = [](const World&, const WorldEdit&, void* n) { ++*static_cast<uint64_t*>(n); };
+    worldSubscribe(r.world, countEdits, &edits);
+    double playStart = profilerNowMs();
+    while (!stopRequested && demoNext(r)) {
+        if (opt.speed > 0.0f) {
+            auto due = wallStart + std::chrono::microseconds(int64_t((r.tick - firstTick) * 1e6 / (hz * opt.speed)));
+            std::this_thread::sleep_until(due);
+        }
+        if (r.tick - reported < r.tickHz) continue;
+        reported = r.tick;
+        Fix top = fixInt(0), speed2 = fixInt(0);
+        for (const DetPlayer& p : r.players) {
+            top = fixMax(top, p.pos.y);
+            speed2 += p.vel.x * p.vel.x + p.vel.z * p.vel.z;
+        }
+        float meanSpeed = r.players.empty() ? 0.0f : sqrtf(fixToFloat(speed2) / r.players.size());
+        printf("[play] %7.1f s  players %zu  rms speed %.2f  highest %.1f  edited chunks %llu\n", r.tick / hz,
+               r.players.size(), meanSpeed, fixToFloat(top), (unsigned long long)edits);
+        edits = 0;
+    }
+    double ms = profilerNowMs() - playStart, seconds = (r.tick - firstTick) / hz;
+    printf("[play] %.1f s of match in %.2f s (%.1fx), %llu frames\n", seconds, ms * 0.001,
+           ms > 0.0 ? seconds * 1000.0 / ms : 0.0, (unsigned long long)(r.framesRead - frames0));
+    demoClose(r);
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    ServerOptions opt;
+    if (!parseOptions(argc, argv, opt)) return 1;
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+    if (opt.play) return playDemo(opt);
+
+    double start = profilerNowMs();
+    WorldConfig cfg;
+    cfg.chunkSize = worldChooseChunkSize(cfg.gridW, cfg.gridH);
+    worldInit(world, cfg);
+    WorldGenPipeline gen;
+    if (!worldGenerate(world, opt.seed, &gen)) {
+        printf("[server] generated %llu chunks in %.2f ms (%.0f chunks/s):", (unsigned long long)gen.chunks, gen.ms,
+               gen.chunks / (gen.ms * 0.001));
+        for (int l=0; l<GEN_LAYER_COUNT; ++l) printf(" %s %.2f ms", genLayerName(l), gen.stats[l].ms);
+        printf("\n");
+    }
+
+    // recovery: checkpoint regions, then the journal tail on top
+    autosaveInit(opt.dir);
+    int regions = autosaveLoad(world, opt.seed);
+    JournalRecovery rec = journalRecover(opt.dir, opt.seed, world);
+    printf("[server] seed %u: %d checkpoint regions, replayed %llu records (%llu edits, %.1f KiB) "
+           "from %d segments in %.2f ms%s\n", opt.seed, regions, (unsigned long long)rec.records,
+           (unsigned long long)rec.edits, rec.bytes / 1024.0, rec.segments, rec.ms,
+           rec.tornTail ? ", torn tail dropped" : "");
+
+    journal.durable = opt.durable;
+    if (!journalOpen(journal, opt.dir, opt.seed, rec.lastSegment + 1, rec.lastSeq + 1)) return 1;
+    worldSubscribe(world, journalOnEdit, &journal);
+    // fold the replayed tail into a fresh checkpoint right away
+    if (rec.records > 0) startCheckpoint(opt.seed);
+    spawnBots(opt.bots);
+    DemoRecorder recorder, broadcast;
+    if (opt.record && !demoRecordStart(recorder, opt.record, world, opt.seed, TICK_HZ)) return 1;
+    if (opt.broadcast) {
+        sockaddr_in relay;
+        int fd = netParseAddr(opt.broadcast, relay) ? netTcpConnect(relay) : -1;
+        if (fd < 0 || !demoStreamStart(broadcast, fd, world, opt.seed, TICK_HZ, DEMO_KEYFRAME_SECONDS, opt.delay)) {
+            printf("[server] cannot broadcast to %s\n", opt.broadcast);
+            return 1;
+        }
+        printf("[server] broadcasting to %s with a %d s delay\n", opt.broadcast, opt.delay);
+    }
+    SessionServer sessions;
+    if (opt.wsPort >= 0 && opt.port < 0) opt.port = 0;  // sessions need a UDP socket; any port will do
+    if (opt.port >= 0) {
+        SessionConfig sc;
+        sc.io = netFindBackend(opt.io);
+        sc.seed = opt.seed;
+        sc.tickHz = TICK_HZ;
+        sc.bind.sin_family = AF_INET;
+        sc.bind.sin_addr.s_addr = htonl(INADDR_ANY);
+        sc.bind.sin_port = htons(uint16_t(opt.port));
+        sc.webSocket = opt.wsPort >= 0;
+        sc.webSocketBind = sc.bind;
+        sc.webSocketBind.sin_port = htons(uint16_t(std::max(opt.wsPort, 0)));
+        if (!sc.io) {
+            printf("[server] no %s network backend here\n", opt.io);
+            return 1;
+        }
+        if (!sessionOpen(sessions, sc)) return 1;
+        printf("[server] accepting players on UDP port %u (%s)\n", unsigned(netLocalPort(sessions.io.fd)), sc.io->name);
+        if (sc.webSocket) printf("[server] accepting browsers on WebSocket port %u\n",
+                                 unsigned(netLocalPort(sessions.wsListenFd)));
+    }
+    printf("[server] ready after %.2f ms, ticking at %d Hz\n", profilerNowMs() - start, TICK_HZ);
+
+    using clock = std::chrono::steady_clock;
+    const auto tickLength = std::chrono::microseconds(1000000 / TICK_HZ);
+    auto nextTick = clock::now();
+    lastCheckpointMs = profilerNowMs();
+    std::vector<DetPlayer> players;
+    for (long tick=0; !stopRequested && (opt.ticks < 0 || tick < opt.ticks); ++tick) {
+        // (client edit messages are applied to the world here once the protocol carries them)
+        sessionReceive(sessions, world, profilerNowMs());
+        stepBots(tick);
+        sessionStep(sessions, world, DET_TICK_HZ / TICK_HZ);
+        players = bots;
+        sessionPlayers(sessions, players);
+        if (opt.record) demoRecordTick(recorder, world, uint32_t(tick), players.data(), int(players.size()));
+        if (opt.broadcast) demoRecordTick(broadcast, world, uint32_t(tick), players.data(), int(players.size()));
+        sessionSnapshot(sessions, uint32_t(tick), bots.data(), int(bots.size()));
+        sessionTransfer(sessions, world, profilerNowMs());
+
+        // group commit: at most one fsync per tick
+        journalCommit(journal);
+
+        double now = profilerNowMs();
+        if (!checkpoint.active && (now - lastCheckpointMs >= CHECKPOINT_INTERVAL_MS ||
+                                   journal.segmentBytes >= CHECKPOINT_JOURNAL_BYTES)) {
+            lastCheckpointMs = now;
+            startCheckpoint(opt.seed);
+        }
+        finishCheckpoint();
+
+        nextTick += tickLength;
+        std::this_thread::sleep_until(nextTick);
+    }
+
+    if (opt.record) {
+        bool ok = demoRecordStop(recorder);
+        const DemoRecordStats& d = recorder.stats;
+        printf("[server] recording %s: %llu frames (%llu keyframes), %.1f KiB, capture %.3f ms avg "
+               "%.3f max, encode %.2f ms off the tick%s\n", ok ? "saved" : "FAILED", (unsigned long long)d.frames,
+               (unsigned long long)d.keyframes, d.bytes / 1024.0, d.captureMs / std::max<uint64_t>(d.captures, 1),
+               d.maxCaptureMs, d.encodeMs, d.coalesced ? ", worker fell behind and dropped ticks"
+                                           : d.maxQueued > 1 ? ", worker fell behind" : "");
+    }
+    if (opt.broadcast) {
+        bool ok = demoRecordStop(broadcast);
+        printf("[server] broadcast %s: %llu frames, %.1f KiB\n", ok ? "finished" : "FAILED (relay went away)",
+               (unsigned long long)broadcast.stats.frames, broadcast.stats.bytes / 1024.0);
+    }
+
+    if (opt.port >= 0) {
+        const SessionStats& st = sessions.stats;
+        const NetIoStats& io = sessions.io.stats;
+        printf("[server] sessions: %llu joins (%llu challenged), %llu left, %llu timed out, %llu refused; %llu inputs "
+               "in %llu datagrams over %llu receive calls, %llu sent over %llu send calls\n",
+               (unsigned long long)st.joins, (unsigned long long)st.challenges, (unsigned long long)st.leaves,
+               (unsigned long long)st.timeouts, (unsigned long long)st.refused, (unsigned long long)st.inputs,
+               (unsigned long long)io.received,
+               (unsigned long long)io.recvCalls, (unsigned long long)io.sent, (unsigned long long)io.sendCalls);
+        if (st.moveChecks > 0) {
+            printf("[server] movement: %llu claims checked, %llu flagged, %.1f ns per claim\n",
+                   (unsigned long long)st.moveChecks, (unsigned long long)st.moveFlagged,
+                   st.moveCheckMs * 1e6 / st.moveChecks);
+        }
+        if (st.transfers > 0) {
+            printf("[server] world transfers: %llu of %llu finished in %.0f ms avg, %llu chunks in %llu messages "
+                   "(%.1f KiB, %llu resent)\n", (unsigned long long)st.transfersDone, (unsigned long long)st.transfers,
+                   st.transferMs / std::max<uint64_t>(st.transfersDone, 1), (unsigned long long)st.transferChunks,
+                   (unsigned long long)st.transferMessages, st.transferBytes / 1024.0,
+                   (unsigned long long)st.transferResent);
+        }
+        if (opt.wsPort >= 0) {
+            printf("[server] websocket: %llu connections, %llu messages in, %.1f KiB out in %llu writes\n",
+                   (unsigned long long)st.wsConnections, (unsigned long long)st.wsMessages, st.wsBytesSent / 1024.0,
+                   (unsigned long long)st.wsWrites);
+        }
+        sessionClose(sessions);
+    }
+
+    // clean shutdown: everything into the regions, nothing left to replay
+    startCheckpoint(opt.seed);
+    autosaveFlush();
+    finishCheckpoint();
+    journalClose(journal);
+    if (!checkpoint.active) journalDropSegments(journal, journal.segment);
+    else printf("[server] final checkpoint failed, keeping the journal for the next start\n");
+    printf("[server] stopped: %llu edits in %llu commits this run\n",
+           (unsigned long long)journal.editsLogged, (unsigned long long)journal.commits);
+    return 0;
+}
@@ -0,0 +1,681 @@
+#include "session.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <unistd.h>
+
+namespace {
+
+uint64_t connKey(int fd) {
+    return 1ull << 63 | uint32_t(fd);
+}
+
+// Clients start on a ring around the origin above the tallest column, like the server's bots.
+DetPlayer spawnPlayer(const World& w, uint16_t id) {
+    DetPlayer p;
+    uint16_t a = uint16_t(id * 40503u);
+    Fix r = fixInt(3 + id % 8);
+    p.pos = { fixCos(a) * r, fixInt(w.cfg.maxStack + 2), fixSin(a) * r };
+    return p;
+}
+
+// A WebSocket client's connection is only marked here and closed by closeConnections(), so
+// nothing that is still reading from it loses its buffer.
+void dropClient(SessionServer& s, int i, const char* why) {
+    SessionSlot& c = s.clients[i];
+    if (s.cfg.verbose) printf("[session] player %u at %s%s %s\n", unsigned(c.id), netAddrString(c.addr),
+                              c.conn >= 0 ? " (websocket)" : "", why);
+    if (c.conn >= 0) s.closing.push_back(c.conn);
+    s.byAddr.erase(c.conn >= 0 ? connKey(c.conn) : netAddrKey(c.addr));
+    if (i != int(s.clients.size()) - 1) {
+        s.clients[i] = std::move(s.clients.back());
+        const SessionSlot& moved = s.clients[i];
+        s.byAddr[moved.conn >= 0 ? connKey(moved.conn) : netAddrKey(moved.addr)] = i;
+    }
+    s.clients.pop_back();
+}
+
+void closeConnections(SessionServer& s) {
+    while (!s.closing.empty()) {
+        int fd = s.closing.back();
+        s.closing.pop_back();
+        auto it = s.conns.find(fd);
+        if (it == s.conns.end()) continue;
+        auto client = s.byAddr.find(connKey(fd));
+        if (client != s.byAddr.end()) {
+            ++s.stats.leaves;
+            dropClient(s, client->second, "disconnected");
+        }
+        close(fd);
+        s.conns.erase(it);
+        s.connOpenedMs.erase(fd);
+    }
+}
+
+// The chunks go out nearest the spawn first, so the player stands on real ground long before
+// the far side of the map has arrived.
+void startTransfer(SessionServer& s, const World& w, SessionSlot& c, double nowMs) {
+    c.transferring = true;
+    c.joinMs = nowMs;
+    transferOrder(w, worldToGridX(w, fixToFloat(c.player.pos.x)), worldToGridZ(w, fixToFloat(c.player.pos.z)), c.order);
+    c.next = 0;
+    c.seq = uint16_t(std::random_device()());
+    c.verified = c.conn >= 0;  // the TCP handshake already proved the address
+    c.unverifiedSends = 0;
+    c.flights.assign(std::max(s.cfg.transferWindow, 1), SessionFlight());
+    ++s.stats.transfers;
+}
+
+size_t handleJoin(SessionServer& s, const World& w, uint64_t key, const sockaddr_in& addr, int conn,
+                  bool wantsWorld, uint8_t* reply, double nowMs) {
+    auto it = s.byAddr.find(key);
+    int i = it != s.byAddr.end() ? it->second : -1;
+    if (i < 0 && int(s.clients.size()) >= s.cfg.maxClients) {
+        ++s.stats.refused;
+        reply[0] = SESSION_FULL;
+        return 1;
+    }
+    if (i < 0) {
+        // ids in use are at most maxClients below SESSION_BOT_ID, so a free one is near
+        uint16_t id = s.nextId;
+        auto used = [&](uint16_t c) {
+            for (const SessionSlot& slot : s.clients) if (slot.id == c) return true;
+            return false;
+        };
+        while (id == 0 || id >= SESSION_BOT_ID || used(id)) id = id >= SESSION_BOT_ID - 1 ? 1 : id + 1;
+        s.nextId = uint16_t(id + 1);
+        i = int(s.clients.size());
+        SessionSlot slot;
+        slot.addr = addr;
+        slot.conn = conn;
+        slot.id = id;
+        slot.player = spawnPlayer(w, id);
+        slot.lastHeardMs = nowMs;
+        s.clients.push_back(std::move(slot));
+        s.byAddr[key] = i;
+        if (wantsWorld && w.cfg.chunkSize <= SESSION_MAX_CHUNK_SIZE) {
+            s.clients[i].wantsWorld = true;
+            startTransfer(s, w, s.clients[i], nowMs);
+        }
+        ++s.stats.joins;
+        if (s.cfg.verbose) printf("[session] player %u joined from %s%s (%zu playing)\n", unsigned(id),
+                                  netAddrString(addr), conn >= 0 ? " (websocket)" : "", s.clients.size());
+    }
+    // a repeated join (the welcome got lost) is answered again
+    SessionSlot& c = s.clients[i];
+    c.lastHeardMs = nowMs;
+    size_t n = sessionWriteWelcome(reply, c.id, s.cfg.seed, uint16_t(s.cfg.tickHz));
+    return c.wantsWorld ? sessionWriteWelcomeWorld(reply, w.cfg) : n;
+}
+
+void handleAcks(SessionSlot& c, const uint8_t* data, size_t size) {
+    int count = size >= 2 ? data[1] : 0;
+    if (!c.transferring || size < 2 + 2 * size_t(count)) return;
+    for (int k=0; k<count; ++k) {
+        uint16_t seq = sessionGetU16(data + 2 + 2*k);
+        SessionFlight& f = c.flights[seq % c.flights.size()];
+        if (!f.live || f.seq != seq) continue;  // a late duplicate
+        f.live = false;
+        --c.inFlight;
+        c.verified = true;
+    }
+}
+
+// One client message, from either transport. A reply (welcome or full) is written to reply,
+// which may be the message's own buffer; returns its size, 0 for none.
+size_t handleMessage(SessionServer& s, const World& w, uint64_t key, const sockaddr_in& addr, int conn,
+                     const uint8_t* data, size_t size, uint8_t* reply, double nowMs) {
+    if (size == 0) {
+        ++s.stats.malformed;
+        return 0;
+    }
+    if (data[0] == SESSION_JOIN) {
+        bool wantsWorld = size >= 2 && (data[1] & SESSION_JOIN_WORLD);
+        if (conn < 0) {
+            // a datagram's source is only a claim: it gets a slot once it echoes the cookie sent there
+            if (size < size_t(SESSION_JOIN_BYTES)) {
+                ++s.stats.malformed;
+                return 0;
+            }
+            if (!netCookieValid(s.cookieKey, addr, sessionGetU32(data + 2), nowMs)) {
+                ++s.stats.challenges;
+                reply[0] = SESSION_CHALLENGE;
+                sessionPutU32(reply + 1, netCookie(s.cookieKey, addr, nowMs));
+                return SESSION_CHALLENGE_BYTES;
+            }
+        }
+        return handleJoin(s, w, key, addr, conn, wantsWorld, reply, nowMs);
+    }
+    auto it = s.byAddr.find(key);
+    if (it == s.byAddr.end()) return 0;  // not (or no longer) a client
+    SessionSlot& c = s.clients[it->second];
+    c.lastHeardMs = nowMs;
+    uint32_t tick;
+    DetInput in;
+    if (data[0] == SESSION_LEAVE) {
+        ++s.stats.leaves;
+        dropClient(s, it->second, "left");
+    } else if (data[0] == SESSION_CHUNK_ACK) {
+        handleAcks(c, data, size);
+    } else if (sessionReadInput(data, size, &tick, &in)) {
+        if (int32_t(tick - c.inputTick) < 0) {
+            ++s.stats.stale;  // reordered on the way
+            return 0;
+        }
+        c.inputTick = tick;
+        c.input = in;
+        ++s.stats.inputs;
+        FixVec3 claim;
+        if (sessionReadClaim(data, size, &claim)) {
+            if (!c.movesItself) {
+                // checked as one tick from where the server had the player, like any later claim
+                c.movesItself = true;
+                c.checkedTick = tick - 1;
+                c.checkedServerTick = s.ticks;
+            }
+            c.claim = claim;
+            c.claimTick = tick;
+        }
+    } else {
+        ++s.stats.malformed;
+    }
+    return 0;
+}
+
+void receiveDatagrams(SessionServer& s, const World& w, double nowMs) {
+    while (netIoReceive(s.io) > 0) {
+        for (NetPacket* p : s.io.received) {
+            // a reply is written over the message and the buffer goes back where it came from
+            size_t n = handleMessage(s, w, netAddrKey(p->addr), p->addr, -1, p->data, p->size, p->data, nowMs);
+            if (n == 0) {
+                netIoRelease(s.io, p);
+                continue;
+            }
+            p->size = uint32_t(n);
+            netIoSendPacket(s.io, p);
+        }
+    }
+    netIoFlush(s.io);
+}
+
+// Returns false when the connection has to go.
+bool readConnection(SessionServer& s, const World& w, WsConn& c, double nowMs) {
+    bool alive = wsReceive(c);
+    if (!c.open) {
+        int r = wsServerHandshake(c);
+        if (r <= 0) return r == 0 && alive;
+    }
+    sockaddr_in addr = {};
+    socklen_t len = sizeof(addr);
+    getpeername(c.fd, reinterpret_cast<sockaddr*>(&addr), &len);
+    size_t pos = 0;
+    WsMessage m;
+    int r;
+    // what came before a close is still taken
+    bool keep = true;
+    while (keep && (r = wsNextMessage(c, &pos, true, m)) != 0) {
+        if (r < 0) {
+            keep = false;
+        } else if (m.opcode == WS_BINARY) {
+            ++s.stats.wsMessages;
+            uint8_t reply[SESSION_WELCOME_WORLD_BYTES];
+            size_t n = handleMessage(s, w, connKey(c.fd), addr, c.fd, m.data, m.size, reply, nowMs);
+            if (n > 0) keep = wsSend(c, WS_BINARY, reply, n);
+        } else if (m.opcode == WS_PING) {
+            keep = wsSend(c, WS_PONG, m.data, m.size);
+        } else if (m.opcode == WS_CLOSE) {
+            wsSend(c, WS_CLOSE, m.data, std::min<size_t>(m.size, 2));
+            keep = false;
+        }
+    }
+    wsConsume(c, pos);
+    return wsFlush(c) && keep && alive;
+}
+
+void receiveConnections(SessionServer& s, const World& w, double nowMs) {
+    for (int fd; (fd = netAccept(s.wsListenFd)) >= 0; ) {
+        WsConn& c = s.conns[fd];
+        c.fd = fd;
+        s.connOpenedMs[fd] = nowMs;
+        ++s.stats.wsConnections;
+    }
+    for (auto& entry : s.conns) {
+        if (!readConnection(s, w, entry.second, nowMs)) {
+            s.closing.push_back(entry.first);
+        } else if (!s.byAddr.count(connKey(entry.first)) && nowMs - s.connOpenedMs[entry.first] >= s.cfg.timeoutMs) {
+            // never upgraded or never joined: it would hold its descriptor for good
+            ++s.stats.timeouts;
+            s.closing.push_back(entry.first);
+        }
+    }
+    closeConnections(s);
+}
+
+} // namespace
+
+bool sessionOpen(SessionServer& s, const SessionConfig& cfg) {
+    s.cfg = cfg;
+    const NetIoBackend& backend = cfg.io ? *cfg.io : netMmsgBackend();
+    if (!netIoOpen(s.io, cfg.bind, backend)) return false;
+    if (cfg.webSocket) {
+        s.wsListenFd = netTcpListen(cfg.webSocketBind);
+        if (s.wsListenFd < 0) {
+            netIoClose(s.io);
+            return false;
+        }
+    }
+    s.clients.clear();
+    s.byAddr.clear();
+    s.cookieKey = netCookieKey();
+    s.stats = SessionStats();
+    return true;
+}
+
+void sessionClose(SessionServer& s) {
+    netIoClose(s.io);
+    for (auto& entry : s.conns) close(entry.first);
+    s.conns.clear();
+    s.connOpenedMs.clear();
+    if (s.wsListenFd >= 0) close(s.wsListenFd);
+    s.wsListenFd = -1;
+    s.clients.clear();
+    s.byAddr.clear();
+}
+
+void sessionReceive(SessionServer& s, const World& w, double nowMs) {
+    if (s.io.fd < 0) return;
+    double start = profilerNowMs();
+    receiveDatagrams(s, w, nowMs);
+    if (s.wsListenFd >= 0) receiveConnections(s, w, nowMs);
+    for (int i=int(s.clients.size())-1; i>=0; --i) {
+        if (nowMs - s.clients[i].lastHeardMs < s.cfg.timeoutMs) continue;
+        ++s.stats.timeouts;
+        dropClient(s, i, "timed out");
+    }
+    closeConnections(s);
+    s.stats.receiveMs += profilerNowMs() - start;
+}
+
+void sessionStep(SessionServer& s, const World& w, int steps) {
+    const uint32_t maxTicks = 8;  // a claim after a longer silence is checked as if this long
+    double start = profilerNowMs();
+    ++s.ticks;
+    // A claim moves the player by the client's ticks since the last check, but at most by the
+    // server ticks not yet spent on claims: a client counting its ticks fast gets no further.
+    // Ticks without a claim stay banked, so a late claim can catch up.
+    auto claimTicks = [&](const SessionSlot& c) {
+        uint32_t banked = std::min(s.ticks - c.checkedServerTick, maxTicks);
+        return std::min(c.claimTick - c.checkedTick, banked);
+    };
+    s.moveLanes.clear();
+    for (int i=0; i<int(s.clients.size()); ++i) {
+        SessionSlot& c = s.clients[i];
+        if (!c.movesItself) {
+            for (int k=0; k<steps; ++k) detStep(w, c.player, c.input);
+        } else if (c.claimTick != c.checkedTick) {
+            s.moveLanes.push_back(i);
+        }
+    }
+    if (!s.moveLanes.empty()) {
+        double checkStart = profilerNowMs();
+        moveBatchResize(s.moves, int(s.moveLanes.size()));
+        for (int k=0; k<s.moves.count; ++k) {
+            const SessionSlot& c = s.clients[s.moveLanes[k]];
+            moveSetLane(s.moves, k, c.player, c.moveDebt, c.input, int(claimTicks(c)) * steps, c.claim);
+        }
+        s.stats.moveFlagged += moveCheck(w, s.moves, s.cfg.moveRules);
+        for (int k=0; k<s.moves.count; ++k) {
+            SessionSlot& c = s.clients[s.moveLanes[k]];
+            moveGetLane(s.moves, k, c.player, &c.moveDebt);
+            uint32_t banked = std::min(s.ticks - c.checkedServerTick, maxTicks), used = claimTicks(c);
+            c.checkedServerTick = s.ticks - (banked - used);
+            c.checkedTick = c.claimTick;
+            c.flagged += s.moves.flags[k] != MOVE_OK;
+        }
+        s.stats.moveChecks += s.moves.count;
+        s.stats.moveCheckMs += profilerNowMs() - checkStart;
+    }
+    s.stats.stepMs += profilerNowMs() - start;
+}
+
+void sessionSnapshot(SessionServer& s, uint32_t tick, const DetPlayer* bots, int botCount) {
+    if (s.io.fd < 0 || s.clients.empty()) return;
+    double start = profilerNowMs();
+    int total = int(s.clients.size()) + botCount;
+    int parts = std::max(1, (total + SESSION_PLAYERS_PER_PART - 1) / SESSION_PLAYERS_PER_PART);
+    s.snapshot.resize(size_t(parts) * SESSION_MAX_MESSAGE);
+    s.partSizes.resize(parts);
+    for (int part=0, next=0; part<parts; ++part) {
+        uint8_t* base = &s.snapshot[size_t(part) * SESSION_MAX_MESSAGE];
+        int count = std::min(SESSION_PLAYERS_PER_PART, total - next);
+        base[0] = SESSION_SNAPSHOT;
+        sessionPutU32(base + 1, tick);
+        base[5] = uint8_t(part);
+        base[6] = uint8_t(parts);
+        sessionPutU16(base + 7, uint16_t(count));
+        uint8_t* out = base + SESSION_SNAPSHOT_HEADER_BYTES;
+        for (int k=0; k<count; ++k, ++next) {
+            int bot = next - int(s.clients.size());
+            out = bot < 0 ? sessionWritePlayer(out, s.clients[next].id, s.clients[next].player)
+                          : sessionWritePlayer(out, uint16_t(SESSION_BOT_ID + bot), bots[bot]);
+        }
+        s.partSizes[part] = uint16_t(out - base);
+    }
+
+    // browsers: a frame header in front of each part, the whole tick in one sendmsg()
+    bool anyWebSocket = false;
+    for (const SessionSlot& c : s.clients) anyWebSocket = anyWebSocket || c.conn >= 0;
+    size_t wsBytes = 0;
+    if (anyWebSocket) {
+        s.wsHeaders.resize(size_t(parts) * WS_MAX_FRAME_HEADER);
+        s.wsIov.resize(size_t(parts) * 2);
+        for (int part=0; part<parts; ++part) {
+            uint8_t* header = &s.wsHeaders[size_t(part) * WS_MAX_FRAME_HEADER];
+            size_t n = wsFrameHeader(header, WS_BINARY, s.partSizes[part]);
+            s.wsIov[2*part] = { header, n };
+            s.wsIov[2*part + 1] = { &s.snapshot[size_t(part) * SESSION_MAX_MESSAGE], s.partSizes[part] };
+            wsBytes += n + s.partSizes[part];
+        }
+    }
+    // the same bytes for everyone; they stay put until the flush below
+    for (int i=int(s.clients.size())-1; i>=0; --i) {
+        const SessionSlot& c = s.clients[i];
+        if (c.conn < 0) {
+            for (int part=0; part<parts; ++part) {
+                netIoSend(s.io, &s.snapshot[size_t(part) * SESSION_MAX_MESSAGE], s.partSizes[part], c.addr);
+            }
+            continue;
+        }
+        ++s.stats.wsWrites;
+        s.stats.wsBytesSent += wsBytes;
+        if (wsSendv(s.conns[c.conn], s.wsIov.data(), int(s.wsIov.size()))) continue;
+        ++s.stats.behind;
+        dropClient(s, i, "fell behind");
+    }
+    netIoFlush(s.io);
+    closeConnections(s);
+    s.stats.snapshotMs += profilerNowMs() - start;
+}
+
+namespace {
+
+// Packs the client's next chunks (lost ones first) behind a SESSION_CHUNKS header; returns the
+// message size, 0 if there is nothing left to send.
+size_t packChunks(SessionServer& s, const World& w, SessionSlot& c, SessionFlight& f, uint8_t* out) {
+    size_t size = SESSION_CHUNKS_HEADER_BYTES;
+    f.chunks.clear();
+    while (f.chunks.size() < 255) {
+        bool lost = !c.resend.empty();
+        if (!lost && c.next == c.order.size()) break;
+        uint32_t chunk = lost ? c.resend.back() : c.order[c.next];
+        const std::vector<uint8_t>& code = transferChunkCode(s.transferCache, w, chunk);
+        if (size + code.size() > size_t(SESSION_MAX_MESSAGE)) break;
+        memcpy(out + size, code.data(), code.size());
+        size += code.size();
+        f.chunks.push_back(chunk);
+        if (lost) c.resend.pop_back();
+        else ++c.next;
+    }
+    if (f.chunks.empty()) return 0;
+    out[0] = SESSION_CHUNKS;
+    sessionPutU16(out + 1, c.seq);
+    out[3] = uint8_t(f.chunks.size());
+    return size;
+}
+
+// Returns false if a WebSocket client fell behind.
+bool transferTo(SessionServer& s, const World& w, SessionSlot& c, double nowMs) {
+    const int maxBackoff = 5;  // unverified resends wait at most 32 x transferResendMs
+    double resendMs = s.cfg.transferResendMs;
+    if (!c.verified) resendMs *= double(1 << std::min(std::max(c.unverifiedSends - 1, 0), maxBackoff));
+    for (SessionFlight& f : c.flights) {
+        if (!f.live || nowMs - f.sentMs < resendMs) continue;
+        f.live = false;
+        --c.inFlight;
+        c.resend.insert(c.resend.end(), f.chunks.rbegin(), f.chunks.rend());
+        s.stats.transferResent += f.chunks.size();
+    }
+    for (;;) {
+        SessionFlight& f = c.flights[c.seq % c.flights.size()];
+        if (f.live || (!c.verified && c.inFlight > 0)) break;  // the window is full
+        size_t size;
+        if (c.conn >= 0) {
+            s.transferScratch.resize(SESSION_MAX_MESSAGE);
+            size = packChunks(s, w, c, f, s.transferScratch.data());
+            if (size > 0 && !wsSend(s.conns[c.conn], WS_BINARY, s.transferScratch.data(), size)) return false;
+        } else {
+            NetPacket* p = netIoAlloc(s.io);
+            if (!p) {
+                netIoFlush(s.io);
+                p = netIoAlloc(s.io);
+                if (!p) break;
+            }
+            size = packChunks(s, w, c, f, p->data);
+            if (size == 0) {
+                netIoRelease(s.io, p);
+            } else {
+                p->size = uint32_t(size);
+                p->addr = c.addr;
+                netIoSendPacket(s.io, p);
+            }
+        }
+        if (size == 0) break;
+        f.seq = c.seq++;
+        f.live = true;
+        f.sentMs = nowMs;
+        ++c.inFlight;
+        if (!c.verified) ++c.unverifiedSends;
+        ++s.stats.transferMessages;
+        s.stats.transferChunks += f.chunks.size();
+        s.stats.transferBytes += size;
+    }
+    if (c.inFlight == 0 && c.resend.empty() && c.next == c.order.size()) {
+        c.transferring = false;
+        ++s.stats.transfersDone;
+        s.stats.transferMs += nowMs - c.joinMs;
+        std::vector<uint32_t>().swap(c.order);
+        std::vector<SessionFlight>().swap(c.flights);
+    }
+    return true;
+}
+
+} // namespace
+
+void sessionTransfer(SessionServer& s, const World& w, double nowMs) {
+    if (s.io.fd < 0) return;
+    for (int i=int(s.clients.size())-1; i>=0; --i) {
+        if (!s.clients[i].transferring || transferTo(s, w, s.clients[i], nowMs)) continue;
+        ++s.stats.behind;
+        dropClient(s, i, "fell behind");
+    }
+    netIoFlush(s.io);
+    closeConnections(s);
+}
+
+void sessionPlayers(const SessionServer& s, std::vector<DetPlayer>& out) {
+    for (const SessionSlot& c : s.clients) out.push_back(c.player);
+}
+
+// ----------------- Client -----------------
+namespace {
+
+void sendMessage(SessionClient& c, const uint8_t* data, size_t size) {
+    if (c.webSocket) {
+        if (!wsClientSend(c.ws, WS_BINARY, data, size)) c.lost = true;
+        return;
+    }
+    send(c.fd, data, size, 0);
+}
+
+void takeSnapshot(SessionClient& c, const uint8_t* data, size_t size) {
+    uint32_t tick;
+    int count;
+    if (!sessionReadSnapshot(data, size, &tick, &count)) return;
+    if (c.snapshots > 0 && int32_t(tick - c.tick) < 0) return;  // older than what we show
+    if (c.snapshots == 0 || tick != c.tick) c.players.clear();
+    c.tick = tick;
+    ++c.snapshots;
+    const uint8_t* in = data + SESSION_SNAPSHOT_HEADER_BYTES;
+    for (int k=0; k<count; ++k) {
+        SessionPlayerState ps;
+        in = sessionReadPlayer(in, &ps.id, &ps.player);
+        c.players.push_back(ps);
+    }
+}
+
+// Returns whether it was a snapshot part.
+void sendJoin(SessionClient& c) {
+    uint8_t join[SESSION_JOIN_BYTES] = { SESSION_JOIN, uint8_t(c.wantsWorld ? SESSION_JOIN_WORLD : 0) };
+    sessionPutU32(join + 2, c.cookie);
+    sendMessage(c, join, sizeof(join));
+}
+
+bool takeMessage(SessionClient& c, const uint8_t* data, size_t size) {
+    ++c.messages;
+    if (size >= size_t(SESSION_WELCOME_BYTES) && data[0] == SESSION_WELCOME) {
+        WorldConfig cfg;
+        // the world starts empty with the first welcome; a repeated one changes nothing
+        if (c.wantsWorld && !c.joined && sessionReadWelcomeWorld(data, size, &cfg)) {
+            worldInit(c.world, cfg);
+            transferReset(c.world, c.transfer, false);
+        }
+        c.id = sessionGetU16(data + 1);
+        c.seed = sessionGetU32(data + 3);
+        c.tickHz = sessionGetU16(data + 7);
+        c.joined = true;
+    } else if (size >= 1 && data[0] == SESSION_CHUNKS && c.joined) {
+        uint16_t seq;
+        if (transferApply(c.world, c.transfer, data, size, &seq)) c.acks.push_back(seq);
+    } else if (size >= size_t(SESSION_CHALLENGE_BYTES) && data[0] == SESSION_CHALLENGE && !c.joined) {
+        c.cookie = sessionGetU32(data + 1);
+        sendJoin(c);
+    } else if (size >= 1 && data[0] == SESSION_FULL) {
+        c.refused = true;
+    } else if (size >= 1 && data[0] == SESSION_SNAPSHOT && c.joined) {
+        takeSnapshot(c, data, size);
+        return true;
+    }
+    return false;
+}
+
+void sendAcks(SessionClient& c) {
+    uint8_t msg[2 + 2 * SESSION_MAX_ACKS];
+    for (size_t k=0; k<c.acks.size(); k += SESSION_MAX_ACKS) {
+        int count = int(std::min<size_t>(c.acks.size() - k, SESSION_MAX_ACKS));
+        msg[0] = SESSION_CHUNK_ACK;
+        msg[1] = uint8_t(count);
+        for (int i=0; i<count; ++i) sessionPutU16(msg + 2 + 2*i, c.acks[k + i]);
+        sendMessage(c, msg, 2 + 2 * size_t(count));
+    }
+    c.acks.clear();
+}
+
+} // namespace
+
+bool sessionClientOpen(SessionClient& c, const sockaddr_in& server) {
+    sockaddr_in any = {};
+    any.sin_family = AF_INET;
+    any.sin_addr.s_addr = htonl(INADDR_ANY);
+    c.fd = netUdpOpen(any);
+    if (c.fd < 0) return false;
+    // connected, so the kernel drops datagrams from anyone but the server: a forged welcome
+    // or world chunk would otherwise reach worldInit() and transferApply()
+    if (connect(c.fd, reinterpret_cast<const sockaddr*>(&server), sizeof(server)) != 0) {
+        printf("[session] cannot connect to %s: %s\n", netAddrString(server), strerror(errno));
+        close(c.fd);
+        c.fd = -1;
+        return false;
+    }
+    c.webSocket = false;
+    c.server = server;
+    c.joined = c.refused = c.lost = false;
+    c.snapshots = c.messages = 0;
+    c.players.clear();
+    c.acks.clear();
+    c.lastJoinMs = -1e9;
+    c.cookie = 0;
+    return true;
+}
+
+bool sessionClientOpenWebSocket(SessionClient& c, const sockaddr_in& server) {
+    c.fd = netTcpConnect(server);
+    if (c.fd < 0) return false;
+    c.ws = WsConn();
+    c.ws.fd = c.fd;
+    c.ws.maskState ^= uint32_t(c.fd) * 2654435761u;
+    netSetNonBlocking(c.fd);
+    if (!wsClientStartHandshake(c.ws, netAddrString(server), "/")) {
+        close(c.fd);
+        c.fd = -1;
+        return false;
+    }
+    c.webSocket = true;
+    c.server = server;
+    c.joined = c.refused = c.lost = false;
+    c.snapshots = c.messages = 0;
+    c.players.clear();
+    c.acks.clear();
+    c.lastJoinMs = -1e9;
+    c.cookie = 0;
+    return true;
+}
+
+void sessionClientClose(SessionClient& c) {
+    if (c.fd < 0) return;
+    if (c.joined && !c.lost) {
+        uint8_t leave = SESSION_LEAVE;
+        sendMessage(c, &leave, 1);
+        if (c.webSocket) wsFlush(c.ws);
+    }
+    close(c.fd);
+    c.fd = -1;
+}
+
+void sessionClientSendInput(SessionClient& c, uint32_t tick, const DetInput& in, const FixVec3* claim) {
+    if (!c.joined || c.lost) return;
+    uint8_t msg[SESSION_INPUT_CLAIM_BYTES];
+    size_t n = sessionWriteInput(msg, tick, in);
+    if (claim) n = sessionWriteClaim(msg, *claim);
+    sendMessage(c, msg, n);
+}
+
+int sessionClientPump(SessionClient& c, double nowMs) {
+    if (c.lost) return 0;
+    if (c.webSocket && !c.ws.open) {
+        int r = wsReceive(c.ws) ? wsClientFinishHandshake(c.ws) : -1;
+        if (r < 0) c.lost = true;
+        if (r <= 0) return 0;
+    }
+    if (!c.joined && !c.refused && nowMs - c.lastJoinMs >= SESSION_JOIN_RETRY_MS) {
+        sendJoin(c);
+        c.lastJoinMs = nowMs;
+    }
+    int taken = 0;
+    if (c.webSocket) {
+        bool alive = wsReceive(c.ws);
+        size_t pos = 0;
+        WsMessage m;
+        int r;
+        while ((r = wsNextMessage(c.ws, &pos, false, m)) == 1) {
+            if (m.opcode == WS_BINARY) taken += takeMessage(c, m.data, m.size);
+            else if (m.opcode == WS_CLOSE) alive = false;
+        }
+        wsConsume(c.ws, pos);
+        sendAcks(c);
+        if (!alive || r < 0 || !wsFlush(c.ws)) c.lost = true;
+        return taken;
+    }
+    uint8_t buf[NET_MAX_DATAGRAM + 64];
+    for (;;) {
+        ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        taken += takeMessage(c, buf, size_t(n));
+    }
+    sendAcks(c);
+    return taken;
+}
@@ -0,0 +1,186 @@
+// Player sessions for the dedicated server (native only).
+//
+// Clients join, then send their input every tick; the server steps each client's player with
+// the lockstep physics (det_physics.h) and answers with one snapshot of every player per tick
+// (messages: session_protocol.h). Native clients use UDP, browsers WebSocket (ws.h); both are
+// the same clients to the rest of the server.
+//
+// UDP runs on a NetIo (net_io.h): a tick's datagrams arrive a batch at a time in pool buffers
+// and are parsed where they landed, a join is answered by rewriting its own buffer into the
+// welcome, and the snapshot is encoded once and the same bytes queued for every client.
+// WebSocket messages are parsed in the connection's read buffer, and the snapshot goes out to
+// each browser as one sendmsg() of frame headers around those same bytes.
+//
+// A datagram's source address proves nothing, so a UDP join gets a slot only when it echoes
+// the cookie (net.h) of a SESSION_CHALLENGE sent to that address; the challenge is smaller
+// than the join and the server keeps no state for it. Forged joins fill no slots and draw no
+// snapshots. A WebSocket's TCP handshake already proved its address.
+//
+// Clients that ask for it get the world streamed after the welcome (world_transfer.h): up to
+// transferWindow SESSION_CHUNKS messages in flight per client, each resent if its
+// acknowledgement has not come back after transferResendMs. The window opens only once the
+// first message is acknowledged; a client that stops listening after its join gets one
+// message, resent with doubling waits, instead of the world.
+//
+// Clients that move themselves send where they ended up with each input instead of being
+// stepped by the server; sessionStep() checks all of their claims as one SIMD batch against
+// the movement rules (move_check.h) and pulls back the ones that went too far. The first claim
+// is checked from where the server had the player too, so such a client takes its place from a
+// snapshot before it claims anything.
+#pragma once
+
+#include "move_check.h"
+#include "net_io.h"
+#include "session_protocol.h"
+#include "world_transfer.h"
+#include "ws.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+static_assert(SESSION_MAX_MESSAGE <= NET_MAX_DATAGRAM, "session messages must fit a datagram");
+
+struct SessionConfig {
+    sockaddr_in bind = {};             // UDP
+    const NetIoBackend* io = nullptr;  // nullptr: mmsg
+    bool webSocket = false;            // also accept browsers
+    sockaddr_in webSocketBind = {};    // TCP
+    uint32_t seed = 0;
+    int tickHz = 30;
+    int maxClients = 1024;
+    double timeoutMs = 5000.0;  // clients that stay silent this long are dropped, connections that
+                                // have not joined by then closed
+    int transferWindow = 64;    // SESSION_CHUNKS messages in flight per client
+    double transferResendMs = 250.0;
+    MoveRules moveRules;
+    bool verbose = true;        // log joins and leaves
+};
+
+struct SessionStats {
+    uint64_t joins = 0, leaves = 0, timeouts = 0, refused = 0, behind = 0;
+    uint64_t challenges = 0;      // UDP joins answered with a cookie instead of a slot
+    uint64_t inputs = 0, stale = 0, malformed = 0;
+    uint64_t wsConnections = 0, wsMessages = 0, wsBytesSent = 0, wsWrites = 0;
+    uint64_t transfers = 0, transfersDone = 0, transferMessages = 0, transferChunks = 0, transferBytes = 0;
+    uint64_t transferResent = 0;  // chunks sent again after a lost message or acknowledgement
+    double transferMs = 0.0;      // summed join-to-last-chunk time of the finished transfers
+    uint64_t moveChecks = 0, moveFlagged = 0;
+    double moveCheckMs = 0.0;
+    double receiveMs = 0.0, stepMs = 0.0, snapshotMs = 0.0;  // datagram counts are in SessionServer::io.stats
+};
+
+// A SESSION_CHUNKS message waiting for its acknowledgement.
+struct SessionFlight {
+    uint16_t seq;
+    bool live = false;
+    double sentMs;
+    std::vector<uint32_t> chunks;
+};
+
+struct SessionSlot {
+    sockaddr_in addr = {};
+    int conn = -1;             // WebSocket connection (its fd), -1 for UDP
+    uint16_t id = 0;
+    DetPlayer player;
+    DetInput input;            // latest, applied every tick until the next one arrives
+    uint32_t inputTick = 0;    // client tick of that input; older ones are ignored
+    double lastHeardMs = 0.0;
+    // world transfer, for clients that joined with SESSION_JOIN_WORLD
+    bool wantsWorld = false, transferring = false;
+    double joinMs = 0.0;
+    std::vector<uint32_t> order;     // chunks nearest the spawn first; sent up to next
+    size_t next = 0;
+    std::vector<uint32_t> resend;    // of messages that were not acknowledged in time
+    std::vector<SessionFlight> flights;  // by sequence % transferWindow
+    int inFlight = 0;
+    uint16_t seq = 0;                // starts at random, so acknowledgements cannot be guessed
+    // until the client acknowledges a message its address may be forged: one message in
+    // flight, resent after ever longer waits
+    bool verified = false;
+    int unverifiedSends = 0;
+    // clients that move themselves, from where the server had them when the first claim came
+    bool movesItself = false;
+    FixVec3 claim = {};
+    uint32_t claimTick = 0, checkedTick = 0;
+    uint32_t checkedServerTick = 0;  // server ticks up to here are spent on checked claims
+    float moveDebt = 0.0f;
+    uint64_t flagged = 0;
+};
+
+struct SessionServer {
+    SessionConfig cfg;
+    NetIo io;
+    int wsListenFd = -1;
+    std::unordered_map<int, WsConn> conns;  // by fd, including those still in the handshake
+    std::unordered_map<int, double> connOpenedMs;  // closed after timeoutMs unless they joined
+    std::vector<int> closing;               // connections to close once nothing reads them
+    std::vector<SessionSlot> clients;
+    std::unordered_map<uint64_t, int> byAddr;  // UDP address or WebSocket connection -> client
+    uint16_t nextId = 1;
+    NetCookieKey cookieKey;            // for the SESSION_CHALLENGE cookies
+    uint32_t ticks = 0;                // sessionStep() calls
+    std::vector<uint8_t> snapshot;     // this tick's parts, SESSION_MAX_MESSAGE apart
+    std::vector<uint16_t> partSizes;
+    std::vector<uint8_t> wsHeaders;    // a frame header per part, WS_MAX_FRAME_HEADER apart
+    std::vector<iovec> wsIov;
+    MoveBatch moves;
+    std::vector<int> moveLanes;        // client of each lane
+    TransferCache transferCache;
+    std::vector<uint8_t> transferScratch;  // a WebSocket client's SESSION_CHUNKS message
+    SessionStats stats;
+};
+
+bool sessionOpen(SessionServer& s, const SessionConfig& cfg);
+void sessionClose(SessionServer& s);
+// Handles every message waiting: joins, inputs and leaves; drops clients that went silent.
+void sessionReceive(SessionServer& s, const World& w, double nowMs);
+// Steps every client's player by steps physics ticks with its latest input, or checks its
+// newest claim if it moves itself.
+void sessionStep(SessionServer& s, const World& w, int steps);
+// Sends the tick's snapshot of the clients and the given bots to every client.
+void sessionSnapshot(SessionServer& s, uint32_t tick, const DetPlayer* bots, int botCount);
+// Resends what went unacknowledged and fills every transferring client's window.
+void sessionTransfer(SessionServer& s, const World& w, double nowMs);
+// The clients' players, for recording.
+void sessionPlayers(const SessionServer& s, std::vector<DetPlayer>& out);
+
+// ----------------- Client -----------------
+// A native client over UDP or WebSocket: joins, sends inputs and keeps the latest snapshot.
+// The test stand-in for the game client.
+struct SessionPlayerState {
+    uint16_t id;
+    DetPlayer player;
+};
+
+struct SessionClient {
+    int fd = -1;
+    bool webSocket = false;
+    WsConn ws;
+    sockaddr_in server = {};
+    bool joined = false, refused = false, lost = false;
+    uint16_t id = 0;
+    uint32_t seed = 0;
+    int tickHz = 0;
+    uint32_t tick = 0;                         // of the newest snapshot
+    std::vector<SessionPlayerState> players;   // its parts received so far
+    double lastJoinMs = -1e9;
+    uint32_t cookie = 0;                       // from the server's SESSION_CHALLENGE
+    uint64_t snapshots = 0, messages = 0;
+    // set before the first pump to take the server's world instead of generating it
+    bool wantsWorld = false;
+    World world;
+    TransferState transfer;
+    std::vector<uint16_t> acks;                // SESSION_CHUNKS taken since the last pump
+};
+
+bool sessionClientOpen(SessionClient& c, const sockaddr_in& server);
+// Connects and asks for the upgrade; the pump finishes it, then it runs like the UDP client.
+bool sessionClientOpenWebSocket(SessionClient& c, const sockaddr_in& server);
+void sessionClientClose(SessionClient& c);
+// With claim, the client moves itself and tells the server where it is.
+void sessionClientSendInput(SessionClient& c, uint32_t tick, const DetInput& in, const FixVec3* claim = nullptr);
+// Joins if not yet welcomed and takes everything waiting (acknowledging world chunks);
+// returns the snapshot parts taken.
+int sessionClientPump(SessionClient& c, double nowMs);
@@ -0,0 +1,159 @@
+// Wire format of the player session messages, shared by the server (session.h) and the
+// clients, native and web. Over UDP each message is a datagram, over WebSocket a binary
+// message; the bytes are the same.
+//
+// client -> server:
+//   u8 SESSION_JOIN, u8 flags, u32 cookie (repeated every second until welcomed), u8 SESSION_LEAVE
+//     with SESSION_JOIN_WORLD the server streams the world to the client (world_transfer.h)
+//     over UDP the first join carries cookie 0 and gets SESSION_CHALLENGE back; only a join
+//     echoing it takes a slot (net.h cookies). Over WebSocket the cookie may be left off.
+//   u8 SESSION_INPUT, u32 tick, u16 yaw, u16 pitch, u8 buttons, [3 x i32 raw position]
+//     clients that move themselves add where they ended up, checked by the server (move_check.h)
+//   u8 SESSION_CHUNK_ACK, u8 count, count x u16 sequence of a SESSION_CHUNKS message taken
+// server -> client:
+//   u8 SESSION_CHALLENGE, u32 cookie, shorter than the join it answers
+//   u8 SESSION_WELCOME, u16 player id, u32 seed, u16 tick rate; or u8 SESSION_FULL
+//     joins asking for the world also get u16 grid width, u16 grid height, u8 chunk size,
+//     u8 max stack, f32 block size
+//   u8 SESSION_CHUNKS, u16 sequence, u8 count, then per chunk varint index + chunk_codec cells
+//     nearest the player's spawn first; resent until acknowledged
+//   u8 SESSION_SNAPSHOT, u32 tick, u8 part, u8 parts, u16 players, then per player
+//     u16 id, u8 on ground, 6 x i32 raw position and velocity
+//     each part holds whole players, so a lost part only loses its players for that tick
+#pragma once
+
+#include "det_physics.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+enum SessionMessage : uint8_t {
+    SESSION_JOIN = 1, SESSION_INPUT = 2, SESSION_LEAVE = 3,
+    SESSION_WELCOME = 4, SESSION_FULL = 5, SESSION_SNAPSHOT = 6,
+    SESSION_CHUNKS = 7, SESSION_CHUNK_ACK = 8, SESSION_CHALLENGE = 9,
+};
+
+const uint8_t SESSION_JOIN_WORLD = 1;  // join flag
+
+const int SESSION_MAX_MESSAGE = 1200;  // fits a datagram on every path (NET_MAX_DATAGRAM)
+const int SESSION_JOIN_BYTES = 6;
+const int SESSION_CHALLENGE_BYTES = 5;
+const int SESSION_INPUT_BYTES = 10;
+const int SESSION_INPUT_CLAIM_BYTES = SESSION_INPUT_BYTES + 12;
+const int SESSION_WELCOME_BYTES = 9;
+const int SESSION_WELCOME_WORLD_BYTES = SESSION_WELCOME_BYTES + 10;
+const int SESSION_CHUNKS_HEADER_BYTES = 4;
+const int SESSION_MAX_ACKS = 255;
+const int SESSION_MAX_CHUNK_SIZE = 32;  // any chunk this size encodes into one SESSION_CHUNKS message
+const int SESSION_SNAPSHOT_HEADER_BYTES = 9;
+const int SESSION_PLAYER_BYTES = 27;
+const int SESSION_PLAYERS_PER_PART = (SESSION_MAX_MESSAGE - SESSION_SNAPSHOT_HEADER_BYTES) / SESSION_PLAYER_BYTES;
+const uint16_t SESSION_BOT_ID = 0x8000;  // bots are numbered from here, clients below
+const double SESSION_JOIN_RETRY_MS = 1000.0;
+
+// Fixed offsets, written and read straight in the message buffers.
+inline void sessionPutU16(uint8_t* p, uint16_t v) {
+    p[0] = uint8_t(v);
+    p[1] = uint8_t(v >> 8);
+}
+inline void sessionPutU32(uint8_t* p, uint32_t v) {
+    for (int i=0; i<4; ++i) p[i] = uint8_t(v >> (8*i));
+}
+inline uint16_t sessionGetU16(const uint8_t* p) {
+    return uint16_t(p[0] | p[1] << 8);
+}
+inline uint32_t sessionGetU32(const uint8_t* p) {
+    return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+}
+
+inline size_t sessionWriteInput(uint8_t* out, uint32_t tick, const DetInput& in) {
+    out[0] = SESSION_INPUT;
+    sessionPutU32(out + 1, tick);
+    sessionPutU16(out + 5, in.yaw);
+    sessionPutU16(out + 7, in.pitch);
+    out[9] = in.buttons;
+    return SESSION_INPUT_BYTES;
+}
+
+inline bool sessionReadInput(const uint8_t* data, size_t size, uint32_t* tick, DetInput* in) {
+    if (size < size_t(SESSION_INPUT_BYTES) || data[0] != SESSION_INPUT) return false;
+    *tick = sessionGetU32(data + 1);
+    in->yaw = sessionGetU16(data + 5);
+    in->pitch = sessionGetU16(data + 7);
+    in->buttons = data[9];
+    return true;
+}
+
+inline size_t sessionWriteWelcome(uint8_t* out, uint16_t id, uint32_t seed, uint16_t tickHz) {
+    out[0] = SESSION_WELCOME;
+    sessionPutU16(out + 1, id);
+    sessionPutU32(out + 3, seed);
+    sessionPutU16(out + 7, tickHz);
+    return SESSION_WELCOME_BYTES;
+}
+
+// Appends the claimed position to an input written at out.
+inline size_t sessionWriteClaim(uint8_t* out, const FixVec3& p) {
+    sessionPutU32(out + SESSION_INPUT_BYTES, uint32_t(p.x.raw));
+    sessionPutU32(out + SESSION_INPUT_BYTES + 4, uint32_t(p.y.raw));
+    sessionPutU32(out + SESSION_INPUT_BYTES + 8, uint32_t(p.z.raw));
+    return SESSION_INPUT_CLAIM_BYTES;
+}
+
+inline bool sessionReadClaim(const uint8_t* data, size_t size, FixVec3* p) {
+    if (size < size_t(SESSION_INPUT_CLAIM_BYTES) || data[0] != SESSION_INPUT) return false;
+    p->x = fixRaw(int32_t(sessionGetU32(data + SESSION_INPUT_BYTES)));
+    p->y = fixRaw(int32_t(sessionGetU32(data + SESSION_INPUT_BYTES + 4)));
+    p->z = fixRaw(int32_t(sessionGetU32(data + SESSION_INPUT_BYTES + 8)));
+    return true;
+}
+
+// The map's dimensions after a welcome, for clients that take the world from the server.
+inline size_t sessionWriteWelcomeWorld(uint8_t* out, const WorldConfig& cfg) {
+    uint32_t block;
+    memcpy(&block, &cfg.blockSize, 4);
+    sessionPutU16(out + 9, uint16_t(cfg.gridW));
+    sessionPutU16(out + 11, uint16_t(cfg.gridH));
+    out[13] = uint8_t(cfg.chunkSize);
+    out[14] = uint8_t(cfg.maxStack);
+    sessionPutU32(out + 15, block);
+    return SESSION_WELCOME_WORLD_BYTES;
+}
+
+inline bool sessionReadWelcomeWorld(const uint8_t* data, size_t size, WorldConfig* cfg) {
+    if (size < size_t(SESSION_WELCOME_WORLD_BYTES) || data[0] != SESSION_WELCOME) return false;
+    uint32_t block = sessionGetU32(data + 15);
+    cfg->gridW = sessionGetU16(data + 9);
+    cfg->gridH = sessionGetU16(data + 11);
+    cfg->chunkSize = data[13];
+    cfg->maxStack = data[14];
+    memcpy(&cfg->blockSize, &block, 4);
+    return worldConfigValid(*cfg) && cfg->chunkSize <= SESSION_MAX_CHUNK_SIZE;
+}
+
+inline uint8_t* sessionWritePlayer(uint8_t* out, uint16_t id, const DetPlayer& p) {
+    sessionPutU16(out, id);
+    out[2] = p.onGround ? 1 : 0;
+    const Fix v[6] = { p.pos.x, p.pos.y, p.pos.z, p.vel.x, p.vel.y, p.vel.z };
+    for (int k=0; k<6; ++k) sessionPutU32(out + 3 + 4*k, uint32_t(v[k].raw));
+    return out + SESSION_PLAYER_BYTES;
+}
+
+inline const uint8_t* sessionReadPlayer(const uint8_t* in, uint16_t* id, DetPlayer* p) {
+    *id = sessionGetU16(in);
+    p->onGround = in[2] != 0;
+    Fix v[6];
+    for (int k=0; k<6; ++k) v[k] = fixRaw(int32_t(sessionGetU32(in + 3 + 4*k)));
+    p->pos = { v[0], v[1], v[2] };
+    p->vel = { v[3], v[4], v[5] };
+    return in + SESSION_PLAYER_BYTES;
+}
+
+// Checks a snapshot part; its players start at data + SESSION_SNAPSHOT_HEADER_BYTES.
+inline bool sessionReadSnapshot(const uint8_t* data, size_t size, uint32_t* tick, int* count) {
+    if (size < size_t(SESSION_SNAPSHOT_HEADER_BYTES) || data[0] != SESSION_SNAPSHOT) return false;
+    *tick = sessionGetU32(data + 1);
+    *count = sessionGetU16(data + 7);
+    return size >= size_t(SESSION_SNAPSHOT_HEADER_BYTES + *count * SESSION_PLAYER_BYTES);
+}
@@ -0,0 +1,256 @@
+#include "shadows.h"
+#include "glutil.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+const char* depthVertexSrc = R"(#version 300 es
+in vec3 aPos;
+uniform mat4 uMVP;
+void main() {
+    gl_Position = uMVP * vec4(aPos, 1.0);
+}
+)";
+
+const char* depthFragSrc = R"(#version 300 es
+void main(){}
+)";
+
+struct Cascade {
+    float extent;     // half-size of the ortho window in world units
+    int res;
+    bool cached;      // static terrain only; kept across frames
+    GLuint tex[2] = {};    // ping-pong pair so a scroll can blit old -> new
+    GLuint fbo[2] = {};
+    int cur = 0;
+    bool valid = false;
+    int originX = 0, originY = 0;  // window center in light space, in texels
+    Mat4 vp = {};
+    // Texel rectangle (in the current window) that must be redrawn; empty when x0 >= x1.
+    int dirtyX0 = 0, dirtyY0 = 0, dirtyX1 = 0, dirtyY1 = 0;
+};
+
+Cascade cascades[SHADOW_CASCADES] = {
+    { 12.0f, 1024, false },
+    { 40.0f, 1024, true  },
+    { 120.0f, 1024, true },
+};
+
+GLuint depthProg = 0;
+GLint depthLocMVP = -1, depthAttrPos = -1;
+Vec3 lightRight, lightUp, lightFwd;
+Mat4 lightView;
+float casterTop = 0.0f, lightDepthRange = 1.0f;
+
+int profPass = -1, profTexels = -1, profPasses = -1;
+
+float texelSize(const Cascade& c) { return 2.0f * c.extent / c.res; }
+
+Mat4 cascadeVP(const Cascade& c) {
+    float t = texelSize(c);
+    float cx = c.originX * t, cy = c.originY * t;
+    return mul(orthographic(cx - c.extent, cx + c.extent, cy - c.extent, cy + c.extent,
+                            -lightDepthRange, lightDepthRange), lightView);
+}
+
+void markDirty(Cascade& c, int x0, int y0, int x1, int y1) {
+    x0 = std::max(x0, 0); y0 = std::max(y0, 0);
+    x1 = std::min(x1, c.res); y1 = std::min(y1, c.res);
+    if (x0 >= x1 || y0 >= y1) return;
+    if (c.dirtyX0 >= c.dirtyX1) {
+        c.dirtyX0 = x0; c.dirtyY0 = y0; c.dirtyX1 = x1; c.dirtyY1 = y1;
+        return;
+    }
+    c.dirtyX0 = std::min(c.dirtyX0, x0); c.dirtyY0 = std::min(c.dirtyY0, y0);
+    c.dirtyX1 = std::max(c.dirtyX1, x1); c.dirtyY1 = std::max(c.dirtyY1, y1);
+}
+
+// World XZ bounds of the light-space prism over a texel rectangle, clipped to caster heights.
+ShadowCasterRegion regionForTexels(const Cascade& c, int x0, int y0, int x1, int y1) {
+    float t = texelSize(c);
+    float lx[2] = { (c.originX - c.res/2 + x0) * t, (c.originX - c.res/2 + x1) * t };
+    float ly[2] = { (c.originY - c.res/2 + y0) * t, (c.originY - c.res/2 + y1) * t };
+    float hs[2] = { 0.0f, casterTop };
+    ShadowCasterRegion r = { 1e30f, 1e30f, -1e30f, -1e30f };
+    for (float x : lx) for (float y : ly) for (float h : hs) {
+        // p = x*right + y*up + d*fwd with p.y == h
+        float d = (h - x*lightRight.y - y*lightUp.y) / lightFwd.y;
+        Vec3 p = lightRight*x + lightUp*y + lightFwd*d;
+        r.minX = std::min(r.minX, p.x); r.maxX = std::max(r.maxX, p.x);
+        r.minZ = std::min(r.minZ, p.z); r.maxZ = std::max(r.maxZ, p.z);
+    }
+    return r;
+}
+
+void renderTexels(Cascade& c, int x0, int y0, int x1, int y1, ShadowCasterFn drawCasters) {
+    glBindFramebuffer(GL_FRAMEBUFFER, c.fbo[c.cur]);
+    glViewport(0, 0, c.res, c.res);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(x0, y0, x1 - x0, y1 - y0);
+    glClear(GL_DEPTH_BUFFER_BIT);
+
+    ShadowPass pass;
+    pass.lightVP = c.vp;
+    pass.locMVP = depthLocMVP;
+    pass.attrPos = depthAttrPos;
+    pass.region = regionForTexels(c, x0, y0, x1, y1);
+    drawCasters(pass);
+
+    glDisable(GL_SCISSOR_TEST);
+    profilerAddCount(profTexels, double(x1 - x0) * (y1 - y0) / 1000.0);
+    profilerAddCount(profPasses, 1);
+}
+
+// Moves the window by (dx,dy) texels reusing the overlapping depth, and redraws the strips
+// that scrolled into view.
+void scroll(Cascade& c, int dx, int dy, ShadowCasterFn drawCasters) {
+    int next = 1 - c.cur;
+    int w = c.res - std::abs(dx), h = c.res - std::abs(dy);
+    int sx = std::max(dx, 0), sy = std::max(dy, 0);
+    int tx = std::max(-dx, 0), ty = std::max(-dy, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, c.fbo[c.cur]);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, c.fbo[next]);
+    glBlitFramebuffer(sx, sy, sx + w, sy + h, tx, ty, tx + w, ty + h, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    c.cur = next;
+    c.originX += dx;
+    c.originY += dy;
+    c.vp = cascadeVP(c);
+
+    if (c.dirtyX0 < c.dirtyX1) {
+        int x0 = c.dirtyX0 - dx, y0 = c.dirtyY0 - dy, x1 = c.dirtyX1 - dx, y1 = c.dirtyY1 - dy;
+        c.dirtyX0 = c.dirtyX1 = 0;
+        markDirty(c, x0, y0, x1, y1);
+    }
+    if (dx > 0) renderTexels(c, c.res - dx, 0, c.res, c.res, drawCasters);
+    if (dx < 0) renderTexels(c, 0, 0, -dx, c.res, drawCasters);
+    // the corner shared with the column strip is already drawn
+    int cx0 = dx > 0 ? 0 : -dx, cx1 = dx > 0 ? c.res - dx : c.res;
+    if (dy > 0) renderTexels(c, cx0, c.res - dy, cx1, c.res, drawCasters);
+    if (dy < 0) renderTexels(c, cx0, 0, cx1, -dy, drawCasters);
+}
+
+} // namespace
+
+void shadowsInit(const Vec3& sunDir, float worldTop, float depthRange) {
+    depthProg = buildProgram(depthVertexSrc, depthFragSrc);
+    depthLocMVP = glGetUniformLocation(depthProg, "uMVP");
+    depthAttrPos = glGetAttribLocation(depthProg, "aPos");
+
+    lightView = lookAt(Vec3(0,0,0), sunDir, fabsf(sunDir.y) > 0.99f ? Vec3(0,0,1) : Vec3(0,1,0));
+    lightRight = Vec3(lightView.m[0], lightView.m[4], lightView.m[8]);
+    lightUp = Vec3(lightView.m[1], lightView.m[5], lightView.m[9]);
+    lightFwd = normalize(sunDir);
+    casterTop = worldTop;
+    lightDepthRange = depthRange;
+
+    for (Cascade& c : cascades) {
+        glGenTextures(2, c.tex);
+        glGenFramebuffers(2, c.fbo);
+        for (int i=0; i<2; ++i) {
+            glBindTexture(GL_TEXTURE_2D, c.tex[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, c.res, c.res, 0,
+                         GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+            glBindFramebuffer(GL_FRAMEBUFFER, c.fbo[i]);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, c.tex[i], 0);
+            GLenum none = GL_NONE;
+            glDrawBuffers(1, &none);
+            glReadBuffer(GL_NONE);
+        }
+        c.cur = 0;
+        c.valid = false;
+        c.dirtyX0 = c.dirtyX1 = 0;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    profPass = profilerSlot("shadow.pass");
+    profPasses = profilerSlot("shadow.draws");
+    profTexels = profilerSlot("shadow.ktexels");
+}
+
+void shadowsInvalidateAll() {
+    for (Cascade& c : cascades) c.valid = false;
+}
+
+void shadowsInvalidateBox(const Vec3& minp, const Vec3& maxp) {
+    for (Cascade& c : cascades) {
+        if (!c.cached || !c.valid) continue;
+        float inv = 1.0f / texelSize(c);
+        float lx0 = 1e30f, ly0 = 1e30f, lx1 = -1e30f, ly1 = -1e30f;
+        for (int i=0; i<8; ++i) {
+            Vec3 p((i&1) ? maxp.x : minp.x, (i&2) ? maxp.y : minp.y, (i&4) ? maxp.z : minp.z);
+            float x = dot(lightRight, p) * inv, y = dot(lightUp, p) * inv;
+            lx0 = std::min(lx0, x); lx1 = std::max(lx1, x);
+            ly0 = std::min(ly0, y); ly1 = std::max(ly1, y);
+        }
+        int bx = c.originX - c.res/2, by = c.originY - c.res/2;
+        markDirty(c, int(floorf(lx0)) - bx - 1, int(floorf(ly0)) - by - 1,
+                     int(ceilf(lx1)) - bx + 1, int(ceilf(ly1)) - by + 1);
+    }
+}
+
+void shadowsUpdate(const Vec3& cameraPos, ShadowCasterFn drawCasters) {
+    ProfileScope scope(profPass);
+    glUseProgram(depthProg);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(2.0f, 4.0f);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+    for (Cascade& c : cascades) {
+        float inv = 1.0f / texelSize(c);
+        int wantX = int(floorf(dot(lightRight, cameraPos) * inv + 0.5f));
+        int wantY = int(floorf(dot(lightUp, cameraPos) * inv + 0.5f));
+        int dx = wantX - c.originX, dy = wantY - c.originY;
+        if (!c.cached || !c.valid || std::abs(dx) >= c.res || std::abs(dy) >= c.res) {
+            c.originX = wantX; c.originY = wantY;
+            c.vp = cascadeVP(c);
+            c.dirtyX0 = c.dirtyX1 = 0;
+            renderTexels(c, 0, 0, c.res, c.res, drawCasters);
+            c.valid = true;
+            continue;
+        }
+        // cached cascades only follow the camera once it drifts past an eighth of the map
+        int threshold = c.res / 8;
+        if (std::abs(dx) > threshold || std::abs(dy) > threshold) scroll(c, dx, dy, drawCasters);
+        if (c.dirtyX0 < c.dirtyX1) {
+            renderTexels(c, c.dirtyX0, c.dirtyY0, c.dirtyX1, c.dirtyY1, drawCasters);
+            c.dirtyX0 = c.dirtyX1 = 0;
+        }
+    }
+
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void shadowsBind(GLuint program, int firstUnit) {
+    static GLuint cachedProg = 0;
+    static GLint locLightVP = -1, locMaps[SHADOW_CASCADES];
+    if (cachedProg != program) {
+        cachedProg = program;
+        locLightVP = glGetUniformLocation(program, "uLightVP");
+        const char* names[SHADOW_CASCADES] = { "uShadow0", "uShadow1", "uShadow2" };
+        for (int i=0; i<SHADOW_CASCADES; ++i) locMaps[i] = glGetUniformLocation(program, names[i]);
+    }
+    float mats[16 * SHADOW_CASCADES];
+    for (int i=0; i<SHADOW_CASCADES; ++i) {
+        const Cascade& c = cascades[i];
+        memcpy(mats + 16*i, c.vp.m, sizeof(c.vp.m));
+        glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+        glBindTexture(GL_TEXTURE_2D, c.tex[c.cur]);
+        glUniform1i(locMaps[i], firstUnit + i);
+    }
+    glUniformMatrix4fv(locLightVP, SHADOW_CASCADES, GL_FALSE, mats);
+    glActiveTexture(GL_TEXTURE0);
+}
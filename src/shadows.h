@@ -0,0 +1,38 @@
+// Cascaded sun shadow maps.
+//
+// Cascade 0 follows the camera and is re-rendered every frame. The outer cascades hold
+// static terrain only: they are rendered once and then kept until the camera drifts past
+// a threshold (the cached depth is scrolled and only the newly exposed strips are drawn)
+// or the terrain under them changes (only the dirty rectangle is redrawn).
+#pragma once
+
+#include <GLES3/gl3.h>
+#include "vecmath.h"
+
+const int SHADOW_CASCADES = 3;
+
+// World-space XZ bounds of the casters that can land in the region being redrawn.
+struct ShadowCasterRegion { float minX, minZ, maxX, maxZ; };
+
+struct ShadowPass {
+    Mat4 lightVP;
+    GLint locMVP;    // uMVP of the bound depth program
+    GLint attrPos;   // aPos of the bound depth program
+    ShadowCasterRegion region;
+};
+typedef void (*ShadowCasterFn)(const ShadowPass& pass);
+
+// sunDir is the direction light travels; worldTop is the highest caster y and depthRange
+// a distance that covers the whole world from the origin.
+void shadowsInit(const Vec3& sunDir, float worldTop, float depthRange);
+
+// Terrain edits: drop everything, or redraw only the texels a world box projects to.
+void shadowsInvalidateAll();
+void shadowsInvalidateBox(const Vec3& minp, const Vec3& maxp);
+
+// Brings all cascades up to date for the camera. Leaves the default framebuffer bound.
+void shadowsUpdate(const Vec3& cameraPos, ShadowCasterFn drawCasters);
+
+// Binds the cascade maps to texture units [firstUnit, firstUnit+SHADOW_CASCADES) and sets
+// uLightVP[] / uShadow0..2 on the (already bound) scene program.
+void shadowsBind(GLuint program, int firstUnit);
@@ -0,0 +1,107 @@
+// 4-wide float SIMD wrapper: SSE2 on native x86, simd128 on WebAssembly (-msimd128), and a
+// scalar fallback elsewhere. Kernels written against F4 stay identical on every target.
+#pragma once
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SANDBOX_SIMD_SSE 1
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#define SANDBOX_SIMD_WASM 1
+#endif
+
+#include <cmath>
+
+struct F4 {
+#if defined(SANDBOX_SIMD_SSE)
+    __m128 v;
+#elif defined(SANDBOX_SIMD_WASM)
+    v128_t v;
+#else
+    float v[4];
+#endif
+};
+
+#if defined(SANDBOX_SIMD_SSE)
+
+inline F4 f4Load(const float* p) { return { _mm_loadu_ps(p) }; }
+inline void f4Store(float* p, F4 a) { _mm_storeu_ps(p, a.v); }
+inline F4 f4Splat(float s) { return { _mm_set1_ps(s) }; }
+inline F4 f4Set(float a, float b, float c, float d) { return { _mm_setr_ps(a, b, c, d) }; }
+inline F4 operator+(F4 a, F4 b) { return { _mm_add_ps(a.v, b.v) }; }
+inline F4 operator-(F4 a, F4 b) { return { _mm_sub_ps(a.v, b.v) }; }
+inline F4 operator*(F4 a, F4 b) { return { _mm_mul_ps(a.v, b.v) }; }
+inline F4 operator/(F4 a, F4 b) { return { _mm_div_ps(a.v, b.v) }; }
+inline F4 f4Min(F4 a, F4 b) { return { _mm_min_ps(a.v, b.v) }; }
+inline F4 f4Max(F4 a, F4 b) { return { _mm_max_ps(a.v, b.v) }; }
+inline F4 f4Sqrt(F4 a) { return { _mm_sqrt_ps(a.v) }; }
+// Comparisons return all-ones / all-zeros lane masks.
+inline F4 f4Less(F4 a, F4 b) { return { _mm_cmplt_ps(a.v, b.v) }; }
+inline F4 f4LessEq(F4 a, F4 b) { return { _mm_cmple_ps(a.v, b.v) }; }
+inline F4 f4And(F4 a, F4 b) { return { _mm_and_ps(a.v, b.v) }; }
+inline F4 f4Or(F4 a, F4 b) { return { _mm_or_ps(a.v, b.v) }; }
+inline F4 f4Select(F4 mask, F4 a, F4 b) { return { _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)) }; }
+inline int f4MoveMask(F4 mask) { return _mm_movemask_ps(mask.v); }
+
+#elif defined(SANDBOX_SIMD_WASM)
+
+inline F4 f4Load(const float* p) { return { wasm_v128_load(p) }; }
+inline void f4Store(float* p, F4 a) { wasm_v128_store(p, a.v); }
+inline F4 f4Splat(float s) { return { wasm_f32x4_splat(s) }; }
+inline F4 f4Set(float a, float b, float c, float d) { return { wasm_f32x4_make(a, b, c, d) }; }
+inline F4 operator+(F4 a, F4 b) { return { wasm_f32x4_add(a.v, b.v) }; }
+inline F4 operator-(F4 a, F4 b) { return { wasm_f32x4_sub(a.v, b.v) }; }
+inline F4 operator*(F4 a, F4 b) { return { wasm_f32x4_mul(a.v, b.v) }; }
+inline F4 operator/(F4 a, F4 b) { return { wasm_f32x4_div(a.v, b.v) }; }
+inline F4 f4Min(F4 a, F4 b) { return { wasm_f32x4_pmin(a.v, b.v) }; }
+inline F4 f4Max(F4 a, F4 b) { return { wasm_f32x4_pmax(a.v, b.v) }; }
+inline F4 f4Sqrt(F4 a) { return { wasm_f32x4_sqrt(a.v) }; }
+inline F4 f4Less(F4 a, F4 b) { return { wasm_f32x4_lt(a.v, b.v) }; }
+inline F4 f4LessEq(F4 a, F4 b) { return { wasm_f32x4_le(a.v, b.v) }; }
+inline F4 f4And(F4 a, F4 b) { return { wasm_v128_and(a.v, b.v) }; }
+inline F4 f4Or(F4 a, F4 b) { return { wasm_v128_or(a.v, b.v) }; }
+inline F4 f4Select(F4 mask, F4 a, F4 b) { return { wasm_v128_bitselect(a.v, b.v, mask.v) }; }
+inline int f4MoveMask(F4 mask) { return int(wasm_i32x4_bitmask(mask.v)); }
+
+#else
+
+#include <cstring>
+
+inline F4 f4Load(const float* p) { F4 r; for (int i=0;i<4;++i) r.v[i] = p[i]; return r; }
+inline void f4Store(float* p, F4 a) { for (int i=0;i<4;++i) p[i] = a.v[i]; }
+inline F4 f4Splat(float s) { return { { s, s, s, s } }; }
+inline F4 f4Set(float a, float b, float c, float d) { return { { a, b, c, d } }; }
+inline F4 operator+(F4 a, F4 b) { F4 r; for (int i=0;i<4;++i) r.v[i] = a.v[i] + b.v[i]; return r; }
+inline F4 operator-(F4 a, F4 b) { F4 r; for (int i=0;i<4;++i) r.v[i] = a.v[i] - b.v[i]; return r; }
+inline F4 operator*(F4 a, F4 b) { F4 r; for (int i=0;i<4;++i) r.v[i] = a.v[i] * b.v[i]; return r; }
+inline F4 operator/(F4 a, F4 b) { F4 r; for (int i=0;i<4;++i) r.v[i] = a.v[i] / b.v[i]; return r; }
+inline F4 f4Min(F4 a, F4 b) { F4 r; for (int i=0;i<4;++i) r.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i]; return r; }
+inline F4 f4Max(F4 a, F4 b) { F4 r; for (int i=0;i<4;++i) r.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]; return r; }
+inline F4 f4Sqrt(F4 a) { F4 r; for (int i=0;i<4;++i) r.v[i] = sqrtf(a.v[i]); return r; }
+inline F4 f4MaskFromBool(bool b0, bool b1, bool b2, bool b3) {
+    unsigned bits[4] = { b0 ? ~0u : 0u, b1 ? ~0u : 0u, b2 ? ~0u : 0u, b3 ? ~0u : 0u };
+    F4 r; memcpy(r.v, bits, sizeof(bits)); return r;
+}
+inline F4 f4Less(F4 a, F4 b) { return f4MaskFromBool(a.v[0]<b.v[0], a.v[1]<b.v[1], a.v[2]<b.v[2], a.v[3]<b.v[3]); }
+inline F4 f4LessEq(F4 a, F4 b) { return f4MaskFromBool(a.v[0]<=b.v[0], a.v[1]<=b.v[1], a.v[2]<=b.v[2], a.v[3]<=b.v[3]); }
+inline F4 f4Bitwise(F4 a, F4 b, int op) {
+    unsigned ua[4], ub[4]; memcpy(ua, a.v, 16); memcpy(ub, b.v, 16);
+    for (int i=0;i<4;++i) ua[i] = op == 0 ? (ua[i] & ub[i]) : (ua[i] | ub[i]);
+    F4 r; memcpy(r.v, ua, 16); return r;
+}
+inline F4 f4And(F4 a, F4 b) { return f4Bitwise(a, b, 0); }
+inline F4 f4Or(F4 a, F4 b) { return f4Bitwise(a, b, 1); }
+inline int f4MoveMask(F4 mask) {
+    unsigned u[4]; memcpy(u, mask.v, 16);
+    return int((u[0]>>31) | ((u[1]>>31)<<1) | ((u[2]>>31)<<2) | ((u[3]>>31)<<3));
+}
+inline F4 f4Select(F4 mask, F4 a, F4 b) {
+    int m = f4MoveMask(mask); F4 r;
+    for (int i=0;i<4;++i) r.v[i] = (m >> i) & 1 ? a.v[i] : b.v[i];
+    return r;
+}
+
+#endif
+
+inline F4 f4Abs(F4 a) { return f4Max(a, f4Splat(0.0f) - a); }
+inline F4 f4Clamp(F4 a, F4 lo, F4 hi) { return f4Min(f4Max(a, lo), hi); }
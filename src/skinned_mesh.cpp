@@ -0,0 +1,130 @@
+#include "skinned_mesh.h"
+#include "cubemesh.h"
+#include "glutil.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+const char* skinnedVertexSrc = R"(#version 300 es
+in vec3 aPos;
+in vec3 aColor;
+in float aBone;
+uniform highp sampler2D uPalette;
+uniform mat4 uVP;
+out vec3 vColor;
+
+vec3 xform(int col, vec3 p) {
+    vec4 h = vec4(p, 1.0);
+    vec4 r0 = texelFetch(uPalette, ivec2(col,     gl_InstanceID), 0);
+    vec4 r1 = texelFetch(uPalette, ivec2(col + 1, gl_InstanceID), 0);
+    vec4 r2 = texelFetch(uPalette, ivec2(col + 2, gl_InstanceID), 0);
+    return vec3(dot(r0, h), dot(r1, h), dot(r2, h));
+}
+
+void main() {
+    int bone = int(aBone + 0.5);
+    vec3 modelPos = xform(3 + bone * 3, aPos);
+    vColor = aColor;
+    gl_Position = uVP * vec4(xform(0, modelPos), 1.0);
+}
+)";
+
+const char* skinnedFragSrc = R"(#version 300 es
+precision mediump float;
+in vec3 vColor;
+out vec4 fragColor;
+void main(){
+    fragColor = vec4(vColor, 1.0);
+}
+)";
+
+GLuint skinProg = 0;
+GLint locVP = -1, locPalette = -1, attrPos = -1, attrColor = -1, attrBone = -1;
+GLuint meshVbo = 0, meshIbo = 0, paletteTex = 0;
+GLsizei meshIndexCount = 0;
+int profDraw = -1;
+
+// Each body part is a box rigidly bound to its bone; faces get a fixed shade so the
+// silhouette reads without lighting.
+void buildHumanMesh() {
+    static const Vec3 partColor[SKEL_BONES] = {
+        Vec3(0.25f,0.25f,0.35f), Vec3(0.75f,0.2f,0.2f), Vec3(0.95f,0.8f,0.65f),
+        Vec3(0.75f,0.2f,0.2f), Vec3(0.95f,0.8f,0.65f), Vec3(0.75f,0.2f,0.2f), Vec3(0.95f,0.8f,0.65f),
+        Vec3(0.25f,0.25f,0.35f), Vec3(0.2f,0.2f,0.25f), Vec3(0.25f,0.25f,0.35f), Vec3(0.2f,0.2f,0.25f),
+    };
+
+    std::vector<float> verts;
+    std::vector<unsigned short> idx;
+    for (int b=0; b<SKEL_BONES; ++b) {
+        const Vec3& lo = humanSkeleton.boxMin[b];
+        const Vec3& hi = humanSkeleton.boxMax[b];
+        for (int f=0; f<6; ++f) {
+            unsigned short base = (unsigned short)(verts.size() / 7);
+            for (int k=0; k<4; ++k) {
+                int c = kCubeFaces[f].corner[k];
+                Vec3 col = partColor[b] * kCubeFaces[f].shade;
+                float v[7] = { (c&1) ? hi.x : lo.x, (c&2) ? hi.y : lo.y, (c&4) ? hi.z : lo.z,
+                               col.x, col.y, col.z, float(b) };
+                verts.insert(verts.end(), v, v + 7);
+            }
+            for (unsigned short q : kQuadIndices) idx.push_back((unsigned short)(base + q));
+        }
+    }
+    glGenBuffers(1, &meshVbo);
+    glBindBuffer(GL_ARRAY_BUFFER, meshVbo);
+    glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(float), verts.data(), GL_STATIC_DRAW);
+    glGenBuffers(1, &meshIbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshIbo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, idx.size() * sizeof(unsigned short), idx.data(), GL_STATIC_DRAW);
+    meshIndexCount = GLsizei(idx.size());
+}
+
+} // namespace
+
+void skinnedInit() {
+    skinProg = buildProgram(skinnedVertexSrc, skinnedFragSrc);
+    locVP = glGetUniformLocation(skinProg, "uVP");
+    locPalette = glGetUniformLocation(skinProg, "uPalette");
+    attrPos = glGetAttribLocation(skinProg, "aPos");
+    attrColor = glGetAttribLocation(skinProg, "aColor");
+    attrBone = glGetAttribLocation(skinProg, "aBone");
+    buildHumanMesh();
+
+    glGenTextures(1, &paletteTex);
+    glBindTexture(GL_TEXTURE_2D, paletteTex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, CHAR_GPU_TEXELS, MAX_CHARACTERS, 0, GL_RGBA, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    profDraw = profilerSlot("anim.draw");
+}
+
+void skinnedDraw(const CharacterSet& set, const Mat4& vp) {
+    int count = std::min(set.count, MAX_CHARACTERS);
+    if (count == 0) return;
+    ProfileScope scope(profDraw);
+
+    glUseProgram(skinProg);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, paletteTex);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, CHAR_GPU_TEXELS, count, GL_RGBA, GL_FLOAT, set.gpu.data());
+    glUniform1i(locPalette, 0);
+    glUniformMatrix4fv(locVP, 1, GL_FALSE, vp.m);
+
+    glBindBuffer(GL_ARRAY_BUFFER, meshVbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshIbo);
+    glEnableVertexAttribArray(attrPos);
+    glVertexAttribPointer(attrPos, 3, GL_FLOAT, GL_FALSE, sizeof(float)*7, (void*)(0));
+    glEnableVertexAttribArray(attrColor);
+    glVertexAttribPointer(attrColor, 3, GL_FLOAT, GL_FALSE, sizeof(float)*7, (void*)(sizeof(float)*3));
+    glEnableVertexAttribArray(attrBone);
+    glVertexAttribPointer(attrBone, 1, GL_FLOAT, GL_FALSE, sizeof(float)*7, (void*)(sizeof(float)*6));
+    glDrawElementsInstanced(GL_TRIANGLES, meshIndexCount, GL_UNSIGNED_SHORT, 0, count);
+    glDisableVertexAttribArray(attrPos);
+    glDisableVertexAttribArray(attrColor);
+    glDisableVertexAttribArray(attrBone);
+}
@@ -0,0 +1,11 @@
+// Instanced GPU skinning: one box-built humanoid mesh, all instances' bone palettes packed into
+// a float texture (one row per instance), one instanced draw call per model.
+#pragma once
+
+#include "animation.h"
+#include "vecmath.h"
+
+const int MAX_CHARACTERS = 1024;
+
+void skinnedInit();
+void skinnedDraw(const CharacterSet& set, const Mat4& vp);
@@ -0,0 +1,189 @@
+#include "terrain_render.h"
+#include "glutil.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+// Simple vertex + fragment shader (colored, sun shadows from the cascades in shadows.cpp)
+const char* terrainVertexSrc = R"(#version 300 es
+in vec3 aPos;
+in vec3 aColor;
+uniform mat4 uMVP;
+uniform mat4 uModel;
+out vec3 vColor;
+out vec3 vWorld;
+void main() {
+    vColor = aColor;
+    vWorld = (uModel * vec4(aPos, 1.0)).xyz;
+    gl_Position = uMVP * vec4(aPos, 1.0);
+}
+)";
+
+const char* terrainFragSrc = R"(#version 300 es
+precision mediump float;
+precision highp sampler2DShadow;
+in vec3 vColor;
+in vec3 vWorld;
+uniform highp mat4 uLightVP[3];
+uniform sampler2DShadow uShadow0;
+uniform sampler2DShadow uShadow1;
+uniform sampler2DShadow uShadow2;
+out vec4 fragColor;
+
+float pcf(sampler2DShadow s, vec3 c) {
+    vec2 t = 1.0 / vec2(textureSize(s, 0));
+    return 0.25 * (texture(s, c + vec3(-0.5*t.x, -0.5*t.y, 0.0)) +
+                   texture(s, c + vec3( 0.5*t.x, -0.5*t.y, 0.0)) +
+                   texture(s, c + vec3(-0.5*t.x,  0.5*t.y, 0.0)) +
+                   texture(s, c + vec3( 0.5*t.x,  0.5*t.y, 0.0)));
+}
+bool inside(vec3 c) { return all(greaterThan(c, vec3(0.01))) && all(lessThan(c, vec3(0.99))); }
+vec3 lightCoord(int i) { return (uLightVP[i] * vec4(vWorld, 1.0)).xyz * 0.5 + 0.5; }
+
+void main(){
+    float lit = 1.0;
+    vec3 c0 = lightCoord(0), c1 = lightCoord(1), c2 = lightCoord(2);
+    if (inside(c0)) lit = pcf(uShadow0, c0);
+    else if (inside(c1)) lit = pcf(uShadow1, c1);
+    else if (inside(c2)) lit = pcf(uShadow2, c2);
+    fragColor = vec4(vColor * mix(0.55, 1.0, lit), 1.0);
+}
+)";
+
+struct ChunkMesh {
+    GLuint vbo = 0;
+    GLsizei quads = 0;
+    bool dirty = true;
+    float minX, minZ, maxX, maxZ;  // world bounds for caster culling
+};
+
+GLuint terrainProg = 0;
+GLint locMVP = -1, locModel = -1, attrPos = -1, attrColor = -1;
+GLuint quadIbo = 0;
+GLsizei quadIboCapacity = 0;  // in quads
+std::vector<ChunkMesh> meshes;
+std::vector<int> dirtyMeshes;  // rebuilt by the next terrainUpdateMeshes()
+std::vector<float> scratch;
+int profMesh = -1, profRemeshed = -1, profDraw = -1;
+
+// Shared 0,1,2 2,3,0 index pattern; 32-bit because a full 32x32 chunk can exceed 64k vertices.
+void ensureQuadIndices(GLsizei quads) {
+    if (quads <= quadIboCapacity) return;
+    GLsizei cap = std::max(quads, quadIboCapacity * 2);
+    std::vector<uint32_t> idx(size_t(cap) * 6);
+    for (GLsizei q=0; q<cap; ++q) {
+        uint32_t b = uint32_t(q) * 4;
+        uint32_t* o = &idx[size_t(q) * 6];
+        o[0] = b; o[1] = b + 1; o[2] = b + 2; o[3] = b + 2; o[4] = b + 3; o[5] = b;
+    }
+    if (!quadIbo) glGenBuffers(1, &quadIbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadIbo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, idx.size() * sizeof(uint32_t), idx.data(), GL_STATIC_DRAW);
+    quadIboCapacity = cap;
+}
+
+void markDirty(int chunk) {
+    if (chunk < 0 || chunk >= int(meshes.size()) || meshes[chunk].dirty) return;
+    meshes[chunk].dirty = true;
+    dirtyMeshes.push_back(chunk);
+}
+
+// Border faces depend on the neighbouring chunks: an edit on a chunk's edge dirties the chunk
+// across it too.
+void onWorldEdit(const World& w, const WorldEdit& e, void*) {
+    int S = w.cfg.chunkSize;
+    int cx = e.chunk % w.chunksX, cz = e.chunk / w.chunksX;
+    markDirty(e.chunk);
+    if (e.minGX == cx * S && cx > 0) markDirty(e.chunk - 1);
+    if (e.maxGX == cx * S + S - 1 && cx + 1 < w.chunksX) markDirty(e.chunk + 1);
+    if (e.minGZ == cz * S && cz > 0) markDirty(e.chunk - w.chunksX);
+    if (e.maxGZ == cz * S + S - 1 && cz + 1 < w.chunksZ) markDirty(e.chunk + w.chunksX);
+}
+
+} // namespace
+
+void terrainRenderInit(World& w) {
+    terrainProg = buildProgram(terrainVertexSrc, terrainFragSrc);
+    locMVP = glGetUniformLocation(terrainProg, "uMVP");
+    locModel = glGetUniformLocation(terrainProg, "uModel");
+    attrPos = glGetAttribLocation(terrainProg, "aPos");
+    attrColor = glGetAttribLocation(terrainProg, "aColor");
+
+    meshes.assign(w.chunks.size(), ChunkMesh());
+    dirtyMeshes.clear();
+    for (int i=0; i<int(meshes.size()); ++i) dirtyMeshes.push_back(i);
+    const float B = w.cfg.blockSize;
+    for (size_t i=0; i<meshes.size(); ++i) {
+        ChunkMesh& m = meshes[i];
+        glGenBuffers(1, &m.vbo);
+        int cx = int(i) % w.chunksX, cz = int(i) / w.chunksX;
+        m.minX = gridToWorldX(w, cx * w.cfg.chunkSize) - 0.5f * B;
+        m.minZ = gridToWorldZ(w, cz * w.cfg.chunkSize) - 0.5f * B;
+        m.maxX = m.minX + w.cfg.chunkSize * B;
+        m.maxZ = m.minZ + w.cfg.chunkSize * B;
+    }
+    ensureQuadIndices(4096);
+    worldSubscribe(w, onWorldEdit, nullptr);
+    profMesh = profilerSlot("terrain.mesh");
+    profRemeshed = profilerSlot("terrain.remeshed");
+    profDraw = profilerSlot("terrain.draw");
+}
+
+void terrainMarkChunkDirty(int chunk) {
+    markDirty(chunk);
+}
+
+void terrainUpdateMeshes(const World& w) {
+    ProfileScope scope(profMesh);
+    for (int i : dirtyMeshes) {
+        ChunkMesh& m = meshes[i];
+        w.kernels->buildMesh(w, i, scratch);
+        m.quads = GLsizei(scratch.size() / (TERRAIN_VERTEX_FLOATS * 4));
+        glBindBuffer(GL_ARRAY_BUFFER, m.vbo);
+        glBufferData(GL_ARRAY_BUFFER, scratch.size() * sizeof(float), scratch.data(), GL_STATIC_DRAW);
+        ensureQuadIndices(m.quads);
+        m.dirty = false;
+        profilerAddCount(profRemeshed, 1);
+    }
+    dirtyMeshes.clear();
+}
+
+void terrainDraw(const Mat4& vp) {
+    ProfileScope scope(profDraw);
+    glUseProgram(terrainProg);
+    shadowsBind(terrainProg, 0);
+    // chunk vertices are already in world space
+    Mat4 model = Mat4::identity();
+    glUniformMatrix4fv(locMVP, 1, GL_FALSE, vp.m);
+    glUniformMatrix4fv(locModel, 1, GL_FALSE, model.m);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadIbo);
+    glEnableVertexAttribArray(attrPos);
+    glEnableVertexAttribArray(attrColor);
+    for (const ChunkMesh& m : meshes) {
+        if (m.quads == 0) continue;
+        glBindBuffer(GL_ARRAY_BUFFER, m.vbo);
+        glVertexAttribPointer(attrPos, 3, GL_FLOAT, GL_FALSE, sizeof(float)*TERRAIN_VERTEX_FLOATS, (void*)(0));
+        glVertexAttribPointer(attrColor, 3, GL_FLOAT, GL_FALSE, sizeof(float)*TERRAIN_VERTEX_FLOATS, (void*)(sizeof(float)*3));
+        glDrawElements(GL_TRIANGLES, m.quads * 6, GL_UNSIGNED_INT, 0);
+    }
+    glDisableVertexAttribArray(attrPos);
+    glDisableVertexAttribArray(attrColor);
+}
+
+void terrainDrawShadowCasters(const ShadowPass& pass) {
+    glUniformMatrix4fv(pass.locMVP, 1, GL_FALSE, pass.lightVP.m);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadIbo);
+    glEnableVertexAttribArray(pass.attrPos);
+    for (const ChunkMesh& m : meshes) {
+        if (m.quads == 0) continue;
+        if (m.maxX < pass.region.minX || m.minX > pass.region.maxX ||
+            m.maxZ < pass.region.minZ || m.minZ > pass.region.maxZ) continue;
+        glBindBuffer(GL_ARRAY_BUFFER, m.vbo);
+        glVertexAttribPointer(pass.attrPos, 3, GL_FLOAT, GL_FALSE, sizeof(float)*TERRAIN_VERTEX_FLOATS, (void*)(0));
+        glDrawElements(GL_TRIANGLES, m.quads * 6, GL_UNSIGNED_INT, 0);
+    }
+    glDisableVertexAttribArray(pass.attrPos);
+}
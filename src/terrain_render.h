@@ -0,0 +1,16 @@
+// Terrain rendering: one GPU mesh per world chunk, rebuilt only when an edit subscription
+// (world.h) reports a change to the chunk, or to the edge of a neighbour it borders. Drawn with
+// sun shadows from shadows.cpp.
+#pragma once
+
+#include "shadows.h"
+#include "world.h"
+
+// Subscribes to the world's edits.
+void terrainRenderInit(World& w);
+// Forces a rebuild without an edit.
+void terrainMarkChunkDirty(int chunk);
+// Rebuilds the edited chunk meshes with the world's mesh kernel.
+void terrainUpdateMeshes(const World& w);
+void terrainDraw(const Mat4& vp);
+void terrainDrawShadowCasters(const ShadowPass& pass);
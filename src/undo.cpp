@@ -0,0 +1,101 @@
+#include "undo.h"
+#include "chunk_codec.h"
+
+namespace {
+
+size_t stepBytes(const UndoStep& s) { return s.data.size() + sizeof(UndoStep); }
+
+void dropOldest(UndoHistory& h) {
+    // the newest step always survives, even if it alone is over budget
+    while (h.usedBytes > h.budgetBytes && h.undo.size() + h.redo.size() > 1) {
+        std::deque<UndoStep>& from = h.undo.empty() ? h.redo : h.undo;
+        h.usedBytes -= stepBytes(from.front());  // oldest undo, else the farthest redo
+        from.pop_front();
+    }
+}
+
+// XORs every delta of the step into the world as one batch.
+void applyStep(const UndoStep& s, World& w) {
+    const int S = w.cfg.chunkSize, cells = S * S;
+    std::vector<uint8_t> delta(cells);
+    size_t pos = 0;
+    worldBeginEdits(w);
+    while (pos < s.data.size()) {
+        uint32_t chunk;
+        if (!getVarint(s.data.data(), s.data.size(), &pos, &chunk) || chunk >= w.chunks.size()) break;
+        size_t used = chunkDecode(s.data.data() + pos, s.data.size() - pos, delta.data(), cells);
+        if (used == 0) break;
+        pos += used;
+        int gx0 = int(chunk) % w.chunksX * S, gz0 = int(chunk) / w.chunksX * S;
+        for (int i=0; i<cells; ++i) {
+            if (delta[i] == 0) continue;
+            worldSetHeight(w, gx0 + i % S, gz0 + i / S, w.chunks[chunk]->heights[i] ^ delta[i]);
+        }
+    }
+    worldEndEdits(w);
+}
+
+} // namespace
+
+void undoBegin(UndoHistory& h, const World& w, const char* label) {
+    if (h.nesting++ > 0) return;
+    h.before = worldSnapshot(w);
+    h.openLabel = label;
+}
+
+bool undoEnd(UndoHistory& h, const World& w) {
+    if (h.nesting == 0 || --h.nesting > 0) return false;
+    WorldSnapshot before = std::move(h.before);
+    h.before.reset();
+    if (before->chunks.size() != w.chunks.size()) {
+        undoClear(h);  // the map was re-created; old deltas no longer line up
+        return false;
+    }
+    UndoStep step = { h.openLabel, 0, {} };
+    const int cells = w.cfg.chunkSize * w.cfg.chunkSize;
+    std::vector<uint8_t> delta(cells);
+    for (size_t c=0; c<w.chunks.size(); ++c) {
+        // untouched chunks still share their storage with the snapshot
+        if (before->chunks[c] == w.chunks[c]) continue;
+        const uint8_t* a = before->chunks[c]->heights.data();
+        const uint8_t* b = w.chunks[c]->heights.data();
+        bool any = false;
+        for (int i=0; i<cells; ++i) any |= (delta[i] = a[i] ^ b[i]) != 0;
+        if (!any) continue;
+        putVarint(step.data, uint32_t(c));
+        chunkEncode(delta.data(), cells, step.data);
+        ++step.chunks;
+    }
+    if (step.chunks == 0) return false;
+    step.data.shrink_to_fit();
+    for (const UndoStep& s : h.redo) h.usedBytes -= stepBytes(s);
+    h.redo.clear();
+    h.usedBytes += stepBytes(step);
+    h.undo.push_back(std::move(step));
+    dropOldest(h);
+    return true;
+}
+
+const char* undoApply(UndoHistory& h, World& w) {
+    if (h.undo.empty() || h.nesting > 0) return nullptr;
+    UndoStep s = std::move(h.undo.back());
+    h.undo.pop_back();
+    applyStep(s, w);
+    h.redo.push_back(std::move(s));
+    return h.redo.back().label;
+}
+
+const char* redoApply(UndoHistory& h, World& w) {
+    if (h.redo.empty() || h.nesting > 0) return nullptr;
+    UndoStep s = std::move(h.redo.back());
+    h.redo.pop_back();
+    applyStep(s, w);
+    h.undo.push_back(std::move(s));
+    return h.undo.back().label;
+}
+
+void undoClear(UndoHistory& h) {
+    h.undo.clear();
+    h.redo.clear();
+    h.usedBytes = 0;
+}
@@ -0,0 +1,43 @@
+// Undo/redo history for world editing.
+//
+// A step opens with a copy-on-write snapshot of the world; when it closes, the chunks whose
+// pointers changed are the ones the step touched. Each is stored as the XOR of its cells
+// before and after, run-length/bit-packed with chunk_codec.h: mostly zeros, so it costs a few
+// bytes per edited column instead of a world copy. XOR deltas are their own inverse, so the
+// same bytes serve for undo and redo. Steps live in a byte-budgeted ring: the oldest undo
+// steps are dropped when the budget is exceeded.
+#pragma once
+
+#include "world.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+struct UndoStep {
+    const char* label;
+    int chunks;                  // chunks touched
+    std::vector<uint8_t> data;   // { varint chunk, encoded XOR cells } per chunk
+};
+
+struct UndoHistory {
+    size_t budgetBytes = 4u << 20;
+    size_t usedBytes = 0;
+    std::deque<UndoStep> undo, redo;
+    WorldSnapshot before;        // state at undoBegin() of the open step
+    const char* openLabel = nullptr;
+    int nesting = 0;
+};
+
+// Steps nest: only the outermost begin/end pair records a step.
+void undoBegin(UndoHistory& h, const World& w, const char* label);
+// Closes the step; returns false if it changed nothing (no step recorded).
+bool undoEnd(UndoHistory& h, const World& w);
+
+// Reverts the newest step / re-applies the newest undone step as one batched world edit
+// (one edit event and one remesh per chunk). Return the step's label, or nullptr if none.
+const char* undoApply(UndoHistory& h, World& w);
+const char* redoApply(UndoHistory& h, World& w);
+
+void undoClear(UndoHistory& h);
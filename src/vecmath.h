@@ -0,0 +1,84 @@
+// Minimal math (vec3, mat4) shared by the renderer and the simulation.
+#pragma once
+
+#include <cmath>
+#include <cstring>
+
+struct Vec3 {
+    float x,y,z;
+    Vec3():x(0),y(0),z(0){}
+    Vec3(float X,float Y,float Z):x(X),y(Y),z(Z){}
+    Vec3 operator+(const Vec3& o) const { return Vec3(x+o.x,y+o.y,z+o.z); }
+    Vec3 operator-(const Vec3& o) const { return Vec3(x-o.x,y-o.y,z-o.z); }
+    Vec3 operator*(float s) const { return Vec3(x*s,y*s,z*s); }
+};
+inline float dot(const Vec3& a, const Vec3& b){ return a.x*b.x + a.y*b.y + a.z*b.z; }
+inline Vec3 cross(const Vec3& a,const Vec3& b){ return Vec3(a.y*b.z-a.z*b.y, a.z*b.x-a.x*b.z, a.x*b.y-a.y*b.x); }
+inline float length(const Vec3& v){ return sqrtf(dot(v,v)); }
+inline Vec3 normalize(const Vec3& v){ float l=length(v); return l>0? v*(1.0f/l) : Vec3(0,0,0); }
+
+struct Mat4 {
+    float m[16];
+    static Mat4 identity() {
+        Mat4 r; memset(r.m,0,sizeof(r.m));
+        r.m[0]=r.m[5]=r.m[10]=r.m[15]=1.0f;
+        return r;
+    }
+};
+
+// column-major helpers
+inline Mat4 mul(const Mat4& a, const Mat4& b){
+    Mat4 o;
+    for (int r=0;r<4;++r) for (int c=0;c<4;++c) {
+        float sum=0.0f;
+        for (int k=0;k<4;++k) sum += a.m[k*4 + r] * b.m[c*4 + k];
+        o.m[c*4 + r] = sum;
+    }
+    return o;
+}
+
+inline Mat4 perspective(float fovy, float aspect, float nearv, float farv){
+    Mat4 o; memset(o.m,0,sizeof(o.m));
+    float f = 1.0f / tanf(fovy*0.5f);
+    o.m[0] = f / aspect;
+    o.m[5] = f;
+    o.m[10] = (farv + nearv) / (nearv - farv);
+    o.m[11] = -1.0f;
+    o.m[14] = (2.0f * farv * nearv) / (nearv - farv);
+    return o;
+}
+
+inline Mat4 orthographic(float l, float r, float b, float t, float nearv, float farv){
+    Mat4 o = Mat4::identity();
+    o.m[0] = 2.0f / (r - l);
+    o.m[5] = 2.0f / (t - b);
+    o.m[10] = -2.0f / (farv - nearv);
+    o.m[12] = -(r + l) / (r - l);
+    o.m[13] = -(t + b) / (t - b);
+    o.m[14] = -(farv + nearv) / (farv - nearv);
+    return o;
+}
+
+inline Mat4 lookAt(const Vec3& eye, const Vec3& center, const Vec3& up){
+    Vec3 f = normalize(center - eye);
+    Vec3 s = normalize(cross(f, up));
+    Vec3 u = cross(s, f);
+    Mat4 m = Mat4::identity();
+    m.m[0] = s.x; m.m[4] = s.y; m.m[8]  = s.z;
+    m.m[1] = u.x; m.m[5] = u.y; m.m[9]  = u.z;
+    m.m[2] = -f.x; m.m[6] = -f.y; m.m[10] = -f.z;
+    m.m[12] = -dot(s, eye);
+    m.m[13] = -dot(u, eye);
+    m.m[14] = dot(f, eye);
+    return m;
+}
+
+// Translate-then-uniform-scale model matrix.
+inline Mat4 translateScale(const Vec3& pos, float scale){
+    Mat4 model = Mat4::identity();
+    model.m[0] = scale; model.m[5] = scale; model.m[10] = scale;
+    model.m[12] = pos.x;
+    model.m[13] = pos.y;
+    model.m[14] = pos.z;
+    return model;
+}
@@ -0,0 +1,317 @@
+#include "world.h"
+#include "cubemesh.h"
+#include "decorations.h"
+#include "worldgen_pipeline.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+namespace {
+
+// chunkSize == 1 << L: chunk/local splits are shifts and masks.
+template<int L>
+struct StaticIndexer {
+    static constexpr int size = 1 << L;
+    static constexpr int mask = size - 1;
+    int chunkOf(int g) const { return g >> L; }
+    int local(int g) const { return g & mask; }
+    int cell(int lx, int lz) const { return (lz << L) | lx; }
+};
+
+// Any chunk size: plain division, modulo and multiplication.
+struct DynamicIndexer {
+    int size;
+    int chunkOf(int g) const { return g / size; }
+    int local(int g) const { return g % size; }
+    int cell(int lx, int lz) const { return lz * size + lx; }
+};
+
+template<class Ix> Ix makeIndexer(const World& w);
+template<> DynamicIndexer makeIndexer<DynamicIndexer>(const World& w) { return { w.cfg.chunkSize }; }
+template<> StaticIndexer<3> makeIndexer<StaticIndexer<3>>(const World&) { return {}; }
+template<> StaticIndexer<4> makeIndexer<StaticIndexer<4>>(const World&) { return {}; }
+template<> StaticIndexer<5> makeIndexer<StaticIndexer<5>>(const World&) { return {}; }
+
+template<class Ix>
+inline int columnHeight(const World& w, const Ix& ix, int gx, int gz) {
+    if (gx < 0 || gx >= w.cfg.gridW || gz < 0 || gz >= w.cfg.gridH) return 0;
+    const Chunk& c = *w.chunks[ix.chunkOf(gz) * w.chunksX + ix.chunkOf(gx)];
+    return c.heights[ix.cell(ix.local(gx), ix.local(gz))];
+}
+
+template<class Ix>
+int heightAtT(const World& w, int gx, int gz) {
+    return columnHeight(w, makeIndexer<Ix>(w), gx, gz);
+}
+
+// ----------------- Collision (capsule vs stacked cubes) -----------------
+template<class Ix>
+void collideT(const World& w, Vec3& pos, Vec3& vel, bool& onGround) {
+    // simple: for each nearby column, for each cube level, treat AABB and push player out if
+    // overlapping in x/z and y.
+    const Ix ix = makeIndexer<Ix>(w);
+    const float radius = 0.25f;
+    const float B = w.cfg.blockSize;
+    const int halfW = w.cfg.gridW/2, halfH = w.cfg.gridH/2;
+    int reach = int(ceilf(radius * w.invBlockSize)) + 1;
+    int cgx = worldToGridX(w, pos.x), cgz = worldToGridZ(w, pos.z);
+    int x0 = std::max(cgx - reach, 0), x1 = std::min(cgx + reach, w.cfg.gridW - 1);
+    int z0 = std::max(cgz - reach, 0), z1 = std::min(cgz + reach, w.cfg.gridH - 1);
+    for (int gz=z0; gz<=z1; ++gz) for (int gx=x0; gx<=x1; ++gx) {
+        int h = columnHeight(w, ix, gx, gz);
+        for (int level=0; level < h; ++level) {
+            Vec3 minp( (gx - halfW - 0.5f) * B, level * B, (gz - halfH - 0.5f) * B );
+            Vec3 maxp = minp + Vec3(B, B, B);
+            // player capsule center
+            Vec3 pc(pos.x, pos.y-0.9f, pos.z); // approximate foot-level
+            // clamp pc to AABB
+            float cx = std::max(minp.x, std::min(pc.x, maxp.x));
+            float cy = std::max(minp.y, std::min(pc.y, maxp.y));
+            float cz = std::max(minp.z, std::min(pc.z, maxp.z));
+            Vec3 diff = pc - Vec3(cx,cy,cz);
+            float dist = length(diff);
+            if (dist < radius) {
+                // push player out along horizontal plane mostly
+                Vec3 push = normalize(Vec3(diff.x, 0.0f, diff.z)) * (radius - dist + 0.001f);
+                if (std::isnan(push.x) || std::isnan(push.y) || std::isnan(push.z)) {
+                    // degenerate; separate vertically
+                    push = Vec3(0, (radius-dist)+0.001f, 0);
+                }
+                pos.x += push.x;
+                pos.z += push.z;
+                // if push y positive and small, set onGround
+                if (pos.y <= maxp.y + 0.01f) {
+                    onGround = true;
+                    vel.y = 0.0f;
+                    pos.y = maxp.y + 1.8f; // stand on top of cube
+                }
+            }
+        }
+    }
+}
+
+// ----------------- Hitscan -----------------
+template<class Ix>
+bool raycastT(const World& w, const Vec3& origin, const Vec3& dir, float maxDist, RayHit& hit) {
+    const Ix ix = makeIndexer<Ix>(w);
+    const float step = 0.1f;
+    for (float t=0.0f; t<maxDist; t += step) {
+        Vec3 p = origin + dir * t;
+        // convert world x,z to grid coords
+        int gx = worldToGridX(w, p.x);
+        int gz = worldToGridZ(w, p.z);
+        if (gx < 0 || gx >= w.cfg.gridW || gz < 0 || gz >= w.cfg.gridH) continue;
+        int h = columnHeight(w, ix, gx, gz);
+        if (h == 0) continue;
+        // block base height is 0; block top is h * blockSize
+        float hTop = h * w.cfg.blockSize;
+        if (p.y >= 0.0f && p.y <= hTop + 0.5f) {
+            hit = { gx, gz, h };
+            return true;
+        }
+    }
+    return false;
+}
+
+// ----------------- Chunk meshing -----------------
+template<class Ix>
+void buildMeshT(const World& w, int chunk, std::vector<float>& out) {
+    const Ix ix = makeIndexer<Ix>(w);
+    const int S = w.cfg.chunkSize;
+    const float B = w.cfg.blockSize;
+    out.clear();
+    int cx = chunk % w.chunksX, cz = chunk / w.chunksX;
+    const Chunk& c = *w.chunks[chunk];
+    for (int lz=0; lz<S; ++lz) for (int lx=0; lx<S; ++lx) {
+        int h = c.heights[ix.cell(lx, lz)];
+        if (h == 0) continue;
+        int gx = cx * S + lx, gz = cz * S + lz;
+        // neighbour heights for side culling; interior columns never leave this chunk
+        int nh[6];
+        for (int f=0; f<6; ++f) {
+            const CubeFace& face = kCubeFaces[f];
+            if (face.ny != 0) continue;
+            int nlx = lx + face.nx, nlz = lz + face.nz;
+            nh[f] = (nlx >= 0 && nlx < S && nlz >= 0 && nlz < S) ? c.heights[ix.cell(nlx, nlz)]
+                                                                  : columnHeight(w, ix, gx + face.nx, gz + face.nz);
+        }
+        float x0 = (gx - w.cfg.gridW/2 - 0.5f) * B, z0 = (gz - w.cfg.gridH/2 - 0.5f) * B;
+        for (int level=0; level<h; ++level) {
+            Vec3 tint = worldLevelTint(level);
+            for (int f=0; f<6; ++f) {
+                const CubeFace& face = kCubeFaces[f];
+                if (face.ny < 0) continue;                    // bottoms rest on the ground
+                if (face.ny > 0 && level < h - 1) continue;   // covered by the next level
+                if (face.ny == 0 && level < nh[f]) continue;  // neighbour column covers it
+                Vec3 col = tint * face.shade;
+                for (int k=0; k<4; ++k) {
+                    const float* v = kCubeFaceCorners.v[f][k];
+                    float vert[TERRAIN_VERTEX_FLOATS] = { x0 + v[0]*B, (level + v[1])*B, z0 + v[2]*B,
+                                                          col.x, col.y, col.z };
+                    out.insert(out.end(), vert, vert + TERRAIN_VERTEX_FLOATS);
+                }
+            }
+        }
+    }
+}
+
+template<class Ix>
+const WorldKernels& kernelsFor(const char* name) {
+    static const WorldKernels k = { name, heightAtT<Ix>, collideT<Ix>, raycastT<Ix>, buildMeshT<Ix> };
+    return k;
+}
+
+} // namespace
+
+const WorldKernels* worldSpecializedKernels(int chunkSize) {
+    switch (chunkSize) {
+    case 8:  return &kernelsFor<StaticIndexer<3>>("static8");
+    case 16: return &kernelsFor<StaticIndexer<4>>("static16");
+    case 32: return &kernelsFor<StaticIndexer<5>>("static32");
+    default: return nullptr;
+    }
+}
+
+const WorldKernels& worldRuntimeKernels() {
+    return kernelsFor<DynamicIndexer>("runtime");
+}
+
+int worldChooseChunkSize(int gridW, int gridH) {
+    int edge = std::max(gridW, gridH);
+    if (edge <= 16) return 8;
+    return edge <= 256 ? 16 : 32;
+}
+
+bool worldConfigValid(const WorldConfig& cfg) {
+    return cfg.gridW >= 1 && cfg.gridW <= WORLD_MAX_GRID && cfg.gridH >= 1 && cfg.gridH <= WORLD_MAX_GRID &&
+           cfg.chunkSize >= 1 && cfg.chunkSize <= WORLD_MAX_CHUNK_SIZE && cfg.maxStack >= 1 && cfg.maxStack <= 255 &&
+           std::isfinite(cfg.blockSize) && cfg.blockSize > 0.0f;
+}
+
+void worldInit(World& w, const WorldConfig& cfg) {
+    w.cfg = cfg;
+    w.invBlockSize = 1.0f / cfg.blockSize;
+    w.chunksX = (cfg.gridW + cfg.chunkSize - 1) / cfg.chunkSize;
+    w.chunksZ = (cfg.gridH + cfg.chunkSize - 1) / cfg.chunkSize;
+    // every chunk starts out sharing one empty chunk; the first edit gives it its own copy
+    auto empty = std::make_shared<Chunk>();
+    empty->heights.assign(size_t(cfg.chunkSize) * cfg.chunkSize, 0);
+    w.chunks.assign(size_t(w.chunksX) * w.chunksZ, empty);
+    w.chunkCopies = 0;
+    w.pendingEdits.clear();
+    w.editDepth = 0;
+    const WorldKernels* k = worldSpecializedKernels(cfg.chunkSize);
+    w.kernels = k ? k : &worldRuntimeKernels();
+}
+
+bool worldGenerate(World& w, uint32_t seed, WorldGenPipeline* pipeline) {
+    const WorldConfig& cfg = w.cfg;
+    bool baked = false;
+    worldBeginEdits(w);
+#if SANDBOX_BAKED_WORLD
+    if (seed == DEFAULT_WORLD_SEED && cfg.gridW == DEFAULT_GRID_W && cfg.gridH == DEFAULT_GRID_H &&
+        cfg.maxStack == DEFAULT_MAX_STACK) {
+        for (int z=0; z<cfg.gridH; ++z) for (int x=0; x<cfg.gridW; ++x) {
+            worldSetHeight(w, x, z, kDefaultHeightmap.h[z * DEFAULT_GRID_W + x]);
+        }
+        baked = true;
+    }
+#endif
+    if (!baked) {
+        WorldGenPipeline local;
+        WorldGenPipeline& p = pipeline ? *pipeline : local;
+        genPipelineInit(p, cfg.gridW, cfg.gridH, cfg.maxStack, seed);
+        int S = cfg.chunkSize;
+        std::vector<uint8_t> heights(size_t(S) * S);
+        for (int cz=0; cz<w.chunksZ; ++cz) for (int cx=0; cx<w.chunksX; ++cx) {
+            genChunkHeights(p, cx * S, cz * S, S, S, heights.data());
+            for (int lz=0; lz<S; ++lz) for (int lx=0; lx<S; ++lx) {
+                worldSetHeight(w, cx * S + lx, cz * S + lz, heights[lz * S + lx]);
+            }
+        }
+    }
+    // prefabs stand on the generated heights, so the baked map gets them the same way
+    for (int c=0; c<int(w.chunks.size()); ++c) decorStampPrefabs(w, seed, c);
+    worldEndEdits(w);
+    return baked;
+}
+
+void worldSetHeight(World& w, int gx, int gz, int h) {
+    if (gx < 0 || gx >= w.cfg.gridW || gz < 0 || gz >= w.cfg.gridH) return;
+    int S = w.cfg.chunkSize;
+    int chunk = worldChunkIndex(w, gx, gz);
+    uint8_t v = uint8_t(std::max(0, std::min(h, 255)));
+    int cell = (gz % S) * S + gx % S;
+    int old = w.chunks[chunk]->heights[cell];
+    if (old == v) return;  // no-op edits never copy or notify
+    worldEditChunk(w, chunk).heights[cell] = v;
+    worldNoteEdit(w, gx, gz, std::min(old, int(v)), std::max(old, int(v)));
+}
+
+void worldNoteEdit(World& w, int gx, int gz, int minLevel, int maxLevel) {
+    int chunk = worldChunkIndex(w, gx, gz);
+    Chunk& c = worldEditChunk(w, chunk);
+    uint64_t v = ++w.version;
+    c.version = v;
+    int s0 = std::max(minLevel, 0) / WORLD_SECTION_LEVELS;
+    int s1 = std::min((std::max(maxLevel, minLevel + 1) - 1) / WORLD_SECTION_LEVELS, WORLD_MAX_SECTIONS - 1);
+    for (int s=s0; s<=s1; ++s) c.sectionVersion[s] = v;
+
+    WorldEdit e = { chunk, gx, gz, gx, gz, minLevel, maxLevel, v };
+    if (w.editDepth == 0) {
+        for (const WorldSubscriber& sub : w.subscribers) sub.fn(w, e, sub.user);
+        return;
+    }
+    WorldEdit& p = w.pendingEdits[chunk];
+    if (p.version == 0) { p = e; return; }
+    p.minGX = std::min(p.minGX, gx); p.maxGX = std::max(p.maxGX, gx);
+    p.minGZ = std::min(p.minGZ, gz); p.maxGZ = std::max(p.maxGZ, gz);
+    p.minLevel = std::min(p.minLevel, minLevel); p.maxLevel = std::max(p.maxLevel, maxLevel);
+    p.version = v;
+}
+
+void worldBeginEdits(World& w) {
+    if (w.editDepth++ == 0) w.pendingEdits.assign(w.chunks.size(), WorldEdit());
+}
+
+void worldEndEdits(World& w) {
+    if (--w.editDepth > 0) return;
+    for (const WorldEdit& e : w.pendingEdits) {
+        if (e.version == 0) continue;
+        for (const WorldSubscriber& sub : w.subscribers) sub.fn(w, e, sub.user);
+    }
+    w.pendingEdits.clear();
+}
+
+int worldSubscribe(World& w, WorldEditFn fn, void* user) {
+    int id = w.nextSubscriber++;
+    w.subscribers.push_back({ id, fn, user });
+    return id;
+}
+
+void worldUnsubscribe(World& w, int id) {
+    for (size_t i=0; i<w.subscribers.size(); ++i) {
+        if (w.subscribers[i].id == id) { w.subscribers.erase(w.subscribers.begin() + i); return; }
+    }
+}
+
+Chunk& worldEditChunk(World& w, int chunk) {
+    std::shared_ptr<const Chunk>& slot = w.chunks[chunk];
+    // use_count() can only drop concurrently (a reader releasing its snapshot), never rise:
+    // new references are made by worldSnapshot() on this thread. A stale count above 1 just
+    // costs one unnecessary copy. A count of 1 is a relaxed load, though, and says nothing
+    // about the order of the other thread's last reads of the chunk; the acquire fence pairs
+    // with the release in that thread's decrement, so those reads happen before our writes.
+    if (slot.use_count() > 1) {
+        slot = std::make_shared<Chunk>(*slot);
+        ++w.chunkCopies;
+    } else {
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+    return const_cast<Chunk&>(*slot);
+}
+
+WorldSnapshot worldSnapshot(const World& w) {
+    return std::make_shared<const World>(w);
+}
@@ -0,0 +1,160 @@
+// ----------------- World (grid of stacked cubes, stored in square chunks) -----------------
+//
+// Column heights live in chunks of chunkSize x chunkSize columns. The hot loops (collision,
+// hitscan, meshing) are templates over an indexer: StaticIndexer<L> turns every chunk/local
+// split into shifts and masks for chunkSize == 1<<L, DynamicIndexer keeps the runtime
+// division. worldInit() picks a compiled specialization for the configured chunk size and
+// falls back to the runtime-parametric kernels for anything else.
+//
+// Chunks are immutable once shared. The World holds reference-counted chunk pointers, so a
+// snapshot is one pointer copy per chunk; the next edit of a chunk that a snapshot still
+// references copies that chunk first (copy-on-write). Snapshots are taken on the thread that
+// edits the world and handed to render/AI/network/save work by value; readers then use the
+// normal kernels on them without locks and never see a half-applied edit.
+//
+// Every edit stamps the chunk (and the vertical sections whose levels it touched) with a new
+// value of the world's monotonically increasing version counter. Derived data (meshes,
+// collision/LOS caches, nav tiles, network baselines) remembers the stamps it was built from
+// and rebuilds only when they no longer match; subscribers are also told about each edit
+// as it happens.
+#pragma once
+
+#include "vecmath.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct WorldConfig {
+    int gridW = 32;
+    int gridH = 32;
+    int maxStack = 4;
+    float blockSize = 1.0f;
+    int chunkSize = 16;
+};
+
+// Bounds on configurations read from files or the network (worldConfigValid()).
+const int WORLD_MAX_GRID = 8192;      // columns per side
+const int WORLD_MAX_CHUNK_SIZE = 32;  // the largest worldChooseChunkSize() picks
+
+// Vertical sections of WORLD_SECTION_LEVELS block levels each (heights go up to 255).
+const int WORLD_SECTION_LEVELS = 16;
+const int WORLD_MAX_SECTIONS = 256 / WORLD_SECTION_LEVELS;
+
+struct Chunk {
+    std::vector<uint8_t> heights;  // chunkSize*chunkSize, row-major (z, x)
+    uint64_t version = 0;          // stamp of the last edit anywhere in the chunk
+    uint64_t sectionVersion[WORLD_MAX_SECTIONS] = {};
+};
+
+struct World;
+struct WorldGenPipeline;
+
+struct RayHit {
+    int gx, gz;
+    int h;  // column height at the time of the hit
+};
+
+// Vertex layout produced by buildMesh: position xyz, colour rgb; 4 vertices per quad.
+const int TERRAIN_VERTEX_FLOATS = 6;
+
+// One edit notification: the columns and block levels that changed inside one chunk.
+// Inside worldBeginEdits()/worldEndEdits() edits are merged into one event per chunk.
+struct WorldEdit {
+    int chunk;
+    int minGX, minGZ, maxGX, maxGZ;  // inclusive column range
+    int minLevel, maxLevel;          // changed levels [minLevel, maxLevel)
+    uint64_t version;                // chunk version after the edit
+};
+typedef void (*WorldEditFn)(const World& w, const WorldEdit& e, void* user);
+
+struct WorldSubscriber {
+    int id;
+    WorldEditFn fn;
+    void* user;
+};
+
+struct WorldKernels {
+    const char* name;
+    int (*heightAt)(const World& w, int gx, int gz);
+    // Pushes the player's foot sphere out of the stacked cubes around it.
+    void (*collide)(const World& w, Vec3& pos, Vec3& vel, bool& onGround);
+    // Marches a ray in fixed steps and reports the first column it enters.
+    bool (*raycast)(const World& w, const Vec3& origin, const Vec3& dir, float maxDist, RayHit& hit);
+    // Visible faces of one chunk in world space (hidden side/top faces culled, no bottoms).
+    void (*buildMesh)(const World& w, int chunk, std::vector<float>& out);
+};
+
+struct World {
+    WorldConfig cfg;
+    int chunksX = 0, chunksZ = 0;
+    float invBlockSize = 1.0f;
+    std::vector<std::shared_ptr<const Chunk>> chunks;
+    const WorldKernels* kernels = nullptr;
+    uint64_t chunkCopies = 0;  // copy-on-write duplications so far
+    uint64_t version = 0;      // last stamp handed out
+    std::vector<WorldSubscriber> subscribers;
+    int nextSubscriber = 1;
+    int editDepth = 0;
+    std::vector<WorldEdit> pendingEdits;  // per chunk while batching (version 0 = untouched)
+};
+
+// Read-only view of the world at one point in time.
+typedef std::shared_ptr<const World> WorldSnapshot;
+
+// Largest power-of-two chunk edge (8..32) that keeps a handful of chunks per axis.
+int worldChooseChunkSize(int gridW, int gridH);
+void worldInit(World& w, const WorldConfig& cfg);
+// Whether worldInit() can build cfg without overflowing: dimensions, chunk size and stack
+// height in bounds, a finite positive block size.
+bool worldConfigValid(const WorldConfig& cfg);
+
+// Kernels compiled for chunkSize (nullptr if there is no specialization) and the generic ones.
+const WorldKernels* worldSpecializedKernels(int chunkSize);
+const WorldKernels& worldRuntimeKernels();
+
+// Fills the map with the layered island generator (one batched edit). The default seed and
+// dimensions come straight from the compile-time table in worldgen.h; anything else runs the
+// same layers at runtime, chunk by chunk through a cached pipeline (worldgen_pipeline.h).
+// Pass a pipeline to keep its caches and per-layer stats. Returns true if the baked table
+// was used.
+bool worldGenerate(World& w, uint32_t seed, WorldGenPipeline* pipeline = nullptr);
+
+// Edit path: every change of block data goes through here.
+void worldSetHeight(World& w, int gx, int gz, int h);
+// Writable chunk, duplicated first if a snapshot still shares it. Callers that change it
+// directly must report the change with worldNoteEdit().
+Chunk& worldEditChunk(World& w, int chunk);
+// Stamps the chunk/sections covering the edit and notifies (or queues) subscribers.
+void worldNoteEdit(World& w, int gx, int gz, int minLevel, int maxLevel);
+
+// Batches edits (e.g. regeneration): subscribers get one merged event per touched chunk
+// when the outermost worldEndEdits() runs. Versions are still bumped per edit.
+void worldBeginEdits(World& w);
+void worldEndEdits(World& w);
+
+// Subscribers run synchronously on the editing thread; returns an id for unsubscribing.
+int worldSubscribe(World& w, WorldEditFn fn, void* user);
+void worldUnsubscribe(World& w, int id);
+
+inline uint64_t worldChunkVersion(const World& w, int chunk) { return w.chunks[chunk]->version; }
+inline uint64_t worldSectionVersion(const World& w, int chunk, int section) {
+    return w.chunks[chunk]->sectionVersion[section];
+}
+
+// O(chunks) pointer copies; only chunks edited afterwards get duplicated.
+WorldSnapshot worldSnapshot(const World& w);
+
+inline int worldHeight(const World& w, int gx, int gz) { return w.kernels->heightAt(w, gx, gz); }
+inline int worldChunkIndex(const World& w, int gx, int gz) {
+    return (gz / w.cfg.chunkSize) * w.chunksX + gx / w.cfg.chunkSize;
+}
+
+// World <-> grid conversion (grid origin is at the centre of the map).
+inline int worldToGridX(const World& w, float x) { return int(roundf(x * w.invBlockSize)) + w.cfg.gridW/2; }
+inline int worldToGridZ(const World& w, float z) { return int(roundf(z * w.invBlockSize)) + w.cfg.gridH/2; }
+inline float gridToWorldX(const World& w, int gx) { return (gx - w.cfg.gridW/2) * w.cfg.blockSize; }
+inline float gridToWorldZ(const World& w, int gz) { return (gz - w.cfg.gridH/2) * w.cfg.blockSize; }
+
+// Colour varies with height.
+inline Vec3 worldLevelTint(int level) { return Vec3(0.2f + 0.08f*level, 0.6f - 0.05f*level, 0.2f); }
@@ -0,0 +1,90 @@
+#include "world_transfer.h"
+#include "chunk_codec.h"
+#include "session_protocol.h"
+
+#include <algorithm>
+
+namespace {
+
+// Columns of the chunk that differ go through worldSetHeight(), inside the caller's batch.
+void writeChunk(World& w, int chunk, const uint8_t* cells) {
+    const int S = w.cfg.chunkSize;
+    int gx0 = chunk % w.chunksX * S, gz0 = chunk / w.chunksX * S;
+    int sx = std::min(S, w.cfg.gridW - gx0), sz = std::min(S, w.cfg.gridH - gz0);
+    for (int z=0; z<sz; ++z) for (int x=0; x<sx; ++x) {
+        int i = z * S + x;
+        if (w.chunks[chunk]->heights[i] != cells[i]) worldSetHeight(w, gx0 + x, gz0 + z, cells[i]);
+    }
+}
+
+} // namespace
+
+void transferOrder(const World& w, int gx, int gz, std::vector<uint32_t>& out) {
+    const int S = w.cfg.chunkSize;
+    // squared distance from the column to the nearest column of each chunk
+    std::vector<std::pair<int64_t, uint32_t>> byDistance(w.chunks.size());
+    for (uint32_t c=0; c<byDistance.size(); ++c) {
+        int x0 = int(c) % w.chunksX * S, z0 = int(c) / w.chunksX * S;
+        int64_t dx = std::max({ x0 - gx, gx - (x0 + S - 1), 0 });
+        int64_t dz = std::max({ z0 - gz, gz - (z0 + S - 1), 0 });
+        byDistance[c] = { dx * dx + dz * dz, c };
+    }
+    std::sort(byDistance.begin(), byDistance.end());
+    out.resize(byDistance.size());
+    for (size_t i=0; i<out.size(); ++i) out[i] = byDistance[i].second;
+}
+
+const std::vector<uint8_t>& transferChunkCode(TransferCache& cache, const World& w, uint32_t chunk) {
+    if (cache.codes.size() != w.chunks.size()) {
+        cache.codes.assign(w.chunks.size(), std::vector<uint8_t>());
+        cache.versions.assign(w.chunks.size(), 0);
+    }
+    std::vector<uint8_t>& code = cache.codes[chunk];
+    const Chunk& c = *w.chunks[chunk];
+    if (code.empty() || cache.versions[chunk] != c.version) {
+        code.clear();
+        putVarint(code, chunk);
+        chunkEncode(c.heights.data(), int(c.heights.size()), code);
+        cache.versions[chunk] = c.version;
+        ++cache.encoded;
+    }
+    return code;
+}
+
+void transferReset(World& w, TransferState& t, bool clear) {
+    t.have.assign(w.chunks.size(), 0);
+    t.chunks = 0;
+    t.bytes = 0;
+    if (!clear) return;
+    std::vector<uint8_t> zero(size_t(w.cfg.chunkSize) * w.cfg.chunkSize, 0);
+    worldBeginEdits(w);
+    for (int c=0; c<int(w.chunks.size()); ++c) writeChunk(w, c, zero.data());
+    worldEndEdits(w);
+}
+
+bool transferApply(World& w, TransferState& t, const uint8_t* data, size_t size, uint16_t* seq) {
+    if (size < size_t(SESSION_CHUNKS_HEADER_BYTES) || data[0] != SESSION_CHUNKS) return false;
+    if (t.have.size() != w.chunks.size()) return false;
+    *seq = sessionGetU16(data + 1);
+    const int count = data[3], cellCount = w.cfg.chunkSize * w.cfg.chunkSize;
+    std::vector<uint8_t> cells(cellCount);
+    size_t pos = SESSION_CHUNKS_HEADER_BYTES;
+    bool ok = true;
+    worldBeginEdits(w);
+    for (int k=0; k<count && ok; ++k) {
+        uint32_t chunk;
+        size_t used = 0;
+        ok = getVarint(data, size, &pos, &chunk) && chunk < w.chunks.size() &&
+             (used = chunkDecode(data + pos, size - pos, cells.data(), cellCount)) != 0;
+        if (!ok) break;
+        pos += used;
+        writeChunk(w, int(chunk), cells.data());
+        if (!t.have[chunk]) {
+            t.have[chunk] = 1;
+            ++t.chunks;
+        }
+    }
+    worldEndEdits(w);
+    t.bytes += size;
+    return ok;
+}
@@ -0,0 +1,43 @@
+// Initial world transfer for joining clients (the server side is in session.h, the messages in
+// session_protocol.h).
+//
+// A client that joins with SESSION_JOIN_WORLD starts from an empty map of the server's
+// dimensions and receives every chunk in its chunk_codec encoding, nearest its spawn first,
+// packed into SESSION_CHUNKS messages. The ground around the player arrives within the first
+// messages, so the player can move while the rest of the map streams in behind. The server
+// encodes each chunk once per version, however many clients take it.
+#pragma once
+
+#include "world.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Chunk indices of w by distance from column (gx, gz), nearest first.
+void transferOrder(const World& w, int gx, int gz, std::vector<uint32_t>& out);
+
+// Server side: { varint chunk, encoded cells } per chunk, re-encoded once its version moves on.
+struct TransferCache {
+    std::vector<std::vector<uint8_t>> codes;
+    std::vector<uint64_t> versions;
+    uint64_t encoded = 0;
+};
+
+const std::vector<uint8_t>& transferChunkCode(TransferCache& cache, const World& w, uint32_t chunk);
+
+// Client side: which chunks have arrived.
+struct TransferState {
+    std::vector<uint8_t> have;  // per chunk
+    int chunks = 0;             // distinct chunks received
+    uint64_t bytes = 0;         // SESSION_CHUNKS bytes, resends included
+};
+
+// Starts a transfer into w, which must already have the server's dimensions; with clear, the
+// columns go to 0 first (one batched edit) so nothing of the old map is left.
+void transferReset(World& w, TransferState& t, bool clear);
+// Applies one SESSION_CHUNKS message as one batched edit (chunks already there are written
+// again, the resend of a lost acknowledgement). Returns false on a malformed message; *seq is
+// what to acknowledge.
+bool transferApply(World& w, TransferState& t, const uint8_t* data, size_t size, uint16_t* seq);
+inline bool transferDone(const World& w, const TransferState& t) { return t.chunks == int(w.chunks.size()); }
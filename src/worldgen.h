@@ -0,0 +1,172 @@
+// Procedural generation: a layered island generator (continent, climate, biome, height, surface).
+//
+// Everything here is constexpr so the default map can be evaluated by the compiler and
+// stored in the binary. The runtime generator calls the very same functions, so a baked
+// map and a generated one are bit-for-bit identical.
+#pragma once
+
+#include <cstdint>
+
+constexpr float pseudoNoise(int x, int z, uint32_t seed = 0) {
+    // unsigned so the wrap-around is defined (and allowed in constant expressions)
+    uint32_t n = uint32_t(x) + uint32_t(z) * 57u + seed * 131u;
+    n = (n<<13) ^ n;
+    uint32_t m = (n*(n*n*15731u + 789221u) + 1376312589u) & 0x7fffffffu;
+    return 1.0f - float(m) / 1073741824.0f;
+}
+
+// Newton iteration in double; stands in for sqrtf, which is not constexpr.
+constexpr float ctSqrt(float v) {
+    if (v <= 0.0f) return 0.0f;
+    double x = v, r = v > 1.0f ? v : 1.0;
+    for (int i=0; i<64; ++i) {
+        double next = 0.5 * (r + x / r);
+        if (next >= r) break;
+        r = next;
+    }
+    return float(r);
+}
+
+constexpr int ctFloor(float v) {
+    int i = int(v);
+    return v < float(i) ? i - 1 : i;
+}
+
+constexpr int ctFloorDiv(int a, int b) {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+// Lattice noise in [-1,1] with `cell` columns between lattice points, smoothly interpolated.
+constexpr float valueNoise(int x, int z, int cell, uint32_t seed) {
+    int cx = ctFloorDiv(x, cell), cz = ctFloorDiv(z, cell);
+    float fx = float(x - cx * cell) / float(cell), fz = float(z - cz * cell) / float(cell);
+    fx = fx * fx * (3.0f - 2.0f * fx);
+    fz = fz * fz * (3.0f - 2.0f * fz);
+    float a = pseudoNoise(cx, cz, seed), b = pseudoNoise(cx + 1, cz, seed);
+    float c = pseudoNoise(cx, cz + 1, seed), d = pseudoNoise(cx + 1, cz + 1, seed);
+    float top = a + (b - a) * fx, bottom = c + (d - c) * fx;
+    return top + (bottom - top) * fz;
+}
+
+// ----------------- Generator layers -----------------
+// continent -> climate -> biome -> height -> surface. Each layer is a pure function of the
+// column and the layers before it; worldgen_pipeline.h evaluates them tile by tile with a
+// cache per layer, the baked map below evaluates them directly.
+
+// Continent: > 0 is land. A radial island mask with a noisy coastline.
+constexpr float continentAt(int x, int z, int gridW, int gridH, uint32_t seed) {
+    int cx = gridW/2, cz = gridH/2;
+    float radius = (gridW < gridH ? gridW : gridH) * 0.45f;
+    float dx = float(x - cx), dz = float(z - cz);
+    float mask = 1.0f - ctSqrt(dx*dx + dz*dz) / radius;
+    return mask + 0.25f * valueNoise(x, z, 16, seed + 1u) + 0.1f * valueNoise(x, z, 5, seed + 2u);
+}
+
+struct GenClimate {
+    float temperature;  // roughly 0 (cold) .. 1 (hot)
+    float humidity;     // roughly 0 (dry) .. 1 (wet)
+};
+
+// Climate: slow noise fields; the interior of the continent is colder and drier.
+constexpr GenClimate climateAt(int x, int z, float continent, uint32_t seed) {
+    float inland = continent > 0.0f ? continent : 0.0f;
+    return { 0.55f + 0.45f * valueNoise(x, z, 24, seed + 3u) - 0.3f * inland,
+             0.5f + 0.45f * valueNoise(x, z, 20, seed + 4u) - 0.15f * inland };
+}
+
+enum Biome : uint8_t {
+    BIOME_OCEAN, BIOME_BEACH, BIOME_PLAINS, BIOME_FOREST, BIOME_DESERT, BIOME_TUNDRA, BIOME_MOUNTAINS,
+    BIOME_COUNT
+};
+
+constexpr Biome biomeFor(float continent, GenClimate c) {
+    if (continent <= 0.0f) return BIOME_OCEAN;
+    if (continent < 0.06f) return BIOME_BEACH;
+    if (continent > 0.7f) return BIOME_MOUNTAINS;
+    if (c.temperature < 0.3f) return BIOME_TUNDRA;
+    if (c.temperature > 0.6f && c.humidity < 0.4f) return BIOME_DESERT;
+    if (c.humidity > 0.55f) return BIOME_FOREST;
+    return BIOME_PLAINS;
+}
+
+// Height of a biome as fractions of maxStack: base level plus noise relief.
+struct BiomeShape {
+    float base, relief;
+};
+constexpr BiomeShape kBiomeShapes[BIOME_COUNT] = {
+    { 0.0f, 0.0f }, { 0.1f, 0.05f }, { 0.3f, 0.15f }, { 0.4f, 0.2f }, { 0.25f, 0.1f }, { 0.45f, 0.15f },
+    { 0.75f, 0.35f },
+};
+
+// Height: biome shapes averaged over a (2R+1)^2 neighbourhood so biome borders slope, plus
+// the two noise octaves of the original island. biomeAt(x, z) looks up the biome layer.
+const int GEN_BLEND_RADIUS = 2;
+
+template<class BiomeAt>
+constexpr int heightAt(int x, int z, const BiomeAt& biomeAt, int maxStack, uint32_t seed) {
+    if (biomeAt(x, z) == BIOME_OCEAN) return 0;
+    float base = 0.0f, relief = 0.0f;
+    for (int dz=-GEN_BLEND_RADIUS; dz<=GEN_BLEND_RADIUS; ++dz) {
+        for (int dx=-GEN_BLEND_RADIUS; dx<=GEN_BLEND_RADIUS; ++dx) {
+            const BiomeShape& s = kBiomeShapes[biomeAt(x + dx, z + dz)];
+            base += s.base;
+            relief += s.relief;
+        }
+    }
+    const float n = float((2*GEN_BLEND_RADIUS + 1) * (2*GEN_BLEND_RADIUS + 1));
+    float noise = pseudoNoise(x*3, z*3, seed) * 0.6f + pseudoNoise(x*7, z*7, seed) * 0.4f;
+    int h = ctFloor((base + relief * noise) / n * maxStack + 0.5f);
+    return h < 1 ? 1 : (h > maxStack ? maxStack : h);
+}
+
+// Surface decoration: per-biome details on top of the height (flat beaches, boulders on
+// mountains and tundra, single stacks for trees in forests).
+constexpr int surfaceAt(int x, int z, int h, Biome b, int maxStack, uint32_t seed) {
+    float r = pseudoNoise(x*13 + 5, z*13 + 11, seed + 5u);
+    switch (b) {
+    case BIOME_BEACH: h = h > 1 ? 1 : h; break;
+    case BIOME_FOREST: if (r > 0.86f) h += 2; break;
+    case BIOME_MOUNTAINS: case BIOME_TUNDRA: if (r > 0.9f) h += 1; break;
+    default: break;
+    }
+    return h > maxStack ? maxStack : h;
+}
+
+// ----------------- Default world, evaluated at compile time -----------------
+const int DEFAULT_GRID_W = 32;
+const int DEFAULT_GRID_H = 32;
+const int DEFAULT_MAX_STACK = 4;
+const uint32_t DEFAULT_WORLD_SEED = 0;
+
+struct BakedHeightmap {
+    uint8_t h[DEFAULT_GRID_W * DEFAULT_GRID_H];
+};
+
+// The layers over the map plus the blend margin, then heights and surface per column.
+constexpr BakedHeightmap bakeDefaultHeightmap() {
+    const int R = GEN_BLEND_RADIUS, W = DEFAULT_GRID_W + 2*R, H = DEFAULT_GRID_H + 2*R;
+    struct Biomes {
+        uint8_t b[W * H];
+        constexpr Biome operator()(int x, int z) const { return Biome(b[(z + R) * W + x + R]); }
+    } biomes{};
+    for (int z=-R; z<DEFAULT_GRID_H + R; ++z) for (int x=-R; x<DEFAULT_GRID_W + R; ++x) {
+        float c = continentAt(x, z, DEFAULT_GRID_W, DEFAULT_GRID_H, DEFAULT_WORLD_SEED);
+        biomes.b[(z + R) * W + x + R] = biomeFor(c, climateAt(x, z, c, DEFAULT_WORLD_SEED));
+    }
+    BakedHeightmap m{};
+    for (int z=0; z<DEFAULT_GRID_H; ++z) for (int x=0; x<DEFAULT_GRID_W; ++x) {
+        int h = heightAt(x, z, biomes, DEFAULT_MAX_STACK, DEFAULT_WORLD_SEED);
+        m.h[z * DEFAULT_GRID_W + x] = uint8_t(surfaceAt(x, z, h, biomes(x, z), DEFAULT_MAX_STACK, DEFAULT_WORLD_SEED));
+    }
+    return m;
+}
+
+#ifndef SANDBOX_BAKED_WORLD
+#define SANDBOX_BAKED_WORLD 1
+#endif
+
+#if SANDBOX_BAKED_WORLD
+inline constexpr BakedHeightmap kDefaultHeightmap = bakeDefaultHeightmap();
+static_assert(kDefaultHeightmap.h[(DEFAULT_GRID_H/2) * DEFAULT_GRID_W + DEFAULT_GRID_W/2] > 0,
+              "default island must have land in the middle");
+#endif
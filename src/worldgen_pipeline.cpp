@@ -0,0 +1,191 @@
+#include "worldgen_pipeline.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+
+const char* const layerNames[GEN_LAYER_COUNT] = { "continent", "climate", "biome", "height", "surface", "caves" };
+int profLayer[GEN_LAYER_COUNT] = { -1, -1, -1, -1, -1, -1 };
+int profChunks = -1;
+
+int64_t tileKey(int tx, int tz) {
+    return int64_t((uint64_t(uint32_t(tx)) << 32) | uint32_t(tz));
+}
+
+// Own time of a layer build; dependencies are fetched before the timer starts.
+struct LayerTimer {
+    WorldGenPipeline& p;
+    int layer;
+    double start;
+    LayerTimer(WorldGenPipeline& pipe, int l) : p(pipe), layer(l), start(profilerNowMs()) {}
+    ~LayerTimer() {
+        double ms = profilerNowMs() - start;
+        p.stats[layer].ms += ms;
+        profilerAddTime(profLayer[layer], ms);
+    }
+};
+
+// Returns the tile's data, building it on a miss. The pointer stays valid until this cache is
+// used again, so builders copy or finish with one tile before fetching the next of the same
+// layer (fetching a lower layer never touches a higher layer's cache).
+template<class T, class Build>
+const T* fetchTile(GenTileCache<T>& c, GenLayerStats& stats, int tx, int tz, Build build) {
+    int64_t key = tileKey(tx, tz);
+    auto it = c.index.find(key);
+    if (it != c.index.end()) {
+        c.tiles.splice(c.tiles.begin(), c.tiles, it->second);
+        ++stats.hits;
+        return c.tiles.front().data.data();
+    }
+    std::vector<T> data;
+    if (c.tiles.size() >= c.capacity) {
+        // evict the least recently used tile and reuse its storage
+        data = std::move(c.tiles.back().data);
+        c.index.erase(c.tiles.back().key);
+        c.tiles.pop_back();
+    }
+    build(data);
+    ++stats.built;
+    c.tiles.push_front({ key, std::move(data) });
+    c.index[key] = c.tiles.begin();
+    return c.tiles.front().data.data();
+}
+
+const float* continentTile(WorldGenPipeline& p, int tx, int tz) {
+    return fetchTile(p.continent, p.stats[GEN_CONTINENT], tx, tz, [&](std::vector<float>& d) {
+        LayerTimer timer(p, GEN_CONTINENT);
+        d.resize(GEN_TILE * GEN_TILE);
+        for (int j=0; j<GEN_TILE; ++j) for (int i=0; i<GEN_TILE; ++i) {
+            d[j * GEN_TILE + i] = continentAt(tx * GEN_TILE + i, tz * GEN_TILE + j, p.gridW, p.gridH, p.seed);
+        }
+    });
+}
+
+const GenClimate* climateTile(WorldGenPipeline& p, int tx, int tz) {
+    return fetchTile(p.climate, p.stats[GEN_CLIMATE], tx, tz, [&](std::vector<GenClimate>& d) {
+        const float* cont = continentTile(p, tx, tz);
+        LayerTimer timer(p, GEN_CLIMATE);
+        d.resize(GEN_TILE * GEN_TILE);
+        for (int j=0; j<GEN_TILE; ++j) for (int i=0; i<GEN_TILE; ++i) {
+            d[j * GEN_TILE + i] = climateAt(tx * GEN_TILE + i, tz * GEN_TILE + j, cont[j * GEN_TILE + i], p.seed);
+        }
+    });
+}
+
+const uint8_t* biomeTile(WorldGenPipeline& p, int tx, int tz) {
+    return fetchTile(p.biome, p.stats[GEN_BIOME], tx, tz, [&](std::vector<uint8_t>& d) {
+        const GenClimate* clim = climateTile(p, tx, tz);
+        const float* cont = continentTile(p, tx, tz);
+        LayerTimer timer(p, GEN_BIOME);
+        d.resize(GEN_TILE * GEN_TILE);
+        for (int k=0; k<GEN_TILE * GEN_TILE; ++k) d[k] = biomeFor(cont[k], clim[k]);
+    });
+}
+
+const uint8_t* heightTile(WorldGenPipeline& p, int tx, int tz) {
+    return fetchTile(p.height, p.stats[GEN_HEIGHT], tx, tz, [&](std::vector<uint8_t>& d) {
+        // the tile's biomes plus the blend margin, gathered from up to 9 biome tiles
+        const int R = GEN_BLEND_RADIUS, W = GEN_TILE + 2*R;
+        int x0 = tx * GEN_TILE - R, z0 = tz * GEN_TILE - R;
+        std::vector<uint8_t>& m = p.scratch;
+        m.resize(size_t(W) * W);
+        for (int btz=tz-1; btz<=tz+1; ++btz) for (int btx=tx-1; btx<=tx+1; ++btx) {
+            int ax = std::max(x0, btx * GEN_TILE), bx = std::min(x0 + W, (btx + 1) * GEN_TILE);
+            int az = std::max(z0, btz * GEN_TILE), bz = std::min(z0 + W, (btz + 1) * GEN_TILE);
+            if (ax >= bx || az >= bz) continue;
+            const uint8_t* b = biomeTile(p, btx, btz);
+            for (int z=az; z<bz; ++z) {
+                std::copy_n(b + (z - btz * GEN_TILE) * GEN_TILE + (ax - btx * GEN_TILE), bx - ax,
+                            &m[(z - z0) * W + (ax - x0)]);
+            }
+        }
+        LayerTimer timer(p, GEN_HEIGHT);
+        auto biomeAt = [&](int x, int z) { return Biome(m[(z - z0) * W + (x - x0)]); };
+        d.resize(GEN_TILE * GEN_TILE);
+        for (int j=0; j<GEN_TILE; ++j) for (int i=0; i<GEN_TILE; ++i) {
+            d[j * GEN_TILE + i] = uint8_t(heightAt(tx * GEN_TILE + i, tz * GEN_TILE + j, biomeAt, p.maxStack, p.seed));
+        }
+    });
+}
+
+const uint8_t* surfaceTile(WorldGenPipeline& p, int tx, int tz) {
+    return fetchTile(p.surface, p.stats[GEN_SURFACE], tx, tz, [&](std::vector<uint8_t>& d) {
+        const uint8_t* h = heightTile(p, tx, tz);
+        const uint8_t* b = biomeTile(p, tx, tz);
+        LayerTimer timer(p, GEN_SURFACE);
+        d.resize(GEN_TILE * GEN_TILE);
+        for (int j=0; j<GEN_TILE; ++j) for (int i=0; i<GEN_TILE; ++i) {
+            int k = j * GEN_TILE + i;
+            d[k] = uint8_t(surfaceAt(tx * GEN_TILE + i, tz * GEN_TILE + j, h[k], Biome(b[k]), p.maxStack, p.seed));
+        }
+    });
+}
+
+const uint8_t* cavesTile(WorldGenPipeline& p, int tx, int tz) {
+    return fetchTile(p.caves, p.stats[GEN_CAVES], tx, tz, [&](std::vector<uint8_t>& d) {
+        const uint8_t* s = surfaceTile(p, tx, tz);
+        LayerTimer timer(p, GEN_CAVES);
+        d.assign(s, s + GEN_TILE * GEN_TILE);
+        if (p.maxStack < CAVE_MIN_STACK) return;
+        caveEvaluate(p.caveVolume, tx * GEN_TILE, tz * GEN_TILE, GEN_TILE, d.data(), p.maxStack, p.seed, &p.caveStats);
+        caveApplyToHeights(p.caveVolume, d.data());
+    });
+}
+
+template<class T>
+void resetCache(GenTileCache<T>& c, int capacity) {
+    c.tiles.clear();
+    c.index.clear();
+    c.capacity = size_t(std::max(capacity, 1));
+}
+
+} // namespace
+
+const char* genLayerName(int layer) {
+    return layerNames[layer];
+}
+
+void genPipelineInit(WorldGenPipeline& p, int gridW, int gridH, int maxStack, uint32_t seed, int cacheTiles) {
+    p.gridW = gridW;
+    p.gridH = gridH;
+    p.maxStack = maxStack;
+    p.seed = seed;
+    resetCache(p.continent, cacheTiles);
+    resetCache(p.climate, cacheTiles);
+    resetCache(p.biome, cacheTiles);
+    resetCache(p.height, cacheTiles);
+    resetCache(p.surface, cacheTiles);
+    resetCache(p.caves, cacheTiles);
+    for (GenLayerStats& s : p.stats) s = GenLayerStats();
+    p.caveStats = CaveStats();
+    p.chunks = 0;
+    p.ms = 0.0;
+    if (profChunks < 0) {
+        char name[32];
+        for (int l=0; l<GEN_LAYER_COUNT; ++l) {
+            snprintf(name, sizeof(name), "gen.%s", layerNames[l]);
+            profLayer[l] = profilerSlot(name);
+        }
+        profChunks = profilerSlot("gen.chunks");
+    }
+}
+
+void genChunkHeights(WorldGenPipeline& p, int x0, int z0, int width, int depth, uint8_t* out) {
+    double start = profilerNowMs();
+    int tx0 = ctFloorDiv(x0, GEN_TILE), tx1 = ctFloorDiv(x0 + width - 1, GEN_TILE);
+    int tz0 = ctFloorDiv(z0, GEN_TILE), tz1 = ctFloorDiv(z0 + depth - 1, GEN_TILE);
+    for (int tz=tz0; tz<=tz1; ++tz) for (int tx=tx0; tx<=tx1; ++tx) {
+        const uint8_t* s = cavesTile(p, tx, tz);
+        int ax = std::max(x0, tx * GEN_TILE), bx = std::min(x0 + width, (tx + 1) * GEN_TILE);
+        int az = std::max(z0, tz * GEN_TILE), bz = std::min(z0 + depth, (tz + 1) * GEN_TILE);
+        for (int z=az; z<bz; ++z) {
+            std::copy_n(s + (z - tz * GEN_TILE) * GEN_TILE + (ax - tx * GEN_TILE), bx - ax,
+                        out + (z - z0) * width + (ax - x0));
+        }
+    }
+    ++p.chunks;
+    p.ms += profilerNowMs() - start;
+    profilerAddCount(profChunks, 1);
+}
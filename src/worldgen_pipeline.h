@@ -0,0 +1,64 @@
+// Tiled, cached evaluation of the generator layers in worldgen.h, followed by the caves
+// carved out of the result (caves.h) on maps tall enough for them.
+//
+// Every layer is computed for whole GEN_TILE x GEN_TILE tiles of columns and kept in its own
+// LRU cache, so neighbouring chunk requests share the intermediate results they have in
+// common: the biome tiles of the border margin that the height layer blends over, and the
+// continent and climate tiles under them. The result does not depend on the request order or
+// the cache size, only the time spent does. Per-layer build time goes to the profiler
+// ("gen.<layer>") and into the pipeline's stats.
+#pragma once
+
+#include "caves.h"
+#include "worldgen.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+const int GEN_TILE = 32;                 // columns per tile edge
+const int GEN_CACHE_TILES = 128;         // default tiles kept per layer (3 rows of a 1024-column map)
+
+enum GenLayer { GEN_CONTINENT, GEN_CLIMATE, GEN_BIOME, GEN_HEIGHT, GEN_SURFACE, GEN_CAVES, GEN_LAYER_COUNT };
+const char* genLayerName(int layer);
+
+// Least recently used tiles of one layer, most recent first.
+template<class T>
+struct GenTileCache {
+    struct Tile {
+        int64_t key;
+        std::vector<T> data;  // GEN_TILE^2 values (times components), row-major
+    };
+    std::list<Tile> tiles;
+    std::unordered_map<int64_t, typename std::list<Tile>::iterator> index;
+    size_t capacity = GEN_CACHE_TILES;
+};
+
+struct GenLayerStats {
+    uint64_t built = 0;   // tiles computed
+    uint64_t hits = 0;    // tiles served from the cache
+    double ms = 0.0;      // own build time, excluding the layers it pulled in
+};
+
+struct WorldGenPipeline {
+    int gridW = 0, gridH = 0, maxStack = 0;
+    uint32_t seed = 0;
+    GenTileCache<float> continent;
+    GenTileCache<GenClimate> climate;
+    GenTileCache<uint8_t> biome, height, surface, caves;
+    GenLayerStats stats[GEN_LAYER_COUNT];
+    uint64_t chunks = 0;  // genChunkHeights() requests
+    double ms = 0.0;      // total time inside genChunkHeights()
+    std::vector<uint8_t> scratch;
+    CaveVolume caveVolume;
+    CaveStats caveStats;
+};
+
+// Resets the caches and stats for a map; cacheTiles bounds each layer's cache (minimum 1).
+void genPipelineInit(WorldGenPipeline& p, int gridW, int gridH, int maxStack, uint32_t seed,
+                     int cacheTiles = GEN_CACHE_TILES);
+
+// Final column heights of the rectangle [x0, x0+width) x [z0, z0+depth), row-major into out.
+void genChunkHeights(WorldGenPipeline& p, int x0, int z0, int width, int depth, uint8_t* out);
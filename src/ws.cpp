@@ -0,0 +1,297 @@
+#include "ws.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+const char* const WS_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+const int MAX_IOV = 64;
+
+// ----------------- Handshake hashing (SHA-1, base64) -----------------
+uint32_t rol(uint32_t v, int n) {
+    return v << n | v >> (32 - n);
+}
+
+void sha1(const uint8_t* data, size_t size, uint8_t digest[20]) {
+    uint32_t h[5] = { 0x67452301u, 0xefcdab89u, 0x98badcfeu, 0x10325476u, 0xc3d2e1f0u };
+    std::vector<uint8_t> msg(data, data + size);
+    msg.push_back(0x80);
+    while (msg.size() % 64 != 56) msg.push_back(0);
+    uint64_t bits = uint64_t(size) * 8;
+    for (int i=7; i>=0; --i) msg.push_back(uint8_t(bits >> (8*i)));
+    for (size_t block=0; block<msg.size(); block+=64) {
+        uint32_t w[80];
+        for (int i=0; i<16; ++i) {
+            const uint8_t* p = &msg[block + 4*i];
+            w[i] = uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3];
+        }
+        for (int i=16; i<80; ++i) w[i] = rol(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i=0; i<80; ++i) {
+            uint32_t f, k;
+            if (i < 20) { f = (b & c) | (~b & d); k = 0x5a827999u; }
+            else if (i < 40) { f = b ^ c ^ d; k = 0x6ed9eba1u; }
+            else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8f1bbcdcu; }
+            else { f = b ^ c ^ d; k = 0xca62c1d6u; }
+            uint32_t t = rol(a, 5) + f + e + k + w[i];
+            e = d; d = c; c = rol(b, 30); b = a; a = t;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+    }
+    for (int i=0; i<20; ++i) digest[i] = uint8_t(h[i / 4] >> (24 - 8 * (i % 4)));
+}
+
+std::string base64(const uint8_t* data, size_t size) {
+    static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    for (size_t i=0; i<size; i+=3) {
+        uint32_t v = uint32_t(data[i]) << 16 | (i + 1 < size ? uint32_t(data[i+1]) << 8 : 0) |
+                     (i + 2 < size ? data[i+2] : 0);
+        out += digits[v >> 18 & 63];
+        out += digits[v >> 12 & 63];
+        out += i + 1 < size ? digits[v >> 6 & 63] : '=';
+        out += i + 2 < size ? digits[v & 63] : '=';
+    }
+    return out;
+}
+
+// Value of an HTTP header (case-insensitive name), trimmed; empty if missing.
+std::string headerValue(const std::string& request, const char* name) {
+    size_t n = strlen(name);
+    for (size_t line = request.find("\r\n"); line != std::string::npos; line = request.find("\r\n", line + 2)) {
+        size_t start = line + 2;
+        if (request.size() - start < n + 1 || request[start + n] != ':') continue;
+        bool same = true;
+        for (size_t i=0; i<n && same; ++i) same = tolower(request[start + i]) == tolower(name[i]);
+        if (!same) continue;
+        size_t from = request.find_first_not_of(" \t", start + n + 1);
+        size_t end = request.find("\r\n", start);
+        if (from == std::string::npos || from >= end) return std::string();
+        return request.substr(from, request.find_last_not_of(" \t", end - 1) + 1 - from);
+    }
+    return std::string();
+}
+
+bool containsToken(std::string value, const char* token) {
+    for (char& ch : value) ch = char(tolower(ch));
+    return value.find(token) != std::string::npos;
+}
+
+// Whatever the socket takes of iov; the rest goes to the backlog.
+bool writeOrQueue(WsConn& c, const iovec* iov, int count) {
+    size_t total = 0;
+    for (int i=0; i<count; ++i) total += iov[i].iov_len;
+    msghdr msg = {};
+    msg.msg_iov = const_cast<iovec*>(iov);
+    msg.msg_iovlen = size_t(count);
+    ssize_t n;
+    do {
+        n = sendmsg(c.fd, &msg, MSG_NOSIGNAL);  // a peer gone away is an error, not a SIGPIPE
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+        n = 0;
+    }
+    if (size_t(n) == total) return true;
+    size_t skip = size_t(n);
+    for (int i=0; i<count; ++i) {
+        const uint8_t* p = static_cast<const uint8_t*>(iov[i].iov_base);
+        size_t len = iov[i].iov_len;
+        if (skip >= len) {
+            skip -= len;
+            continue;
+        }
+        c.out.insert(c.out.end(), p + skip, p + len);
+        skip = 0;
+    }
+    return c.out.size() <= WS_MAX_BACKLOG;
+}
+
+} // namespace
+
+std::string wsAcceptKey(const std::string& key) {
+    std::string text = key + WS_GUID;
+    uint8_t digest[20];
+    sha1(reinterpret_cast<const uint8_t*>(text.data()), text.size(), digest);
+    return base64(digest, sizeof(digest));
+}
+
+int wsServerHandshake(WsConn& c) {
+    static const uint8_t end[] = { '\r', '\n', '\r', '\n' };
+    auto at = std::search(c.in.begin(), c.in.end(), end, end + 4);
+    if (at == c.in.end()) return c.in.size() > WS_MAX_REQUEST ? -1 : 0;
+    std::string request(c.in.begin(), at + 2);
+    wsConsume(c, size_t(at - c.in.begin()) + 4);
+    std::string key = headerValue(request, "Sec-WebSocket-Key");
+    if (request.compare(0, 4, "GET ") != 0 || key.empty() ||
+        !containsToken(headerValue(request, "Upgrade"), "websocket")) {
+        static const char refuse[] = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        iovec iov = { const_cast<char*>(refuse), sizeof(refuse) - 1 };
+        writeOrQueue(c, &iov, 1);
+        return -1;
+    }
+    std::string reply = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                        "Sec-WebSocket-Accept: " + wsAcceptKey(key) + "\r\n";
+    // a browser that asks for a subprotocol (Emscripten asks for "binary") needs it confirmed
+    std::string protocols = headerValue(request, "Sec-WebSocket-Protocol");
+    if (!protocols.empty()) reply += "Sec-WebSocket-Protocol: " + protocols.substr(0, protocols.find(',')) + "\r\n";
+    reply += "\r\n";
+    iovec iov = { &reply[0], reply.size() };
+    if (!writeOrQueue(c, &iov, 1)) return -1;
+    c.open = true;
+    return 1;
+}
+
+bool wsClientStartHandshake(WsConn& c, const char* host, const char* path) {
+    uint8_t nonce[16];
+    for (uint8_t& b : nonce) {
+        c.maskState = c.maskState * 1664525u + 1013904223u;
+        b = uint8_t(c.maskState >> 24);
+    }
+    std::string key = base64(nonce, sizeof(nonce));
+    c.accept = wsAcceptKey(key);
+    std::string request = std::string("GET ") + path + " HTTP/1.1\r\nHost: " + host +
+                          "\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Key: " + key +
+                          "\r\nSec-WebSocket-Version: 13\r\nSec-WebSocket-Protocol: binary\r\n\r\n";
+    iovec iov = { &request[0], request.size() };
+    return writeOrQueue(c, &iov, 1);
+}
+
+int wsClientFinishHandshake(WsConn& c) {
+    static const uint8_t end[] = { '\r', '\n', '\r', '\n' };
+    auto at = std::search(c.in.begin(), c.in.end(), end, end + 4);
+    if (at == c.in.end()) return c.in.size() > WS_MAX_REQUEST ? -1 : 0;
+    std::string reply(c.in.begin(), at + 2);
+    wsConsume(c, size_t(at - c.in.begin()) + 4);
+    if (reply.compare(0, 12, "HTTP/1.1 101") != 0 || headerValue(reply, "Sec-WebSocket-Accept") != c.accept) {
+        printf("[ws] handshake refused: %.*s\n", int(reply.find("\r\n")), reply.c_str());
+        return -1;
+    }
+    c.open = true;
+    return 1;
+}
+
+bool wsReceive(WsConn& c) {
+    for (;;) {
+        size_t at = c.in.size();
+        c.in.resize(at + 16384);
+        ssize_t n = read(c.fd, &c.in[at], 16384);
+        c.in.resize(at + size_t(std::max<ssize_t>(n, 0)));
+        if (n > 0 && c.in.size() > 4 * WS_MAX_MESSAGE) return true;  // the rest on the next read
+        if (n > 0) continue;
+        if (n < 0 && errno == EINTR) continue;
+        return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+}
+
+int wsNextMessage(WsConn& c, size_t* pos, bool expectMasked, WsMessage& m) {
+    size_t at = *pos, avail = c.in.size() - at;
+    if (avail < 2) return 0;
+    uint8_t* p = &c.in[at];
+    bool fin = p[0] & 0x80, masked = p[1] & 0x80;
+    uint8_t opcode = p[0] & 0x0f;
+    if ((p[0] & 0x70) || masked != expectMasked) return -1;
+    // messages here are a datagram each: nothing is ever fragmented
+    if (!fin || opcode == WS_CONTINUATION) return -1;
+    uint64_t size = p[1] & 0x7f;
+    size_t header = 2;
+    if (size == 126) {
+        if (avail < 4) return 0;
+        size = uint64_t(p[2]) << 8 | p[3];
+        header = 4;
+    } else if (size == 127) {
+        if (avail < 10) return 0;
+        size = 0;
+        for (int i=0; i<8; ++i) size = size << 8 | p[2 + i];
+        header = 10;
+    }
+    if (size > WS_MAX_MESSAGE) return -1;
+    size_t maskAt = header;
+    if (masked) header += 4;
+    if (avail < header + size) return 0;
+    uint8_t* data = p + header;
+    if (masked) {
+        const uint8_t* key = p + maskAt;
+        for (size_t i=0; i<size; ++i) data[i] ^= key[i & 3];
+    }
+    m = { opcode, data, size_t(size) };
+    *pos = at + header + size_t(size);
+    return 1;
+}
+
+void wsConsume(WsConn& c, size_t n) {
+    c.in.erase(c.in.begin(), c.in.begin() + std::min(n, c.in.size()));
+}
+
+size_t wsFrameHeader(uint8_t* out, uint8_t opcode, size_t size, const uint8_t* mask) {
+    out[0] = uint8_t(0x80 | opcode);
+    uint8_t maskBit = mask ? 0x80 : 0;
+    size_t n;
+    if (size < 126) {
+        out[1] = uint8_t(maskBit | size);
+        n = 2;
+    } else if (size <= 0xffff) {
+        out[1] = uint8_t(maskBit | 126);
+        out[2] = uint8_t(size >> 8);
+        out[3] = uint8_t(size);
+        n = 4;
+    } else {
+        out[1] = uint8_t(maskBit | 127);
+        for (int i=0; i<8; ++i) out[2 + i] = uint8_t(uint64_t(size) >> (56 - 8*i));
+        n = 10;
+    }
+    if (mask) {
+        memcpy(out + n, mask, 4);
+        n += 4;
+    }
+    return n;
+}
+
+bool wsSendv(WsConn& c, const iovec* iov, int count) {
+    if (!c.out.empty()) {
+        // keep the order: everything behind the backlog
+        for (int i=0; i<count; ++i) {
+            const uint8_t* p = static_cast<const uint8_t*>(iov[i].iov_base);
+            c.out.insert(c.out.end(), p, p + iov[i].iov_len);
+        }
+        return wsFlush(c) && c.out.size() <= WS_MAX_BACKLOG;
+    }
+    for (int i=0; i<count; i+=MAX_IOV) {
+        if (!c.out.empty()) return wsSendv(c, iov + i, count - i);
+        if (!writeOrQueue(c, iov + i, std::min(MAX_IOV, count - i))) return false;
+    }
+    return true;
+}
+
+bool wsSend(WsConn& c, uint8_t opcode, const uint8_t* data, size_t size) {
+    uint8_t header[WS_MAX_FRAME_HEADER];
+    iovec iov[2] = { { header, wsFrameHeader(header, opcode, size) }, { const_cast<uint8_t*>(data), size } };
+    return wsSendv(c, iov, size ? 2 : 1);
+}
+
+bool wsClientSend(WsConn& c, uint8_t opcode, const uint8_t* data, size_t size) {
+    c.maskState = c.maskState * 1664525u + 1013904223u;
+    uint8_t mask[4] = { uint8_t(c.maskState), uint8_t(c.maskState >> 8), uint8_t(c.maskState >> 16),
+                        uint8_t(c.maskState >> 24) };
+    std::vector<uint8_t> frame(WS_MAX_FRAME_HEADER + size);
+    size_t n = wsFrameHeader(frame.data(), opcode, size, mask);
+    for (size_t i=0; i<size; ++i) frame[n + i] = data[i] ^ mask[i & 3];
+    iovec iov = { frame.data(), n + size };
+    return wsSendv(c, &iov, 1);
+}
+
+bool wsFlush(WsConn& c) {
+    while (!c.out.empty()) {
+        ssize_t n = send(c.fd, c.out.data(), c.out.size(), MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK;
+        c.out.erase(c.out.begin(), c.out.begin() + n);
+    }
+    return true;
+}
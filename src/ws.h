@@ -0,0 +1,68 @@
+// WebSocket (RFC 6455) framing over a non-blocking TCP socket (native only).
+//
+// Browsers cannot send UDP, so the server also speaks WebSocket: the same session messages
+// (session.h), each one a binary message. Frames are parsed where they sit in the connection's
+// read buffer (client frames are unmasked in place) and written with sendmsg(): a frame header
+// in front of bytes that stay where they are, so one snapshot encoded per tick goes out to
+// every browser without copying, all of a tick's messages in one system call per connection.
+// Only what the socket does not take right away is copied, into a per-connection backlog.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sys/uio.h>
+#include <vector>
+
+enum WsOpcode : uint8_t {
+    WS_CONTINUATION = 0x0, WS_TEXT = 0x1, WS_BINARY = 0x2, WS_CLOSE = 0x8, WS_PING = 0x9, WS_PONG = 0xA,
+};
+
+const int WS_MAX_FRAME_HEADER = 14;
+const size_t WS_MAX_MESSAGE = 64u << 10;   // larger client messages close the connection
+const size_t WS_MAX_BACKLOG = 1u << 20;    // a client this far behind is dropped
+const size_t WS_MAX_REQUEST = 8u << 10;    // handshake request
+
+struct WsConn {
+    int fd = -1;
+    bool open = false;                 // handshake done
+    std::vector<uint8_t> in;           // received, not consumed yet
+    std::vector<uint8_t> out;          // what the socket would not take yet
+    uint32_t maskState = 0x9e3779b9u;  // client side: masking keys
+    std::string accept;                // client side: the answer the handshake must carry
+};
+
+struct WsMessage {
+    uint8_t opcode;
+    uint8_t* data;  // points into WsConn::in, unmasked
+    size_t size;
+};
+
+// "Sec-WebSocket-Accept" for a client's key.
+std::string wsAcceptKey(const std::string& key);
+
+// Server side: answers the upgrade request once it is all in c.in; 1 when open, 0 for more
+// bytes, -1 for anything that is not a WebSocket upgrade.
+int wsServerHandshake(WsConn& c);
+// Client side: sends the upgrade request, then takes the answer from c.in like the server
+// takes the request (1 open, 0 for more bytes, -1 refused).
+bool wsClientStartHandshake(WsConn& c, const char* host, const char* path);
+int wsClientFinishHandshake(WsConn& c);
+
+// Reads what the socket has into c.in; false once the peer is gone.
+bool wsReceive(WsConn& c);
+// Next complete frame starting at *pos in c.in: 1 with the message, 0 if it has not all
+// arrived, -1 on a protocol error. Servers expect masked frames, clients unmasked ones.
+int wsNextMessage(WsConn& c, size_t* pos, bool expectMasked, WsMessage& m);
+// Drops the first n bytes of c.in (the frames taken).
+void wsConsume(WsConn& c, size_t n);
+
+// Header of a frame with size payload bytes; masked (client side) if mask is given.
+size_t wsFrameHeader(uint8_t* out, uint8_t opcode, size_t size, const uint8_t* mask = nullptr);
+// Writes iov after the backlog; false if the connection failed or the backlog overflowed.
+bool wsSendv(WsConn& c, const iovec* iov, int count);
+bool wsSend(WsConn& c, uint8_t opcode, const uint8_t* data, size_t size);
+// Client side: masks a copy of the payload.
+bool wsClientSend(WsConn& c, uint8_t opcode, const uint8_t* data, size_t size);
+// Retries the backlog.
+bool wsFlush(WsConn& c);